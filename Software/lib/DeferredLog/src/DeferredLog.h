@@ -0,0 +1,359 @@
+#ifndef OSSM_DEFERRED_LOG_H
+#define OSSM_DEFERRED_LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Deferred Log
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Logging for the motion tasks. A call stores the format string pointer, the
+ * tag and the raw arguments in a lock-free ring and returns; a low priority
+ * task formats and prints them later, see services/deferredLog.h in the
+ * firmware. The caller never formats, never allocates and never waits for the
+ * UART.
+ *
+ *   DEFERRED_LOGD("Homing", "Current over limit: %f", current);
+ *
+ * Up to six arguments: integers of 32 bits or less, float, double (stored as
+ * float) and strings. Only the pointer of a string is kept, so it must outlive
+ * the ring: string literals, names in static tables, never a String.c_str().
+ *
+ * The ring holds a fixed number of messages. When it is full new messages are
+ * dropped and counted, the producer is never blocked.
+ */
+
+enum class DeferredLogLevel : uint8_t {
+    None,
+    Error,
+    Warn,
+    Info,
+    Debug,
+    Verbose
+};
+
+namespace DeferredLogArgs {
+    static constexpr size_t maxArgs = 6;
+
+    enum Type : uint8_t { Int, Unsigned, Float, String };
+
+    // An argument as stored: an integer, the bits of a float or a pointer.
+    struct Arg {
+        Type type;
+        uintptr_t bits;
+    };
+
+    template <class T>
+    inline Arg encode(T value) {
+        if constexpr (std::is_enum_v<T>) {
+            return encode(static_cast<std::underlying_type_t<T>>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            float f = static_cast<float>(value);
+            uint32_t bits = 0;
+            memcpy(&bits, &f, sizeof(bits));
+            return {Float, bits};
+        } else if constexpr (std::is_integral_v<T>) {
+            static_assert(sizeof(T) <= 4, "64 bit integers are not supported");
+            return {std::is_signed_v<T> ? Int : Unsigned,
+                    static_cast<uintptr_t>(static_cast<uint32_t>(value))};
+        } else {
+            static_assert(std::is_convertible_v<T, const char *>,
+                          "Unsupported deferred log argument");
+            return {String, reinterpret_cast<uintptr_t>(
+                                static_cast<const char *>(value))};
+        }
+    }
+}
+
+struct DeferredLogMessage {
+    uint32_t micros;
+    DeferredLogLevel level;
+    uint8_t argCount;
+    // Two bits per argument, DeferredLogArgs::Type.
+    uint16_t types;
+    const char *tag;
+    const char *format;
+    uintptr_t args[DeferredLogArgs::maxArgs];
+
+    DeferredLogArgs::Type type(size_t i) const {
+        return (DeferredLogArgs::Type)((types >> (2 * i)) & 3);
+    }
+
+    /**
+     * Format the message as "[  micros][D][tag] text\n" into out.
+     * @return the length, truncated to fit size including the terminator.
+     */
+    size_t render(char *out, size_t size) const {
+        static const char levels[] = "NEWIDV";
+        int written = snprintf(out, size, "[%8u][%c][%s] ", (unsigned)micros,
+                               levels[(int)level], tag);
+        size_t length = clamp(written, size);
+        length = formatText(out, size, length);
+        if (length + 1 < size) {
+            out[length++] = '\n';
+            out[length] = '\0';
+        }
+        return length;
+    }
+
+  private:
+    static size_t clamp(int written, size_t size) {
+        if (written < 0) {
+            return 0;
+        }
+        return (size_t)written < size ? (size_t)written : size - 1;
+    }
+
+    // printf, one conversion at a time, with the stored arguments.
+    size_t formatText(char *out, size_t size, size_t length) const {
+        size_t next = 0;
+        const char *p = format;
+        while (*p != '\0' && length + 1 < size) {
+            if (*p != '%') {
+                out[length++] = *p++;
+                continue;
+            }
+            if (p[1] == '%') {
+                out[length++] = '%';
+                p += 2;
+                continue;
+            }
+
+            // Flags, width and precision are kept, length modifiers are
+            // dropped since numbers are stored in 32 bits.
+            char spec[16] = {'%'};
+            size_t specLength = 1;
+            const char *q = p + 1;
+            while (*q != '\0' && strchr("-+ #0123456789.", *q) != nullptr) {
+                if (specLength < sizeof(spec) - 2) {
+                    spec[specLength++] = *q;
+                }
+                q++;
+            }
+            while (*q != '\0' && strchr("hlLqjzt", *q) != nullptr) {
+                q++;
+            }
+            char conversion = *q;
+            if (conversion == '\0' || next >= argCount) {
+                // Malformed, or more conversions than arguments: print as is.
+                size_t n = q - p + (conversion != '\0');
+                for (size_t i = 0; i < n && length + 1 < size; i++) {
+                    out[length++] = p[i];
+                }
+                p += n;
+                continue;
+            }
+            spec[specLength++] = conversion;
+            spec[specLength] = '\0';
+            p = q + 1;
+
+            length += clamp(
+                formatArg(out + length, size - length, spec, conversion, next),
+                size - length);
+            next++;
+        }
+        out[length] = '\0';
+        return length;
+    }
+
+    int formatArg(char *out, size_t size, const char *spec, char conversion,
+                  size_t i) const {
+        auto bits = (uint32_t)args[i];
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        DeferredLogArgs::Type t = type(i);
+
+        // Convert to what the conversion expects, like printf would have
+        // after the usual promotions.
+        switch (conversion) {
+            case 's':
+                return snprintf(
+                    out, size, spec,
+                    t == DeferredLogArgs::String
+                        ? reinterpret_cast<const char *>(args[i])
+                        : "?");
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                return snprintf(out, size, spec,
+                                t == DeferredLogArgs::Float ? (double)f
+                                : t == DeferredLogArgs::Int
+                                    ? (double)(int32_t)bits
+                                    : (double)bits);
+            case 'p':
+                return snprintf(out, size, spec, (void *)args[i]);
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                return snprintf(out, size, spec,
+                                t == DeferredLogArgs::Float ? (uint32_t)f
+                                                            : bits);
+            default:
+                return snprintf(out, size, spec,
+                                t == DeferredLogArgs::Float ? (int32_t)f
+                                                            : (int32_t)bits);
+        }
+    }
+};
+
+/**
+ * Multi producer, single consumer ring (Vyukov's bounded queue). Each slot
+ * carries a sequence number that says whether it is free for the producer
+ * of a given position or ready for the consumer, so producers only contend
+ * on one compare and swap.
+ */
+template <uint16_t Capacity>
+class DeferredLogRing {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+  public:
+    DeferredLogRing() {
+        for (uint32_t i = 0; i < Capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template <class... Args>
+    bool log(DeferredLogLevel level, const char *tag, const char *format,
+             uint32_t micros, Args... args) {
+        static_assert(sizeof...(Args) <= DeferredLogArgs::maxArgs,
+                      "Too many deferred log arguments");
+
+        uint32_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &slots[position & (Capacity - 1)];
+            uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+            auto difference = (int32_t)(sequence - position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // Full, the printer is behind.
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        DeferredLogMessage &message = slot->message;
+        message.micros = micros;
+        message.level = level;
+        message.tag = tag;
+        message.format = format;
+        message.argCount = sizeof...(Args);
+        message.types = 0;
+        size_t i = 0;
+        for (DeferredLogArgs::Arg arg : {DeferredLogArgs::encode(args)...,
+                                         DeferredLogArgs::Arg{}}) {
+            if (i < sizeof...(Args)) {
+                message.args[i] = arg.bits;
+                message.types |= (uint16_t)(arg.type << (2 * i));
+            }
+            i++;
+        }
+
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Take the oldest message. Only one task may call this.
+     * @return false if there is none.
+     */
+    bool pop(DeferredLogMessage &out) {
+        Slot &slot = slots[dequeuePosition & (Capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) !=
+            dequeuePosition + 1) {
+            return false;
+        }
+        out = slot.message;
+        slot.sequence.store(dequeuePosition + Capacity,
+                            std::memory_order_release);
+        dequeuePosition++;
+        return true;
+    }
+
+    // Messages lost to a full ring since boot.
+    uint32_t dropped() const {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        DeferredLogMessage message;
+    };
+
+    Slot slots[Capacity];
+    std::atomic<uint32_t> enqueuePosition{0};
+    std::atomic<uint32_t> droppedCount{0};
+    uint32_t dequeuePosition = 0;
+};
+
+using DeferredLog = DeferredLogRing<64>;
+
+// The one ring shared by every translation unit.
+inline DeferredLog deferredLog;
+
+/**
+ * Same levels as ESP_LOGx, compiled out above CORE_DEBUG_LEVEL. The clock is
+ * micros(), so these are for code that includes Arduino.h.
+ */
+#define DEFERRED_LOG(level, tag, format, ...) \
+    deferredLog.log(level, tag, format, micros(), ##__VA_ARGS__)
+
+#if CORE_DEBUG_LEVEL >= 1
+#define DEFERRED_LOGE(tag, format, ...) \
+    DEFERRED_LOG(DeferredLogLevel::Error, tag, format, ##__VA_ARGS__)
+#else
+#define DEFERRED_LOGE(tag, format, ...) ((void)0)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 2
+#define DEFERRED_LOGW(tag, format, ...) \
+    DEFERRED_LOG(DeferredLogLevel::Warn, tag, format, ##__VA_ARGS__)
+#else
+#define DEFERRED_LOGW(tag, format, ...) ((void)0)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 3
+#define DEFERRED_LOGI(tag, format, ...) \
+    DEFERRED_LOG(DeferredLogLevel::Info, tag, format, ##__VA_ARGS__)
+#else
+#define DEFERRED_LOGI(tag, format, ...) ((void)0)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 4
+#define DEFERRED_LOGD(tag, format, ...) \
+    DEFERRED_LOG(DeferredLogLevel::Debug, tag, format, ##__VA_ARGS__)
+#else
+#define DEFERRED_LOGD(tag, format, ...) ((void)0)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 5
+#define DEFERRED_LOGV(tag, format, ...) \
+    DEFERRED_LOG(DeferredLogLevel::Verbose, tag, format, ##__VA_ARGS__)
+#else
+#define DEFERRED_LOGV(tag, format, ...) ((void)0)
+#endif
+
+#endif  // OSSM_DEFERRED_LOG_H
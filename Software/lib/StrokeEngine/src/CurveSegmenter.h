@@ -0,0 +1,428 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "VibrationOverlay.h"
+
+/**************************************************************************/
+/*!
+  @brief  A position over time, one cycle after the other, e.g. a sine or a
+  Bézier curve. CurveSegmenter samples it for the stepper.
+*/
+/**************************************************************************/
+class PositionCurve {
+  public:
+    virtual ~PositionCurve() {}
+
+    //! @return Seconds a cycle takes. Asked for every segment, so a new
+    //! speed applies right away.
+    virtual float cycleTime() = 0;
+
+    //! Position along the curve
+    /*!
+      @param cycle Index of the cycle, counting from 0
+      @param phase From 0 to 1 through the cycle. A cycle should end where
+      the next one starts, a jump is caught up within the limits.
+      @return Position in steps
+    */
+    virtual float positionAt(unsigned int cycle, float phase) = 0;
+};
+
+/**************************************************************************/
+/*!
+  @brief  Samples a PositionCurve into segments of constant acceleration
+  and hands them out as pieces of constant speed for the command queue of
+  the stepper. The stepper's own ramps only go from one position to the
+  next, a curve needs its own generator.
+
+  A segment is as long as the curve allows. It starts at twice the last
+  one, at most 32 ms, and is halved, down to 2 ms, until the curve is
+  within tolerance of a parabola along it: its speeds at the ends cover the
+  distance between them and its quarters lie on the parabola through its
+  ends and middle. It ends at a speed halfway between the curve's and the
+  one that would land on the curve's position, so an error, from a jump in
+  the curve or a segment cut to the motor's limits, is gone after two
+  segments without overshooting.
+
+  Each segment is cut into pieces that stray less than half a step from it
+  at a constant speed, at most 4 ms, the slowest step a queue entry takes.
+  A segment at a constant speed needs few pieces, a sharp turn many.
+
+  Segments end on the end of a cycle, where the segmenter waits for
+  nextCycle(), e.g. to swap patterns or let a stroke gate hold.
+
+  All positions in steps, speeds in steps/s, accelerations in steps/s^2.
+*/
+/**************************************************************************/
+class CurveSegmenter {
+  public:
+    //! Pieces are what VibrationOverlay hands out, one speed each
+    using Segment = VibrationOverlay::Segment;
+
+    //! Shortest and longest segment of constant acceleration
+    static constexpr uint32_t minSegmentMicros = 2000;
+    static constexpr uint32_t maxSegmentMicros = 32000;
+
+    //! Longest piece, a step every 4 ms is the slowest a queue entry has
+    static constexpr uint32_t maxPieceMicros = 4000;
+
+    //! How far a piece at constant speed strays from its segment, in steps
+    static constexpr float pieceTolerance = 0.5f;
+
+    //! A half cycle the segmenter planned, for telemetry
+    struct HalfCycle {
+        float position;  //!< Where it ends
+        float topSpeed;  //!< Fastest it went
+        bool isClipped;  //!< Whether the limits cut a segment short
+    };
+
+    //! Set the range the carriage is kept in and the motor's limits
+    void setLimits(int32_t minPosition, int32_t maxPosition,
+                   uint32_t maxSpeed, uint32_t maxAcceleration) {
+        _minPosition = minPosition;
+        _maxPosition = maxPosition;
+        _maxSpeed = float(maxSpeed);
+        _maxAcceleration = float(maxAcceleration);
+    }
+
+    //! How far the middle of a segment may be off the curve, in steps
+    void setTolerance(float tolerance) {
+        _tolerance = fmaxf(tolerance, pieceTolerance);
+    }
+
+    //! Follow a curve from its first cycle, from rest at position
+    void start(PositionCurve *curve, int32_t position) {
+        _curve = curve;
+        _cycle = 0;
+        _phase = 0;
+        _position = float(position);
+        _velocity = 0;
+        _issued = position;
+        _segmentSeconds = 0.5f * maxSegmentMicros * 1e-6f;
+        _isStopping = false;
+        _isAtCycleEnd = false;
+        _piecesLeft = 0;
+        _halfCycles = 0;
+        _half = {_position, 0, false};
+        _isPastHalf = false;
+        _segments = 0;
+    }
+
+    //! Follow a curve from rest at position, from where its first cycle
+    //! comes closest, e.g. after a move brought the carriage in. The half
+    //! cycle it joins in counts as played.
+    void join(PositionCurve *curve, int32_t position) {
+        start(curve, position);
+        _phase = nearestPhase(curve, float(position));
+        _isPastHalf = true;
+    }
+
+    //! @return The phase where the first cycle of a curve comes closest to
+    //! position, to 1/256 of the cycle
+    static float nearestPhase(PositionCurve *curve, float position) {
+        float nearest = 0;
+        float distance = fabsf(curve->positionAt(0, 0) - position);
+        for (int i = 1; i < 256; i++) {
+            float phase = i / 256.0f;
+            float d = fabsf(curve->positionAt(0, phase) - position);
+            if (d < distance) {
+                nearest = phase;
+                distance = d;
+            }
+        }
+        return nearest;
+    }
+
+    //! Brake as hard as allowed and leave the curve
+    void stop() {
+        _isStopping = true;
+        _isAtCycleEnd = false;
+    }
+
+    //! Drop the curve, e.g. once the stepper's queue was cleared
+    void reset() {
+        _curve = nullptr;
+        _piecesLeft = 0;
+    }
+
+    //! Go on with the next cycle once the last one is handed out
+    void nextCycle() {
+        if (isAtCycleEnd()) {
+            _cycle++;
+            _phase = 0;
+            _isAtCycleEnd = false;
+            _isPastHalf = false;
+        }
+    }
+
+    //! Wait at the end of the cycle, for curves that come to rest there.
+    //! The queue runs dry, nextCycle() starts from a standstill.
+    void pause() {
+        if (isAtCycleEnd()) {
+            _velocity = 0;
+        }
+    }
+
+    //! @return Whether the cycle is handed out and waits for nextCycle()
+    bool isAtCycleEnd() const { return _isAtCycleEnd && _piecesLeft == 0; }
+
+    //! @return Whether the carriage was brought to rest after stop()
+    bool isIdle() const {
+        return _piecesLeft == 0 &&
+               (_curve == nullptr || (_isStopping && _velocity == 0));
+    }
+
+    //! @return Whether next() has a piece to hand out
+    bool hasNext() const {
+        return _piecesLeft > 0 || (!_isAtCycleEnd && !isIdle());
+    }
+
+    //! The next piece, fed to the stepper one after the other
+    Segment next() {
+        if (_piecesLeft == 0 && !_plan()) {
+            return {0, 0};
+        }
+        // Piece ends spread evenly over the segment, to the microsecond
+        uint32_t piece = _pieces - _piecesLeft + 1;
+        uint32_t end = uint32_t(uint64_t(_plannedMicros) * piece / _pieces);
+        uint32_t micros = end - _elapsedMicros;
+        _elapsedMicros = end;
+        _piecesLeft--;
+
+        float t = float(end) * 1e-6f;
+        float desired = _fromPosition + _fromVelocity * t +
+                        0.5f * _plannedAcceleration * t * t;
+        if (desired < float(_minPosition)) {
+            desired = float(_minPosition);
+        } else if (desired > float(_maxPosition)) {
+            desired = float(_maxPosition);
+        }
+        int32_t steps = int32_t(lroundf(desired)) - _issued;
+
+        // Never faster than the motor, whatever rounding did
+        int32_t most = int32_t(_maxSpeed * float(micros) * 1e-6f) + 1;
+        if (steps > most) {
+            steps = most;
+        } else if (steps < -most) {
+            steps = -most;
+        }
+        _issued += steps;
+        return {steps, micros};
+    }
+
+    //! @return Whether another half cycle was planned since the last call
+    bool takeHalfCycle(HalfCycle &half) {
+        if (_halfCycles == 0) {
+            return false;
+        }
+        half = _reported;
+        _halfCycles = 0;
+        return true;
+    }
+
+    //! @return The cycle being planned
+    unsigned int cycle() const { return _cycle; }
+
+    //! @return Segments of constant acceleration planned since start()
+    uint32_t segments() const { return _segments; }
+
+    //! @return Where the planned segments end, phase and speed
+    float phase() const { return _phase; }
+    float velocity() const { return _velocity; }
+
+  private:
+    PositionCurve *_curve = nullptr;
+    int32_t _minPosition = 0;
+    int32_t _maxPosition = 0;
+    float _maxSpeed = 1;
+    float _maxAcceleration = 1;
+    float _tolerance = 1;
+
+    // Where the planned segments end
+    unsigned int _cycle = 0;
+    float _phase = 0;
+    float _position = 0;
+    float _velocity = 0;
+    float _segmentSeconds = 0;
+    bool _isStopping = false;
+    bool _isAtCycleEnd = false;
+    uint32_t _segments = 0;
+
+    // The segment being handed out
+    float _fromPosition = 0;
+    float _fromVelocity = 0;
+    float _plannedAcceleration = 0;
+    uint32_t _plannedMicros = 0;
+    uint32_t _pieces = 0;
+    uint32_t _piecesLeft = 0;
+    uint32_t _elapsedMicros = 0;
+    // Where the pieces handed out so far end
+    int32_t _issued = 0;
+
+    // The half cycle being planned, and the last one planned
+    HalfCycle _half = {0, 0, false};
+    HalfCycle _reported = {0, 0, false};
+    uint32_t _halfCycles = 0;
+    bool _isPastHalf = false;
+
+    //! The curve at a phase of this cycle, running into the cycles around
+    float _at(float phase) {
+        if (phase > 1) {
+            return _curve->positionAt(_cycle + 1, phase - 1);
+        }
+        if (phase < 0) {
+            return _cycle > 0 ? _curve->positionAt(_cycle - 1, phase + 1)
+                              : _curve->positionAt(0, 0);
+        }
+        return _curve->positionAt(_cycle, phase);
+    }
+
+    //! Plan the next segment. @return false if there is none to plan.
+    bool _plan() {
+        if (_curve == nullptr) {
+            return false;
+        }
+        float h;
+        float acceleration;
+        bool isCycleEnd = false;
+        float phase = _phase;
+
+        if (_isStopping) {
+            // Brake, the last segment just long enough to come to rest
+            float rest = fabsf(_velocity) / _maxAcceleration;
+            if (rest < 1e-6f) {
+                _velocity = 0;
+                return false;
+            }
+            h = fminf(rest, maxSegmentMicros * 1e-6f);
+            acceleration = _velocity > 0 ? -_maxAcceleration
+                                         : _maxAcceleration;
+        } else {
+            if (_isAtCycleEnd) {
+                return false;
+            }
+            float cycleTime = fmaxf(_curve->cycleTime(), 0.01f);
+            float left = (1 - _phase) * cycleTime;
+            // Half a millisecond for the curve's speed at a phase
+            float delta = fminf(0.5e-3f / cycleTime, 0.01f);
+            float startTarget = _at(_phase);
+            float startSpeed = (_at(_phase + delta) - _at(_phase - delta)) /
+                               (2 * delta * cycleTime);
+            h = fminf(2 * _segmentSeconds, maxSegmentMicros * 1e-6f);
+
+            while (true) {
+                // No sliver of a segment left over before the cycle ends
+                isCycleEnd = h + minSegmentMicros * 1e-6f > left;
+                float span = isCycleEnd ? left : h;
+                float end = isCycleEnd ? 1 : _phase + span / cycleTime;
+                float target = _at(end);
+                float curveSpeed =
+                    (_at(end + delta) - _at(end - delta)) /
+                    (2 * delta * cycleTime);
+                float landingSpeed =
+                    2 * (target - _position) / span - _velocity;
+                acceleration =
+                    (0.5f * (curveSpeed + landingSpeed) - _velocity) / span;
+
+                // Whether the curve is a parabola, wherever the carriage is:
+                // its speeds at the ends cover the distance between them, or
+                // the carriage would land off by half of what is missing,
+                // and its quarters lie on the one through its ends and
+                // middle
+                float stride = span / cycleTime;
+                float missing = target - startTarget -
+                                0.5f * (startSpeed + curveSpeed) * span;
+                float middle = _at(_phase + 0.5f * stride);
+                bool isShortest = h <= minSegmentMicros * 1e-6f;
+                bool isWithin = fabsf(missing) <= _tolerance &&
+                                fabsf(_at(_phase + 0.25f * stride) -
+                                      (3 * startTarget + 6 * middle - target) /
+                                          8) <= _tolerance &&
+                                fabsf(_at(_phase + 0.75f * stride) -
+                                      (3 * target + 6 * middle - startTarget) /
+                                          8) <= _tolerance;
+                if (isShortest || isWithin) {
+                    // Grown back from here, unless the cycle cut it short
+                    if (!isCycleEnd || span >= _segmentSeconds) {
+                        _segmentSeconds = span;
+                    }
+                    h = span;
+                    phase = end;
+                    break;
+                }
+                h = fmaxf(0.5f * span, minSegmentMicros * 1e-6f);
+            }
+        }
+
+        // Within the motor's limits, and slow enough to stop before the
+        // end of the range
+        bool isClipped = false;
+        float endVelocity = _velocity + acceleration * h;
+        float toward = endVelocity > 0 ? 1 : -1;
+        float room = toward > 0 ? _maxPosition - _position
+                                : _position - _minPosition;
+        // The end speed v with v^2 = 2 a (room - (v0 + v) h / 2), room to
+        // brake left over after the segment
+        float ah = _maxAcceleration * h;
+        float reach = room - 0.5f * toward * _velocity * h;
+        float root = sqrtf(fmaxf(ah * ah + 8 * _maxAcceleration * reach, 0));
+        float limit = fminf(_maxSpeed, fmaxf(0.5f * (root - ah), 0));
+        if (fabsf(endVelocity) > limit) {
+            endVelocity = copysignf(limit, endVelocity);
+            acceleration = (endVelocity - _velocity) / h;
+            isClipped = true;
+        }
+        if (fabsf(acceleration) > _maxAcceleration) {
+            acceleration = copysignf(_maxAcceleration, acceleration);
+            endVelocity = _velocity + acceleration * h;
+            isClipped = true;
+        }
+        if (_isStopping && fabsf(endVelocity) < fabsf(_velocity) * 1e-3f) {
+            endVelocity = 0;
+        }
+
+        _fromPosition = _position;
+        _fromVelocity = _velocity;
+        _plannedAcceleration = acceleration;
+        _plannedMicros = uint32_t(lroundf(h * 1e6f));
+        _plannedMicros = _plannedMicros > 0 ? _plannedMicros : 1;
+        _elapsedMicros = 0;
+
+        // Short enough that a constant speed strays less than half a step
+        float pieceSeconds = maxPieceMicros * 1e-6f;
+        if (acceleration != 0) {
+            pieceSeconds = fminf(
+                pieceSeconds, sqrtf(8 * pieceTolerance / fabsf(acceleration)));
+        }
+        // And at most 255 steps, what a queue entry takes
+        float fastest = fmaxf(fabsf(_velocity), fabsf(endVelocity));
+        if (fastest > 0) {
+            pieceSeconds = fminf(pieceSeconds, 255 / fastest);
+        }
+        _pieces = uint32_t(ceilf(h / pieceSeconds));
+        _pieces = _pieces < 1 ? 1 : _pieces;
+        _piecesLeft = _pieces;
+
+        _position += (_velocity + endVelocity) * 0.5f * h;
+        _velocity = endVelocity;
+        _segments++;
+
+        // Halves of the cycle, for telemetry
+        _half.topSpeed = fmaxf(_half.topSpeed, fabsf(_velocity));
+        _half.isClipped = _half.isClipped || isClipped;
+        if (!_isStopping) {
+            bool isHalf = !_isPastHalf && phase >= 0.5f;
+            _isPastHalf = _isPastHalf || isHalf;
+            if (isHalf || isCycleEnd) {
+                _half.position = _position;
+                _reported = _half;
+                _halfCycles++;
+                _half = {_position, 0, false};
+            }
+            _phase = phase;
+            _isAtCycleEnd = isCycleEnd;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**************************************************************************/
+/*!
+  @brief  One stop of a motion table.
+*/
+/**************************************************************************/
+struct MotionKeyframe {
+    float position;  //!< Where to go, 0 is the back of the stroke and 1 the
+                     //!< depth
+    float time;      //!< Time to get there, as a share of the stroke time
+                     //!< relative to the other keyframes
+    float ramp;      //!< Share of the move spent speeding up and braking, the
+                     //!< rest coasts. 2/3 is the trapezoid of SimpleStroke,
+                     //!< 1 a triangle
+};
+
+/**************************************************************************/
+/*!
+  @brief  A pattern as data: keyframes played in a loop, one move each, and
+  stretched so a loop takes one stroke time. Stroke and depth set the window
+  the positions map into, so the same table works on every machine.
+
+  Tables are written as text, one keyframe per line or separated by ';':
+  "position time [ramp]", position and ramp in percent, time relative to
+  the other keyframes. A keyframe at the position of the one before holds
+  still for its time. "#" starts a comment. SimpleStroke is "100 1; 0 1".
+*/
+/**************************************************************************/
+struct MotionTable {
+    static constexpr size_t maxKeyframes = 32;
+    static constexpr float defaultRamp = 2.0f / 3.0f;
+    // Below this, the acceleration a move needs grows without bound.
+    static constexpr float minRamp = 0.05f;
+    // "33.3333 0.333333 12.5; " for every keyframe.
+    static constexpr size_t formatLength = 24 * maxKeyframes;
+
+    uint32_t count = 0;
+    MotionKeyframe keyframes[maxKeyframes] = {};
+
+    //! Sum of the keyframe times, one loop of the table.
+    float totalTime() const {
+        float total = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            total += keyframes[i].time;
+        }
+        return total;
+    }
+
+    //! Whether the table can be played: two keyframes or more, positions
+    //! within the stroke, times above zero and ramps within [minRamp, 1].
+    bool isValid() const {
+        if (count < 2 || count > maxKeyframes) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const MotionKeyframe &k = keyframes[i];
+            if (!(k.position >= 0 && k.position <= 1 && k.time > 0 &&
+                  k.ramp >= minRamp && k.ramp <= 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*!
+      @brief Reads a table from text.
+      @return false, leaving the table as it was, if the text is not a valid
+      table.
+    */
+    bool parse(const char *text) {
+        MotionTable table;
+        const char *p = text;
+        while (*p != '\0') {
+            // One keyframe up to the next separator.
+            size_t length = strcspn(p, ";\n");
+            char entry[64];
+            if (length >= sizeof(entry)) {
+                return false;
+            }
+            memcpy(entry, p, length);
+            entry[length] = '\0';
+            p += length + (p[length] != '\0');
+
+            char *comment = strchr(entry, '#');
+            if (comment != nullptr) {
+                *comment = '\0';
+            }
+            if (entry[strspn(entry, " \t\r")] == '\0') {
+                continue;
+            }
+            float position, time, ramp = 100 * defaultRamp;
+            char extra;
+            int n = sscanf(entry, "%f %f %f %c", &position, &time, &ramp,
+                           &extra);
+            if (n < 2 || n > 3 || table.count == maxKeyframes) {
+                return false;
+            }
+            table.keyframes[table.count++] = {position / 100, time,
+                                              ramp / 100};
+        }
+        if (!table.isValid()) {
+            return false;
+        }
+        *this = table;
+        return true;
+    }
+
+    /*!
+      @brief Writes the table as one line of text that parse() reads back,
+      at most formatLength long.
+      @return the length, as snprintf(); the text is cut if it is longer
+      than size.
+    */
+    size_t format(char *out, size_t size) const {
+        size_t length = 0;
+        if (size > 0) {
+            out[0] = '\0';
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const MotionKeyframe &k = keyframes[i];
+            // The default ramp goes without saying.
+            bool isDefaultRamp = fabsf(k.ramp - defaultRamp) < 1e-6f;
+            bool fits = length < size;
+            length += snprintf(fits ? out + length : nullptr,
+                               fits ? size - length : 0,
+                               isDefaultRamp ? "%s%g %g" : "%s%g %g %g",
+                               i == 0 ? "" : "; ", k.position * 100, k.time,
+                               k.ramp * 100);
+        }
+        return length;
+    }
+};
@@ -33,22 +33,16 @@
 inline float fscale( float originalMin, float originalMax, float newBegin, float
 newEnd, float inputValue, float curve){
 
-  float OriginalRange = 0;
-  float NewRange = 0;
-  float zeroRefCurVal = 0;
-  float normalizedCurVal = 0;
-  float rangedValue = 0;
-  bool invFlag = 0;
+  // Check for originalMin > originalMax  - the math for all other cases i.e. negative numbers seems to work out fine
+  if (originalMin > originalMax ) {
+    return 0;
+  }
 
   // condition curve parameter
   // limit range
-
   if (curve > 10) curve = 10;
   if (curve < -10) curve = -10;
 
-  curve = (curve * -.1) ; // - invert and scale - this seems more intuitive - positive numbers give more weight to high end on output
-  curve = pow(10, curve); // convert linear scale into logarithmic exponent for other pow function
-
   // Check for out of range inputValues
   if (inputValue < originalMin) {
     inputValue = originalMin;
@@ -57,36 +51,139 @@ newEnd, float inputValue, float curve){
     inputValue = originalMax;
   }
 
-  // Zero Reference the values
-  OriginalRange = originalMax - originalMin;
+  // normalize to 0 - 1 float
+  float normalizedCurVal = (inputValue - originalMin) / (originalMax - originalMin);
 
-  if (newEnd > newBegin){
-    NewRange = newEnd - newBegin;
-  }
-  else
-  {
-    NewRange = newBegin - newEnd;
-    invFlag = 1;
+  // A curve of 0 is a straight line, which is what the patterns use. Only
+  // curved mappings pay for powf(). All of it is single precision, doubles
+  // are emulated in software on the ESP32.
+  if (curve != 0) {
+    // - invert and scale - this seems more intuitive - positive numbers give more weight to high end on output
+    // convert linear scale into logarithmic exponent for the other powf
+    normalizedCurVal = powf(normalizedCurVal, powf(10.0f, curve * -0.1f));
   }
 
-  zeroRefCurVal = inputValue - originalMin;
-  normalizedCurVal  =  zeroRefCurVal / OriginalRange;   // normalize to 0 - 1 float
+  // newEnd may be smaller than newBegin, which inverts the range
+  return newBegin + normalizedCurVal * (newEnd - newBegin);
+}
 
-  // Check for originalMin > originalMax  - the math for all other cases i.e. negative numbers seems to work out fine
-  if (originalMin > originalMax ) {
-    return 0;
+namespace PatternMath {
+  // Compile time exp() and log(), in double as only the compiler runs them.
+  constexpr double ln2 = 0.69314718055994530942;
+  constexpr double ln10 = 2.30258509299404568402;
+
+  constexpr double constLog(double x) {
+    if (x <= 0) {
+      return -INFINITY;
+    }
+    // x = m * 2^k with m in [1, 2), then log(m) = 2 atanh((m - 1) / (m + 1))
+    int k = 0;
+    while (x >= 2) {
+      x /= 2;
+      k++;
+    }
+    while (x < 1) {
+      x *= 2;
+      k--;
+    }
+    double z = (x - 1) / (x + 1);
+    double z2 = z * z;
+    double term = z;
+    double sum = 0;
+    for (int n = 1; n < 60; n += 2) {
+      sum += term / n;
+      term *= z2;
+    }
+    return 2 * sum + k * ln2;
   }
 
-  if (invFlag == 0){
-    rangedValue =  (pow(normalizedCurVal, curve) * NewRange) + newBegin;
+  constexpr double constExp(double x) {
+    // x = k ln2 + r with |r| <= ln2 / 2, then exp(x) = 2^k exp(r)
+    int k = int(x / ln2 + (x < 0 ? -0.5 : 0.5));
+    double r = x - k * ln2;
+    double term = 1;
+    double sum = 1;
+    for (int n = 1; n < 30; n++) {
+      term *= r / n;
+      sum += term;
+    }
+    for (; k > 0; k--) {
+      sum *= 2;
+    }
+    for (; k < 0; k++) {
+      sum /= 2;
+    }
+    return sum;
+  }
 
+  constexpr double constPow(double base, double exponent) {
+    return base <= 0 ? 0 : constExp(exponent * constLog(base));
   }
-  else     // invert the ranges
-  {  
-    rangedValue =  newBegin - (pow(normalizedCurVal, curve) * NewRange);
+}
+
+/**************************************************************************/
+/*!
+  @brief  fscale() sampled at compile time. Looking up a value is a
+  multiplication, a float to int conversion and a linear interpolation
+  between two samples, no pow() at run time. Exact for a curve of 0. With 32
+  segments negative curves stay within 1 % of the output range. Positive
+  curves start with an infinite slope at originalMin that interpolation
+  cannot follow, use fscale() for those.
+  Build one with makeFscaleTable().
+*/
+/**************************************************************************/
+template <size_t Segments>
+struct FscaleTable {
+  float originalMin;
+  float originalMax;
+  float segmentsPerUnit;
+  float values[Segments + 1];
+
+  float operator()(float inputValue) const {
+    if (!(inputValue > originalMin)) {
+      return values[0];
+    }
+    if (inputValue >= originalMax) {
+      return values[Segments];
+    }
+    float position = (inputValue - originalMin) * segmentsPerUnit;
+    size_t index = size_t(position);
+    if (index >= Segments) {
+      return values[Segments];
+    }
+    float fraction = position - float(index);
+    return values[index] + fraction * (values[index + 1] - values[index]);
   }
+};
+
+/**************************************************************************/
+/*!
+  @brief  Builds a FscaleTable. Takes the same arguments as fscale(), all but
+  the input value, and should be assigned to a constexpr variable so the
+  samples are computed by the compiler.
+  @returns the table
+*/
+/**************************************************************************/
+template <size_t Segments = 32>
+constexpr FscaleTable<Segments> makeFscaleTable(float originalMin,
+    float originalMax, float newBegin, float newEnd, float curve = 0.0f) {
+  FscaleTable<Segments> table{};
+  table.originalMin = originalMin;
+  table.originalMax = originalMax;
+  table.segmentsPerUnit = Segments / (originalMax - originalMin);
+
+  if (curve > 10) curve = 10;
+  if (curve < -10) curve = -10;
+  double exponent = PatternMath::constExp(curve * -0.1 * PatternMath::ln10);
 
-  return rangedValue;
+  for (size_t i = 0; i <= Segments; i++) {
+    double normalized = double(i) / Segments;
+    if (curve != 0) {
+      normalized = PatternMath::constPow(normalized, exponent);
+    }
+    table.values[i] = float(newBegin + normalized * (double(newEnd) - newBegin));
+  }
+  return table;
 }
 
 /**************************************************************************/
@@ -119,22 +216,52 @@ inline float fmap(float x, float in_min, float in_max, float out_min, float out_
   @returns the scaled factor
 */
 /**************************************************************************/
-inline float mapSensationToFactor(float maximumFactor, float inputValue, float curve = 0.0) {
-    inputValue = constrain(inputValue, -100.0, 100.0);
-    float fscaledValue = 0.0;
+inline float mapSensationToFactor(float maximumFactor, float inputValue, float curve = 0.0f) {
+    inputValue = constrain(inputValue, -100.0f, 100.0f);
 
-    if (inputValue == 0.0) {
-        return 1.0;
+    if (inputValue == 0.0f) {
+        return 1.0f;
     } 
 
-    fscaledValue = fscale(0.0, 100.0, 1.0, maximumFactor, abs(inputValue), curve);
+    float fscaledValue = fscale(0.0f, 100.0f, 1.0f, maximumFactor, fabsf(inputValue), curve);
 
     if (inputValue >= 0) {
         return fscaledValue;
     } else {
-        return 1.0/fscaledValue;
+        return 1.0f/fscaledValue;
     }
     
 }
 
+/**************************************************************************/
+/*!
+  @brief  mapSensationToFactor() for a fixed maximum factor and curve, from a
+  table built with makeSensationTable().
+  @param table          the precomputed mapping
+  @param inputValue     Input parameter to be mapped
+  @returns the scaled factor
+*/
+/**************************************************************************/
+template <size_t Segments>
+inline float mapSensationToFactor(const FscaleTable<Segments> &table, float inputValue) {
+    inputValue = constrain(inputValue, -100.0f, 100.0f);
+
+    if (inputValue >= 0) {
+        return table(inputValue);
+    } else {
+        return 1.0f/table(-inputValue);
+    }
+}
+
+/**************************************************************************/
+/*!
+  @brief  The table for mapSensationToFactor(table, inputValue), with the
+  same maximumFactor and curve arguments as mapSensationToFactor().
+  @returns the table
+*/
+/**************************************************************************/
+template <size_t Segments = 32>
+constexpr FscaleTable<Segments> makeSensationTable(float maximumFactor, float curve = 0.0f) {
+    return makeFscaleTable<Segments>(0.0f, 100.0f, 1.0f, maximumFactor, curve);
+}
 
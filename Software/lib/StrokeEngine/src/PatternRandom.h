@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+/**************************************************************************/
+/*!
+  @brief  Small, fast pseudo random numbers for patterns: Marsaglia's
+  xorshift32, three shifts and three xors a draw. The same seed always gives
+  the same sequence, on the ESP32 and on a computer alike, so a pattern that
+  draws from it can be traced and tested.
+*/
+/**************************************************************************/
+class PatternRandom {
+  public:
+    explicit PatternRandom(uint32_t seed = 1) { setSeed(seed); }
+
+    //! Restart the sequence
+    /*!
+      @param seed Any value. 0 would repeat itself forever, so it is swapped
+      for another.
+    */
+    void setSeed(uint32_t seed) { _state = seed != 0 ? seed : 0x9E3779B9; }
+
+    //! @return The next 32 random bits
+    uint32_t next() {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state;
+    }
+
+    //! @return A value in [0, 1), from the top 24 bits which a float holds
+    //! exactly
+    float uniform() { return float(next() >> 8) * (1.0f / 16777216.0f); }
+
+    //! @return A value in [low, high)
+    float between(float low, float high) {
+        return low + uniform() * (high - low);
+    }
+
+  private:
+    uint32_t _state;
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**************************************************************************/
+/*!
+  @brief  Tracks a stream of target positions, e.g. from a remote or a
+  second machine, with the speed and acceleration limits of the motor.
+
+  Only the latest target counts: a new one replaces the one before, so a
+  burst of late targets is never worked through one after the other. The
+  velocity of the target is estimated over the last few targets, so that one
+  arriving a little early or late does not throw it, and fed forward, which
+  keeps the carriage up with a moving target instead of trailing it. On top
+  of that the remaining distance closes at gain per second. The command is
+  a position with a speed and an acceleration, for a stepper that plans its
+  own ramps, like FastAccelStepper. It brakes for the target on its own, so
+  the carriage does not overshoot a target that stopped.
+
+  A target is carried forward along its velocity for at most
+  extrapolateMicros, which rides out a late or lost target or two. One
+  older than staleMicros is held where it is, without feed forward: when
+  the stream stops the carriage stops at the last target instead of
+  running on.
+
+  All positions in steps, all times in microseconds.
+*/
+/**************************************************************************/
+class PositionFollower {
+  public:
+    struct Settings {
+        uint32_t staleMicros = 50000;  //!< Hold the target when this old
+        uint32_t extrapolateMicros = 20000;  //!< Carry it forward this long
+        uint32_t leadMicros = 10000;   //!< How far ahead to aim, to make up
+                                       //!< for the time a command takes
+        float gain = 25.0f;  //!< Share of the distance closed per second
+        float smoothing = 0.5f;  //!< Weight of a new velocity estimate
+    };
+
+    struct Command {
+        int32_t position;  //!< Where to go
+        uint32_t speed;    //!< Steps/s, at least 1
+        uint32_t acceleration;  //!< Steps/s^2
+        bool isHolding;    //!< No fresh target, stopping at the last one
+    };
+
+    PositionFollower() {}
+    explicit PositionFollower(const Settings &settings)
+        : _settings(settings) {}
+
+    //! Set the range targets are kept in and the motor's limits
+    void setLimits(int32_t minPosition, int32_t maxPosition,
+                   uint32_t maxSpeed, uint32_t maxAcceleration) {
+        _minPosition = minPosition;
+        _maxPosition = maxPosition;
+        _maxSpeed = maxSpeed > 0 ? maxSpeed : 1;
+        _maxAcceleration = maxAcceleration;
+    }
+
+    //! Forget the stream, the carriage holds at position until a target
+    //! arrives
+    void reset(int32_t position) {
+        _target = _clamp(position);
+        _velocity = 0;
+        _count = 0;
+        _hasTarget = false;
+    }
+
+    //! A new target, replacing the last
+    /*!
+      @param position Target in steps, kept inside the limits
+      @param timeMicros When it was taken
+    */
+    void setTarget(int32_t position, uint64_t timeMicros) {
+        position = _clamp(position);
+        if (!_hasTarget || timeMicros < _targetMicros ||
+            timeMicros - _targetMicros > _settings.staleMicros) {
+            // Moving again after a pause, nothing to estimate from yet
+            _count = 0;
+            _velocity = 0;
+        }
+
+        _history[_next] = {position, timeMicros};
+        _next = (_next + 1) % historySize;
+        if (_count < historySize) {
+            _count++;
+        }
+        if (_count > 1) {
+            // Newest against oldest, the time between them is long enough
+            // for jitter to matter little
+            const Sample &oldest = _history[_count < historySize ? 0 : _next];
+            uint64_t span = timeMicros - oldest.timeMicros;
+            if (span > 0) {
+                float velocity =
+                    float(position - oldest.position) * 1e6f / float(span);
+                _velocity += _settings.smoothing * (velocity - _velocity);
+            }
+        }
+
+        _target = position;
+        _targetMicros = timeMicros;
+        _hasTarget = true;
+    }
+
+    //! What the motor should do now
+    /*!
+      @param nowMicros Current time, on the clock of setTarget()
+      @param position Where the carriage is
+    */
+    Command update(uint64_t nowMicros, int32_t position) {
+        Command command = {_target, 1, _maxAcceleration, true};
+        if (!_hasTarget) {
+            command.speed = _maxSpeed;
+            return command;
+        }
+
+        uint64_t age =
+            nowMicros > _targetMicros ? nowMicros - _targetMicros : 0;
+        float velocity = 0;
+        if (age <= _settings.staleMicros) {
+            velocity = _velocity;
+            // Where the target is by the time the command takes effect
+            uint64_t carried = age < _settings.extrapolateMicros
+                                   ? age
+                                   : _settings.extrapolateMicros;
+            float ahead = float(carried + _settings.leadMicros) * 1e-6f;
+            command.position = _clamp(_target + int32_t(velocity * ahead));
+            command.isHolding = false;
+        }
+
+        float speed = fabsf(velocity) +
+                      _settings.gain * float(abs(command.position - position));
+        if (speed > float(_maxSpeed)) {
+            speed = float(_maxSpeed);
+        }
+        command.speed = speed >= 1.0f ? uint32_t(speed) : 1;
+        return command;
+    }
+
+    //! Estimated speed of the target in steps/s
+    float targetVelocity() const { return _velocity; }
+
+  private:
+    Settings _settings;
+    int32_t _minPosition = 0;
+    int32_t _maxPosition = 0;
+    uint32_t _maxSpeed = 1;
+    uint32_t _maxAcceleration = 1;
+
+    struct Sample {
+        int32_t position;
+        uint64_t timeMicros;
+    };
+    static constexpr uint8_t historySize = 4;
+    Sample _history[historySize];
+    uint8_t _next = 0;
+    uint8_t _count = 0;
+
+    int32_t _target = 0;
+    uint64_t _targetMicros = 0;
+    float _velocity = 0;
+    bool _hasTarget = false;
+
+    int32_t _clamp(int32_t position) const {
+        if (position < _minPosition) {
+            return _minPosition;
+        }
+        return position > _maxPosition ? _maxPosition : position;
+    }
+};
@@ -1,7 +1,9 @@
 #include "StrokeEngine.h"
 
 #include <Arduino.h>
+#include <esp_timer.h>
 
+#include "DeferredLog.h"
 #include "pattern.h"
 
 // static pointer to engine and _servo
@@ -16,6 +18,8 @@ void StrokeEngine::begin(machineGeometry *physics, motorProperties *motor,
     _travel = (_physics->physicalTravel - (2 * _physics->keepoutBoundary));
     _minStep = 0;
     _maxStep = int(0.5 + _travel * _motor->stepsPerMillimeter);
+    // Converting back to mm happens on every move, multiply instead of divide
+    _millimetersPerStep = 1.0f / _motor->stepsPerMillimeter;
     _maxStepPerSecond =
         int(0.5 + _motor->maxSpeed * _motor->stepsPerMillimeter);
     _maxStepAcceleration =
@@ -31,6 +35,10 @@ void StrokeEngine::begin(machineGeometry *physics, motorProperties *motor,
     _previousStroke = _maxStep / 3;
     _timeOfStroke = 1.0;
     _sensation = 0.0;
+    _strokesPlayed = 0;
+    _swappedAtMillis = millis();
+    _overlay.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                       _maxStepAcceleration);
 
     if (_servo) {
         _servo->setDirectionPin(_motor->directionPin, _motor->invertDirection);
@@ -41,7 +49,8 @@ void StrokeEngine::begin(machineGeometry *physics, motorProperties *motor,
     Serial.println("_servo initialized");
 
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Stroke Engine State: " + verboseState[_state]);
+    DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                  verboseState[_state]);
 #endif
 }
 
@@ -51,12 +60,12 @@ void StrokeEngine::setSpeed(float speed, bool applyNow = false) {
     if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
         // Convert FPM into seconds to complete a full stroke
         // Constrain stroke time between 10ms and 120 seconds
-        _timeOfStroke = constrain(60.0 / speed, 0.01, 120.0);
+        _timeOfStroke = constrain(60.0f / speed, 0.01f, 120.0f);
 
         pattern->setTimeOfStroke(_timeOfStroke);
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("setTimeOfStroke: " + String(_timeOfStroke, 2));
+        DEFERRED_LOGD("StrokeEngine", "setTimeOfStroke: %.2f", _timeOfStroke);
 #endif
 
         // When running a pattern and immediate update requested:
@@ -65,7 +74,7 @@ void StrokeEngine::setSpeed(float speed, bool applyNow = false) {
             _applyUpdate = true;
 
 #ifdef DEBUG_TALKATIVE
-            Serial.println("Apply New Settings Now");
+            DEFERRED_LOGD("StrokeEngine", "Apply New Settings Now");
 #endif
         }
 
@@ -76,7 +85,7 @@ void StrokeEngine::setSpeed(float speed, bool applyNow = false) {
 
 float StrokeEngine::getSpeed() {
     // Convert speed into FPMs
-    return 60.0 / _timeOfStroke;
+    return 60.0f / _timeOfStroke;
 }
 
 void StrokeEngine::setDepth(float depth, bool applyNow = false) {
@@ -89,7 +98,7 @@ void StrokeEngine::setDepth(float depth, bool applyNow = false) {
         pattern->setDepth(_depth);
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("setDepth: " + String(_depth));
+        DEFERRED_LOGD("StrokeEngine", "setDepth: %d", _depth);
 #endif
         // When running a pattern and immediate update requested:
         if ((_state == PATTERN) && (applyNow == true)) {
@@ -97,7 +106,7 @@ void StrokeEngine::setDepth(float depth, bool applyNow = false) {
             _applyUpdate = true;
 
 #ifdef DEBUG_TALKATIVE
-            Serial.println("Apply New Settings Now");
+            DEFERRED_LOGD("StrokeEngine", "Apply New Settings Now");
 #endif
         }
 
@@ -113,7 +122,7 @@ void StrokeEngine::setDepth(float depth, bool applyNow = false) {
 
 float StrokeEngine::getDepth() {
     // Convert depth from steps into mm
-    return _depth / _motor->stepsPerMillimeter;
+    return _depth * _millimetersPerStep;
 }
 
 void StrokeEngine::setStroke(float stroke, bool applyNow = false) {
@@ -128,7 +137,7 @@ void StrokeEngine::setStroke(float stroke, bool applyNow = false) {
         pattern->setStroke(_stroke);
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("setStroke: " + String(_stroke));
+        DEFERRED_LOGD("StrokeEngine", "setStroke: %d", _stroke);
 #endif
 
         // When running a pattern and immediate update requested:
@@ -137,7 +146,7 @@ void StrokeEngine::setStroke(float stroke, bool applyNow = false) {
             _applyUpdate = true;
 
 #ifdef DEBUG_TALKATIVE
-            Serial.println("Apply New Settings Now");
+            DEFERRED_LOGD("StrokeEngine", "Apply New Settings Now");
 #endif
         }
 
@@ -153,7 +162,7 @@ void StrokeEngine::setStroke(float stroke, bool applyNow = false) {
 
 float StrokeEngine::getStroke() {
     // Convert stroke from steps into mm
-    return _stroke / _motor->stepsPerMillimeter;
+    return _stroke * _millimetersPerStep;
 }
 
 void StrokeEngine::setSensation(float sensation, bool applyNow = false) {
@@ -166,7 +175,7 @@ void StrokeEngine::setSensation(float sensation, bool applyNow = false) {
         pattern->setSensation(_sensation);
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("setSensation: " + String(_sensation));
+        DEFERRED_LOGD("StrokeEngine", "setSensation: %.2f", _sensation);
 #endif
 
         // When running a pattern and immediate update requested:
@@ -175,7 +184,7 @@ void StrokeEngine::setSensation(float sensation, bool applyNow = false) {
             _applyUpdate = true;
 
 #ifdef DEBUG_TALKATIVE
-            Serial.println("Apply New Settings Now");
+            DEFERRED_LOGD("StrokeEngine", "Apply New Settings Now");
 #endif
         }
 
@@ -193,52 +202,178 @@ float StrokeEngine::getSensation() { return _sensation; }
 
 bool StrokeEngine::setPattern(Pattern *NextPattern,
                               bool applyNow = false) {
-    // Free up memory from previous pattern
+    Pattern *dropped = NULL;
+    Pattern *retired = NULL;
 
-    delete pattern;
-    pattern = NextPattern;
-
-    // Inject current motion parameters into new pattern
+    // Stage the new pattern. While stroking the stroking task swaps it in at
+    // the end of a stroke, the running pattern is left alone until then.
     if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
-        pattern->setSpeedLimit(_maxStepPerSecond, _maxStepAcceleration,
-                              _motor->stepsPerMillimeter);
-        pattern->setTimeOfStroke(_timeOfStroke);
-        pattern->setStroke(_stroke);
-        pattern->setDepth(_depth);
-        pattern->setSensation(_sensation);
+        dropped = _stagePattern(NextPattern);
 
-        // When running a pattern and immediate update requested:
-        if ((_state == PATTERN) && (applyNow == true)) {
-            // set flag to apply update from stroking thread
-            _applyUpdate = true;
+        if (_state == PATTERN) {
+            // Take over from the current position instead of waiting
+            _crossfade = applyNow;
 
 #ifdef DEBUG_TALKATIVE
-            Serial.println("Apply New Settings Now");
+            if (applyNow == true) {
+                DEFERRED_LOGD("StrokeEngine", "Apply New Pattern Now");
+            }
 #endif
+        } else {
+            // Not stroking, so there is no stroke to wait for
+            retired = _swapPattern();
         }
 
-        // Reset index counter
-        _index = -1;
-
         // give back mutex
         xSemaphoreGive(_patternMutex);
     }
 
+    // Free up memory outside of the mutex, nothing refers to these anymore
+    delete dropped;
+    delete retired;
+
 #ifdef DEBUG_TALKATIVE
-    Serial.println("setPattern: " + String(pattern->getName()));
-    Serial.println("setTimeOfStroke: " + String(_timeOfStroke, 2));
-    Serial.println("setDepth: " + String(_depth));
-    Serial.println("setStroke: " + String(_stroke));
-    Serial.println("setSensation: " + String(_sensation));
+    DEFERRED_LOGD("StrokeEngine", "setPattern: %s", NextPattern->getName());
+    DEFERRED_LOGD("StrokeEngine", "setTimeOfStroke: %.2f", _timeOfStroke);
+    DEFERRED_LOGD("StrokeEngine", "setDepth: %d", _depth);
+    DEFERRED_LOGD("StrokeEngine", "setStroke: %d", _stroke);
+    DEFERRED_LOGD("StrokeEngine", "setSensation: %.2f", _sensation);
 #endif
     return true;
 }
 
+bool StrokeEngine::queuePattern(Pattern *nextPattern,
+                                const patternSettings &settings,
+                                uint32_t strokes, uint32_t millis) {
+    Pattern *dropped = NULL;
+    Pattern *retired = NULL;
+
+    if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        dropped = _stagePattern(nextPattern);
+        _nextAfterStrokes = strokes;
+        _nextAfterMillis = millis;
+        _nextSettings = settings;
+
+        // Not stroking and nothing left to wait for, take it right away
+        if (_state != PATTERN && _isNextPatternDue()) {
+            retired = _swapPattern();
+        }
+
+        xSemaphoreGive(_patternMutex);
+    }
+
+    delete dropped;
+    delete retired;
+
+#ifdef DEBUG_TALKATIVE
+    DEFERRED_LOGD("StrokeEngine", "queuePattern: %s after %u strokes, %u ms",
+                  nextPattern->getName(), strokes, millis);
+#endif
+    return true;
+}
+
+bool StrokeEngine::isPatternQueued() {
+    bool isQueued = false;
+    if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        isQueued = _nextPattern != NULL;
+        xSemaphoreGive(_patternMutex);
+    }
+    return isQueued;
+}
+
+bool StrokeEngine::setQueuedSettings(const patternSettings &settings) {
+    bool isQueued = false;
+    if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        isQueued = _nextPattern != NULL;
+        if (isQueued) {
+            _nextSettings = settings;
+        }
+        xSemaphoreGive(_patternMutex);
+    }
+    return isQueued;
+}
+
 int StrokeEngine::getPattern() { return 0; }
 
+void StrokeEngine::setVibration(float frequency, float amplitude) {
+    frequency = constrain(frequency, 1.0f, 50.0f);
+    amplitude = constrain(amplitude, 0.0f, _travel);
+
+    // The stroking task picks it up with the next segment
+    if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        _overlay.setVibration(frequency,
+                              amplitude * _motor->stepsPerMillimeter);
+        xSemaphoreGive(_patternMutex);
+    }
+
+#ifdef DEBUG_TALKATIVE
+    DEFERRED_LOGD("StrokeEngine", "setVibration: %.1f Hz, %.2f mm", frequency,
+                  amplitude);
+#endif
+}
+
+bool StrokeEngine::startStreaming() {
+    // isHomed is only true in states READY, PATTERN, SETUPDEPTH and STREAMING
+    if (!_isHomed) {
+#ifdef DEBUG_TALKATIVE
+        DEFERRED_LOGD("StrokeEngine", "Failed to start streaming");
+#endif
+        return false;
+    }
+    if (_state == STREAMING) {
+        return true;
+    }
+
+    // Come to a halt first, the follower starts from standstill
+    stopMotion();
+
+    // Hold the current position until the first target arrives
+    if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        _follower.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                            _maxStepAcceleration);
+        _follower.reset(_servo->getCurrentPosition());
+        xSemaphoreGive(_patternMutex);
+    }
+
+    // Set state to STREAMING
+    _state = STREAMING;
+
+    if (_taskStreamingHandle == NULL) {
+        // Create Streaming Task, placed like the stroking task
+        xTaskCreatePinnedToCore(
+            this->_streamingImpl,   // Function that should be called
+            "Streaming",            // Name of the task (for debugging)
+            _strokingStackSize,     // Stack size (bytes)
+            this,                   // Pass reference to this class instance
+            _strokingPriority,      // Pretty high task priority
+            &_taskStreamingHandle,  // Task handle
+            _strokingCore           // Application core by default
+        );
+    } else {
+        // Resume task, if it already exists
+        vTaskResume(_taskStreamingHandle);
+    }
+
+#ifdef DEBUG_TALKATIVE
+    DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                  verboseState[_state]);
+#endif
+    return true;
+}
+
+void StrokeEngine::streamPosition(float position) {
+    int target = int(position * _motor->stepsPerMillimeter);
+
+    // Replaces the previous target, the follower never queues them
+    if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        _follower.setTarget(target, esp_timer_get_time());
+        xSemaphoreGive(_patternMutex);
+    }
+}
+
 bool StrokeEngine::startPattern() {
     // Only valid if state is ready
-    if (_state == READY || _state == SETUPDEPTH) {
+    if (_state == READY || _state == SETUPDEPTH || _state == STREAMING) {
         // Stop current move, should one be pending (moveToMax or moveToMin)
         if (_servo->isRunning()) {
             // Stop _servo motor as fast as legally allowed
@@ -252,21 +387,25 @@ bool StrokeEngine::startPattern() {
 
         // Reset Stroke and Motion parameters
         _index = -1;
+        Pattern *retired = NULL;
         if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
-            pattern->setSpeedLimit(_maxStepPerSecond, _maxStepAcceleration,
-                                  _motor->stepsPerMillimeter);
-            pattern->setTimeOfStroke(_timeOfStroke);
-            pattern->setStroke(_stroke);
-            pattern->setDepth(_depth);
-            pattern->setSensation(_sensation);
+            // A pattern still staged from the last run starts right away,
+            // unless it is queued behind the running one
+            if (_nextPattern != NULL && _isNextPatternDue()) {
+                retired = _swapPattern();
+            } else {
+                _injectParameters(pattern);
+            }
+            _crossfade = false;
             xSemaphoreGive(_patternMutex);
         }
+        delete retired;
 
 #ifdef DEBUG_TALKATIVE
-        Serial.print(" _timeOfStroke: " + String(_timeOfStroke));
-        Serial.print(" | _depth: " + String(_depth));
-        Serial.print(" | _stroke: " + String(_stroke));
-        Serial.println(" | _sensation: " + String(_sensation));
+        DEFERRED_LOGD("StrokeEngine",
+                      "_timeOfStroke: %.2f | _depth: %d | _stroke: %d | "
+                      "_sensation: %.2f",
+                      _timeOfStroke, _depth, _stroke, _sensation);
 #endif
 
         if (_taskStrokingHandle == NULL) {
@@ -274,11 +413,11 @@ bool StrokeEngine::startPattern() {
             xTaskCreatePinnedToCore(
                 this->_strokingImpl,   // Function that should be called
                 "Stroking",            // Name of the task (for debugging)
-                4096,                  // Stack size (bytes)
+                _strokingStackSize,    // Stack size (bytes)
                 this,                  // Pass reference to this class instance
-                24,                    // Pretty high task priority
+                _strokingPriority,     // Pretty high task priority
                 &_taskStrokingHandle,  // Task handle
-                1                      // Pin to application core
+                _strokingCore          // Application core by default
             );
         } else {
             // Resume task, if it already exists
@@ -286,15 +425,16 @@ bool StrokeEngine::startPattern() {
         }
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Started motion task");
-        Serial.println("Stroke Engine State: " + verboseState[_state]);
+        DEFERRED_LOGD("StrokeEngine", "Started motion task");
+        DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                      verboseState[_state]);
 #endif
 
         return true;
 
     } else {
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Failed to start motion");
+        DEFERRED_LOGD("StrokeEngine", "Failed to start motion");
 #endif
         return false;
     }
@@ -302,17 +442,34 @@ bool StrokeEngine::startPattern() {
 
 void StrokeEngine::stopMotion() {
     // only valid when
-    if (_state == PATTERN || _state == SETUPDEPTH) {
-        // Set state
-        _state = READY;
+    if (_state == PATTERN || _state == SETUPDEPTH || _state == STREAMING) {
+        // Set state under the mutex, so a streaming pass that already read
+        // STREAMING retargets before and none after
+        if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+            _state = READY;
+
+            // A vibration or a curve is braked by the stroking task, which
+            // keeps feeding the queue until the carriage is at rest
+            if (_isVibrating || _isTracing) {
+                _overlay.stop();
+                _segmenter.stop();
+            }
+            xSemaphoreGive(_patternMutex);
+        }
+        while (_isVibrating || _isTracing) {
+            vTaskDelay(1);
+        }
 
         // Stop _servo motor as fast as legally allowed
-        _servo->setAcceleration(_maxStepAcceleration);
-        _servo->applySpeedAcceleration();
-        _servo->stopMove();
+        if (xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+            _servo->setAcceleration(_maxStepAcceleration);
+            _servo->applySpeedAcceleration();
+            _servo->stopMove();
+            xSemaphoreGive(_patternMutex);
+        }
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Motion stopped");
+        DEFERRED_LOGD("StrokeEngine", "Motion stopped");
 #endif
 
         // Wait for _servo stopped
@@ -321,14 +478,15 @@ void StrokeEngine::stopMotion() {
 
         // Send telemetry data
         if (_callbackTelemetry != NULL) {
-            _callbackTelemetry(float(_servo->getCurrentPosition() /
-                                     _motor->stepsPerMillimeter),
-                               0.0, false);
+            _callbackTelemetry(
+                float(_servo->getCurrentPosition() * _millimetersPerStep), 0.0,
+                false);
         }
     }
 
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Stroke Engine State: " + verboseState[_state]);
+    DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                  verboseState[_state]);
 #endif
 }
 
@@ -372,7 +530,7 @@ void StrokeEngine::enableAndHome(endstopProperties *endstop, float speed) {
         1                            // Have it on application core
     );
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Homing task started");
+    DEFERRED_LOGD("StrokeEngine", "Homing task started");
 #endif
 }
 
@@ -400,20 +558,21 @@ void StrokeEngine::thisIsHome(float speed) {
         _state = READY;
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("This is Home now");
+        DEFERRED_LOGD("StrokeEngine", "This is Home now");
 #endif
 
         return;
     }
 
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Manual homing failed. Not in state UNDEFINED");
+    DEFERRED_LOGD("StrokeEngine",
+                  "Manual homing failed. Not in state UNDEFINED");
 #endif
 }
 
 bool StrokeEngine::moveToMax(float speed) {
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Move to max");
+    DEFERRED_LOGD("StrokeEngine", "Move to max");
 #endif
 
     if (_isHomed) {
@@ -429,12 +588,13 @@ bool StrokeEngine::moveToMax(float speed) {
 
         // Send telemetry data
         if (_callbackTelemetry != NULL) {
-            _callbackTelemetry(float(_maxStep / _motor->stepsPerMillimeter),
+            _callbackTelemetry(float(_maxStep * _millimetersPerStep),
                                speed, false);
         }
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Stroke Engine State: " + verboseState[_state]);
+        DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                      verboseState[_state]);
 #endif
 
         // Return success
@@ -448,7 +608,7 @@ bool StrokeEngine::moveToMax(float speed) {
 
 bool StrokeEngine::moveToMin(float speed) {
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Move to min");
+    DEFERRED_LOGD("StrokeEngine", "Move to min");
 #endif
 
     if (_isHomed) {
@@ -464,12 +624,13 @@ bool StrokeEngine::moveToMin(float speed) {
 
         // Send telemetry data
         if (_callbackTelemetry != NULL) {
-            _callbackTelemetry(float(_minStep / _motor->stepsPerMillimeter),
+            _callbackTelemetry(float(_minStep * _millimetersPerStep),
                                speed, false);
         }
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Stroke Engine State: " + verboseState[_state]);
+        DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                      verboseState[_state]);
 #endif
 
         // Return success
@@ -483,7 +644,7 @@ bool StrokeEngine::moveToMin(float speed) {
 
 bool StrokeEngine::setupDepth(float speed, bool fancy) {
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Move to Depth");
+    DEFERRED_LOGD("StrokeEngine", "Move to Depth");
 #endif
     // store fanciness
     _fancyAdjustment = fancy;
@@ -512,7 +673,8 @@ bool StrokeEngine::setupDepth(float speed, bool fancy) {
         allowed = true;
     }
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Stroke Engine State: " + verboseState[_state]);
+    DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                  verboseState[_state]);
 #endif
     return allowed;
 }
@@ -526,6 +688,17 @@ void StrokeEngine::disable() {
     // Disable _servo motor
     _servo->disableOutputs();
 
+    // Drop what is queued, the stroking task gives up the vibration or
+    // curve
+    if ((_isVibrating || _isTracing) &&
+        xSemaphoreTake(_patternMutex, portMAX_DELAY) == pdTRUE) {
+        _servo->forceStop();
+        _overlay.reset(_servo->getCurrentPosition());
+        _segmenter.reset();
+        _hasSegment = false;
+        xSemaphoreGive(_patternMutex);
+    }
+
     // Delete homing Task
     if (_taskHomingHandle != NULL) {
         vTaskDelete(_taskHomingHandle);
@@ -533,8 +706,9 @@ void StrokeEngine::disable() {
     }
 
 #ifdef DEBUG_TALKATIVE
-    Serial.println("_servo disabled. Call home to continue.");
-    Serial.println("Stroke Engine State: " + verboseState[_state]);
+    DEFERRED_LOGD("StrokeEngine", "_servo disabled. Call home to continue.");
+    DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                  verboseState[_state]);
 #endif
 }
 
@@ -550,12 +724,16 @@ void StrokeEngine::setMaxSpeed(float maxSpeed) {
             int(0.5 + _motor->maxSpeed * _motor->stepsPerMillimeter);
         pattern->setSpeedLimit(_maxStepPerSecond, _maxStepAcceleration,
                               _motor->stepsPerMillimeter);
+        _overlay.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                           _maxStepAcceleration);
+        _segmenter.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                             _maxStepAcceleration);
         xSemaphoreGive(_patternMutex);
     }
 }
 
 float StrokeEngine::getMaxSpeed() {
-    return float(_maxStepPerSecond / _motor->stepsPerMillimeter);
+    return float(_maxStepPerSecond * _millimetersPerStep);
 }
 
 void StrokeEngine::setMaxAcceleration(float maxAcceleration) {
@@ -566,12 +744,16 @@ void StrokeEngine::setMaxAcceleration(float maxAcceleration) {
             int(0.5 + _motor->maxAcceleration * _motor->stepsPerMillimeter);
         pattern->setSpeedLimit(_maxStepPerSecond, _maxStepAcceleration,
                               _motor->stepsPerMillimeter);
+        _overlay.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                           _maxStepAcceleration);
+        _segmenter.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                             _maxStepAcceleration);
         xSemaphoreGive(_patternMutex);
     }
 }
 
 float StrokeEngine::getMaxAcceleration() {
-    return float(_maxStepAcceleration / _motor->stepsPerMillimeter);
+    return float(_maxStepAcceleration * _millimetersPerStep);
 }
 
 void StrokeEngine::registerTelemetryCallback(void (*callbackTelemetry)(float,
@@ -580,6 +762,23 @@ void StrokeEngine::registerTelemetryCallback(void (*callbackTelemetry)(float,
     _callbackTelemetry = callbackTelemetry;
 }
 
+void StrokeEngine::registerLoopTimeCallback(
+    void (*callbackLoopTime)(uint32_t)) {
+    _callbackLoopTime = callbackLoopTime;
+}
+
+void StrokeEngine::registerStrokeGateCallback(
+    uint32_t (*callbackStrokeGate)(int)) {
+    _callbackStrokeGate = callbackStrokeGate;
+}
+
+void StrokeEngine::setStrokingTask(BaseType_t core, UBaseType_t priority,
+                                   uint32_t stackSize) {
+    _strokingCore = core;
+    _strokingPriority = priority;
+    _strokingStackSize = stackSize;
+}
+
 void StrokeEngine::_homingProcedure() {
     // Set feedrate for homing
     _servo->setSpeedInHz(_homeingSpeed);
@@ -647,7 +846,7 @@ void StrokeEngine::_homingProcedure() {
         _state = UNDEFINED;
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Homing failed");
+        DEFERRED_LOGD("StrokeEngine", "Homing failed");
 #endif
 
     } else {
@@ -655,7 +854,7 @@ void StrokeEngine::_homingProcedure() {
         _state = READY;
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("Homing succeeded");
+        DEFERRED_LOGD("StrokeEngine", "Homing succeeded");
 #endif
     }
 
@@ -670,7 +869,8 @@ void StrokeEngine::_homingProcedure() {
     }
 
 #ifdef DEBUG_TALKATIVE
-    Serial.println("Stroke Engine State: " + verboseState[_state]);
+    DEFERRED_LOGD("StrokeEngine", "Stroke Engine State: %s",
+                  verboseState[_state]);
 #endif
 
     // delete one-time task
@@ -683,26 +883,62 @@ void StrokeEngine::_stroking() {
 
     while (1) {  // infinite loop
 
-        // Suspend task, if not in PATTERN state
-        if (_state != PATTERN) {
+        // Suspend task, if not in PATTERN state and a vibration or curve
+        // has come to rest
+        if (_state != PATTERN && !_isVibrating && !_isTracing) {
             vTaskSuspend(_taskStrokingHandle);
         }
 
+        uint32_t loopStart = micros();
+        uint32_t gateWait = 0;
+        Pattern *retired = NULL;
+
         // Take mutex to ensure no interference / race condition with
         // communication threat on other core
         if (xSemaphoreTake(_patternMutex, 0) == pdTRUE) {
-            if (_applyUpdate == true) {
+            // Stopping, only a vibration or curve is left to bring to rest
+            if (_state != PATTERN) {
+                _feedQueue();
+                bool isIdle =
+                    _isTracing ? _segmenter.isIdle() : _overlay.isIdle();
+                if (isIdle && !_hasSegment && !_servo->isRunning()) {
+                    _isVibrating = false;
+                    _isTracing = false;
+                }
+                xSemaphoreGive(_patternMutex);
+                vTaskDelay(5 / portTICK_PERIOD_MS);
+                continue;
+            }
+
+            // A staged pattern asked to apply now takes over mid-move. Its
+            // first motion retargets the running one, so the carriage turns
+            // around from where it is instead of stopping first. A curve
+            // brakes first, see _traceCurve().
+            if (_nextPattern != NULL && _crossfade == true && !_isTracing) {
+                retired = _swapPattern();
+                _index = 0;
+                _applyUpdate = true;
+            }
+
+            // A curve is sampled into the queue until it is left
+            if (_isTracing) {
+                gateWait = _traceCurve();
+            }
+
+            else if (_applyUpdate == true) {
                 // Ask pattern for update on motion parameters
                 currentMotion = pattern->nextTarget(_index);
 
                 // Increase deceleration if required to avoid crash
-                if (_servo->getAcceleration() > currentMotion.acceleration) {
+                int acceleration = _isVibrating ? int(_overlay.acceleration())
+                                                : _servo->getAcceleration();
+                if (acceleration > currentMotion.acceleration) {
 #ifdef DEBUG_CLIPPING
                     Serial.print("Crash avoidance! Set Acceleration from " +
                                  String(currentMotion.acceleration));
-                    Serial.println(" to " + String(_servo->getAcceleration()));
+                    Serial.println(" to " + String(acceleration));
 #endif
-                    currentMotion.acceleration = _servo->getAcceleration();
+                    currentMotion.acceleration = acceleration;
                 }
 
                 // Apply new trapezoidal motion profile to _servo
@@ -712,36 +948,207 @@ void StrokeEngine::_stroking() {
                 _applyUpdate = false;
             }
 
+            // A curve takes over from the stepper's ramps once the first
+            // move has brought the carriage in, and goes on from there.
+            // Under a vibration the pattern plays its moves instead.
+            else if (_isMoving() == false && _index == 0 &&
+                     pattern->curve() != NULL && !_isVibrating &&
+                     !_overlay.isOn()) {
+                _segmenter.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                                     _maxStepAcceleration);
+                _segmenter.setTolerance(_curveToleranceMm *
+                                        _motor->stepsPerMillimeter);
+                _segmenter.join(pattern->curve(),
+                                _servo->getCurrentPosition());
+                _hasSegment = false;
+                _isTracing = true;
+            }
+
             // If motor has stopped issue moveTo command to next position
-            else if (_servo->isRunning() == false) {
+            else if (_isMoving() == false) {
+                // Swap in a staged pattern at the end of a stroke. Odd moves
+                // go out, so the new pattern's first move, in, follows on.
+                if (_nextPattern != NULL && _index % 2 != 0 &&
+                    _isNextPatternDue()) {
+                    retired = _swapPattern();
+                }
+
+                // Take over from the stepper's ramps to lay a vibration over
+                // the moves. Once taken over, the queue is fed until the
+                // pattern stops.
+                if (_isVibrating == false && _overlay.isOn()) {
+                    _overlay.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                                       _maxStepAcceleration);
+                    _overlay.reset(_servo->getCurrentPosition());
+                    _hasSegment = false;
+                    _isVibrating = true;
+                }
+
                 // Increment index for pattern
                 _index++;
 
                 // Querey new set of pattern parameters
                 currentMotion = pattern->nextTarget(_index);
 
+                // Let the gate hold back the start
+                if (currentMotion.skip == false &&
+                    _callbackStrokeGate != NULL) {
+                    gateWait = _callbackStrokeGate(_index);
+                }
+
                 // Pattern may introduce pauses between strokes
-                if (currentMotion.skip == false) {
+                if (currentMotion.skip == false && gateWait == 0) {
 #ifdef DEBUG_STROKE
                     Serial.println("Stroking Index: " + String(_index));
 #endif
                     // Apply new trapezoidal motion profile to _servo
                     _applyMotionProfile(&currentMotion);
 
+                    // A stroke is played once its move out is on its way
+                    if (_index % 2 != 0) {
+                        _strokesPlayed++;
+                    }
+
                 } else {
                     // decrement _index so that it stays the same until the next
-                    // valid stroke parameters are delivered
+                    // valid stroke parameters are delivered and the gate opens
                     _index--;
                 }
             }
 
+            // Keep the queue ahead of the stepper
+            if (_isVibrating || _isTracing) {
+                _feedQueue();
+            }
+
             // give back mutex
             xSemaphoreGive(_patternMutex);
         }
 
-        // Delay 10ms
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        // The motion is on its way, the old pattern can go
+        delete retired;
+
+        // The queue runs dry when a wait outlasts it
+        uint32_t longest = 5000;
+        if ((_isVibrating || _isTracing) && gateWait > longest) {
+            gateWait = longest;
+        }
+
+        // Wait for the gate to open, to the tick and then to the microsecond
+        if (gateWait >= 1000 * portTICK_PERIOD_MS) {
+            vTaskDelay(gateWait / (1000 * portTICK_PERIOD_MS));
+            continue;
+        } else if (gateWait > 0) {
+            delayMicroseconds(gateWait);
+            continue;
+        }
+
+        // Report loop timing
+        if (_callbackLoopTime != NULL) {
+            _callbackLoopTime(micros() - loopStart);
+        }
+
+        // Delay 10ms, or 5ms to keep feeding the queue
+        vTaskDelay((_isVibrating || _isTracing ? 5 : 10) / portTICK_PERIOD_MS);
+    }
+}
+
+void StrokeEngine::_feedQueue() {
+    while (_servo->queueEntries() < _queueDepth) {
+        if (_hasSegment == false) {
+            if (_isTracing ? !_segmenter.hasNext() : _overlay.isIdle()) {
+                return;
+            }
+            _segment = _isTracing ? _segmenter.next() : _overlay.next();
+            if (_segment.durationMicros == 0) {
+                continue;
+            }
+            _hasSegment = true;
+        }
+
+        // An entry takes at most 255 steps, a longer segment is split into
+        // entries of equal length
+        uint32_t steps = abs(_segment.steps);
+        uint32_t entries = steps > 255 ? (steps + 254) / 255 : 1;
+        uint32_t share = steps / entries;
+        uint32_t micros = _segment.durationMicros / entries;
+        uint32_t ticks = micros * (TICKS_PER_S / 1000000) + _carriedTicks;
+
+        struct stepper_command_s command;
+        command.steps = share;
+        command.ticks = share > 0 ? ticks / share : ticks;
+        command.count_up = _segment.steps > 0;
+        if (_servo->addQueueEntry(&command) != AQE_OK) {
+            // Try again on the next pass
+            return;
+        }
+        // Ticks the steps could not share evenly go to the next entry, so
+        // a curve keeps time
+        _carriedTicks = share > 0 ? ticks % share : 0;
+
+        // The rest of the segment follows
+        int32_t s = int32_t(share);
+        _segment.steps += _segment.steps > 0 ? -s : s;
+        _segment.durationMicros -= micros;
+        _hasSegment = entries > 1;
+    }
+}
+
+uint32_t StrokeEngine::_traceCurve() {
+    // The curve follows new settings as it is sampled
+    _applyUpdate = false;
+
+    // Telemetry as if each half of a cycle were a move
+    CurveSegmenter::HalfCycle half;
+    if (_segmenter.takeHalfCycle(half) && _callbackTelemetry != NULL) {
+        _callbackTelemetry(float(half.position * _millimetersPerStep),
+                           float(half.topSpeed * _millimetersPerStep),
+                           half.isClipped);
+    }
+
+    // A pattern asked to apply now is brought in from rest
+    if (_nextPattern != NULL && _crossfade == true) {
+        _segmenter.stop();
+    }
+
+    uint32_t gateWait = 0;
+    if (_segmenter.isAtCycleEnd()) {
+        // A cycle is a stroke, in and out, and counts as its two moves
+        int index = 2 * int(_segmenter.cycle()) + 1;
+        if (_index != index) {
+            _index = index;
+            _strokesPlayed++;
+        }
+
+        // Leave the curve for a staged pattern, or go on once the gate
+        // lets the next stroke start
+        if (_nextPattern != NULL && _isNextPatternDue()) {
+            _segmenter.stop();
+        } else {
+            if (_callbackStrokeGate != NULL) {
+                gateWait = _callbackStrokeGate(_index + 1);
+            }
+            if (gateWait > 0) {
+                _segmenter.pause();
+            } else {
+                _segmenter.nextCycle();
+            }
+        }
+    }
+
+    // Handed back to the stepper's ramps once at rest
+    if (_segmenter.isIdle() && !_hasSegment && !_servo->isRunning()) {
+        _isTracing = false;
+    }
+    return gateWait;
+}
+
+bool StrokeEngine::_isMoving() {
+    if (_isVibrating) {
+        // The segments are planned ahead of the carriage by the queue
+        return _overlay.isMoving();
     }
+    return _servo->isRunning();
 }
 
 void StrokeEngine::_streaming() {
@@ -752,11 +1159,102 @@ void StrokeEngine::_streaming() {
             vTaskSuspend(_taskStreamingHandle);
         }
 
-        // Delay 10ms
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        uint32_t loopStart = micros();
+
+        // Take mutex to read the latest target consistently
+        if (xSemaphoreTake(_patternMutex, 0) == pdTRUE) {
+            // Limits may have changed with setMaxSpeed() & co.
+            _follower.setLimits(_minStep, _maxStep, _maxStepPerSecond,
+                                _maxStepAcceleration);
+            PositionFollower::Command command = _follower.update(
+                esp_timer_get_time(), _servo->getCurrentPosition());
+
+            // Retarget the running move, the stepper plans the ramps. Only
+            // this task talks to the stepper while streaming.
+            if (_state == STREAMING) {
+                _servo->setSpeedInHz(command.speed);
+                _servo->setAcceleration(command.acceleration);
+                _servo->moveTo(command.position);
+            }
+
+            // give back mutex
+            xSemaphoreGive(_patternMutex);
+        }
+
+        // Report loop timing
+        if (_callbackLoopTime != NULL) {
+            _callbackLoopTime(micros() - loopStart);
+        }
+
+        // Delay 5ms, fast enough to follow a stream at 100 Hz and more
+        vTaskDelay(5 / portTICK_PERIOD_MS);
     }
 }
 
+void StrokeEngine::_injectParameters(Pattern *target) {
+    target->setSpeedLimit(_maxStepPerSecond, _maxStepAcceleration,
+                          _motor->stepsPerMillimeter);
+    target->setTimeOfStroke(_timeOfStroke);
+    target->setStroke(_stroke);
+    target->setDepth(_depth);
+    target->setSensation(_sensation);
+    target->setCurrentPosition(_servo->targetPos());
+}
+
+Pattern *StrokeEngine::_stagePattern(Pattern *nextPattern) {
+    // A pattern staged earlier that never got to run is replaced
+    Pattern *dropped = _nextPattern;
+    _nextPattern = nextPattern;
+    _nextAfterStrokes = 0;
+    _nextAfterMillis = 0;
+    _nextSettings = {NAN, NAN, NAN, NAN};
+    return dropped;
+}
+
+bool StrokeEngine::_isNextPatternDue() {
+    return _strokesPlayed >= _nextAfterStrokes &&
+           millis() - _swappedAtMillis >= _nextAfterMillis;
+}
+
+Pattern *StrokeEngine::_swapPattern() {
+    Pattern *retired = pattern;
+    pattern = _nextPattern;
+    _nextPattern = NULL;
+    _crossfade = false;
+
+    // The settings queued with it, constrained as by the set functions
+    if (!isnan(_nextSettings.speed)) {
+        _timeOfStroke = constrain(60.0f / _nextSettings.speed, 0.01f, 120.0f);
+    }
+    if (!isnan(_nextSettings.depth)) {
+        _depth =
+            constrain(int(_nextSettings.depth * _motor->stepsPerMillimeter),
+                      _minStep, _maxStep);
+    }
+    if (!isnan(_nextSettings.stroke)) {
+        _stroke =
+            constrain(int(_nextSettings.stroke * _motor->stepsPerMillimeter),
+                      _minStep, _maxStep);
+    }
+    if (!isnan(_nextSettings.sensation)) {
+        _sensation = constrain(_nextSettings.sensation, -100, 100);
+    }
+    _nextAfterStrokes = 0;
+    _nextAfterMillis = 0;
+    _nextSettings = {NAN, NAN, NAN, NAN};
+    _strokesPlayed = 0;
+    _swappedAtMillis = millis();
+
+    // Settings may have changed since the pattern was staged
+    _injectParameters(pattern);
+    _index = -1;
+
+#ifdef DEBUG_TALKATIVE
+    DEFERRED_LOGD("StrokeEngine", "Pattern swapped in: %s", pattern->getName());
+#endif
+    return retired;
+}
+
 void StrokeEngine::_applyMotionProfile(motionParameter *motion) {
     bool clipping = false;
     float speed = 0.0;
@@ -764,55 +1262,66 @@ void StrokeEngine::_applyMotionProfile(motionParameter *motion) {
 
     // Apply new trapezoidal motion profile to _servo if pattern does not skip
     if (motion->skip == false) {
-        // Constrain speed to below _maxStepPerSecond
-        if (motion->speed > _maxStepPerSecond) {
+        // A vibration leaves the moves less
+        int maxSpeed = _maxStepPerSecond;
+        int maxAcceleration = _maxStepAcceleration;
+        if (_isVibrating) {
+            maxSpeed = int(_overlay.speedLimit());
+            maxAcceleration = int(_overlay.accelerationLimit());
+        }
+
+        // Constrain speed to below maxSpeed
+        if (motion->speed > maxSpeed) {
 #ifdef DEBUG_CLIPPING
             Serial.println(
                 "Max Speed Exceeded: " +
-                String(float(motion->speed / _motor->stepsPerMillimeter), 2) +
+                String(float(motion->speed * _millimetersPerStep), 2) +
                 "mm/s --> Limit: " +
-                String(float(_maxStepPerSecond / _motor->stepsPerMillimeter),
-                       2) +
+                String(float(maxSpeed * _millimetersPerStep), 2) +
                 "mm/s");
 #endif
-            motion->speed = _maxStepPerSecond;
+            motion->speed = maxSpeed;
             clipping = true;
         }
 
-        // Constrain acceleration between 1 step/sec^2 and _maxStepAcceleration
-        if (motion->acceleration > _maxStepAcceleration) {
+        // Constrain acceleration between 1 step/sec^2 and maxAcceleration
+        if (motion->acceleration > maxAcceleration) {
 #ifdef DEBUG_CLIPPING
             Serial.println(
                 "Max Acceleration Exceeded: " +
-                String(float(motion->acceleration / _motor->stepsPerMillimeter),
+                String(float(motion->acceleration * _millimetersPerStep),
                        2) +
                 "mm/s² --> Limit: " +
-                String(float(_maxStepAcceleration / _motor->stepsPerMillimeter),
-                       2) +
+                String(float(maxAcceleration * _millimetersPerStep), 2) +
                 "mm/s²");
 #endif
-            motion->acceleration = _maxStepAcceleration;
+            motion->acceleration = maxAcceleration;
             clipping = true;
         }
 
         // Constrain stroke to motion envelope
         int pos = constrain((motion->stroke), _minStep, _maxStep);
 
-        // write values to _servo
-        _servo->setSpeedInHz(motion->speed);
-        _servo->setAcceleration(motion->acceleration);
-        _servo->moveTo(pos);
+        if (_isVibrating) {
+            // Planned with the vibration on top, fed to the queue
+            _overlay.moveTo(pos, motion->speed, motion->acceleration);
+        } else {
+            // write values to _servo
+            _servo->setSpeedInHz(motion->speed);
+            _servo->setAcceleration(motion->acceleration);
+            _servo->moveTo(pos);
+        }
 
         // Compile speed telemetry data
-        speed = float(motion->speed / _motor->stepsPerMillimeter);
-        position = float(pos / _motor->stepsPerMillimeter);
+        speed = float(motion->speed * _millimetersPerStep);
+        position = float(pos * _millimetersPerStep);
 
 #ifdef DEBUG_STROKE
         Serial.println("motion.stroke: " + String(position, 2) + "mm");
         Serial.println("motion.speed: " + String(speed, 2) + "mm/s");
         Serial.println(
             "motion.acceleration: " +
-            String(float(motion->acceleration / _motor->stepsPerMillimeter),
+            String(float(motion->acceleration * _millimetersPerStep),
                    2) +
             "mm/s²");
 #endif
@@ -835,9 +1344,9 @@ void StrokeEngine::_setupDepths() {
         depth = map(_sensation, -100, 100, _depth - _stroke, _depth);
 
 #ifdef DEBUG_TALKATIVE
-        Serial.println("map sensation " + String(_sensation) +
-                       " to interval [" + String(_depth - _stroke) + ", " +
-                       String(_depth) + "] = " + String(depth));
+        DEFERRED_LOGD("StrokeEngine",
+                      "map sensation %.2f to interval [%d, %d] = %d",
+                      _sensation, _depth - _stroke, _depth, depth);
 #endif
     }
 
@@ -846,13 +1355,13 @@ void StrokeEngine::_setupDepths() {
 
     // Send telemetry data
     if (_callbackTelemetry != NULL) {
-        _callbackTelemetry(float(depth / _motor->stepsPerMillimeter),
-                           float(_servo->getSpeedInMilliHz() * 1000 /
-                                 _motor->stepsPerMillimeter),
+        _callbackTelemetry(float(depth * _millimetersPerStep),
+                           float(_servo->getSpeedInMilliHz() * 1000 *
+                                 _millimetersPerStep),
                            false);
     }
 
 #ifdef DEBUG_TALKATIVE
-    Serial.println("setup new depth: " + String(depth));
+    DEFERRED_LOGD("StrokeEngine", "setup new depth: %d", depth);
 #endif
 }
@@ -13,7 +13,12 @@
 
 #include <Arduino.h>
 
+#include <atomic>
+
+#include "CurveSegmenter.h"
 #include "FastAccelStepper.h"
+#include "PositionFollower.h"
+#include "VibrationOverlay.h"
 #include "pattern.h"
 
 // Debug Levels
@@ -74,6 +79,19 @@ typedef struct {
                         INPUT_PULLDOWN */
 } endstopProperties;
 
+/**************************************************************************/
+/*!
+  @brief  Struct holding the settings a queued pattern starts with, in the
+  units of the set functions. NAN keeps the setting as it is.
+*/
+/**************************************************************************/
+typedef struct {
+    float speed;     /*> Strokes per minute */
+    float depth;     /*> Depth in mm */
+    float stroke;    /*> Stroke length in mm */
+    float sensation; /*> Sensation from -100 to 100 */
+} patternSettings;
+
 /**************************************************************************/
 /*!
   @brief  Enum containing the states of the state machine
@@ -85,11 +103,11 @@ typedef enum {
     PATTERN,     //!< Stroke Engine is running and servo is moving according to
                  //!< defined pattern.
     SETUPDEPTH,  //!< Interactive adjustment mode to setup depth and stroke
-    STREAMING    //!< Tracks the depth-position whenever depth is updated.
+    STREAMING    //!< Follows the positions given to streamPosition()
 } ServoState;
 
 // Verbose strings of states for debugging purposes
-static String verboseState[] = {
+static const char *const verboseState[] = {
     "[0] Servo disabled", "[1] Servo ready", "[2] Servo pattern running",
     "[3] Servo setup depth", "[4] Servo position streaming"};
 
@@ -196,16 +214,58 @@ class StrokeEngine {
 
     /**************************************************************************/
     /*!
-      @brief  Choose a pattern for the StrokeEngine. Settings take effect with
-      next stroke, or after calling applyNewSettingsNow().
-      @param patternIndex  Index of a pattern
-      @param applyNow Set to true if changes should take effect immediately
-      @return TRUE on success, FALSE, if patternIndex is invalid. Previous
-                    pattern will be retained.
+      @brief  Choose a pattern for the StrokeEngine. While stroking the
+      pattern is staged and swapped in by the stroking task at the end of the
+      current stroke, so the motion never stops short or jumps. The previous
+      pattern is deleted once it is no longer in use, as is a staged pattern
+      that is replaced before it ran. Takes ownership of nextPattern.
+      @param nextPattern Pattern created with new
+      @param applyNow Set to true to take over from the current position
+      right away, retargeting the running move instead of finishing the stroke
+      @return TRUE on success
     */
     /**************************************************************************/
     bool setPattern(Pattern *nextPattern, bool applyNow);
 
+    /**************************************************************************/
+    /*!
+      @brief  Queue the pattern to play after the running one, e.g. the next
+      entry of a playlist. It is staged like with setPattern(), but swapped
+      in only at the end of the first stroke after the running pattern played
+      for the given strokes and time, both counted from when it was swapped
+      in. Its settings take effect with the swap, so the handover has no
+      pause. A pattern staged before is replaced. Takes ownership of
+      nextPattern.
+      @param nextPattern Pattern created with new
+      @param settings Settings it starts with, NAN keeps the current one
+      @param strokes Strokes the running pattern plays first
+      @param millis Milliseconds the running pattern plays first
+      @return TRUE on success
+    */
+    /**************************************************************************/
+    bool queuePattern(Pattern *nextPattern, const patternSettings &settings,
+                      uint32_t strokes, uint32_t millis);
+
+    /**************************************************************************/
+    /*!
+      @brief  Whether a pattern given to setPattern() or queuePattern() still
+      waits to be swapped in.
+      @return TRUE while it waits, FALSE once it plays
+    */
+    /**************************************************************************/
+    bool isPatternQueued();
+
+    /**************************************************************************/
+    /*!
+      @brief  Change the settings a queued pattern starts with, e.g. after a
+      knob was turned.
+      @param settings Settings it starts with, NAN keeps the current one
+      @return FALSE if no pattern waits anymore, it may just have been
+      swapped in
+    */
+    /**************************************************************************/
+    bool setQueuedSettings(const patternSettings &settings);
+
     /**************************************************************************/
     /*!
       @brief  Get the pattern index for the StrokeEngine.
@@ -305,6 +365,45 @@ class StrokeEngine {
     /**************************************************************************/
     bool setupDepth(float speed = 10.0, bool fancy = false);
 
+    /**************************************************************************/
+    /*!
+      @brief  In state READY, PATTERN and SETUPDEPTH this enters state
+      STREAMING, in which the endeffector follows the positions given to
+      streamPosition(), within the speed and acceleration limits. Stops any
+      running pattern, and holds still until the first position arrives. The
+      task runs where setStrokingTask() puts the stroking task.
+      @return TRUE on success, FALSE if state does not allow this.
+    */
+    /**************************************************************************/
+    bool startStreaming();
+
+    /**************************************************************************/
+    /*!
+      @brief  Hands the next position to follow in state STREAMING, e.g. from
+      a remote at 100 Hz or more. It replaces the last one, positions are
+      never queued. The speed of the stream is fed forward, and when it stops
+      for more than 50 ms the endeffector stops at the last position. See
+      PositionFollower.h.
+      @param position Position in mm, constrained to [0, _travel]
+    */
+    /**************************************************************************/
+    void streamPosition(float position);
+
+    /**************************************************************************/
+    /*!
+      @brief  Lays a vibration over the running pattern, e.g. 15 Hz at 1 mm.
+      From the end of the current stroke the stroking task plans the moves
+      itself and feeds them with the vibration on top to the stepper's
+      command queue, see VibrationOverlay.h. The vibration fades in and out
+      over a few periods and takes effect right away. Only patterns vibrate.
+      @param frequency Frequency in Hz. Is constrained from 1 to 50
+      @param amplitude Amplitude in [mm], 0 turns it off. Cut to what the
+                    maximum speed and acceleration allow at this frequency,
+                    and the strokes stop short of the ends by as much.
+    */
+    /**************************************************************************/
+    void setVibration(float frequency, float amplitude);
+
     /**************************************************************************/
     /*!
       @brief  Retrieves the current servo state from the internal state machine.
@@ -390,11 +489,49 @@ class StrokeEngine {
     void registerTelemetryCallback(void (*callbackTelemetry)(float, float,
                                                              bool));
 
+    /**************************************************************************/
+    /*!
+      @brief  Register a callback function that receives the time one pass of
+      the stroking loop took. It is called from the stroking task after the
+      pattern mutex was released, so it must be short and must not block.
+      @param callbackLoopTime Function must be of type:
+      void callbackLoopTime(uint32_t micros)
+    */
+    /**************************************************************************/
+    void registerLoopTimeCallback(void (*callbackLoopTime)(uint32_t));
+
+    /**************************************************************************/
+    /*!
+      @brief  Register a callback that may hold back the start of the next
+      motion, e.g. to stroke in step with another machine. It is called from
+      the stroking task once the motor stopped and the pattern delivered the
+      next motion, and again until it allows the start. It must not block.
+      @param callbackStrokeGate Function must be of type:
+      uint32_t callbackStrokeGate(int index), returning the microseconds to
+      wait before asking again, 0 to start the motion with this index now.
+    */
+    /**************************************************************************/
+    void registerStrokeGateCallback(uint32_t (*callbackStrokeGate)(int));
+
+    /**************************************************************************/
+    /*!
+      @brief  Choose where the stroking task runs. Applies the next time the
+      task is created, so call it before startPattern(). By default it is
+      pinned to core 1 at priority 24 with 4096 bytes of stack.
+      @param core Core to pin the task to
+      @param priority FreeRTOS priority
+      @param stackSize Stack size in bytes
+    */
+    /**************************************************************************/
+    void setStrokingTask(BaseType_t core, UBaseType_t priority,
+                         uint32_t stackSize);
+
   protected:
     ServoState _state = UNDEFINED;
     motorProperties *_motor;
     machineGeometry *_physics;
     float _travel;
+    float _millimetersPerStep;
     int _minStep;
     int _maxStep;
     int _maxStepPerSecond;
@@ -409,6 +546,47 @@ class StrokeEngine {
     float _timeOfStroke;
     float _sensation;
     bool _applyUpdate = false;
+    // Latest target of streamPosition(), guarded by _patternMutex
+    PositionFollower _follower;
+    // Vibration over the pattern, guarded by _patternMutex. While
+    // _isVibrating the stroking task feeds the stepper's command queue
+    // instead of using its ramps.
+    VibrationOverlay _overlay;
+    // A curve pattern sampled for the queue the same way, guarded by
+    // _patternMutex, while _isTracing
+    CurveSegmenter _segmenter;
+    // Set and cleared by the stroking task, stopMotion() and disable() read
+    // them from other cores without the mutex
+    std::atomic<bool> _isVibrating{false};
+    std::atomic<bool> _isTracing{false};
+    // How far the curve may be sampled off it
+    static constexpr float _curveToleranceMm = 0.1f;
+    // The piece of either being queued
+    VibrationOverlay::Segment _segment;
+    bool _hasSegment = false;
+    // What rounding a piece's ticks to its steps left over for the next
+    uint32_t _carriedTicks = 0;
+    // Motion kept queued ahead, 20 entries of at most 4 ms
+    static constexpr uint8_t _queueDepth = 20;
+    void _feedQueue();
+    bool _isMoving();
+    uint32_t _traceCurve();
+    // Staged by setPattern(), swapped in by the stroking task
+    Pattern *_nextPattern = NULL;
+    bool _crossfade = false;
+    // What queuePattern() waits for and starts with
+    uint32_t _nextAfterStrokes = 0;
+    uint32_t _nextAfterMillis = 0;
+    patternSettings _nextSettings = {NAN, NAN, NAN, NAN};
+    // How long the running pattern has played
+    uint32_t _strokesPlayed = 0;
+    uint32_t _swappedAtMillis = 0;
+    // All with _patternMutex held. _swapPattern() returns the pattern to
+    // delete after it is given back.
+    Pattern *_stagePattern(Pattern *nextPattern);
+    bool _isNextPatternDue();
+    Pattern *_swapPattern();
+    void _injectParameters(Pattern *target);
     static void _homingProcedureImpl(void *_this) {
         static_cast<StrokeEngine *>(_this)->_homingProcedure();
     }
@@ -422,12 +600,17 @@ class StrokeEngine {
     }
     void _streaming();
     TaskHandle_t _taskStrokingHandle = NULL;
+    BaseType_t _strokingCore = 1;
+    UBaseType_t _strokingPriority = 24;
+    uint32_t _strokingStackSize = 4096;
     TaskHandle_t _taskHomingHandle = NULL;
     TaskHandle_t _taskStreamingHandle = NULL;
     SemaphoreHandle_t _patternMutex = xSemaphoreCreateMutex();
     void _applyMotionProfile(motionParameter *motion);
     void (*_callBackHomeing)(bool) = NULL;
     void (*_callbackTelemetry)(float, float, bool) = NULL;
+    void (*_callbackLoopTime)(uint32_t) = NULL;
+    uint32_t (*_callbackStrokeGate)(int) = NULL;
     int _homeingSpeed;
     int _homeingPin;
     int _homeingToBack;
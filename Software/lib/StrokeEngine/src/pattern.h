@@ -12,9 +12,13 @@
 #pragma once
 
 #include <Arduino.h>
+#include <limits.h>
 #include <math.h>
 
+#include "CurveSegmenter.h"
+#include "MotionTable.h"
 #include "PatternMath.h"
+#include "PatternRandom.h"
 
 #define DEBUG_PATTERN  // Print some debug informations over Serial
 
@@ -61,6 +65,9 @@ class Pattern {
     */
     Pattern(const char *str) { strcpy(_name, str); }
 
+    //! Patterns are deleted through Pattern * once swapped out
+    virtual ~Pattern() {}
+
     //! Set the time a normal stroke should take to complete
     /*!
       @param speed time of a full stroke in [sec]
@@ -86,6 +93,13 @@ class Pattern {
     */
     virtual void setSensation(float sensation) { _sensation = sensation; }
 
+    //! Where the carriage is headed as the pattern takes over, for patterns
+    //! that move relative to where they start
+    /*!
+      @param position target of the running move in Steps
+    */
+    virtual void setCurrentPosition(int position) {}
+
     //! Retrives the name of a pattern
     /*!
       @return c_string containing the name of a pattern
@@ -120,6 +134,13 @@ class Pattern {
         _stepsPerMM = stepsPerMM;
     }
 
+    //! The stroke as a curve of position over time, for patterns that are
+    //! more than moves from point to point. See CurvePattern.
+    /*!
+      @return The curve, or NULL if the pattern only has nextTarget()
+    */
+    virtual PositionCurve *curve() { return NULL; }
+
   protected:
     int _stroke;
     int _depth;
@@ -170,15 +191,15 @@ class SimpleStroke : public Pattern {
 
     void setTimeOfStroke(float speed = 0) {
         // In & Out have same time, so we need to divide by 2
-        _timeOfStroke = 0.5 * speed;
+        _timeOfStroke = 0.5f * speed;
     }
 
     motionParameter nextTarget(unsigned int index) {
         // maximum speed of the trapezoidal motion
-        _nextMove.speed = int(1.5 * _stroke / _timeOfStroke);
+        _nextMove.speed = int(1.5f * _stroke / _timeOfStroke);
 
         // acceleration to meet the profile
-        _nextMove.acceleration = int(3.0 * _nextMove.speed / _timeOfStroke);
+        _nextMove.acceleration = int(3.0f * _nextMove.speed / _timeOfStroke);
 
         // odd stroke is moving out
         if (index % 2) {
@@ -194,6 +215,18 @@ class SimpleStroke : public Pattern {
     }
 };
 
+/**************************************************************************/
+/*!
+  @brief  Sensation mappings of the patterns below, sampled by the compiler
+  so that a sensation update costs a table lookup instead of fscale().
+*/
+/**************************************************************************/
+// How many times faster the fast stroke of TeasingPounding and HalfnHalf is.
+constexpr auto fastStrokeSpeedup = makeFscaleTable(0.0f, 100.0f, 1.0f, 5.0f);
+// RoboStroke's share of the stroke spent accelerating, 1/3 at sensation 0.
+constexpr auto roboRampUp = makeFscaleTable(0.0f, 100.0f, 1.0f / 3.0f, 0.5f);
+constexpr auto roboRampDown = makeFscaleTable(0.0f, 100.0f, 1.0f / 3.0f, 0.05f);
+
 /**************************************************************************/
 /*!
   @brief  Simple pattern where the sensation value can change the speed
@@ -218,20 +251,20 @@ class TeasingPounding : public Pattern {
         // odd stroke is moving out
         if (index % 2) {
             // maximum speed of the trapezoidal motion
-            _nextMove.speed = int(1.5 * _stroke / _timeOfOutStroke);
+            _nextMove.speed = int(1.5f * _stroke / _timeOfOutStroke);
 
             // acceleration to meet the profile
             _nextMove.acceleration =
-                int(3.0 * float(_nextMove.speed) / _timeOfOutStroke);
+                int(3.0f * float(_nextMove.speed) / _timeOfOutStroke);
             _nextMove.stroke = _depth - _stroke;
             // even stroke is moving in
         } else {
             // maximum speed of the trapezoidal motion
-            _nextMove.speed = int(1.5 * _stroke / _timeOfInStroke);
+            _nextMove.speed = int(1.5f * _stroke / _timeOfInStroke);
 
             // acceleration to meet the profile
             _nextMove.acceleration =
-                int(3.0 * float(_nextMove.speed) / _timeOfInStroke);
+                int(3.0f * float(_nextMove.speed) / _timeOfInStroke);
             _nextMove.stroke = _depth;
         }
         _index = index;
@@ -245,8 +278,8 @@ class TeasingPounding : public Pattern {
     void _updateStrokeTiming() {
         // calculate the time it takes to complete the faster stroke
         // Division by 2 because reference is a half stroke
-        _timeOfFastStroke = (0.5 * _timeOfStroke) /
-                            fscale(0.0, 100.0, 1.0, 5.0, abs(_sensation), 0.0);
+        _timeOfFastStroke = (0.5f * _timeOfStroke) /
+                            fastStrokeSpeedup(fabsf(_sensation));
         // positive sensation, in is faster
         if (_sensation > 0.0) {
             _timeOfInStroke = _timeOfFastStroke;
@@ -277,16 +310,16 @@ class RoboStroke : public Pattern {
 
     void setTimeOfStroke(float speed = 0) {
         // In & Out have same time, so we need to divide by 2
-        _timeOfStroke = 0.5 * speed;
+        _timeOfStroke = 0.5f * speed;
     }
 
     void setSensation(float sensation = 0) {
         _sensation = sensation;
         // scale sensation into the range [0.05, 0.5] where 0 = 1/3
         if (sensation >= 0) {
-            _x = fscale(0.0, 100.0, 1.0 / 3.0, 0.5, sensation, 0.0);
+            _x = roboRampUp(sensation);
         } else {
-            _x = fscale(0.0, 100.0, 1.0 / 3.0, 0.05, -sensation, 0.0);
+            _x = roboRampDown(-sensation);
         }
 #ifdef DEBUG_PATTERN
         Serial.println("Sensation:" + String(sensation, 0) + " --> " +
@@ -316,7 +349,7 @@ class RoboStroke : public Pattern {
     }
 
   protected:
-    float _x = 1.0 / 3.0;
+    float _x = 1.0f / 3.0f;
 };
 
 /**************************************************************************/
@@ -358,22 +391,22 @@ class HalfnHalf : public Pattern {
         // odd stroke is moving out
         if (index % 2) {
             // maximum speed of the trapezoidal motion
-            _nextMove.speed = int(1.5 * stroke / _timeOfOutStroke);
+            _nextMove.speed = int(1.5f * stroke / _timeOfOutStroke);
 
             // acceleration to meet the profile
             _nextMove.acceleration =
-                int(3.0 * float(_nextMove.speed) / _timeOfOutStroke);
+                int(3.0f * float(_nextMove.speed) / _timeOfOutStroke);
             _nextMove.stroke = _depth - _stroke;
             // every second move is half
             _half = !_half;
             // even stroke is moving in
         } else {
             // maximum speed of the trapezoidal motion
-            _nextMove.speed = int(1.5 * stroke / _timeOfInStroke);
+            _nextMove.speed = int(1.5f * stroke / _timeOfInStroke);
 
             // acceleration to meet the profile
             _nextMove.acceleration =
-                int(3.0 * float(_nextMove.speed) / _timeOfInStroke);
+                int(3.0f * float(_nextMove.speed) / _timeOfInStroke);
             _nextMove.stroke = (_depth - _stroke) + stroke;
         }
         _index = index;
@@ -388,8 +421,8 @@ class HalfnHalf : public Pattern {
     void _updateStrokeTiming() {
         // calculate the time it takes to complete the faster stroke
         // Division by 2 because reference is a half stroke
-        _timeOfFastStroke = (0.5 * _timeOfStroke) /
-                            fscale(0.0, 100.0, 1.0, 5.0, abs(_sensation), 0.0);
+        _timeOfFastStroke = (0.5f * _timeOfStroke) /
+                            fastStrokeSpeedup(fabsf(_sensation));
         // positive sensation, in is faster
         if (_sensation > 0.0) {
             _timeOfInStroke = _timeOfFastStroke;
@@ -419,7 +452,7 @@ class Deeper : public Pattern {
 
     void setTimeOfStroke(float speed = 0) {
         // In & Out have same time, so we need to divide by 2
-        _timeOfStroke = 0.5 * speed;
+        _timeOfStroke = 0.5f * speed;
     }
 
     void setSensation(float sensation) {
@@ -456,10 +489,10 @@ class Deeper : public Pattern {
 #endif
 
         // maximum speed of the trapezoidal motion
-        _nextMove.speed = int(1.5 * amplitude / _timeOfStroke);
+        _nextMove.speed = int(1.5f * amplitude / _timeOfStroke);
 
         // acceleration to meet the profile
-        _nextMove.acceleration = int(3.0 * _nextMove.speed / _timeOfStroke);
+        _nextMove.acceleration = int(3.0f * _nextMove.speed / _timeOfStroke);
 
         // odd stroke is moving out
         if (index % 2) {
@@ -491,7 +524,7 @@ class StopNGo : public Pattern {
 
     void setTimeOfStroke(float speed = 0) {
         // In & Out have same time, so we need to divide by 2
-        _timeOfStroke = 0.5 * speed;
+        _timeOfStroke = 0.5f * speed;
     }
 
     void setSensation(float sensation) {
@@ -503,10 +536,10 @@ class StopNGo : public Pattern {
 
     motionParameter nextTarget(unsigned int index) {
         // maximum speed of the trapezoidal motion
-        _nextMove.speed = int(1.5 * _stroke / _timeOfStroke);
+        _nextMove.speed = int(1.5f * _stroke / _timeOfStroke);
 
         // acceleration to meet the profile
-        _nextMove.acceleration = int(3.0 * _nextMove.speed / _timeOfStroke);
+        _nextMove.acceleration = int(3.0f * _nextMove.speed / _timeOfStroke);
 
         // adds a delay between each stroke
         if (_isStillDelayed() == false) {
@@ -589,7 +622,7 @@ class Insist : public Pattern {
 
     void setTimeOfStroke(float speed = 0) {
         // In & Out have same time, so we need to divide by 2
-        _timeOfStroke = 0.5 * speed;
+        _timeOfStroke = 0.5f * speed;
         _updateStrokeTiming();
     }
 
@@ -637,13 +670,316 @@ class Insist : public Pattern {
     bool _strokeInFront = false;
     void _updateStrokeTiming() {
         // maximum speed of the longest trapezoidal motion (full stroke)
-        _speed = int(1.5 * _stroke / _timeOfStroke);
+        _speed = int(1.5f * _stroke / _timeOfStroke);
 
         // Acceleration to hold 1/3 profile with fractional strokes
         _acceleration =
-            int(3.0 * _nextMove.speed / (_timeOfStroke * _strokeFraction));
+            int(3.0f * _nextMove.speed / (_timeOfStroke * _strokeFraction));
 
         // Calculate fractional stroke length
         _realStroke = int((float)_stroke * _strokeFraction);
     }
 };
+
+/**************************************************************************/
+/*!
+  @brief  Plays a MotionTable, a pattern written as data instead of code.
+  Each stroke index moves to the next keyframe, mapped into the window from
+  depth - stroke to depth, in the keyframe's share of the stroke time. A
+  keyframe that stays put holds for its time. Sensation scales the ramps:
+  positive values brake harder and coast longer, negative values round the
+  moves off, down to a triangle.
+*/
+/**************************************************************************/
+class TableStroke : public Pattern {
+  public:
+    TableStroke(const char *str, const MotionTable &table)
+        : Pattern(str), _table(table) {
+        _totalTime = _table.totalTime();
+    }
+
+    void setSensation(float sensation) {
+        _sensation = sensation;
+        _rampFactor = mapSensationToFactor(4.0f, -sensation);
+    }
+
+    void setCurrentPosition(int position) { _startPosition = position; }
+
+    motionParameter nextTarget(unsigned int index) {
+        _index = index;
+        if (!_table.isValid()) {
+            _nextMove.skip = true;
+            return _nextMove;
+        }
+
+        // A keyframe starts where the one before it goes, the first where
+        // the carriage was headed as the pattern took over
+        unsigned int step = index + _holdsPassed;
+        const MotionKeyframe &keyframe = _table.keyframes[step % _table.count];
+        int target = _targetOf(step);
+        int from = step == 0 ? _startPosition : _targetOf(step - 1);
+        float time = _timeOfStroke * keyframe.time / _totalTime;
+        int distance = abs(target - from);
+
+        // Holding still, wait out the keyframe's time, then go on to the
+        // next keyframe without a move
+        if (distance == 0) {
+            if (step != _holdStep) {
+                _holdStep = step;
+                _isHoldOver = false;
+                _updateDelay(int(1000 * time));
+                _startDelay();
+            }
+            if (!_isHoldOver && !_isStillDelayed()) {
+                _isHoldOver = true;
+                _holdsPassed++;
+            }
+            _nextMove.skip = true;
+            return _nextMove;
+        }
+
+        // Trapezoid of the given duration whose ramps take the given share
+        float ramp = constrain(keyframe.ramp * _rampFactor,
+                               MotionTable::minRamp, 1.0f);
+        _nextMove.speed = int(distance / (time * (1.0f - 0.5f * ramp)));
+        _nextMove.acceleration = int(_nextMove.speed / (time * 0.5f * ramp));
+        _nextMove.stroke = target;
+        _nextMove.skip = false;
+        return _nextMove;
+    }
+
+  protected:
+    MotionTable _table;
+    float _totalTime = 1.0f;
+    float _rampFactor = 1.0f;
+    // Until setCurrentPosition(), where homing left the carriage, at the
+    // back
+    int _startPosition = 0;
+    // Holds that went by without a move, and so without an index
+    unsigned int _holdsPassed = 0;
+    unsigned int _holdStep = UINT_MAX;
+    bool _isHoldOver = false;
+
+    int _targetOf(unsigned int step) {
+        float position = _table.keyframes[step % _table.count].position;
+        return _depth - _stroke + int(position * _stroke);
+    }
+};
+
+/**************************************************************************/
+/*!
+  @brief  Base for patterns that are a curve of position over time instead
+  of moves from point to point, e.g. a sine. A cycle of the curve is a
+  stroke in and out and takes the time of a stroke. StrokeEngine samples it
+  with a CurveSegmenter into short segments for the stepper, see
+  CurveSegmenter.h. Derived patterns give the curve in _shape(), from 0 out
+  at depth - stroke to 1 in at depth.
+
+  Where a curve can't be played, under a vibration, nextTarget() strokes
+  in and out like SimpleStroke. Otherwise the curve takes over after the
+  first move in, where its first cycle is deepest.
+*/
+/**************************************************************************/
+class CurvePattern : public Pattern, public PositionCurve {
+  public:
+    CurvePattern(const char *str) : Pattern(str) {}
+
+    PositionCurve *curve() { return this; }
+
+    float cycleTime() { return _timeOfStroke; }
+
+    float positionAt(unsigned int cycle, float phase) {
+        return float(_depth - _stroke) + float(_stroke) * _shape(cycle, phase);
+    }
+
+    motionParameter nextTarget(unsigned int index) {
+        // Half the time for each way, with a third of it coasting
+        float time = 0.5f * _timeOfStroke;
+        _nextMove.speed = int(1.5f * _stroke / time);
+        _nextMove.acceleration = int(3.0f * _nextMove.speed / time);
+
+        // odd stroke is moving out, even in
+        _nextMove.stroke = (index % 2) ? _depth - _stroke : _depth;
+        _nextMove.skip = false;
+
+        _index = index;
+        return _nextMove;
+    }
+
+  protected:
+    //! The curve from 0 out to 1 in, along the phase from 0 to 1 of a cycle
+    virtual float _shape(unsigned int cycle, float phase) = 0;
+};
+
+/**************************************************************************/
+/*!
+  @brief  Sine Stroke Pattern. In and out follow a sine, without the jerk
+  of a trapezoid's corners. Sensation changes the speed ratio between in
+  and out like Teasing Pounding, up to 9x: values > 0 make the in move
+  faster, values < 0 the out move. The time for the overall stroke remains
+  the same.
+*/
+/**************************************************************************/
+class SineStroke : public CurvePattern {
+  public:
+    SineStroke(const char *str) : CurvePattern(str) {}
+
+  protected:
+    float _shape(unsigned int, float phase) {
+        // Share of the cycle moving in, from 0.1 to 0.9
+        float in = 0.5f - _sensation / 250.0f;
+        float half = phase < in ? 0.5f * phase / in
+                                : 0.5f + 0.5f * (phase - in) / (1.0f - in);
+        return 0.5f - 0.5f * cosf(2.0f * float(PI) * half);
+    }
+};
+
+/**************************************************************************/
+/*!
+  @brief  Bézier Stroke Pattern. Each way follows an eased cubic Bézier
+  curve, starting and stopping gently. Sensation moves the fastest part of
+  the in move: values > 0 speed up into depth and brake late and hard,
+  values < 0 rush out of the start and glide in. Out always eases in and
+  out alike.
+*/
+/**************************************************************************/
+class BezierStroke : public CurvePattern {
+  public:
+    BezierStroke(const char *str) : CurvePattern(str) {}
+
+  protected:
+    float _shape(unsigned int, float phase) {
+        if (phase < 0.5f) {
+            // Control points from the sensation, 0.42 and 0.58 at 0
+            float late = 0.22f * _sensation / 100.0f;
+            return _ease(2.0f * phase, 0.42f + late, 0.58f + late);
+        }
+        return 1.0f - _ease(2.0f * phase - 1.0f, 0.42f, 0.58f);
+    }
+
+    //! Bézier curve through (0, 0), (x1, 0), (x2, 1) and (1, 1), its height
+    //! where it reaches x
+    static float _ease(float x, float x1, float x2) {
+        // Newton's method for the curve parameter at x, the curve is
+        // monotonic for 0 < x1 <= x2 < 1
+        float t = x;
+        for (int i = 0; i < 6; i++) {
+            float u = 1.0f - t;
+            float at =
+                3.0f * u * u * t * x1 + 3.0f * u * t * t * x2 + t * t * t;
+            float slope = 3.0f * u * u * x1 + 6.0f * u * t * (x2 - x1) +
+                          3.0f * t * t * (1.0f - x2);
+            t = constrain(t - (at - x) / slope, 0.0f, 1.0f);
+        }
+        return t * t * (3.0f - 2.0f * t);
+    }
+};
+
+/**************************************************************************/
+/*!
+  @brief  Bounded randomness for timing, depth and stroke length of a
+  pattern, for a motion that feels less like a machine. Works on top of any
+  pattern with the usual constructor: Humanized<TeasingPounding> plays
+  Teasing Pounding, and sensation keeps its meaning there.
+
+  Each stroke, an in and out pair, draws once when it starts: how much
+  shallower it goes, how much shorter it is and how much faster or slower
+  each of its two moves are. The window it strokes in always stays inside
+  depth - stroke to depth, and speed and acceleration inside the machine's
+  limits. The pattern's moves are mapped into that window and their speed
+  and acceleration scaled to the new distance and time, so the shape of a
+  move is kept. Asking again for the same index gives the same move.
+
+  Draws come from a PatternRandom, the same seed plays the same sequence.
+*/
+/**************************************************************************/
+template <class Base>
+class Humanized : public Base {
+  public:
+    struct Variation {
+        float timing = 0.15f;  //!< Each move up to this share faster or slower
+        float depth = 0.10f;   //!< Up to this share of the stroke shallower
+        float stroke = 0.25f;  //!< Up to this share shorter
+    };
+
+    Humanized(const char *str, uint32_t seed = 1) : Base(str), _random(seed) {}
+
+    Humanized(const char *str, uint32_t seed, const Variation &variation)
+        : Base(str), _random(seed), _variation(variation) {}
+
+    motionParameter nextTarget(unsigned int index) {
+        motionParameter move = Base::nextTarget(index);
+        if (move.skip) {
+            return move;
+        }
+
+        // A new index moves on from where the last one went
+        if (!_hasMoved || index != _moveIndex) {
+            _fromBase = _toBase;
+            _from = _to;
+        }
+        if (!_hasDrawn || index / 2 != _drawIndex) {
+            _drawStroke();
+            _drawIndex = index / 2;
+            _hasDrawn = true;
+        }
+
+        // Map the pattern's window onto this stroke's
+        int top = this->_depth - _shallower;
+        int bottom = this->_depth - this->_stroke;
+        int target = top - int(float(this->_depth - move.stroke) * _shorter);
+        target = constrain(target, bottom, top);
+
+        // Same shape of move over the new distance and in the new time
+        int baseDistance = abs(move.stroke - _fromBase);
+        float scale = baseDistance > 0
+                          ? float(abs(target - _from)) / float(baseDistance)
+                          : 1.0f;
+        float pace = _pace[index % 2];
+        float speed = float(move.speed) * scale * pace;
+        float acceleration = float(move.acceleration) * scale * pace * pace;
+        if (this->_maxSpeed > 0) {
+            speed = min(speed, float(this->_maxSpeed));
+        }
+        if (this->_maxAcceleration > 0) {
+            acceleration = min(acceleration, float(this->_maxAcceleration));
+        }
+
+        _toBase = move.stroke;
+        _to = target;
+        _moveIndex = index;
+        _hasMoved = true;
+
+        move.stroke = target;
+        move.speed = max(1, int(speed));
+        move.acceleration = max(1, int(acceleration));
+        this->_nextMove = move;
+        return move;
+    }
+
+  protected:
+    PatternRandom _random;
+    Variation _variation;
+    // This stroke's draws, in steps and as factors on length and speed
+    int _shallower = 0;
+    float _shorter = 1.0f;
+    float _pace[2] = {1.0f, 1.0f};
+    unsigned int _drawIndex = 0;
+    bool _hasDrawn = false;
+    // The last move as the pattern asked for it and as it was played.
+    // Patterns start where homing left the carriage, at the back.
+    int _fromBase = 0;
+    int _from = 0;
+    int _toBase = 0;
+    int _to = 0;
+    unsigned int _moveIndex = 0;
+    bool _hasMoved = false;
+
+    void _drawStroke() {
+        float timing = _variation.timing;
+        _shallower = int(_random.uniform() * _variation.depth * this->_stroke);
+        _shorter = 1.0f - _random.uniform() * _variation.stroke;
+        _pace[0] = 1.0f / _random.between(1.0f - timing, 1.0f + timing);
+        _pace[1] = 1.0f / _random.between(1.0f - timing, 1.0f + timing);
+    }
+};
@@ -0,0 +1,60 @@
+#ifndef OSSM_SIL_AIESP32ROTARYENCODER_H
+#define OSSM_SIL_AIESP32ROTARYENCODER_H
+
+#include <cstdint>
+
+/**
+ * AiEsp32RotaryEncoder for the software-in-the-loop build.
+ *
+ * The scenario turns the knob in whole notches through
+ * sil::board::turnEncoder(), the quadrature pins are not simulated.
+ */
+class AiEsp32RotaryEncoder {
+  public:
+    AiEsp32RotaryEncoder(uint8_t encoderAPin, uint8_t encoderBPin,
+                         int encoderButtonPin = -1, int encoderVccPin = -1,
+                         uint8_t encoderSteps = 2) {}
+
+    void begin();
+    void setup(void (*isr)()) {}
+    void readEncoder_ISR() {}
+    void enable() { enabled = true; }
+    void disable() { enabled = false; }
+
+    void setBoundaries(long minValue = -100, long maxValue = 100,
+                       bool circleValues = false) {
+        this->minValue = minValue;
+        this->maxValue = maxValue;
+        this->circleValues = circleValues;
+        setEncoderValue(value);
+    }
+    void setAcceleration(unsigned long) {}
+    void disableAcceleration() {}
+
+    long readEncoder() const { return value; }
+    void setEncoderValue(long newValue) {
+        value = newValue < minValue   ? minValue
+                : newValue > maxValue ? maxValue
+                                      : newValue;
+        lastReadValue = value;
+    }
+    void reset(long newValue = 0) { setEncoderValue(newValue); }
+    long encoderChanged() {
+        long change = value - lastReadValue;
+        lastReadValue = value;
+        return change;
+    }
+
+    // Turn by whole notches, positive is clockwise.
+    void turn(long notches);
+
+  private:
+    long value = 0;
+    long lastReadValue = 0;
+    long minValue = -100;
+    long maxValue = 100;
+    bool circleValues = false;
+    bool enabled = true;
+};
+
+#endif  // OSSM_SIL_AIESP32ROTARYENCODER_H
@@ -0,0 +1,152 @@
+#ifndef OSSM_SIL_ARDUINO_H
+#define OSSM_SIL_ARDUINO_H
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "Esp.h"
+#include "WString.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * The Arduino core for the software-in-the-loop build.
+ *
+ * Pins are plain values that the scenario drives, see sil/Board.h. Time is
+ * virtual, so delay() blocks the calling task like vTaskDelay() does on the
+ * ESP32 core.
+ */
+
+using std::abs;
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PI 3.1415926535897932384626433832795
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+
+#define constrain(amt, low, high) \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(p) (p)
+
+typedef enum { ADC_0db, ADC_2_5db, ADC_6db, ADC_11db } adc_attenuation_t;
+
+/** Pins */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+void analogSetAttenuation(adc_attenuation_t attenuation);
+bool adcAttachPin(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+/** Time */
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+/** Math */
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+#define SERIAL_8N1 0x800001c
+#define SERIAL_8E1 0x800001e
+
+/**
+ * Serial goes to stdout when sil is run with --serial, and nowhere
+ * otherwise.
+ *
+ * Bytes read and written go to a host device once one is attached, a pty
+ * of tools/servomock for Serial2, and nowhere otherwise.
+ */
+class HardwareSerial {
+  public:
+    void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1,
+               int8_t = -1) {}
+    void end() {}
+    void flush() {}
+    int available();
+    int read();
+    size_t write(const uint8_t *data, size_t length);
+
+    // Opens the host device, raw and non-blocking. SIL only.
+    bool attach(const char *path);
+
+    size_t write(const char *str);
+    size_t printf(const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+    size_t print(const String &str) { return write(str.c_str()); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return printf("%c", c); }
+    size_t print(int n, int base = DEC) {
+        return printf(base == HEX ? "%x" : "%d", n);
+    }
+    size_t print(unsigned int n, int base = DEC) {
+        return printf(base == HEX ? "%x" : "%u", n);
+    }
+    size_t print(long n, int base = DEC) {
+        return printf(base == HEX ? "%lx" : "%ld", n);
+    }
+    size_t print(unsigned long n, int base = DEC) {
+        return printf(base == HEX ? "%lx" : "%lu", n);
+    }
+    size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+
+    size_t println() { return write("\n"); }
+    template <typename T>
+    size_t println(const T &value) {
+        return print(value) + println();
+    }
+    template <typename T>
+    size_t println(const T &value, int format) {
+        return print(value, format) + println();
+    }
+
+  private:
+    int fd = -1;
+    // A byte peeked by available().
+    int next = -1;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+#endif  // OSSM_SIL_ARDUINO_H
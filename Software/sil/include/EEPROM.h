@@ -0,0 +1,7 @@
+#ifndef OSSM_SIL_EEPROM_H
+#define OSSM_SIL_EEPROM_H
+
+// constants/Images.h includes EEPROM.h for PROGMEM, which Arduino.h has.
+#include "Arduino.h"
+
+#endif  // OSSM_SIL_EEPROM_H
@@ -0,0 +1,20 @@
+#ifndef OSSM_SIL_ESP_H
+#define OSSM_SIL_ESP_H
+
+#include <cstdint>
+
+#include "esp_heap_caps.h"
+
+class EspClass {
+  public:
+    uint32_t getFreeHeap() {
+        return (uint32_t)heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    }
+    const char *getSdkVersion() { return "sil"; }
+    // Ends the simulation, see sil/src/main.cpp.
+    [[noreturn]] void restart();
+};
+
+extern EspClass ESP;
+
+#endif  // OSSM_SIL_ESP_H
@@ -0,0 +1,119 @@
+#ifndef OSSM_SIL_FASTACCELSTEPPER_H
+#define OSSM_SIL_FASTACCELSTEPPER_H
+
+#include <cstdint>
+#include <deque>
+
+/**
+ * FastAccelStepper for the software-in-the-loop build.
+ *
+ * The ramp generator is integrated in virtual time with the same rules as the
+ * library: trapezoid moves, speed and acceleration changes apply on the next
+ * move, moveTo(), stopMove() or applySpeedAcceleration(). The steps drive
+ * sil::Rail, so the carriage, the hard stops and the current sensor follow.
+ *
+ * Commands added with addQueueEntry() play one after the other at their own
+ * constant speed, as long as the ramp generator is idle, like the library's
+ * raw command queue.
+ *
+ * The motion is brought up to date lazily, whenever the firmware asks.
+ */
+
+#define MOVE_OK 0
+#define MOVE_ERR_NO_DIRECTION_PIN -1
+#define MOVE_ERR_SPEED_IS_UNDEFINED -2
+#define MOVE_ERR_ACCELERATION_IS_UNDEFINED -3
+
+#define TICKS_PER_S 16000000L
+#define QUEUE_LEN 32
+#define AQE_OK 0
+#define AQE_QUEUE_FULL 1
+#define AQE_DEVICE_NOT_READY 4
+#define AQE_ERROR_TICKS_TOO_LOW -1
+
+// steps at one every ticks, or a pause of ticks for 0 steps.
+struct stepper_command_s {
+    uint16_t ticks;
+    uint8_t steps;
+    bool count_up;
+};
+
+class FastAccelStepper {
+  public:
+    // Time step of the ramp integration.
+    static constexpr uint32_t tickMicros = 100;
+
+    uint8_t getStepPin() const { return stepPin; }
+
+    void setDirectionPin(uint8_t pin, bool dirHighCountsUp = true,
+                         uint16_t dirChangeDelayUs = 0);
+    void setEnablePin(uint8_t pin, bool lowActiveEnablesStepper = true);
+    void setAutoEnable(bool autoEnable);
+    bool enableOutputs();
+    bool disableOutputs();
+    // Whether the driver follows the steps, from the enable pin.
+    bool isEnabled() const;
+
+    int8_t setSpeedInHz(uint32_t speedHz);
+    int8_t setAcceleration(int32_t stepsPerSecondSquared);
+    void applySpeedAcceleration();
+    uint32_t getSpeedInMilliHz() const { return (uint32_t)(speedHz * 1000); }
+    uint32_t getAcceleration() const { return (uint32_t)acceleration; }
+
+    int8_t move(int32_t steps, bool blocking = false);
+    int8_t moveTo(int32_t position, bool blocking = false);
+    void stopMove();
+    void forceStop();
+    void forceStopAndNewPosition(int32_t position);
+    void setCurrentPosition(int32_t position);
+
+    int32_t getCurrentPosition();
+    int32_t targetPos() const { return target; }
+    int32_t getCurrentSpeedInMilliHz(bool realtime = true);
+    bool isRunning();
+
+    int8_t addQueueEntry(const struct stepper_command_s *cmd,
+                         bool start = true);
+    uint8_t queueEntries();
+    bool isQueueEmpty() { return queueEntries() == 0; }
+    bool isQueueFull() { return queueEntries() >= QUEUE_LEN; }
+
+  private:
+    friend class FastAccelStepperEngine;
+
+    void update();
+    void integrate(double dt);
+    void playQueue(uint64_t now);
+    int8_t start(int32_t position, bool blocking);
+    void applyPending();
+
+    uint8_t stepPin = 0;
+    uint8_t enablePin = 0xff;
+    bool enableLowActive = true;
+    bool countsUp = true;
+
+    // Applied on the next move.
+    double pendingSpeedHz = 0;
+    double pendingAcceleration = 0;
+
+    double speedHz = 0;
+    double acceleration = 0;
+    double position = 0;
+    double velocity = 0;
+    int32_t target = 0;
+    uint64_t updatedAt = 0;
+
+    std::deque<stepper_command_s> queue;
+    // When the command at the front started, and where.
+    double commandStartMicros = 0;
+    double commandStartPosition = 0;
+};
+
+class FastAccelStepperEngine {
+  public:
+    void init() {}
+    // Only one stepper is wired up.
+    FastAccelStepper *stepperConnectToPin(uint8_t stepPin);
+};
+
+#endif  // OSSM_SIL_FASTACCELSTEPPER_H
@@ -0,0 +1,20 @@
+#ifndef OSSM_SIL_HTTPCLIENT_H
+#define OSSM_SIL_HTTPCLIENT_H
+
+#include "WString.h"
+#include "WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+// Every request fails to connect, see WiFi.h.
+class HTTPClient {
+  public:
+    bool begin(WiFiClient &, const String &) { return true; }
+    void addHeader(const String &, const String &) {}
+    int GET() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    int POST(const String &) { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    String getString() { return String(); }
+    void end() {}
+};
+
+#endif  // OSSM_SIL_HTTPCLIENT_H
@@ -0,0 +1,25 @@
+#ifndef OSSM_SIL_HTTPUPDATE_H
+#define OSSM_SIL_HTTPUPDATE_H
+
+#include "HTTPClient.h"
+
+enum HTTPUpdateResult {
+    HTTP_UPDATE_FAILED,
+    HTTP_UPDATE_NO_UPDATES,
+    HTTP_UPDATE_OK
+};
+
+typedef HTTPUpdateResult t_httpUpdate_return;
+
+class HTTPUpdate {
+  public:
+    t_httpUpdate_return update(WiFiClient &, const String &) {
+        return HTTP_UPDATE_FAILED;
+    }
+    int getLastError() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    String getLastErrorString() { return "no network in the simulator"; }
+};
+
+extern HTTPUpdate httpUpdate;
+
+#endif  // OSSM_SIL_HTTPUPDATE_H
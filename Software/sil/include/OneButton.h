@@ -0,0 +1,51 @@
+#ifndef OSSM_SIL_ONEBUTTON_H
+#define OSSM_SIL_ONEBUTTON_H
+
+#include <cstdint>
+
+/**
+ * OneButton for the software-in-the-loop build.
+ *
+ * A compact version of the library's state machine with its default timing:
+ * 50 ms debounce, 400 ms to wait for a second click and 800 ms for a long
+ * press. Like the library it only looks at the pin when tick() is called.
+ */
+class OneButton {
+  public:
+    typedef void (*callbackFunction)();
+
+    OneButton(int pin, bool activeLow = true, bool pullupActive = true)
+        : pin(pin), activeLevel(activeLow ? 0 : 1) {}
+
+    void setDebounceTicks(int ms) { debounceMs = ms; }
+    void setClickTicks(int ms) { clickMs = ms; }
+    void setPressTicks(int ms) { pressMs = ms; }
+
+    void attachClick(callbackFunction f) { onClick = f; }
+    void attachDoubleClick(callbackFunction f) { onDoubleClick = f; }
+    void attachLongPressStart(callbackFunction f) { onLongPressStart = f; }
+    void attachLongPressStop(callbackFunction f) { onLongPressStop = f; }
+
+    void tick();
+    bool isLongPressed() const { return state == State::LongPress; }
+
+  private:
+    enum class State { Idle, Down, Up, Count, LongPress };
+
+    int pin;
+    int activeLevel;
+    uint32_t debounceMs = 50;
+    uint32_t clickMs = 400;
+    uint32_t pressMs = 800;
+
+    callbackFunction onClick = nullptr;
+    callbackFunction onDoubleClick = nullptr;
+    callbackFunction onLongPressStart = nullptr;
+    callbackFunction onLongPressStop = nullptr;
+
+    State state = State::Idle;
+    uint32_t startMs = 0;
+    int clicks = 0;
+};
+
+#endif  // OSSM_SIL_ONEBUTTON_H
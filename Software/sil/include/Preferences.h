@@ -0,0 +1,57 @@
+#ifndef OSSM_SIL_PREFERENCES_H
+#define OSSM_SIL_PREFERENCES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// NVS in memory, empty at every start, like a freshly erased board.
+class Preferences {
+  public:
+    bool begin(const char *name, bool readOnly = false) {
+        space = &storage()[name];
+        this->readOnly = readOnly;
+        return true;
+    }
+    void end() { space = nullptr; }
+
+    size_t getBytesLength(const char *key) {
+        auto entry = space->find(key);
+        return entry == space->end() ? 0 : entry->second.size();
+    }
+    size_t getBytes(const char *key, void *buffer, size_t maxLength) {
+        auto entry = space->find(key);
+        if (entry == space->end() || entry->second.size() > maxLength) {
+            return 0;
+        }
+        memcpy(buffer, entry->second.data(), entry->second.size());
+        return entry->second.size();
+    }
+    size_t putBytes(const char *key, const void *value, size_t length) {
+        if (readOnly) {
+            return 0;
+        }
+        auto bytes = static_cast<const uint8_t *>(value);
+        (*space)[key].assign(bytes, bytes + length);
+        return length;
+    }
+    bool remove(const char *key) {
+        return !readOnly && space->erase(key) > 0;
+    }
+
+  private:
+    using Space = std::map<std::string, std::vector<uint8_t>>;
+
+    static std::map<std::string, Space> &storage() {
+        static std::map<std::string, Space> namespaces;
+        return namespaces;
+    }
+
+    Space *space = nullptr;
+    bool readOnly = false;
+};
+
+#endif  // OSSM_SIL_PREFERENCES_H
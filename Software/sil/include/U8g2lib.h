@@ -0,0 +1,91 @@
+#ifndef OSSM_SIL_U8G2LIB_H
+#define OSSM_SIL_U8G2LIB_H
+
+#include <cstdint>
+
+#include "clib/u8g2.h"
+
+/**
+ * U8g2 for the software-in-the-loop build.
+ *
+ * Draws into a 128x64 buffer that, like the full buffer mode of the real
+ * library, is shared by every display object of the type. Text is drawn with
+ * a built in 5x7 font; the U8g2 font names select its size and weight, so
+ * layouts come out close to, but not pixel identical with, the device.
+ */
+
+struct u8g2_cb_t {
+    uint8_t rotation;
+};
+
+extern const u8g2_cb_t u8g2_cb_r0;
+#define U8G2_R0 (&u8g2_cb_r0)
+#define U8X8_PIN_NONE 255
+#define U8X8_PROGMEM
+
+// First byte is the scale, second whether it is bold.
+extern const uint8_t u8g2_font_helvB08_tf[];
+extern const uint8_t u8g2_font_helvR08_tf[];
+extern const uint8_t u8g2_font_6x10_tf[];
+extern const uint8_t u8g2_font_maniac_tf[];
+
+class U8G2 {
+  public:
+    static constexpr u8g2_uint_t width = 128;
+    static constexpr u8g2_uint_t height = 64;
+
+    bool begin() { return true; }
+    void setBusClock(uint32_t hz);
+    void setPowerSave(uint8_t) {}
+    void setContrast(uint8_t) {}
+
+    void clearBuffer();
+    // Hands the buffer to the panel, see sil::display.
+    void sendBuffer();
+
+    u8g2_uint_t getDisplayWidth() const { return width; }
+    u8g2_uint_t getDisplayHeight() const { return height; }
+
+    void setFont(const uint8_t *font) { this->font = font; }
+    void setDrawColor(uint8_t color) { drawColor = color; }
+    void setFontMode(uint8_t) {}
+
+    void drawPixel(u8g2_uint_t x, u8g2_uint_t y);
+    void drawHLine(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w);
+    void drawVLine(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t h);
+    void drawLine(u8g2_uint_t x1, u8g2_uint_t y1, u8g2_uint_t x2,
+                  u8g2_uint_t y2);
+    void drawBox(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h);
+    void drawFrame(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h);
+    void drawRFrame(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h,
+                    u8g2_uint_t r);
+    void drawXBMP(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h,
+                  const uint8_t *bitmap);
+
+    u8g2_uint_t drawStr(u8g2_uint_t x, u8g2_uint_t y, const char *str);
+    u8g2_uint_t drawUTF8(u8g2_uint_t x, u8g2_uint_t y, const char *str);
+    u8g2_uint_t getStrWidth(const char *str) const;
+    u8g2_uint_t getUTF8Width(const char *str) const;
+
+  protected:
+    explicit U8G2(const u8g2_cb_t *) {}
+
+  private:
+    void plot(int x, int y);
+    int scale() const;
+    bool bold() const;
+
+    const uint8_t *font = u8g2_font_helvR08_tf;
+    uint8_t drawColor = 1;
+};
+
+class U8G2_SSD1306_128X64_NONAME_F_HW_I2C : public U8G2 {
+  public:
+    U8G2_SSD1306_128X64_NONAME_F_HW_I2C(const u8g2_cb_t *rotation,
+                                        uint8_t reset = U8X8_PIN_NONE,
+                                        uint8_t clock = U8X8_PIN_NONE,
+                                        uint8_t data = U8X8_PIN_NONE)
+        : U8G2(rotation) {}
+};
+
+#endif  // OSSM_SIL_U8G2LIB_H
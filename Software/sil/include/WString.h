@@ -0,0 +1,113 @@
+#ifndef OSSM_SIL_WSTRING_H
+#define OSSM_SIL_WSTRING_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/**
+ * Arduino String on top of std::string, with the members the firmware and
+ * its libraries use.
+ */
+class String {
+  public:
+    String() = default;
+    String(const char *str) : value(str == nullptr ? "" : str) {}
+    String(const std::string &str) : value(str) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int n) : value(std::to_string(n)) {}
+    explicit String(unsigned int n) : value(std::to_string(n)) {}
+    explicit String(long n) : value(std::to_string(n)) {}
+    explicit String(unsigned long n) : value(std::to_string(n)) {}
+    explicit String(long long n) : value(std::to_string(n)) {}
+    explicit String(unsigned long long n) : value(std::to_string(n)) {}
+    explicit String(float n, unsigned int decimals = 2)
+        : String((double)n, decimals) {}
+    explicit String(double n, unsigned int decimals = 2) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, n);
+        value = buffer;
+    }
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return (unsigned int)value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+    char operator[](unsigned int index) const {
+        return index < value.length() ? value[index] : 0;
+    }
+
+    bool startsWith(const String &prefix) const {
+        return value.compare(0, prefix.value.length(), prefix.value) == 0;
+    }
+    bool endsWith(const String &suffix) const {
+        return value.length() >= suffix.value.length() &&
+               value.compare(value.length() - suffix.value.length(),
+                             suffix.value.length(), suffix.value) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t index = value.find(c, from);
+        return index == std::string::npos ? -1 : (int)index;
+    }
+    int indexOf(const String &str, unsigned int from = 0) const {
+        size_t index = value.find(str.value, from);
+        return index == std::string::npos ? -1 : (int)index;
+    }
+    String substring(unsigned int from) const {
+        return from < value.length() ? String(value.substr(from)) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        return from < value.length() ? String(value.substr(from, to - from))
+                                     : String();
+    }
+    long toInt() const { return atol(value.c_str()); }
+    float toFloat() const { return (float)atof(value.c_str()); }
+    bool equals(const String &other) const { return value == other.value; }
+
+    bool concat(const String &other) {
+        value += other.value;
+        return true;
+    }
+    String &operator+=(const String &other) {
+        value += other.value;
+        return *this;
+    }
+    String &operator+=(const char *other) {
+        value += other;
+        return *this;
+    }
+    String &operator+=(char c) {
+        value += c;
+        return *this;
+    }
+
+    friend String operator+(const String &a, const String &b) {
+        return String(a.value + b.value);
+    }
+    friend String operator+(const String &a, const char *b) {
+        return String(a.value + b);
+    }
+    friend String operator+(const char *a, const String &b) {
+        return String(a + b.value);
+    }
+    friend bool operator==(const String &a, const String &b) {
+        return a.value == b.value;
+    }
+    friend bool operator==(const String &a, const char *b) {
+        return a.value == b;
+    }
+    friend bool operator!=(const String &a, const String &b) {
+        return a.value != b.value;
+    }
+    friend bool operator<(const String &a, const String &b) {
+        return a.value < b.value;
+    }
+
+  private:
+    std::string value;
+};
+
+#endif  // OSSM_SIL_WSTRING_H
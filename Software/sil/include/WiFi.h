@@ -0,0 +1,46 @@
+#ifndef OSSM_SIL_WIFI_H
+#define OSSM_SIL_WIFI_H
+
+#include <cstdint>
+
+/**
+ * Wi-Fi for the software-in-the-loop build. The simulated OSSM gets no
+ * connection, so the update check and the metrics endpoint stay idle, unless
+ * a run puts it on the host's network with --metrics-port. Update checks fail
+ * either way, see HTTPClient.h.
+ */
+namespace sil {
+    extern bool wifiConnected;
+}
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+  public:
+    static wl_status_t status() {
+        return sil::wifiConnected ? WL_CONNECTED : WL_DISCONNECTED;
+    }
+    wl_status_t begin(const char *, const char * = nullptr) {
+        return status();
+    }
+    bool disconnect(bool = false) { return true; }
+    bool mode(int) { return true; }
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient {
+  public:
+    bool connected() { return false; }
+    void stop() {}
+};
+
+#endif  // OSSM_SIL_WIFI_H
@@ -0,0 +1,46 @@
+#ifndef OSSM_SIL_WIFIMANAGER_H
+#define OSSM_SIL_WIFIMANAGER_H
+
+#include "WString.h"
+#include "WiFi.h"
+
+#include <functional>
+#include <string>
+
+class WiFiManagerParameter {
+  public:
+    WiFiManagerParameter(const char *id, const char *label,
+                         const char *defaultValue, int length)
+        : id(id), value(defaultValue) {}
+
+    const char *getID() const { return id; }
+    const char *getValue() const { return value.c_str(); }
+
+  private:
+    const char *id;
+    std::string value;
+};
+
+// The configuration portal opens and closes, nobody ever joins it.
+class WiFiManager {
+  public:
+    bool addParameter(WiFiManagerParameter *parameter) { return true; }
+    void setSaveParamsCallback(std::function<void()> callback) {}
+    void setConfigPortalBlocking(bool blocking) {}
+    bool startConfigPortal(const char *apName = nullptr,
+                           const char *apPassword = nullptr) {
+        portalActive = true;
+        return false;
+    }
+    bool process() { return false; }
+    void stopConfigPortal() { portalActive = false; }
+    bool getConfigPortalActive() const { return portalActive; }
+    String getWiFiSSID(bool persistent = true) { return String(); }
+    String getWiFiPass(bool persistent = true) { return String(); }
+    void resetSettings() {}
+
+  private:
+    bool portalActive = false;
+};
+
+#endif  // OSSM_SIL_WIFIMANAGER_H
@@ -0,0 +1,9 @@
+#ifndef OSSM_SIL_CLIB_U8G2_H
+#define OSSM_SIL_CLIB_U8G2_H
+
+#include <cstdint>
+
+// The C half of U8g2, of which the firmware only uses the coordinate type.
+typedef uint16_t u8g2_uint_t;
+
+#endif  // OSSM_SIL_CLIB_U8G2_H
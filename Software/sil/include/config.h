@@ -0,0 +1,7 @@
+#ifndef OSSM_SIL_CONFIG_H
+#define OSSM_SIL_CONFIG_H
+
+// utils/StrokeEngineHelper.h includes <config.h> from the ESP32 core, which
+// has nothing the firmware uses.
+
+#endif  // OSSM_SIL_CONFIG_H
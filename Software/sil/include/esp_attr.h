@@ -0,0 +1,9 @@
+#ifndef OSSM_SIL_ESP_ATTR_H
+#define OSSM_SIL_ESP_ATTR_H
+
+// There is one kind of memory on the host.
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define __NOINIT_ATTR
+
+#endif  // OSSM_SIL_ESP_ATTR_H
@@ -0,0 +1,11 @@
+#ifndef OSSM_SIL_ESP_ERR_H
+#define OSSM_SIL_ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+#endif  // OSSM_SIL_ESP_ERR_H
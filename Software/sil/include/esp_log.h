@@ -0,0 +1,43 @@
+#ifndef OSSM_SIL_ESP_LOG_H
+#define OSSM_SIL_ESP_LOG_H
+
+/**
+ * ESP-IDF logging for the software-in-the-loop build.
+ *
+ * Lines are stamped with virtual time and the running task. The level is
+ * chosen at run time, see sil --help.
+ */
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+namespace sil {
+    extern esp_log_level_t logLevel;
+
+    void log(esp_log_level_t level, const char *tag, const char *format, ...);
+}
+
+#define SIL_LOG(level, tag, format, ...)                     \
+    do {                                                     \
+        if (sil::logLevel >= (level)) {                      \
+            sil::log((level), (tag), format, ##__VA_ARGS__); \
+        }                                                    \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) \
+    SIL_LOG(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) \
+    SIL_LOG(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) \
+    SIL_LOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) \
+    SIL_LOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) \
+    SIL_LOG(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif  // OSSM_SIL_ESP_LOG_H
@@ -0,0 +1,44 @@
+#ifndef OSSM_SIL_ESP_PARTITION_H
+#define OSSM_SIL_ESP_PARTITION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+
+/**
+ * The partitions of partition.csv the firmware writes to, backed by RAM.
+ * Only the 64 KiB coredump partition exists. sil --flash loads it from and
+ * saves it to a file, so dumps survive between runs like on the device.
+ */
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+    ESP_PARTITION_SUBTYPE_DATA_COREDUMP = 0x03,
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t srcOffset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              size_t dstOffset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size);
+
+#endif  // OSSM_SIL_ESP_PARTITION_H
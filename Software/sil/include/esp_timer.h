@@ -0,0 +1,11 @@
+#ifndef OSSM_SIL_ESP_TIMER_H
+#define OSSM_SIL_ESP_TIMER_H
+
+#include <cstdint>
+
+#include "sil/VirtualTime.h"
+
+// Microseconds since boot, on the virtual clock.
+inline int64_t esp_timer_get_time() { return (int64_t)sil::now(); }
+
+#endif  // OSSM_SIL_ESP_TIMER_H
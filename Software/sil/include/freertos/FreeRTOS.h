@@ -0,0 +1,84 @@
+#ifndef OSSM_SIL_FREERTOS_H
+#define OSSM_SIL_FREERTOS_H
+
+#include <cstdint>
+
+/**
+ * FreeRTOS for the software-in-the-loop build.
+ *
+ * Only the calls the firmware makes are here. Tasks are coroutines on one
+ * virtual CPU and time only moves when every task is blocked, see
+ * sil/src/Scheduler.cpp. Core affinity is accepted and ignored.
+ *
+ * task.h and semphr.h include this file, so any of the three pulls in the
+ * whole API.
+ */
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+struct tskTaskControlBlock;
+typedef tskTaskControlBlock *TaskHandle_t;
+
+struct QueueDefinition;
+typedef QueueDefinition *SemaphoreHandle_t;
+
+#define pdTRUE ((BaseType_t)1)
+#define pdFALSE ((BaseType_t)0)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs)            \
+    ((TickType_t)(((TickType_t)(xTimeInMs) * \
+                   (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// Interrupts run between tasks, so there is nothing to yield to.
+#define portYIELD_FROM_ISR(...) \
+    do {                        \
+    } while (0)
+
+/** Tasks */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name,
+                                   uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created,
+                                   BaseType_t coreId);
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name,
+                       uint32_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *created);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t increment);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+TickType_t xTaskGetTickCount();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+/** Direct to task notifications */
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task,
+                            BaseType_t *higherPriorityTaskWoken);
+
+/** Semaphores and mutexes */
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore,
+                                   TickType_t ticksToWait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore);
+
+#endif  // OSSM_SIL_FREERTOS_H
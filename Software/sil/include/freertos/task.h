@@ -0,0 +1,6 @@
+#ifndef OSSM_SIL_FREERTOS_TASK_H
+#define OSSM_SIL_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+#endif  // OSSM_SIL_FREERTOS_TASK_H
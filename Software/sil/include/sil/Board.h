@@ -0,0 +1,29 @@
+#ifndef OSSM_SIL_BOARD_H
+#define OSSM_SIL_BOARD_H
+
+#include <cstdint>
+#include <functional>
+
+/**
+ * The outside of the ESP32 pins, for the scenario and the plant model.
+ */
+namespace sil::board {
+    static constexpr uint8_t pinCount = 40;
+
+    /**
+     * Drive an input pin. An interrupt attached to the pin runs right away
+     * if the edge matches its mode.
+     */
+    void setDigital(uint8_t pin, int level);
+
+    // Last level the firmware wrote to an output pin.
+    int digitalOutput(uint8_t pin);
+
+    // What analogRead() returns for a pin, 12 bit.
+    void setAnalogSource(uint8_t pin, std::function<uint16_t()> source);
+
+    // Turn the rotary encoder by whole notches, positive is clockwise.
+    void turnEncoder(long notches);
+}
+
+#endif  // OSSM_SIL_BOARD_H
@@ -0,0 +1,118 @@
+#ifndef OSSM_SIL_DISPLAY_H
+#define OSSM_SIL_DISPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Display
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * The OLED behind the U8g2 shim, and a capture of every frame it is sent.
+ *
+ * Buffers use the SSD1306 page layout that U8g2 sends: 8 pages of 128 bytes,
+ * each byte a column of 8 pixels with the top one in bit 0.
+ */
+namespace sil::display {
+    static constexpr int width = 128;
+    static constexpr int height = 64;
+    static constexpr int pages = height / 8;
+    static constexpr size_t bufferSize = width * height / 8;
+
+    // The drawing buffer shared by every U8G2 object.
+    uint8_t *buffer();
+
+    // What the panel shows, the buffer as of the last sendBuffer().
+    const uint8_t *panel();
+    uint32_t framesSent();
+
+    inline bool pixel(const uint8_t *frame, int x, int y) {
+        return (frame[(y / 8) * width + x] >> (y % 8)) & 1;
+    }
+
+    // Called by U8G2::sendBuffer() and U8G2::setBusClock().
+    void present();
+    void setBusClock(uint32_t hz);
+
+    /**
+     * Bytes on the I2C bus for one full buffer frame, as U8g2's SSD1306 driver
+     * sends it: per page one command transfer (address, control byte, column
+     * and page commands), then the 128 data bytes in transfers of 32, each
+     * with an address and a control byte.
+     */
+    static constexpr uint32_t busBytesPerFrame =
+        pages * ((1 + 1 + 3) + width + (width / 32) * 2);
+
+    struct Frame {
+        uint64_t micros = 0;
+        uint32_t busBytes;
+        // Pages that differ from the frame before, what a partial update
+        // would have to send.
+        uint8_t changedPages;
+        // Index into screens().
+        uint16_t screen;
+        // Empty unless pixels are kept, see keepPixels().
+        std::vector<uint8_t> pixels;
+    };
+
+    /**
+     * Names the screen a frame belongs to, main.cpp uses the state machine
+     * state. Frames are grouped by it in screenStats().
+     */
+    void setScreenSource(std::function<std::string()> source);
+
+    /**
+     * Every frame is kept with its time and byte count. The pixels cost 1 kB a
+     * frame and are only kept when asked for.
+     */
+    void keepPixels(bool keep);
+
+    const std::vector<Frame> &frames();
+    const std::vector<std::string> &screens();
+
+    struct ScreenStats {
+        std::string screen;
+        uint32_t frames = 0;
+        // Frames that follow a frame of the same screen, and the time between
+        // them. The rates are measured over these.
+        uint32_t intervals = 0;
+        uint64_t micros;
+        uint64_t busBytes = 0;
+        uint64_t changedPages = 0;
+        // Wall time spent drawing, from clearBuffer() to sendBuffer().
+        uint64_t drawNanos = 0;
+
+        double framesPerSecond() const;
+        double bytesPerSecond() const;
+        // Share of the time the bus is busy sending frames.
+        double busLoad(uint32_t busHz) const;
+    };
+
+    // One entry per screen, in the order they were first shown.
+    std::vector<ScreenStats> screenStats();
+    uint32_t busClock();
+
+    // Wall time of the current frame starts here, see ScreenStats::drawNanos.
+    void beginDraw();
+
+    /**
+     * Binary PBM (P4) and 1 bit grayscale PNG. Both look like the panel, lit
+     * pixels white on black.
+     */
+    bool writePbm(const std::string &path, const uint8_t *frame);
+    bool writePng(const std::string &path, const uint8_t *frame);
+
+    // Reads a 128x64 P4 PBM as written by writePbm().
+    bool readPbm(const std::string &path, uint8_t *frame);
+
+    // Number of pixels that differ.
+    uint32_t diff(const uint8_t *a, const uint8_t *b);
+}
+
+#endif  // OSSM_SIL_DISPLAY_H
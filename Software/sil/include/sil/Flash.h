@@ -0,0 +1,14 @@
+#ifndef OSSM_SIL_FLASH_H
+#define OSSM_SIL_FLASH_H
+
+/**
+ * The coredump partition behind the esp_partition shim, so flight recorder
+ * dumps can be read with tools/flightrec after a run.
+ */
+namespace sil::flash {
+    // Missing files leave the partition erased.
+    bool load(const char *path);
+    bool save(const char *path);
+}
+
+#endif  // OSSM_SIL_FLASH_H
@@ -0,0 +1,95 @@
+#ifndef OSSM_SIL_RAIL_H
+#define OSSM_SIL_RAIL_H
+
+#include <cstdint>
+
+class FastAccelStepper;
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Rail
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * The mechanics behind the stepper driver: a carriage between two hard stops.
+ *
+ * The stepper counts steps whether or not the carriage follows. Against a
+ * hard stop the motor skips steps and the current sensor sees the stall,
+ * which is what sensorless homing looks for. The current is in ADC counts and
+ * the numbers are picked so a stall clears Config::Driver::sensorlessCurrentLimit
+ * with room to spare and free running never does.
+ */
+namespace sil {
+    class Rail {
+      public:
+        // Carriage travel between the hard stops.
+        float travelMm = 200;
+        // Where the carriage is at boot, from the front stop.
+        float startMm = 100;
+        float stepsPerMm = 20;
+
+        // Current sensor, in 12 bit ADC counts.
+        float idleCurrent = 400;
+        float stallCurrent = 240;
+        // Extra current at full speed.
+        float loadCurrent = 30;
+        float fullSpeedHz = 27000;
+        // Added by the scenario, see "current" in sil/README.md.
+        float injectedCurrent = 0;
+
+        void reset() {
+            positionMm = startMm;
+            stalled = false;
+        }
+
+        /**
+         * Move the carriage by the steps the driver just put out.
+         * @param steps signed, in the direction of the carriage.
+         */
+        void step(double steps, bool enabled) {
+            if (!enabled || steps == 0) {
+                stalled = false;
+                return;
+            }
+            double next = positionMm + steps / stepsPerMm;
+            stalled = next < 0 || next > travelMm;
+            positionMm = next < 0 ? 0 : next > travelMm ? travelMm : next;
+        }
+
+        void setSpeed(double stepsPerSecond) { speedHz = stepsPerSecond; }
+
+        double position() const { return positionMm; }
+        bool isStalled() const { return stalled; }
+
+        // One ADC sample of the current sensor.
+        uint16_t currentSense() {
+            // A small deterministic noise so averaging has something to do.
+            noise = noise * 1103515245u + 12345u;
+            float sample = idleCurrent + injectedCurrent +
+                           (float)((noise >> 16) % 9) - 4;
+            if (stalled) {
+                sample += stallCurrent;
+            }
+            double speed = speedHz < 0 ? -speedHz : speedHz;
+            sample += loadCurrent * (float)(speed > fullSpeedHz
+                                                ? 1.0
+                                                : speed / fullSpeedHz);
+            return sample < 0 ? 0 : sample > 4095 ? 4095 : (uint16_t)sample;
+        }
+
+      private:
+        double positionMm = 100;
+        double speedHz = 0;
+        bool stalled = false;
+        uint32_t noise = 1;
+    };
+
+    // The one rail, shared by the stepper shim, the board and the scenario.
+    Rail &rail();
+
+    // The stepper that drives it.
+    FastAccelStepper &stepper();
+}
+
+#endif  // OSSM_SIL_RAIL_H
@@ -0,0 +1,85 @@
+#ifndef OSSM_SIL_VIRTUALTIME_H
+#define OSSM_SIL_VIRTUALTIME_H
+
+#include <cstdint>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Virtual Time
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * The software-in-the-loop build runs every FreeRTOS task as a coroutine on
+ * one virtual CPU. Code takes no time, so the clock only moves when every
+ * task is blocked, and then jumps straight to the next wake up or stimulus.
+ * An hour of stroking is a few seconds of wall time.
+ */
+namespace sil {
+    static constexpr uint64_t never = UINT64_MAX;
+
+    // Microseconds since boot.
+    uint64_t now();
+
+    /**
+     * Anything outside the firmware that changes on its own schedule, like a
+     * scenario script. It fires between tasks, so it can drive pins and
+     * interrupts.
+     */
+    class Stimulus {
+      public:
+        virtual ~Stimulus() = default;
+        // Time of the next event, or never.
+        virtual uint64_t nextEventMicros() const = 0;
+        virtual void fire(uint64_t nowMicros) = 0;
+    };
+
+    void addStimulus(Stimulus *stimulus);
+
+    enum class RunResult { TimeLimit, Stopped, Deadlock };
+
+    /**
+     * Run the tasks until the clock reaches untilMicros, stop() is called or
+     * nothing can ever run again.
+     */
+    RunResult run(uint64_t untilMicros);
+
+    // Ask run() to return once the current task blocks.
+    void stop();
+
+    /**
+     * Called by shims that firmware polls in a busy loop, like
+     * FastAccelStepper::isRunning(). On the device the hardware moves on while
+     * the CPU spins; here the caller is put to sleep after a run of polls
+     * without blocking, so the loop cannot hang the simulation.
+     */
+    void poll();
+
+    // Name of the running task, or "isr" between tasks.
+    const char *currentTaskName();
+
+    /**
+     * Keep the virtual clock in step with the wall clock, so the firmware can
+     * talk to other processes, like another SIL over UDP. The virtual clock
+     * runs driftPpm parts per million fast, negative is slow, the way a
+     * crystal is off. Call before run().
+     */
+    void setRealtime(double driftPpm);
+
+    /**
+     * The host's monotonic clock, in microseconds, when the virtual clock
+     * showed virtualMicros. Comparable between processes; only meaningful
+     * in realtime.
+     */
+    uint64_t trueMicros(uint64_t virtualMicros);
+
+    struct SchedulerStats {
+        uint64_t contextSwitches;
+        uint32_t tasksCreated;
+        uint32_t tasksAlive;
+    };
+
+    SchedulerStats schedulerStats();
+}
+
+#endif  // OSSM_SIL_VIRTUALTIME_H
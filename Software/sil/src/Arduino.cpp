@@ -0,0 +1,208 @@
+#include "Arduino.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <random>
+
+#include "sil/Board.h"
+#include "sil/VirtualTime.h"
+
+/**
+ * Pins, time, Serial and logging for the Arduino shim.
+ */
+
+HardwareSerial Serial;
+HardwareSerial Serial2;
+
+namespace sil {
+    esp_log_level_t logLevel = ESP_LOG_WARN;
+    bool serialEnabled = false;
+
+    void log(esp_log_level_t level, const char *tag, const char *format,
+             ...) {
+        static const char letters[] = "NEWIDV";
+        uint64_t t = now();
+        fprintf(stderr, "[%6llu.%06llu] %c (%s) %s: ",
+                (unsigned long long)(t / 1000000),
+                (unsigned long long)(t % 1000000), letters[level],
+                currentTaskName(), tag);
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fputc('\n', stderr);
+    }
+}
+
+namespace {
+    struct Pin {
+        uint8_t mode = 0;
+        int level = LOW;
+        void (*isr)() = nullptr;
+        int isrMode = 0;
+        std::function<uint16_t()> analog;
+    };
+
+    Pin pins[sil::board::pinCount];
+    std::minstd_rand randomSource;
+
+    Pin *pinAt(uint8_t pin) {
+        return pin < sil::board::pinCount ? &pins[pin] : nullptr;
+    }
+}
+
+namespace sil::board {
+    void setDigital(uint8_t pin, int level) {
+        Pin *p = pinAt(pin);
+        if (p == nullptr || p->level == level) {
+            return;
+        }
+        p->level = level;
+        bool fire = p->isrMode == CHANGE ||
+                    (p->isrMode == RISING && level == HIGH) ||
+                    (p->isrMode == FALLING && level == LOW);
+        if (p->isr != nullptr && fire) {
+            p->isr();
+        }
+    }
+
+    int digitalOutput(uint8_t pin) {
+        Pin *p = pinAt(pin);
+        return p == nullptr ? LOW : p->level;
+    }
+
+    void setAnalogSource(uint8_t pin, std::function<uint16_t()> source) {
+        Pin *p = pinAt(pin);
+        if (p != nullptr) {
+            p->analog = std::move(source);
+        }
+    }
+}
+
+/** Pins */
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (Pin *p = pinAt(pin)) {
+        p->mode = mode;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (Pin *p = pinAt(pin)) {
+        p->level = value;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    Pin *p = pinAt(pin);
+    return p == nullptr ? LOW : p->level;
+}
+
+uint16_t analogRead(uint8_t pin) {
+    Pin *p = pinAt(pin);
+    return p == nullptr || !p->analog ? 0 : p->analog();
+}
+
+void analogReadResolution(uint8_t) {}
+
+void analogSetAttenuation(adc_attenuation_t) {}
+
+bool adcAttachPin(uint8_t pin) { return pinAt(pin) != nullptr; }
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+    if (Pin *p = pinAt(pin)) {
+        p->isr = isr;
+        p->isrMode = mode;
+    }
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (Pin *p = pinAt(pin)) {
+        p->isr = nullptr;
+    }
+}
+
+/** Time */
+unsigned long millis() { return (unsigned long)(uint32_t)(sil::now() / 1000); }
+
+unsigned long micros() { return (unsigned long)(uint32_t)sil::now(); }
+
+void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+// Too short to be worth a context switch, the caller just spun.
+void delayMicroseconds(uint32_t) { sil::poll(); }
+
+void yield() { sil::poll(); }
+
+/** Math */
+long random(long max) { return max <= 0 ? 0 : (long)(randomSource() % max); }
+
+long random(long min, long max) {
+    return min >= max ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) { randomSource.seed(seed); }
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+/** Serial */
+bool HardwareSerial::attach(const char *path) {
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+    termios settings;
+    if (tcgetattr(fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+    return true;
+}
+
+int HardwareSerial::available() {
+    if (next < 0 && fd >= 0) {
+        uint8_t byte;
+        if (::read(fd, &byte, 1) == 1) {
+            next = byte;
+        }
+    }
+    return next < 0 ? 0 : 1;
+}
+
+int HardwareSerial::read() {
+    if (available() == 0) {
+        return -1;
+    }
+    int byte = next;
+    next = -1;
+    return byte;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length) {
+    if (fd < 0) {
+        return length;
+    }
+    ssize_t n = ::write(fd, data, length);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+size_t HardwareSerial::write(const char *str) {
+    if (sil::serialEnabled) {
+        fputs(str, stdout);
+    }
+    return strlen(str);
+}
+
+size_t HardwareSerial::printf(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    write(buffer);
+    return length < 0 ? 0 : (size_t)length;
+}
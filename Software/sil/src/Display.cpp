@@ -0,0 +1,257 @@
+#include "sil/Display.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "sil/VirtualTime.h"
+
+/**
+ * The panel and the frame capture behind the U8g2 shim.
+ */
+
+namespace {
+    uint8_t drawing[sil::display::bufferSize];
+    uint8_t shown[sil::display::bufferSize];
+    uint32_t sent = 0;
+    uint32_t busHz = 400000;
+
+    bool keep = false;
+    std::vector<sil::display::Frame> captured;
+    std::vector<std::string> names;
+    std::map<std::string, uint16_t> nameIndex;
+    std::vector<uint64_t> drawNanos;
+    std::function<std::string()> screenSource;
+    std::chrono::steady_clock::time_point drawStart;
+
+    uint16_t screenIndex() {
+        std::string name = screenSource ? screenSource() : "";
+        auto found = nameIndex.find(name);
+        if (found != nameIndex.end()) {
+            return found->second;
+        }
+        auto index = (uint16_t)names.size();
+        names.push_back(name);
+        nameIndex.emplace(name, index);
+        return index;
+    }
+
+    // Big endian, as PNG wants it.
+    void put32(std::vector<uint8_t> &out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back((uint8_t)(value >> shift));
+        }
+    }
+
+    uint32_t crc32(const uint8_t *data, size_t length) {
+        static uint32_t table[256];
+        if (table[1] == 0) {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                table[n] = c;
+            }
+        }
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < length; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    void pngChunk(std::vector<uint8_t> &out, const char *type,
+                  const std::vector<uint8_t> &data) {
+        put32(out, (uint32_t)data.size());
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        put32(out, crc32(out.data() + start, out.size() - start));
+    }
+
+    // One row of the frame, leftmost pixel in the top bit.
+    void packRow(const uint8_t *frame, int y, bool litIsOne, uint8_t *row) {
+        for (int x = 0; x < sil::display::width; x += 8) {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                bool lit = sil::display::pixel(frame, x + bit, y);
+                if (lit == litIsOne) {
+                    byte |= (uint8_t)(0x80 >> bit);
+                }
+            }
+            row[x / 8] = byte;
+        }
+    }
+
+    bool writeFile(const std::string &path, const uint8_t *data,
+                   size_t length) {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        size_t written = fwrite(data, 1, length, file);
+        return fclose(file) == 0 && written == length;
+    }
+
+    constexpr int rowBytes = sil::display::width / 8;
+    const char pbmHeader[] = "P4\n128 64\n";
+}
+
+namespace sil::display {
+    uint8_t *buffer() { return drawing; }
+    const uint8_t *panel() { return shown; }
+    uint32_t framesSent() { return sent; }
+
+    void setBusClock(uint32_t hz) { busHz = hz; }
+    uint32_t busClock() { return busHz; }
+
+    void beginDraw() { drawStart = std::chrono::steady_clock::now(); }
+
+    void present() {
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - drawStart)
+                             .count();
+        uint8_t changed = 0;
+        for (int page = 0; page < pages; page++) {
+            if (memcmp(drawing + page * width, shown + page * width, width) !=
+                0) {
+                changed++;
+            }
+        }
+        memcpy(shown, drawing, sizeof(shown));
+        sent++;
+
+        Frame frame{now(), busBytesPerFrame, changed, screenIndex(), {}};
+        if (keep) {
+            frame.pixels.assign(shown, shown + bufferSize);
+        }
+        captured.push_back(std::move(frame));
+        drawNanos.push_back(nanos);
+    }
+
+    void setScreenSource(std::function<std::string()> source) {
+        screenSource = std::move(source);
+    }
+
+    void keepPixels(bool keepThem) { keep = keepThem; }
+
+    const std::vector<Frame> &frames() { return captured; }
+    const std::vector<std::string> &screens() { return names; }
+
+    double ScreenStats::framesPerSecond() const {
+        return micros == 0 ? 0 : intervals * 1e6 / (double)micros;
+    }
+
+    double ScreenStats::bytesPerSecond() const {
+        return frames == 0 ? 0
+                           : framesPerSecond() * (double)busBytes / frames;
+    }
+
+    double ScreenStats::busLoad(uint32_t hz) const {
+        // Eight bits and an acknowledge per byte.
+        return hz == 0 ? 0 : bytesPerSecond() * 9 / hz;
+    }
+
+    std::vector<ScreenStats> screenStats() {
+        std::vector<ScreenStats> stats(names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            stats[i].screen = names[i];
+        }
+        for (size_t i = 0; i < captured.size(); i++) {
+            const Frame &frame = captured[i];
+            ScreenStats &screen = stats[frame.screen];
+            screen.frames++;
+            screen.busBytes += frame.busBytes;
+            screen.changedPages += frame.changedPages;
+            screen.drawNanos += drawNanos[i];
+            if (i > 0 && captured[i - 1].screen == frame.screen) {
+                screen.intervals++;
+                screen.micros += frame.micros - captured[i - 1].micros;
+            }
+        }
+        return stats;
+    }
+
+    bool writePbm(const std::string &path, const uint8_t *frame) {
+        std::vector<uint8_t> out(pbmHeader, pbmHeader + strlen(pbmHeader));
+        size_t start = out.size();
+        out.resize(start + height * rowBytes);
+        for (int y = 0; y < height; y++) {
+            // PBM draws ones black.
+            packRow(frame, y, false, out.data() + start + y * rowBytes);
+        }
+        return writeFile(path, out.data(), out.size());
+    }
+
+    bool writePng(const std::string &path, const uint8_t *frame) {
+        static const uint8_t signature[] = {0x89, 'P',  'N',  'G',
+                                            '\r', '\n', 0x1A, '\n'};
+        std::vector<uint8_t> out(signature, signature + sizeof(signature));
+
+        std::vector<uint8_t> header;
+        put32(header, width);
+        put32(header, height);
+        // 1 bit grayscale, deflate, no interlace.
+        header.insert(header.end(), {1, 0, 0, 0, 0});
+        pngChunk(out, "IHDR", header);
+
+        // Each row is a filter byte and the packed pixels, all of it in one
+        // stored deflate block, which is plenty for 1 kB.
+        std::vector<uint8_t> raw(height * (1 + rowBytes));
+        for (int y = 0; y < height; y++) {
+            packRow(frame, y, true, raw.data() + y * (1 + rowBytes) + 1);
+        }
+        std::vector<uint8_t> zlib = {0x78, 0x01, 0x01};
+        auto length = (uint16_t)raw.size();
+        zlib.insert(zlib.end(),
+                    {(uint8_t)length, (uint8_t)(length >> 8),
+                     (uint8_t)~length, (uint8_t)(~length >> 8)});
+        zlib.insert(zlib.end(), raw.begin(), raw.end());
+        uint32_t a = 1, b = 0;
+        for (uint8_t byte : raw) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        put32(zlib, (b << 16) | a);
+        pngChunk(out, "IDAT", zlib);
+        pngChunk(out, "IEND", {});
+
+        return writeFile(path, out.data(), out.size());
+    }
+
+    bool readPbm(const std::string &path, uint8_t *frame) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        char header[sizeof(pbmHeader) - 1];
+        uint8_t rows[height * rowBytes];
+        bool ok = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+                  memcmp(header, pbmHeader, sizeof(header)) == 0 &&
+                  fread(rows, 1, sizeof(rows), file) == sizeof(rows);
+        fclose(file);
+        if (!ok) {
+            return false;
+        }
+        memset(frame, 0, bufferSize);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                bool black = (rows[y * rowBytes + x / 8] >> (7 - x % 8)) & 1;
+                if (!black) {
+                    frame[(y / 8) * width + x] |= (uint8_t)(1 << (y % 8));
+                }
+            }
+        }
+        return true;
+    }
+
+    uint32_t diff(const uint8_t *a, const uint8_t *b) {
+        uint32_t count = 0;
+        for (size_t i = 0; i < bufferSize; i++) {
+            count += (uint32_t)__builtin_popcount(a[i] ^ b[i]);
+        }
+        return count;
+    }
+}
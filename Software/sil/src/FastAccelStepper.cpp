@@ -0,0 +1,285 @@
+#include "FastAccelStepper.h"
+
+#include <cmath>
+
+#include "Arduino.h"
+#include "sil/Rail.h"
+#include "sil/VirtualTime.h"
+
+namespace sil {
+    Rail &rail() {
+        static Rail instance;
+        return instance;
+    }
+}
+
+namespace {
+    FastAccelStepper theStepper;
+
+    double sign(double x) { return x > 0 ? 1 : x < 0 ? -1 : 0; }
+
+    // Move value towards goal by at most step.
+    double approach(double value, double goal, double step) {
+        if (value < goal) {
+            return value + step > goal ? goal : value + step;
+        }
+        return value - step < goal ? goal : value - step;
+    }
+}
+
+FastAccelStepper &sil::stepper() { return theStepper; }
+
+FastAccelStepper *FastAccelStepperEngine::stepperConnectToPin(uint8_t stepPin) {
+    theStepper.stepPin = stepPin;
+    theStepper.updatedAt = sil::now();
+    return &theStepper;
+}
+
+void FastAccelStepper::setDirectionPin(uint8_t, bool dirHighCountsUp,
+                                       uint16_t) {
+    update();
+    countsUp = dirHighCountsUp;
+}
+
+void FastAccelStepper::setEnablePin(uint8_t pin, bool lowActiveEnablesStepper) {
+    enablePin = pin;
+    enableLowActive = lowActiveEnablesStepper;
+}
+
+void FastAccelStepper::setAutoEnable(bool) {}
+
+bool FastAccelStepper::enableOutputs() {
+    update();
+    digitalWrite(enablePin, enableLowActive ? LOW : HIGH);
+    return true;
+}
+
+bool FastAccelStepper::disableOutputs() {
+    update();
+    digitalWrite(enablePin, enableLowActive ? HIGH : LOW);
+    return true;
+}
+
+int8_t FastAccelStepper::setSpeedInHz(uint32_t speed) {
+    if (speed == 0) {
+        return -1;
+    }
+    pendingSpeedHz = speed;
+    return 0;
+}
+
+int8_t FastAccelStepper::setAcceleration(int32_t stepsPerSecondSquared) {
+    if (stepsPerSecondSquared <= 0) {
+        return -1;
+    }
+    pendingAcceleration = stepsPerSecondSquared;
+    return 0;
+}
+
+void FastAccelStepper::applyPending() {
+    speedHz = pendingSpeedHz;
+    acceleration = pendingAcceleration;
+}
+
+void FastAccelStepper::applySpeedAcceleration() {
+    update();
+    applyPending();
+}
+
+int8_t FastAccelStepper::start(int32_t position, bool blocking) {
+    update();
+    if (pendingSpeedHz <= 0) {
+        return MOVE_ERR_SPEED_IS_UNDEFINED;
+    }
+    if (pendingAcceleration <= 0) {
+        return MOVE_ERR_ACCELERATION_IS_UNDEFINED;
+    }
+    applyPending();
+    target = position;
+    while (blocking && isRunning()) {
+        vTaskDelay(1);
+    }
+    return MOVE_OK;
+}
+
+int8_t FastAccelStepper::move(int32_t steps, bool blocking) {
+    update();
+    return start(target + steps, blocking);
+}
+
+int8_t FastAccelStepper::moveTo(int32_t position, bool blocking) {
+    return start(position, blocking);
+}
+
+void FastAccelStepper::stopMove() {
+    update();
+    if (!queue.empty()) {
+        // Only the ramp generator stops, the queue plays on
+        return;
+    }
+    applyPending();
+    if (acceleration <= 0) {
+        forceStop();
+        return;
+    }
+    double brake = velocity * velocity / (2 * acceleration);
+    target = (int32_t)std::lround(position + sign(velocity) * brake);
+}
+
+void FastAccelStepper::forceStop() {
+    update();
+    queue.clear();
+    velocity = 0;
+    target = (int32_t)std::lround(position);
+    position = target;
+    sil::rail().step(0, false);
+    sil::rail().setSpeed(0);
+}
+
+void FastAccelStepper::forceStopAndNewPosition(int32_t newPosition) {
+    forceStop();
+    position = target = newPosition;
+}
+
+void FastAccelStepper::setCurrentPosition(int32_t newPosition) {
+    update();
+    double shift = newPosition - position;
+    position = newPosition;
+    commandStartPosition += shift;
+    target += (int32_t)std::lround(shift);
+}
+
+bool FastAccelStepper::isEnabled() const {
+    return digitalRead(enablePin) == (enableLowActive ? LOW : HIGH);
+}
+
+int32_t FastAccelStepper::getCurrentPosition() {
+    sil::poll();
+    update();
+    return (int32_t)std::lround(position);
+}
+
+int32_t FastAccelStepper::getCurrentSpeedInMilliHz(bool) {
+    update();
+    return (int32_t)(velocity * 1000);
+}
+
+bool FastAccelStepper::isRunning() {
+    sil::poll();
+    update();
+    return !queue.empty() || velocity != 0 || position != target;
+}
+
+int8_t FastAccelStepper::addQueueEntry(const struct stepper_command_s *cmd,
+                                       bool) {
+    update();
+    if (queue.empty() && (velocity != 0 || position != target)) {
+        // The ramp generator still has the stepper
+        return AQE_DEVICE_NOT_READY;
+    }
+    if (queue.size() >= QUEUE_LEN) {
+        return AQE_QUEUE_FULL;
+    }
+    if (cmd->steps > 0 && cmd->ticks < TICKS_PER_S / 200000) {
+        return AQE_ERROR_TICKS_TOO_LOW;
+    }
+    if (queue.empty()) {
+        commandStartMicros = sil::now();
+        commandStartPosition = position;
+    }
+    queue.push_back(*cmd);
+    return AQE_OK;
+}
+
+uint8_t FastAccelStepper::queueEntries() {
+    sil::poll();
+    update();
+    return (uint8_t)queue.size();
+}
+
+void FastAccelStepper::update() {
+    uint64_t now = sil::now();
+    if (now <= updatedAt) {
+        return;
+    }
+    if (!queue.empty()) {
+        playQueue(now);
+        updatedAt = now;
+        return;
+    }
+    if (velocity == 0 && position == target) {
+        updatedAt = now;
+        return;
+    }
+    while (updatedAt + tickMicros <= now &&
+           (velocity != 0 || position != target)) {
+        integrate(tickMicros * 1e-6);
+        updatedAt += tickMicros;
+    }
+    if (velocity == 0 && position == target) {
+        updatedAt = now;
+        sil::rail().step(0, false);
+        sil::rail().setSpeed(0);
+    }
+}
+
+void FastAccelStepper::playQueue(uint64_t now) {
+    bool enabled = isEnabled();
+    double moved = position;
+    while (!queue.empty()) {
+        const stepper_command_s &command = queue.front();
+        double duration = command.ticks * 1e6 / TICKS_PER_S *
+                          (command.steps > 0 ? command.steps : 1);
+        double steps = command.count_up ? command.steps : -command.steps;
+        double done = (now - commandStartMicros) / duration;
+        if (done < 1) {
+            // Steps at even intervals, so the carriage moves on evenly
+            position = commandStartPosition + std::floor(done * command.steps) *
+                                                  sign(steps);
+            velocity = steps * 1e6 / duration;
+            break;
+        }
+        position = commandStartPosition + steps;
+        commandStartPosition = position;
+        commandStartMicros += duration;
+        queue.pop_front();
+    }
+    if (queue.empty()) {
+        // Ran out, the ramp generator takes over from here
+        velocity = 0;
+        target = (int32_t)std::lround(position);
+    }
+    sil::rail().step(countsUp ? position - moved : moved - position, enabled);
+    sil::rail().setSpeed(enabled ? velocity : 0);
+}
+
+void FastAccelStepper::integrate(double dt) {
+    double distance = target - position;
+    double direction = sign(distance);
+    double dv = acceleration * dt;
+    double brake = velocity * velocity / (2 * acceleration);
+
+    double goal;
+    if (direction == 0 || sign(velocity) == -direction) {
+        goal = 0;
+    } else if (std::fabs(distance) <= brake + std::fabs(velocity) * dt) {
+        goal = 0;
+    } else {
+        goal = direction * speedHz;
+    }
+    double next = approach(velocity, goal, dv);
+    double steps = (velocity + next) * 0.5 * dt;
+    velocity = next;
+
+    // Close enough to stop on the step.
+    if (std::fabs(target - (position + steps)) < 0.5 &&
+        std::fabs(velocity) <= 2 * dv) {
+        steps = target - position;
+        velocity = 0;
+    }
+    position += steps;
+
+    bool enabled = isEnabled();
+    sil::rail().step(countsUp ? steps : -steps, enabled);
+    sil::rail().setSpeed(enabled ? velocity : 0);
+}
@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "AiEsp32RotaryEncoder.h"
+#include "Arduino.h"
+#include "HTTPUpdate.h"
+#include "OneButton.h"
+#include "WiFi.h"
+#include "esp_partition.h"
+#include "sil/Board.h"
+#include "sil/Flash.h"
+#include "sil/VirtualTime.h"
+
+/**
+ * The smaller shims: encoder, button, network, restart and flash.
+ */
+
+WiFiClass WiFi;
+bool sil::wifiConnected = false;
+HTTPUpdate httpUpdate;
+EspClass ESP;
+
+/** AiEsp32RotaryEncoder */
+namespace {
+    // The encoder the firmware set up, which is the one the knob turns.
+    AiEsp32RotaryEncoder *activeEncoder = nullptr;
+}
+
+void AiEsp32RotaryEncoder::begin() { activeEncoder = this; }
+
+void AiEsp32RotaryEncoder::turn(long notches) {
+    if (!enabled) {
+        return;
+    }
+    long next = value + notches;
+    long range = maxValue - minValue + 1;
+    if (circleValues && range > 0) {
+        next = minValue + ((next - minValue) % range + range) % range;
+    }
+    value = next < minValue ? minValue : next > maxValue ? maxValue : next;
+}
+
+void sil::board::turnEncoder(long notches) {
+    if (activeEncoder != nullptr) {
+        activeEncoder->turn(notches);
+    }
+}
+
+/** OneButton */
+void OneButton::tick() {
+    bool pressed = digitalRead(pin) == activeLevel;
+    uint32_t now = millis();
+    uint32_t elapsed = now - startMs;
+
+    switch (state) {
+        case State::Idle:
+            if (pressed) {
+                state = State::Down;
+                startMs = now;
+                clicks = 0;
+            }
+            break;
+
+        case State::Down:
+            if (!pressed && elapsed < debounceMs) {
+                // A bounce, not a click.
+                state = clicks == 0 ? State::Idle : State::Up;
+            } else if (!pressed) {
+                clicks++;
+                state = State::Up;
+                startMs = now;
+            } else if (elapsed > pressMs) {
+                state = State::LongPress;
+                if (onLongPressStart != nullptr) {
+                    onLongPressStart();
+                }
+            }
+            break;
+
+        case State::Up:
+            if (pressed && elapsed > debounceMs) {
+                state = State::Down;
+                startMs = now;
+            } else if (elapsed >= clickMs) {
+                state = State::Count;
+            }
+            break;
+
+        case State::Count:
+            break;
+
+        case State::LongPress:
+            if (!pressed) {
+                state = State::Idle;
+                if (onLongPressStop != nullptr) {
+                    onLongPressStop();
+                }
+            }
+            break;
+    }
+
+    if (state == State::Count) {
+        state = State::Idle;
+        if (clicks == 1 && onClick != nullptr) {
+            onClick();
+        } else if (clicks >= 2 && onDoubleClick != nullptr) {
+            onDoubleClick();
+        }
+    }
+}
+
+/** Esp */
+void EspClass::restart() {
+    ESP_LOGW("sil", "Restart requested, ending the simulation");
+    sil::stop();
+    while (true) {
+        vTaskSuspend(nullptr);
+    }
+}
+
+/** esp_partition */
+namespace {
+    // Offset and size of the coredump partition in partition.csv.
+    const esp_partition_t coredump = {ESP_PARTITION_TYPE_DATA,
+                                      ESP_PARTITION_SUBTYPE_DATA_COREDUMP,
+                                      0x3F0000,
+                                      0x10000,
+                                      "coredump",
+                                      false};
+
+    std::vector<uint8_t> &partitionBytes() {
+        static std::vector<uint8_t> bytes(coredump.size, 0xFF);
+        return bytes;
+    }
+
+    bool inRange(const esp_partition_t *partition, size_t offset,
+                 size_t size) {
+        return partition == &coredump && offset + size <= partition->size;
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+    bool matches = type == coredump.type &&
+                   (subtype == coredump.subtype ||
+                    subtype == ESP_PARTITION_SUBTYPE_ANY) &&
+                   (label == nullptr || strcmp(label, coredump.label) == 0);
+    return matches ? &coredump : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t srcOffset, void *dst, size_t size) {
+    if (!inRange(partition, srcOffset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, partitionBytes().data() + srcOffset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              size_t dstOffset, const void *src, size_t size) {
+    if (!inRange(partition, dstOffset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // NOR flash only clears bits.
+    auto *bytes = (const uint8_t *)src;
+    for (size_t i = 0; i < size; i++) {
+        partitionBytes()[dstOffset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size) {
+    if (!inRange(partition, offset, size) || offset % 4096 != 0 ||
+        size % 4096 != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(partitionBytes().data() + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+namespace sil::flash {
+    bool load(const char *path) {
+        FILE *file = fopen(path, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        std::vector<uint8_t> &bytes = partitionBytes();
+        size_t read = fread(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        return read == bytes.size();
+    }
+
+    bool save(const char *path) {
+        FILE *file = fopen(path, "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        const std::vector<uint8_t> &bytes = partitionBytes();
+        size_t written = fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        return written == bytes.size();
+    }
+}
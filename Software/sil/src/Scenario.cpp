@@ -0,0 +1,290 @@
+#include "Scenario.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "constants/Pins.h"
+#include "ossm/OSSM.h"
+#include "sil/Board.h"
+#include "sil/Display.h"
+#include "sil/Rail.h"
+
+extern OSSM *ossm;
+
+namespace {
+    constexpr uint64_t second = 1000000;
+    // How long a click holds the button down.
+    constexpr uint64_t clickMicros = 100000;
+
+    /**
+     * Seconds, optionally as m:ss or h:mm:ss, with decimals.
+     * @return false if it is not a time.
+     */
+    bool parseTime(const std::string &text, uint64_t &micros) {
+        double total = 0;
+        std::stringstream parts(text);
+        std::string part;
+        int fields = 0;
+        while (std::getline(parts, part, ':')) {
+            char *rest = nullptr;
+            double value = strtod(part.c_str(), &rest);
+            if (part.empty() || *rest != 0 || value < 0) {
+                return false;
+            }
+            total = total * 60 + value;
+            fields++;
+        }
+        if (fields == 0 || fields > 3) {
+            return false;
+        }
+        micros = (uint64_t)(total * second + 0.5);
+        return true;
+    }
+
+    bool parseNumber(const std::string &text, double &value) {
+        char *rest = nullptr;
+        value = strtod(text.c_str(), &rest);
+        return !text.empty() && *rest == 0;
+    }
+
+    void setButton(bool pressed) {
+        sil::board::setDigital(Pins::Remote::encoderSwitch,
+                               pressed ? HIGH : LOW);
+    }
+}
+
+namespace sil {
+    std::string stateName() {
+        std::string name = "none";
+        if (ossm != nullptr) {
+            ossm->sm->visit_current_states(
+                [&name](auto state) { name = state.c_str(); });
+        }
+        return name;
+    }
+
+    bool Scenario::load(const std::string &path, std::string &error) {
+        std::ifstream file(path);
+        if (!file) {
+            error = path + ": cannot open";
+            return false;
+        }
+        name = path;
+        size_t slash = path.rfind('/');
+        directory =
+            slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+        std::string line;
+        int number = 0;
+        while (std::getline(file, line)) {
+            number++;
+            std::string message;
+            if (!parse(line, number, message)) {
+                error = path + ":" + std::to_string(number) + ": " + message;
+                return false;
+            }
+        }
+        if (!explicitEnd) {
+            end = (events.empty() ? 0 : events.rbegin()->first) + second;
+        }
+        return true;
+    }
+
+    bool Scenario::parse(const std::string &line, int number,
+                         std::string &error) {
+        std::vector<std::string> words;
+        std::stringstream stream(line.substr(0, line.find('#')));
+        std::string word;
+        while (stream >> word) {
+            words.push_back(word);
+        }
+        if (words.empty()) {
+            return true;
+        }
+
+        // "+2.5" is relative to the command before.
+        uint64_t at;
+        bool relative = words[0][0] == '+';
+        if (words.size() < 2 ||
+            !parseTime(relative ? words[0].substr(1) : words[0], at)) {
+            error = "expected <time> <command>";
+            return false;
+        }
+        if (relative) {
+            at += previous;
+        }
+        previous = at;
+
+        const std::string &command = words[1];
+        auto argument = [&](size_t index, double &value) {
+            return words.size() > index && parseNumber(words[index], value);
+        };
+        // "over <seconds>" after the value makes a ramp.
+        auto rampDuration = [&](uint64_t &duration) {
+            duration = 0;
+            if (words.size() == 3) {
+                return true;
+            }
+            return words.size() == 5 && words[3] == "over" &&
+                   parseTime(words[4], duration);
+        };
+
+        double value;
+        uint64_t duration;
+        if (command == "rail") {
+            double start;
+            if (at != 0 || !argument(2, value)) {
+                error = "rail <travel mm> [start mm] only at time 0";
+                return false;
+            }
+            rail().travelMm = (float)value;
+            rail().startMm =
+                argument(3, start) ? (float)start : (float)value / 2;
+        } else if (command == "press" || command == "release") {
+            bool pressed = command == "press";
+            schedule(at, number, [pressed](uint64_t) { setButton(pressed); });
+        } else if (command == "click") {
+            schedule(at, number, [](uint64_t) { setButton(true); });
+            schedule(at + clickMicros, number,
+                     [](uint64_t) { setButton(false); });
+        } else if (command == "doubleclick") {
+            for (uint64_t offset : {(uint64_t)0, 2 * clickMicros}) {
+                schedule(at + offset, number,
+                         [](uint64_t) { setButton(true); });
+                schedule(at + offset + clickMicros, number,
+                         [](uint64_t) { setButton(false); });
+            }
+        } else if (command == "hold") {
+            if (!argument(2, value) || value <= 0) {
+                error = "hold <seconds>";
+                return false;
+            }
+            schedule(at, number, [](uint64_t) { setButton(true); });
+            schedule(at + (uint64_t)(value * second), number,
+                     [](uint64_t) { setButton(false); });
+        } else if (command == "turn") {
+            if (!argument(2, value)) {
+                error = "turn <notches>";
+                return false;
+            }
+            long notches = (long)value;
+            schedule(at, number,
+                     [notches](uint64_t) { board::turnEncoder(notches); });
+        } else if (command == "knob" || command == "current") {
+            if (!argument(2, value) || !rampDuration(duration)) {
+                error = command + " <value> [over <time>]";
+                return false;
+            }
+            Ramp &ramp = command == "knob" ? knob : current;
+            schedule(at, number, [&ramp, value, duration](uint64_t now) {
+                ramp.moveTo(value, now, duration);
+            });
+        } else if (command == "expect" && words.size() >= 3) {
+            const std::string &what = words[2];
+            std::string expected = words.size() > 3 ? words[3] : "";
+            if (what == "state" && words.size() == 4) {
+                schedule(at, number, [this, number, expected](uint64_t) {
+                    std::string state = stateName();
+                    expect(number, state == expected,
+                           "state " + expected + ", is " + state);
+                });
+            } else if (what == "motor" &&
+                       (expected == "on" || expected == "off")) {
+                schedule(at, number, [this, number, expected](uint64_t) {
+                    bool on = sil::stepper().isEnabled();
+                    expect(number, on == (expected == "on"),
+                           "motor " + expected);
+                });
+            } else if (what == "stopped" || what == "moving") {
+                schedule(at, number, [this, number, what](uint64_t) {
+                    bool moving = sil::stepper().isRunning();
+                    expect(number, moving == (what == "moving"), what);
+                });
+            } else if (what == "frame" && words.size() <= 5) {
+                double tolerance = 0;
+                if (words.size() == 5 && !argument(4, tolerance)) {
+                    error = "expect frame <file.pbm> [pixels]";
+                    return false;
+                }
+                std::string path = pathOf(expected);
+                schedule(at, number,
+                         [this, number, path, tolerance](uint64_t) {
+                             expectFrame(number, path, (uint32_t)tolerance);
+                         });
+            } else {
+                error =
+                    "expect state <name> | motor on|off | stopped | moving | "
+                    "frame <file.pbm> [pixels]";
+                return false;
+            }
+        } else if (command == "snapshot" && words.size() == 3) {
+            std::string path = pathOf(words[2]);
+            bool png =
+                path.size() > 4 && path.substr(path.size() - 4) == ".png";
+            schedule(at, number, [this, number, path, png](uint64_t) {
+                bool ok = png ? display::writePng(path, display::panel())
+                              : display::writePbm(path, display::panel());
+                expect(number, ok, "to write " + path);
+            });
+        } else if (command == "end") {
+            end = at;
+            explicitEnd = true;
+        } else {
+            error = "unknown command \"" + command + "\"";
+            return false;
+        }
+        return true;
+    }
+
+    void Scenario::schedule(uint64_t at, int line,
+                            std::function<void(uint64_t)> action) {
+        events.emplace(at, Event{line, std::move(action)});
+    }
+
+    void Scenario::expect(int line, bool ok, const std::string &what) {
+        if (ok) {
+            return;
+        }
+        failed++;
+        uint64_t t = now();
+        fprintf(stderr, "%s:%d: at %llu.%03llus expected %s\n", name.c_str(),
+                line, (unsigned long long)(t / second),
+                (unsigned long long)(t % second / 1000), what.c_str());
+    }
+
+    void Scenario::expectFrame(int line, const std::string &path,
+                               uint32_t tolerance) {
+        if (updateFrames) {
+            expect(line, display::writePbm(path, display::panel()),
+                   "to write " + path);
+            return;
+        }
+        uint8_t golden[display::bufferSize];
+        if (!display::readPbm(path, golden)) {
+            expect(line, false, "a 128x64 PBM in " + path);
+            return;
+        }
+        uint32_t pixels = display::diff(golden, display::panel());
+        expect(line, pixels <= tolerance,
+               "frame " + path + ", " + std::to_string(pixels) +
+                   " pixels differ");
+    }
+
+    std::string Scenario::pathOf(const std::string &file) const {
+        return file[0] == '/' ? file : directory + file;
+    }
+
+    uint64_t Scenario::nextEventMicros() const {
+        return events.empty() ? never : events.begin()->first;
+    }
+
+    void Scenario::fire(uint64_t nowMicros) {
+        while (!events.empty() && events.begin()->first <= nowMicros) {
+            Event event = std::move(events.begin()->second);
+            events.erase(events.begin());
+            event.action(nowMicros);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef OSSM_SIL_SCENARIO_H
+#define OSSM_SIL_SCENARIO_H
+
+#include <functional>
+#include <map>
+#include <string>
+
+#include "sil/VirtualTime.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Scenario
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * A script of what the user and the machine do, one timed command per line.
+ * See sil/README.md for the commands.
+ */
+namespace sil {
+    // A value that moves linearly between two set points.
+    struct Ramp {
+        double from = 0;
+        double to = 0;
+        uint64_t startMicros = 0;
+        uint64_t endMicros = 0;
+
+        double at(uint64_t t) const {
+            if (t >= endMicros) {
+                return to;
+            }
+            if (t <= startMicros) {
+                return from;
+            }
+            return from + (to - from) * (double)(t - startMicros) /
+                              (double)(endMicros - startMicros);
+        }
+
+        void moveTo(double value, uint64_t now, uint64_t duration) {
+            from = at(now);
+            to = value;
+            startMicros = now;
+            endMicros = now + duration;
+        }
+    };
+
+    // The state machine state, "none" before the firmware made it.
+    std::string stateName();
+
+    class Scenario : public Stimulus {
+      public:
+        /**
+         * @param error set to "file:line: message" on failure.
+         * @return false if the script does not parse.
+         */
+        bool load(const std::string &path, std::string &error);
+
+        uint64_t nextEventMicros() const override;
+        void fire(uint64_t nowMicros) override;
+
+        // When the script ends, either by "end" or one second after the
+        // last command.
+        uint64_t endMicros() const { return end; }
+        int failures() const { return failed; }
+
+        // Write the panel to the files of "expect frame" instead of checking.
+        bool updateFrames = false;
+
+        // Speed knob in percent.
+        Ramp knob;
+        // Extra current sensor counts.
+        Ramp current;
+
+      private:
+        struct Event {
+            int line;
+            std::function<void(uint64_t)> action;
+        };
+
+        bool parse(const std::string &line, int number, std::string &error);
+        void schedule(uint64_t at, int line,
+                      std::function<void(uint64_t)> action);
+        void expect(int line, bool ok, const std::string &what);
+        void expectFrame(int line, const std::string &path,
+                         uint32_t tolerance);
+
+        std::multimap<uint64_t, Event> events;
+        // Files named in the script are relative to it.
+        std::string pathOf(const std::string &file) const;
+
+        std::string name;
+        std::string directory;
+        uint64_t previous = 0;
+        uint64_t end = 0;
+        bool explicitEnd = false;
+        int failed = 0;
+    };
+}
+
+#endif  // OSSM_SIL_SCENARIO_H
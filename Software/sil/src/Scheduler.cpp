@@ -0,0 +1,553 @@
+#include <setjmp.h>
+#include <ucontext.h>
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "sil/VirtualTime.h"
+
+/**
+ * Cooperative FreeRTOS on virtual time.
+ *
+ * Each task runs on its own stack. makecontext() starts it, after that the
+ * scheduler and the tasks switch with _setjmp/_longjmp, which skip the signal
+ * mask syscall of swapcontext() and keep a switch in the tens of nanoseconds.
+ *
+ * Scheduling follows FreeRTOS: the highest priority ready task runs, equal
+ * priorities take turns. A task keeps the CPU until it blocks, or until it
+ * wakes a higher priority task, which then runs first.
+ */
+
+namespace {
+    constexpr size_t stackBytes = 512 * 1024;
+    // Busy polls in a row before the poller is put to sleep, and for how long.
+    constexpr uint32_t pollsBeforeSleep = 64;
+    constexpr uint64_t pollSleepMicros = 50;
+
+    struct TaskDeleted {};
+}
+
+struct tskTaskControlBlock {
+    enum class State { Ready, Blocked, Suspended, Deleted };
+
+    std::string name;
+    TaskFunction_t function;
+    void *parameters;
+    UBaseType_t priority;
+    uint32_t stackDepth;
+
+    State state = State::Ready;
+    bool started = false;
+    bool deleteRequested = false;
+    bool timedOut = false;
+    uint64_t wakeAt = sil::never;
+    uint64_t lastRun = 0;
+    uint32_t polls = 0;
+
+    uint32_t notifications = 0;
+    bool waitingForNotification = false;
+    SemaphoreHandle_t waitingFor = nullptr;
+
+    char *stack = nullptr;
+    ucontext_t start{};
+    jmp_buf context{};
+};
+
+struct QueueDefinition {
+    enum class Kind { Binary, Mutex, Recursive };
+
+    Kind kind;
+    uint32_t count;
+    TaskHandle_t holder = nullptr;
+    uint32_t depth = 0;
+};
+
+namespace {
+    using State = tskTaskControlBlock::State;
+
+    struct Scheduler {
+        uint64_t now = 0;
+        uint64_t runs = 0;
+        uint64_t switches = 0;
+        uint32_t created = 0;
+        bool stopRequested = false;
+        bool realtime = false;
+        double rate = 1;
+        uint64_t wallStart = 0;
+        TaskHandle_t current = nullptr;
+        std::vector<TaskHandle_t> tasks;
+        std::vector<sil::Stimulus *> stimuli;
+        jmp_buf context{};
+    };
+
+    Scheduler &scheduler() {
+        static Scheduler instance;
+        return instance;
+    }
+
+    uint64_t ticksToMicros(TickType_t ticks) {
+        return (uint64_t)ticks * 1000000 / configTICK_RATE_HZ;
+    }
+
+    TaskHandle_t self() {
+        TaskHandle_t task = scheduler().current;
+        if (task == nullptr) {
+            fprintf(stderr, "sil: blocking FreeRTOS call outside a task\n");
+            abort();
+        }
+        return task;
+    }
+
+    // Hand the CPU back to the scheduler. Returns when this task runs again.
+    void switchOut() {
+        TaskHandle_t task = self();
+        task->polls = 0;
+        if (_setjmp(task->context) == 0) {
+            _longjmp(scheduler().context, 1);
+        }
+        if (task->deleteRequested) {
+            throw TaskDeleted{};
+        }
+    }
+
+    void block(uint64_t wakeAt) {
+        TaskHandle_t task = self();
+        task->state = State::Blocked;
+        task->wakeAt = wakeAt;
+        task->timedOut = false;
+        switchOut();
+    }
+
+    uint64_t deadline(TickType_t ticksToWait) {
+        return ticksToWait == portMAX_DELAY
+                   ? sil::never
+                   : scheduler().now + ticksToMicros(ticksToWait);
+    }
+
+    void makeReady(TaskHandle_t task) {
+        if (task->state == State::Blocked) {
+            task->state = State::Ready;
+            task->wakeAt = sil::never;
+        }
+    }
+
+    // Let a higher priority task that was just woken run first.
+    void preempt() {
+        TaskHandle_t task = scheduler().current;
+        if (task == nullptr) {
+            return;
+        }
+        for (TaskHandle_t other : scheduler().tasks) {
+            if (other->state == State::Ready &&
+                other->priority > task->priority) {
+                switchOut();
+                return;
+            }
+        }
+    }
+
+    void entry() {
+        TaskHandle_t task = scheduler().current;
+        try {
+            task->function(task->parameters);
+        } catch (const TaskDeleted &) {
+        }
+        task->state = State::Deleted;
+        _longjmp(scheduler().context, 1);
+    }
+
+    TaskHandle_t pickReady() {
+        TaskHandle_t best = nullptr;
+        for (TaskHandle_t task : scheduler().tasks) {
+            if (task->state != State::Ready) {
+                continue;
+            }
+            if (best == nullptr || task->priority > best->priority ||
+                (task->priority == best->priority &&
+                 task->lastRun < best->lastRun)) {
+                best = task;
+            }
+        }
+        return best;
+    }
+
+    void resume(TaskHandle_t task) {
+        Scheduler &s = scheduler();
+        s.current = task;
+        task->lastRun = ++s.runs;
+        s.switches++;
+        if (_setjmp(s.context) == 0) {
+            if (!task->started) {
+                task->started = true;
+                setcontext(&task->start);
+            }
+            _longjmp(task->context, 1);
+        }
+        s.current = nullptr;
+
+        if (task->state == State::Deleted) {
+            free(task->stack);
+            task->stack = nullptr;
+            // Handles stay valid, like the firmware expects of a dead task.
+            s.tasks.erase(std::find(s.tasks.begin(), s.tasks.end(), task));
+        }
+    }
+
+    uint64_t wallMicros() {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+    }
+
+    // Sleep until the wall clock catches up with virtual time. Returns the
+    // virtual time it is by then, later if the host fell behind.
+    uint64_t waitFor(uint64_t virtualMicros) {
+        Scheduler &s = scheduler();
+        uint64_t due = s.wallStart + uint64_t(virtualMicros / s.rate);
+        uint64_t wall = wallMicros();
+        if (wall < due) {
+            timespec delay = {time_t((due - wall) / 1000000),
+                              long((due - wall) % 1000000 * 1000)};
+            nanosleep(&delay, nullptr);
+            wall = wallMicros();
+        }
+        return std::max(virtualMicros,
+                        uint64_t(double(wall - s.wallStart) * s.rate));
+    }
+
+    // Nothing can run, move the clock to the next thing that happens.
+    bool advance(uint64_t until) {
+        Scheduler &s = scheduler();
+        uint64_t next = sil::never;
+        for (TaskHandle_t task : s.tasks) {
+            if (task->state == State::Blocked) {
+                next = std::min(next, task->wakeAt);
+            }
+        }
+        for (sil::Stimulus *stimulus : s.stimuli) {
+            next = std::min(next, stimulus->nextEventMicros());
+        }
+        if (next > until) {
+            if (until != sil::never) {
+                s.now = until;
+            }
+            return false;
+        }
+
+        s.now = std::max(s.now, next);
+        if (s.realtime) {
+            s.now = std::min(waitFor(s.now), until);
+        }
+        for (sil::Stimulus *stimulus : s.stimuli) {
+            while (stimulus->nextEventMicros() <= s.now) {
+                stimulus->fire(s.now);
+            }
+        }
+        for (TaskHandle_t task : s.tasks) {
+            if (task->state == State::Blocked && task->wakeAt <= s.now) {
+                makeReady(task);
+                task->timedOut = true;
+            }
+        }
+        return true;
+    }
+
+    TaskHandle_t orSelf(TaskHandle_t task) {
+        return task == nullptr ? self() : task;
+    }
+}
+
+namespace sil {
+    uint64_t now() { return scheduler().now; }
+
+    void addStimulus(Stimulus *stimulus) {
+        scheduler().stimuli.push_back(stimulus);
+    }
+
+    RunResult run(uint64_t untilMicros) {
+        Scheduler &s = scheduler();
+        s.stopRequested = false;
+        while (!s.stopRequested) {
+            TaskHandle_t task = pickReady();
+            if (task != nullptr) {
+                resume(task);
+                continue;
+            }
+            if (!advance(untilMicros)) {
+                return s.now >= untilMicros ? RunResult::TimeLimit
+                                            : RunResult::Deadlock;
+            }
+        }
+        return RunResult::Stopped;
+    }
+
+    void stop() { scheduler().stopRequested = true; }
+
+    void setRealtime(double driftPpm) {
+        Scheduler &s = scheduler();
+        s.realtime = true;
+        s.rate = 1 + driftPpm * 1e-6;
+        s.wallStart = wallMicros() - uint64_t(s.now / s.rate);
+    }
+
+    uint64_t trueMicros(uint64_t virtualMicros) {
+        Scheduler &s = scheduler();
+        return s.wallStart + uint64_t(virtualMicros / s.rate);
+    }
+
+    void poll() {
+        TaskHandle_t task = scheduler().current;
+        if (task != nullptr && ++task->polls > pollsBeforeSleep) {
+            block(scheduler().now + pollSleepMicros);
+        }
+    }
+
+    const char *currentTaskName() {
+        TaskHandle_t task = scheduler().current;
+        return task == nullptr ? "isr" : task->name.c_str();
+    }
+
+    SchedulerStats schedulerStats() {
+        Scheduler &s = scheduler();
+        return {s.switches, s.created, (uint32_t)s.tasks.size()};
+    }
+}
+
+/** Tasks */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name,
+                                   uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created,
+                                   BaseType_t) {
+    auto *task = new tskTaskControlBlock{};
+    task->name = name;
+    task->function = function;
+    task->parameters = parameters;
+    task->priority = std::min<UBaseType_t>(priority, configMAX_PRIORITIES - 1);
+    task->stackDepth = stackDepth;
+    task->stack = (char *)malloc(stackBytes);
+
+    getcontext(&task->start);
+    task->start.uc_stack.ss_sp = task->stack;
+    task->start.uc_stack.ss_size = stackBytes;
+    task->start.uc_link = nullptr;
+    makecontext(&task->start, entry, 0);
+
+    scheduler().tasks.push_back(task);
+    scheduler().created++;
+    if (created != nullptr) {
+        *created = task;
+    }
+    preempt();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name,
+                       uint32_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *created) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameters,
+                                   priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    task = orSelf(task);
+    if (task->state == State::Deleted) {
+        return;
+    }
+    if (task == scheduler().current) {
+        throw TaskDeleted{};
+    }
+    if (!task->started) {
+        task->state = State::Deleted;
+        free(task->stack);
+        task->stack = nullptr;
+        auto &tasks = scheduler().tasks;
+        tasks.erase(std::find(tasks.begin(), tasks.end(), task));
+        return;
+    }
+    // Unwind its stack the next time it runs.
+    task->deleteRequested = true;
+    task->state = State::Ready;
+}
+
+void vTaskDelay(TickType_t ticks) { block(scheduler().now + ticksToMicros(ticks)); }
+
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t increment) {
+    *previousWakeTime += increment;
+    uint64_t wakeAt = ticksToMicros(*previousWakeTime);
+    if (wakeAt <= scheduler().now) {
+        // Already late, just give the others a turn.
+        wakeAt = scheduler().now;
+    }
+    block(wakeAt);
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+    task = orSelf(task);
+    task->state = State::Suspended;
+    if (task == scheduler().current) {
+        switchOut();
+    }
+}
+
+void vTaskResume(TaskHandle_t task) {
+    if (task->state == State::Suspended) {
+        task->state = State::Ready;
+        preempt();
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return scheduler().current; }
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(scheduler().now * configTICK_RATE_HZ / 1000000);
+}
+
+// Host stack frames have nothing in common with the ESP32 ones, so report the
+// size the task asked for.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return orSelf(task)->stackDepth;
+}
+
+/** Direct to task notifications */
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    TaskHandle_t task = self();
+    if (task->notifications == 0 && ticksToWait > 0) {
+        task->waitingForNotification = true;
+        block(deadline(ticksToWait));
+        task->waitingForNotification = false;
+    }
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+static bool notify(TaskHandle_t task) {
+    task->notifications++;
+    if (task->waitingForNotification && task->state == State::Blocked) {
+        makeReady(task);
+        return true;
+    }
+    return false;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (notify(task)) {
+        preempt();
+    }
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task,
+                            BaseType_t *higherPriorityTaskWoken) {
+    if (task == nullptr) {
+        return;
+    }
+    bool woken = notify(task);
+    if (higherPriorityTaskWoken != nullptr && woken) {
+        *higherPriorityTaskWoken = pdTRUE;
+    }
+}
+
+/** Semaphores and mutexes */
+static SemaphoreHandle_t createSemaphore(QueueDefinition::Kind kind,
+                                         uint32_t count) {
+    auto *semaphore = new QueueDefinition{};
+    semaphore->kind = kind;
+    semaphore->count = count;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return createSemaphore(QueueDefinition::Kind::Binary, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return createSemaphore(QueueDefinition::Kind::Mutex, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    return createSemaphore(QueueDefinition::Kind::Recursive, 1);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+
+static BaseType_t take(SemaphoreHandle_t semaphore, TickType_t ticksToWait,
+                       bool recursive) {
+    // Static constructors may lock before the first task exists.
+    TaskHandle_t task = scheduler().current;
+    uint64_t wakeAt = deadline(ticksToWait);
+
+    while (true) {
+        if (recursive && semaphore->holder == task && semaphore->depth > 0) {
+            semaphore->depth++;
+            return pdTRUE;
+        }
+        if (semaphore->count > 0) {
+            semaphore->count--;
+            semaphore->holder = task;
+            semaphore->depth = 1;
+            return pdTRUE;
+        }
+        if (ticksToWait == 0 || task == nullptr ||
+            scheduler().now >= wakeAt) {
+            return pdFALSE;
+        }
+        task->waitingFor = semaphore;
+        block(wakeAt);
+        task->waitingFor = nullptr;
+    }
+}
+
+static BaseType_t give(SemaphoreHandle_t semaphore, bool recursive) {
+    if (semaphore->kind != QueueDefinition::Kind::Binary &&
+        semaphore->holder != scheduler().current) {
+        return pdFALSE;
+    }
+    if (recursive && --semaphore->depth > 0) {
+        return pdTRUE;
+    }
+    if (semaphore->kind == QueueDefinition::Kind::Binary &&
+        semaphore->count > 0) {
+        return pdFALSE;
+    }
+    semaphore->count++;
+    semaphore->holder = nullptr;
+    semaphore->depth = 0;
+
+    bool woken = false;
+    for (TaskHandle_t task : scheduler().tasks) {
+        if (task->waitingFor == semaphore && task->state == State::Blocked) {
+            makeReady(task);
+            woken = true;
+        }
+    }
+    if (woken) {
+        preempt();
+    }
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+    return take(semaphore, ticksToWait, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return give(semaphore, false);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore,
+                                   TickType_t ticksToWait) {
+    return take(semaphore, ticksToWait, true);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    return give(semaphore, true);
+}
@@ -0,0 +1,258 @@
+#include <cstring>
+#include <utility>
+
+#include "U8g2lib.h"
+#include "sil/Display.h"
+
+const u8g2_cb_t u8g2_cb_r0 = {0};
+
+const uint8_t u8g2_font_helvB08_tf[] = {1, 1};
+const uint8_t u8g2_font_helvR08_tf[] = {1, 0};
+const uint8_t u8g2_font_6x10_tf[] = {1, 0};
+const uint8_t u8g2_font_maniac_tf[] = {3, 1};
+
+namespace {
+    constexpr int glyphWidth = 5;
+    constexpr int glyphHeight = 7;
+
+    // Printable ASCII, 5 columns per glyph, top pixel in bit 0.
+    const uint8_t glyphs[95][glyphWidth] = {
+        {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00},
+        {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+        {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+        {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+        {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00},
+        {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+        {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},
+        {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+        {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+        {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},
+        {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},
+        {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+        {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E},
+        {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+        {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+        {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},
+        {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E},
+        {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+        {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41},
+        {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},
+        {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+        {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+        {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F},
+        {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+        {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E},
+        {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+        {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+        {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+        {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07},
+        {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+        {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00},
+        {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+        {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+        {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},
+        {0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18},
+        {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},
+        {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00},
+        {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},
+        {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+        {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+        {0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C},
+        {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+        {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C},
+        {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},
+        {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},
+        {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+        {0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},
+        {0x10, 0x08, 0x08, 0x10, 0x08},
+    };
+
+    // Next code point of a UTF-8 string, anything outside ASCII draws as '?'.
+    char nextGlyph(const char *&str) {
+        auto c = (unsigned char)*str++;
+        if (c < 0x80) {
+            return c >= 0x20 && c < 0x7F ? (char)c : '?';
+        }
+        while (((unsigned char)*str & 0xC0) == 0x80) {
+            str++;
+        }
+        return '?';
+    }
+}
+
+void U8G2::setBusClock(uint32_t hz) { sil::display::setBusClock(hz); }
+
+void U8G2::clearBuffer() {
+    memset(sil::display::buffer(), 0, sil::display::bufferSize);
+    sil::display::beginDraw();
+}
+
+void U8G2::sendBuffer() { sil::display::present(); }
+
+int U8G2::scale() const { return font == nullptr ? 1 : font[0]; }
+
+bool U8G2::bold() const { return font != nullptr && font[1] != 0; }
+
+void U8G2::plot(int x, int y) {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+        return;
+    }
+    uint8_t &byte = sil::display::buffer()[(y / 8) * width + x];
+    auto bit = (uint8_t)(1 << (y % 8));
+    switch (drawColor) {
+        case 0:
+            byte &= (uint8_t)~bit;
+            break;
+        case 2:
+            byte ^= bit;
+            break;
+        default:
+            byte |= bit;
+            break;
+    }
+}
+
+void U8G2::drawPixel(u8g2_uint_t x, u8g2_uint_t y) { plot(x, y); }
+
+void U8G2::drawHLine(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w) {
+    for (int i = 0; i < w; i++) {
+        plot(x + i, y);
+    }
+}
+
+void U8G2::drawVLine(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t h) {
+    for (int i = 0; i < h; i++) {
+        plot(x, y + i);
+    }
+}
+
+void U8G2::drawLine(u8g2_uint_t x1, u8g2_uint_t y1, u8g2_uint_t x2,
+                    u8g2_uint_t y2) {
+    int x = x1, y = y1;
+    int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int dy = y2 > y1 ? -(y2 - y1) : -(y1 - y2);
+    int sx = x1 < x2 ? 1 : -1;
+    int sy = y1 < y2 ? 1 : -1;
+    int error = dx + dy;
+    while (true) {
+        plot(x, y);
+        if (x == x2 && y == y2) {
+            break;
+        }
+        int e2 = 2 * error;
+        if (e2 >= dy) {
+            error += dy;
+            x += sx;
+        }
+        if (e2 <= dx) {
+            error += dx;
+            y += sy;
+        }
+    }
+}
+
+void U8G2::drawBox(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w,
+                   u8g2_uint_t h) {
+    for (int i = 0; i < h; i++) {
+        drawHLine(x, y + i, w);
+    }
+}
+
+void U8G2::drawFrame(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w,
+                     u8g2_uint_t h) {
+    if (w == 0 || h == 0) {
+        return;
+    }
+    drawHLine(x, y, w);
+    drawHLine(x, y + h - 1, w);
+    drawVLine(x, y, h);
+    drawVLine(x + w - 1, y, h);
+}
+
+void U8G2::drawRFrame(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w,
+                      u8g2_uint_t h, u8g2_uint_t r) {
+    if (2 * r + 2 > w || 2 * r + 2 > h) {
+        drawFrame(x, y, w, h);
+        return;
+    }
+    drawHLine(x + r, y, w - 2 * r);
+    drawHLine(x + r, y + h - 1, w - 2 * r);
+    drawVLine(x, y + r, h - 2 * r);
+    drawVLine(x + w - 1, y + r, h - 2 * r);
+
+    // Midpoint circle, one quarter in each corner.
+    int left = x + r, right = x + w - 1 - r;
+    int top = y + r, bottom = y + h - 1 - r;
+    int cx = r, cy = 0, error = 1 - r;
+    while (cx >= cy) {
+        for (auto [px, py] : {std::pair<int, int>{cx, cy}, {cy, cx}}) {
+            plot(right + px, top - py);
+            plot(left - px, top - py);
+            plot(right + px, bottom + py);
+            plot(left - px, bottom + py);
+        }
+        cy++;
+        if (error < 0) {
+            error += 2 * cy + 1;
+        } else {
+            cx--;
+            error += 2 * (cy - cx) + 1;
+        }
+    }
+}
+
+void U8G2::drawXBMP(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w,
+                    u8g2_uint_t h, const uint8_t *bitmap) {
+    int stride = (w + 7) / 8;
+    for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+            if ((bitmap[row * stride + col / 8] >> (col % 8)) & 1) {
+                plot(x + col, y + row);
+            }
+        }
+    }
+}
+
+u8g2_uint_t U8G2::drawStr(u8g2_uint_t x, u8g2_uint_t y, const char *str) {
+    return drawUTF8(x, y, str);
+}
+
+u8g2_uint_t U8G2::drawUTF8(u8g2_uint_t x, u8g2_uint_t y, const char *str) {
+    int s = scale();
+    int advance = (glyphWidth + 1 + (bold() ? 1 : 0)) * s;
+    // y is the baseline, the glyph sits right above it.
+    int top = y - glyphHeight * s;
+    int left = x;
+
+    while (*str != 0) {
+        const uint8_t *glyph = glyphs[nextGlyph(str) - 0x20];
+        for (int col = 0; col < glyphWidth; col++) {
+            for (int row = 0; row < glyphHeight; row++) {
+                if (((glyph[col] >> row) & 1) == 0) {
+                    continue;
+                }
+                for (int i = 0; i < s * (bold() ? 2 : 1); i++) {
+                    for (int j = 0; j < s; j++) {
+                        plot(left + col * s + i, top + row * s + j);
+                    }
+                }
+            }
+        }
+        left += advance;
+    }
+    return (u8g2_uint_t)(left - x);
+}
+
+u8g2_uint_t U8G2::getStrWidth(const char *str) const {
+    return getUTF8Width(str);
+}
+
+u8g2_uint_t U8G2::getUTF8Width(const char *str) const {
+    int count = 0;
+    while (*str != 0) {
+        nextGlyph(str);
+        count++;
+    }
+    return (u8g2_uint_t)(count * (glyphWidth + 1 + (bold() ? 1 : 0)) *
+                         scale());
+}
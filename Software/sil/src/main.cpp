@@ -0,0 +1,333 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Arduino.h"
+#include "Scenario.h"
+#include "constants/Pins.h"
+#include "services/metrics.h"
+#include "services/servo.h"
+#include "services/sync.h"
+#include "services/telemetry.h"
+#include "sil/Board.h"
+#include "sil/Display.h"
+#include "sil/Flash.h"
+#include "sil/Rail.h"
+#include "sil/VirtualTime.h"
+#include "utils/Metrics.h"
+#include "utils/MetricsServer.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Software in the Loop
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Runs the complete firmware on the host against the shims in sil/include,
+ * driven by a scenario script. See sil/README.md.
+ */
+
+// From src/main.cpp.
+void setup();
+void loop();
+
+namespace sil {
+    extern bool serialEnabled;
+}
+
+static const char *usage =
+    "usage: sil [options] <scenario>\n"
+    "  --log <E|W|I|D|V>   firmware log level, W by default\n"
+    "  --serial            print Serial output\n"
+    "  --flash <file>      load and save the coredump partition\n"
+    "  --metrics           print the Prometheus metrics at the end\n"
+    "  --metrics-port <port>\n"
+    "                      put WiFi up and serve /metrics on <port>\n"
+    "  --telemetry-port <port>\n"
+    "                      put WiFi up and stream telemetry on <port>\n"
+    "  --frames <dir>      write every frame to <dir> as PNG\n"
+    "  --display-stats     print frame rate and bus bytes per screen\n"
+    "  --update-frames     rewrite the files of \"expect frame\"\n"
+    "  --realtime          run in step with the wall clock\n"
+    "  --clock-drift <ppm> with --realtime, the clock runs this much fast\n"
+    "  --sync <role>       leader or follower of synchronized playback\n"
+    "  --sync-port <port>  UDP port of the leader, 7878 by default\n"
+    "  --sync-leader <ip>  address of the leader, broadcast by default\n"
+    "  --sync-offset <us>  phase offset of a follower\n"
+    "  --servo <tty>       poll a servo drive on <tty>, e.g. of servomock\n"
+    "  --servo-model <name>\n"
+    "                      ihsv57 (default) or 57aim\n"
+    "  --position-trace <file>\n"
+    "                      write host time and carriage position every ms\n";
+
+// The Arduino core runs setup() and loop() in a task of its own.
+static void loopTask(void *) {
+    setup();
+    while (true) {
+        loop();
+        // loop() spins on the device, a tick is plenty for OneButton.
+        vTaskDelay(1);
+    }
+}
+
+static bool parseLogLevel(const char *level) {
+    static const char letters[] = "NEWIDV";
+    const char *found = strchr(letters, level[0]);
+    if (found == nullptr || level[0] == 0 || level[1] != 0) {
+        return false;
+    }
+    sil::logLevel = (esp_log_level_t)(found - letters);
+    return true;
+}
+
+/**
+ * Where the carriage is, every millisecond, against the host's monotonic
+ * clock, so the traces of several SIL processes line up. For tools/syncbench.
+ */
+class PositionTrace : public sil::Stimulus {
+  public:
+    explicit PositionTrace(FILE *file) : file(file) {}
+
+    uint64_t nextEventMicros() const override { return next; }
+
+    void fire(uint64_t nowMicros) override {
+        fprintf(file, "%llu %.3f\n",
+                (unsigned long long)sil::trueMicros(nowMicros),
+                sil::rail().position());
+        next = nowMicros + 1000;
+    }
+
+  private:
+    FILE *file;
+    uint64_t next = 0;
+};
+
+static bool parseSyncRole(const char *role, SyncConfig &config) {
+    if (strcmp(role, "leader") == 0) {
+        config.role = SyncRole::Leader;
+    } else if (strcmp(role, "follower") == 0) {
+        config.role = SyncRole::Follower;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One PNG per frame, named by number, virtual milliseconds and screen.
+static bool writeFrames(const std::string &directory) {
+    const auto &frames = sil::display::frames();
+    const auto &screens = sil::display::screens();
+    for (size_t i = 0; i < frames.size(); i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/%06zu-%010llu-", i,
+                 (unsigned long long)(frames[i].micros / 1000));
+        std::string path = directory + name + screens[frames[i].screen] +
+                           ".png";
+        if (!sil::display::writePng(path, frames[i].pixels.data())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printScreenStats() {
+    uint32_t busHz = sil::display::busClock();
+    printf("%-28s %7s %8s %10s %8s %9s %9s\n", "screen", "frames", "fps",
+           "bytes/s", "bus", "changed", "draw us");
+    for (const auto &screen : sil::display::screenStats()) {
+        printf("%-28s %7u %8.2f %10.0f %7.1f%% %8.1f%% %9.1f\n",
+               screen.screen.c_str(), screen.frames,
+               screen.framesPerSecond(), screen.bytesPerSecond(),
+               100 * screen.busLoad(busHz),
+               screen.frames == 0 ? 0.0
+                                  : 100.0 * (double)screen.changedPages /
+                                        (screen.frames * sil::display::pages),
+               screen.frames == 0
+                   ? 0.0
+                   : (double)screen.drawNanos / screen.frames / 1000);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *scenarioPath = nullptr;
+    const char *flashPath = nullptr;
+    bool printMetrics = false;
+    bool printDisplayStats = false;
+    bool updateFrames = false;
+    const char *framesPath = nullptr;
+    bool realtime = false;
+    double clockDriftPpm = 0;
+    SyncConfig sync;
+    const char *tracePath = nullptr;
+    const char *servoPath = nullptr;
+    int servoModel = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--log" && i + 1 < argc && parseLogLevel(argv[i + 1])) {
+            i++;
+        } else if (arg == "--serial") {
+            sil::serialEnabled = true;
+        } else if (arg == "--flash" && i + 1 < argc) {
+            flashPath = argv[++i];
+        } else if (arg == "--metrics") {
+            printMetrics = true;
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            metricsPort = (uint16_t)atoi(argv[++i]);
+            sil::wifiConnected = true;
+        } else if (arg == "--telemetry-port" && i + 1 < argc) {
+            telemetryPort = (uint16_t)atoi(argv[++i]);
+            sil::wifiConnected = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            framesPath = argv[++i];
+        } else if (arg == "--display-stats") {
+            printDisplayStats = true;
+        } else if (arg == "--update-frames") {
+            updateFrames = true;
+        } else if (arg == "--realtime") {
+            realtime = true;
+        } else if (arg == "--clock-drift" && i + 1 < argc) {
+            clockDriftPpm = atof(argv[++i]);
+        } else if (arg == "--sync" && i + 1 < argc &&
+                   parseSyncRole(argv[i + 1], sync)) {
+            i++;
+        } else if (arg == "--sync-port" && i + 1 < argc) {
+            sync.port = (uint16_t)atoi(argv[++i]);
+        } else if (arg == "--sync-leader" && i + 1 < argc &&
+                   strlen(argv[i + 1]) < sizeof(sync.leaderAddress)) {
+            strcpy(sync.leaderAddress, argv[++i]);
+        } else if (arg == "--sync-offset" && i + 1 < argc) {
+            sync.phaseOffsetMicros = atoi(argv[++i]);
+        } else if (arg == "--servo" && i + 1 < argc) {
+            servoPath = argv[++i];
+        } else if (arg == "--servo-model" && i + 1 < argc &&
+                   (servoModel = ServoModels::find(argv[i + 1])) >= 0) {
+            i++;
+        } else if (arg == "--position-trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg[0] != '-' && scenarioPath == nullptr) {
+            scenarioPath = argv[i];
+        } else {
+            fputs(usage, stderr);
+            return 2;
+        }
+    }
+    if (scenarioPath == nullptr) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    static sil::Scenario scenario;
+    std::string error;
+    if (!scenario.load(scenarioPath, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+    scenario.updateFrames = updateFrames;
+    if (flashPath != nullptr) {
+        sil::flash::load(flashPath);
+    }
+    sil::display::setScreenSource(sil::stateName);
+    sil::display::keepPixels(framesPath != nullptr);
+
+    sil::rail().reset();
+    sil::board::setAnalogSource(Pins::Driver::currentSensorPin, []() {
+        sil::rail().injectedCurrent = (float)scenario.current.at(sil::now());
+        return sil::rail().currentSense();
+    });
+    sil::board::setAnalogSource(Pins::Remote::speedPotPin, []() {
+        double percent = scenario.knob.at(sil::now());
+        return (uint16_t)constrain(percent * 4095 / 100, 0.0, 4095.0);
+    });
+    sil::addStimulus(&scenario);
+
+    // Saved like the portal would, setup() loads it.
+    if (sync.role != SyncRole::Off) {
+        saveSyncConfig(sync);
+    }
+    if (servoPath != nullptr) {
+        if (!Serial2.attach(servoPath)) {
+            fprintf(stderr, "sil: could not open %s\n", servoPath);
+            return 2;
+        }
+        ServoConfig servo;
+        servo.model = (uint8_t)(servoModel + 1);
+        saveServoConfig(servo);
+    }
+    FILE *trace = nullptr;
+    if (tracePath != nullptr) {
+        trace = fopen(tracePath, "w");
+        if (trace == nullptr) {
+            fprintf(stderr, "sil: could not write %s\n", tracePath);
+            return 2;
+        }
+    }
+    static PositionTrace positionTrace(trace);
+    if (trace != nullptr) {
+        sil::addStimulus(&positionTrace);
+    }
+    if (realtime) {
+        sil::setRealtime(clockDriftPpm);
+    }
+
+    xTaskCreatePinnedToCore(loopTask, "loopTask", 8192, nullptr, 1, nullptr,
+                            1);
+
+    auto wallStart = std::chrono::steady_clock::now();
+    sil::RunResult result = sil::run(scenario.endMicros());
+    double wallSeconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - wallStart)
+                             .count();
+
+    if (result == sil::RunResult::Deadlock) {
+        fprintf(stderr, "sil: every task is blocked for good\n");
+    }
+    if (flashPath != nullptr && !sil::flash::save(flashPath)) {
+        fprintf(stderr, "sil: could not write %s\n", flashPath);
+    }
+    if (framesPath != nullptr && !writeFrames(framesPath)) {
+        fprintf(stderr, "sil: could not write frames to %s\n", framesPath);
+    }
+    if (printDisplayStats) {
+        printScreenStats();
+    }
+    if (printMetrics) {
+        static char text[MetricsServer::bodySize];
+        metrics.render(text, sizeof(text), millis());
+        fputs(text, stdout);
+    }
+
+    if (trace != nullptr) {
+        fclose(trace);
+    }
+    if (sync.role != SyncRole::Off) {
+        SyncStats syncStats = syncLink.getStats();
+        ClockEstimate clock = syncLink.getClock();
+        fprintf(stderr,
+                "sil: sync %s, %u announced, %u aligned, %u late (worst "
+                "%lld us), %u missed, offset %lld us, drift %.1f ppm, "
+                "round trip %lld us\n",
+                sync.role == SyncRole::Leader ? "leader" : "follower",
+                (unsigned)syncStats.announced, (unsigned)syncStats.aligned,
+                (unsigned)syncStats.late,
+                (long long)syncStats.worstLateMicros,
+                (unsigned)syncStats.missed, (long long)clock.offsetMicros(),
+                clock.driftPpm(), (long long)clock.roundTripMicros());
+    }
+
+    double virtualSeconds = (double)sil::now() / 1e6;
+    sil::SchedulerStats stats = sil::schedulerStats();
+    fprintf(stderr,
+            "sil: %.1f s simulated in %.2f s (%.0fx), %llu context switches, "
+            "%u frames, %d failed expectations\n",
+            virtualSeconds, wallSeconds,
+            wallSeconds > 0 ? virtualSeconds / wallSeconds : 0.0,
+            (unsigned long long)stats.contextSwitches,
+            (unsigned)sil::display::framesSent(), scenario.failures());
+
+    return scenario.failures() > 0 || result == sil::RunResult::Deadlock ? 1
+                                                                         : 0;
+}
@@ -1,6 +1,10 @@
 #ifndef OSSM_SOFTWARE_CONFIG_H
 #define OSSM_SOFTWARE_CONFIG_H
 
+#include <U8g2lib.h>
+
+#include "utils/MachineProfile.h"
+
 /**
     Default Config for OSSM - Reference board users should tweak UserConfig to
    match their personal build.
@@ -14,6 +18,15 @@ namespace Config {
     */
     namespace Driver {
 
+        /**
+         * The defaults below describe the reference build. Owners with
+         * another motor or pulley set theirs in the WiFi portal, which is
+         * saved in NVS and loaded at boot, see services/machineProfile.h.
+         *
+         * Build with -D MACHINE_PROFILE_FIXED to drop that and make every
+         * conversion a compile time constant again.
+         */
+
         // Top linear speed of the device.
         constexpr float maxSpeedMmPerSecond = 900.0f;
 
@@ -37,18 +50,45 @@ namespace Config {
         // reached the end of its stroke. during "Homing".
         constexpr float sensorlessCurrentLimit = 1.5f;
 
-        constexpr float stepsPerMM =
-            motorStepPerRevolution / (pulleyToothCount * beltPitchMm);
+        constexpr MachineProfile defaultProfile{
+            .motorStepPerRevolution = motorStepPerRevolution,
+            .pulleyToothCount = pulleyToothCount,
+            .beltPitchMm = beltPitchMm,
+            .maxSpeedMmPerSecond = maxSpeedMmPerSecond,
+            .maxAcceleration = maxAcceleration,
+            .sensorlessCurrentLimit = sensorlessCurrentLimit};
+
+#ifdef MACHINE_PROFILE_FIXED
+#define MACHINE_CONSTEXPR constexpr
+#else
+#define MACHINE_CONSTEXPR inline
+#endif
+
+        // The machine this firmware drives. Starts as the default, so it is
+        // usable before loadMachineProfile() and in tools without NVS.
+        MACHINE_CONSTEXPR MachineKinematics machine{defaultProfile};
 
         namespace Operator {
+            /**
+             * A distance in motor steps. Only ever converts to float, so
+             * motion math written with "_mm" stays in single precision, which
+             * the ESP32 FPU does in hardware. long double and double are
+             * emulated in software.
+             */
+            struct Steps {
+                float value;
+
+                constexpr operator float() const { return value; }
+            };
+
             // Define user-defined literal for unsigned integer values
-            constexpr long long operator"" _mm(unsigned long long x) {
-                return x * stepsPerMM;
+            MACHINE_CONSTEXPR Steps operator"" _mm(unsigned long long x) {
+                return {float(x) * machine.stepsPerMm};
             }
 
             // Define user-defined literal for floating-point values
-            constexpr long double operator"" _mm(long double x) {
-                return x * stepsPerMM;
+            MACHINE_CONSTEXPR Steps operator"" _mm(long double x) {
+                return {float(x) * machine.stepsPerMm};
             }
         }
 
@@ -61,11 +101,11 @@ namespace Config {
         // belt attachments subtract the linear block holder length (75mm on
         // OSSM) Recommended to also subtract e.g. 20mm to keep the backstop
         // well away from the device.
-        constexpr float maxStrokeSteps = 300.0_mm;
+        constexpr float maxStrokeMm = 300.0f;
 
         // If the stroke length is less than this value, then the stroke is
         // likely the result of a poor homing.
-        constexpr float minStrokeLengthMm = 50.0_mm;
+        constexpr float minStrokeLengthMm = 50.0f;
     }
 
     /**
@@ -77,6 +117,30 @@ namespace Config {
         // there is NO security other than knowing this name, make this unique
         // to avoid collisions with other users
         constexpr char *ossmId = nullptr;
+
+        // TCP port of the local Prometheus "/metrics" endpoint.
+        constexpr int metricsPort = 9100;
+        // TCP port that streams telemetry, see utils/Telemetry.h.
+        constexpr int telemetryPort = 9101;
+    }
+
+    namespace Sync {
+        // UDP port the leader of synchronized playback listens on.
+        constexpr uint16_t port = 7878;
+        // How far ahead the leader announces a stroke. Has to cover the
+        // network delay to the followers, and is a pause before every
+        // stroke.
+        constexpr uint32_t leadMicros = 20000;
+    }
+
+    namespace Servo {
+        // How often the servo drive is asked for its readings.
+        constexpr uint16_t pollIntervalMs = 20;
+        // How long one answer of the drive may take.
+        constexpr uint32_t responseTimeoutMs = 50;
+        // How far the motor may lag behind the steps before the supervisor
+        // stops it. 0 leaves it unchecked.
+        constexpr float maxFollowingErrorMm = 10.0f;
     }
 
     /**
@@ -106,11 +170,23 @@ namespace Config {
 
         constexpr float accelerationScaling = 100.0f;
 
+        // How long the encoder button must be held to trigger an emergency
+        // stop. Matches the OneButton long press.
+        constexpr int eStopHoldMs = 800;
+
+        // How far the carriage may stray outside the range the active mode
+        // declared before the supervisor stops it.
+        constexpr float envelopeToleranceMm = 3.0f;
+        // Headroom over the declared top speed before the supervisor stops
+        // the motor.
+        constexpr float envelopeSpeedTolerance = 1.1f;
+
     }
 
 }
 
 // Alias for "_mm" operator
 using namespace Config::Driver::Operator;
+using Config::Driver::machine;
 
 #endif  // OSSM_SOFTWARE_CONFIG_H
@@ -51,6 +51,14 @@ namespace Pins {
         constexpr int limitSwitchPin = 12;
     }
 
+    namespace Servo {
+        // UART2 to the Modbus port of the servo drive, through an RS-232 or
+        // RS-485 level shifter. Only used when a servo model is set in the
+        // portal.
+        constexpr int rxPin = 16;
+        constexpr int txPin = 17;
+    }
+
     namespace Wifi {
         // Pin for Wi-Fi reset button (optional)
         constexpr int resetPin = 23;
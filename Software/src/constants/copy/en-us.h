@@ -16,6 +16,8 @@ static const LanguageStruct enUs = {
     .Idle = "Initializing",
     .InDevelopment = "This feature is in development.",
     .MeasuringStroke = "Measuring Stroke",
+    .MotionOutOfBounds =
+        "Motion left the safe range and was stopped. Please restart.",
     .NoInternalLoop = "No display handler implemented.",
     .Restart = "Restart",
     .Settings = "Settings",
@@ -41,7 +43,17 @@ static const LanguageStruct enUs = {
         "Full and half depth strokes alternate; sensation affects speed.",
         "Stroke depth increases per cycle; sensation sets count.",
         "Pauses between strokes; sensation adjusts length.",
-        "Modifies length, maintains speed; sensation influences direction."
+        "Modifies length, maintains speed; sensation influences direction.",
+        "Plays the motion table from Wi-Fi setup; sensation sharpens moves.",
+        "Teasing Pounding, never quite the same; sensation as there.",
+        "Plays playlist 1 from Wi-Fi setup, pattern after pattern.",
+        "Plays playlist 2 from Wi-Fi setup, pattern after pattern.",
+        "Plays playlist 3 from Wi-Fi setup, pattern after pattern.",
+        "Slow ramp up over minutes, then bursts; speed knob caps it.",
+        "Speed and sensation rise and fall in waves, looping.",
+        "Plays the session program from Wi-Fi setup over time.",
+        "Smooth sine in and out; sensation speeds up in or out.",
+        "Eased curve each way; sensation moves the peak speed in."
     },
     .StrokeEngineNames = {
         "Simple Stroke",
@@ -50,7 +62,17 @@ static const LanguageStruct enUs = {
         "Half'n'Half",
         "Deeper",
         "Stop'n'Go",
-        "Insist"
+        "Insist",
+        "Custom",
+        "Human Touch",
+        "Playlist 1",
+        "Playlist 2",
+        "Playlist 3",
+        "Warm Up",
+        "Waves",
+        "Program",
+        "Sine Stroke",
+        "Bezier Stroke"
     },
 };
 
@@ -18,6 +18,9 @@ static const LanguageStruct fr = {
     .Idle = "Inactif",
     .InDevelopment = "Ceci est en développement.",
     .MeasuringStroke = "Mesure de la course",
+    .MotionOutOfBounds =
+        "Le mouvement a quitté la zone sûre et a été arrêté. Veuillez "
+        "redémarrer.",
     .NoInternalLoop = "Aucun gestionnaire d'affichage implémenté.",
     .Restart = "Redémarrage",
     .Settings = "Paramètres",
@@ -46,6 +49,16 @@ static const LanguageStruct fr = {
         "La profondeur des coups augmente à chaque cycle ; la sensation définit le nombre.",
         "Pauses entre les coups ; la sensation ajuste la longueur.",
         "Modifie la longueur, maintient la vitesse ; la sensation influe sur la direction.",
+        "Joue la table de mouvement de la config. Wi-Fi ; la sensation durcit les mouvements.",
+        "Teasing Pounding, jamais tout à fait pareil ; sensation comme pour celui-ci.",
+        "Joue la playlist 1 de la config. Wi-Fi, motif après motif.",
+        "Joue la playlist 2 de la config. Wi-Fi, motif après motif.",
+        "Joue la playlist 3 de la config. Wi-Fi, motif après motif.",
+        "Montée lente sur quelques minutes, puis des rafales ; la vitesse plafonne.",
+        "Vitesse et sensation montent et descendent en vagues, en boucle.",
+        "Joue le programme de séance de la config. Wi-Fi dans le temps.",
+        "Sinusoïde douce aller et retour ; la sensation accélère l'aller ou le retour.",
+        "Courbe adoucie dans chaque sens ; la sensation déplace la vitesse de pointe.",
     },
     .StrokeEngineNames = {
         "Simple Stroke",
@@ -55,6 +68,16 @@ static const LanguageStruct fr = {
         "Deeper",
         "Stop'n'Go",
         "Insist",
+        "Personnalisé",
+        "Toucher humain",
+        "Playlist 1",
+        "Playlist 2",
+        "Playlist 3",
+        "Échauffement",
+        "Vagues",
+        "Programme",
+        "Sine Stroke",
+        "Bezier Stroke",
     }
 };
 
@@ -4,9 +4,21 @@
 #include "ossm/Events.h"
 #include "ossm/OSSM.h"
 #include "services/board.h"
+#include "services/deferredLog.h"
 #include "services/display.h"
+#include "services/eStop.h"
 #include "services/encoder.h"
+#include "services/flightRecorder.h"
+#include "services/machineProfile.h"
+#include "services/metrics.h"
+#include "services/motionTable.h"
+#include "services/playlist.h"
+#include "services/servo.h"
+#include "services/sessionProgram.h"
 #include "services/stepper.h"
+#include "services/supervisor.h"
+#include "services/sync.h"
+#include "services/telemetry.h"
 
 /*
  *  ██████╗ ███████╗███████╗███╗   ███╗
@@ -27,6 +39,9 @@
 
 OSSM* ossm;
 
+// Not cleared on a software reset, so a crash can be saved on the next boot.
+__NOINIT_ATTR FlightRecorder flightRecorder;
+
 OneButton button(Pins::Remote::encoderSwitch, false);
 
 void setup() {
@@ -34,6 +49,22 @@ void setup() {
     initBoard();
 
     /** Service setup */
+    // Machine profile, before any motion task derives its constants.
+    loadMachineProfile();
+    // Sync role and port, read once like the profile.
+    loadSyncConfig();
+    // The Custom pattern's motion table.
+    loadMotionTable();
+    // The playlists of the pattern menu.
+    loadPlaylists();
+    // The session program saved in the portal.
+    loadSessionProgram();
+    // Servo drive model and Modbus address.
+    loadServoConfig();
+    // Flight recorder, first so it can save a crash from the last session.
+    initFlightRecorder();
+    // Prints what the motion tasks log, so they never wait for the UART.
+    initDeferredLog();
     // Encoder
     initEncoder();
     // Display
@@ -45,9 +76,26 @@ void setup() {
     button.attachClick([]() { ossm->sm->process_event(ButtonPress{}); });
     button.attachDoubleClick([]() { ossm->sm->process_event(DoublePress{}); });
     button.attachLongPressStart([]() { ossm->sm->process_event(LongPress{}); });
+    // Stop the motor on a long press without waiting for the state machine.
+    initEStop(stepper);
+    // Read the servo drive, for the supervisor and the telemetry.
+    initServo();
+    // Stop the motor if it ever leaves the envelope of the active mode.
+    initMotionSupervisor(stepper, [](MotionViolation) {
+        ossm->sm->process_event(MotionFault{});
+    });
+
+    // Serve the local metrics endpoint once Wi-Fi is up.
+    initMetrics();
+    // Stream telemetry to a computer that asks for it.
+    initTelemetry();
+    // Stroke in step with other machines, if set up in the portal.
+    initSync();
 };
 
 void loop() {
     button.tick();
+    // Raise MotionFault for a motor the supervisor stopped.
+    handleMotionViolation();
     ossm->wm.process();
 };
\ No newline at end of file
@@ -4,6 +4,6 @@
 // include the ESP
 #include "Esp.h"
 
-auto restart = []() { ESP.restart(); };
+static auto restart = []() { ESP.restart(); };
 
 #endif  // SOFTWARE_ACTIONS_H
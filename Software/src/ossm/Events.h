@@ -25,11 +25,15 @@ struct Done {};
 
 struct Error {};
 
+// The motion supervisor stopped the motor.
+struct MotionFault {};
+
 // Definitions to make the table easier to read.
 static auto buttonPress = sml::event<ButtonPress>;
 static auto longPress = sml::event<LongPress>;
 static auto doublePress = sml::event<DoublePress>;
 static auto done = sml::event<Done>;
 static auto error = sml::event<Error>;
+static auto motionFault = sml::event<MotionFault>;
 
 #endif  // OSSM_SOFTWARE_EVENTS_H
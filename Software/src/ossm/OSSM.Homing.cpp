@@ -1,7 +1,9 @@
 #include "OSSM.h"
 
+#include "DeferredLog.h"
 #include "Events.h"
 #include "constants/UserConfig.h"
+#include "utils/Metrics.h"
 #include "utils/analog.h"
 
 namespace sml = boost::sml;
@@ -14,7 +16,7 @@ using namespace sml;
  * organized.
  */
 void OSSM::clearHoming() {
-    ESP_LOGD("Homing", "Homing started");
+    DEFERRED_LOGD("Homing", "Homing started");
     isForward = true;
 
     // Set acceleration and deceleration in steps/s^2
@@ -42,10 +44,18 @@ void OSSM::startHomingTask(void *pvParameters) {
     int16_t sign = ossm->sm->is("homing.backward"_s) ? 1 : -1;
 
     int32_t targetPositionInSteps =
-        round(sign * Config::Driver::maxStrokeSteps);
-
-    ESP_LOGD("Homing", "Target position in steps: %d", targetPositionInSteps);
+        round(sign * machine.steps(Config::Driver::maxStrokeMm));
+
+    DEFERRED_LOGD("Homing", "Target position in steps: %d",
+                  targetPositionInSteps);
+    // The home position is unknown, so only the speed can be supervised.
+    motionSupervisor.setEnvelope(
+        {.minSteps = INT32_MIN,
+         .maxSteps = INT32_MAX,
+         .maxSpeedHz =
+             uint32_t(25_mm * Config::Advanced::envelopeSpeedTolerance)});
     ossm->stepper->moveTo(targetPositionInSteps, false);
+    recordFlightMotion(FlightSource::Homing, targetPositionInSteps, 25_mm);
 
     auto isInCorrectState = [](OSSM *ossm) {
         // Add any states that you want to support here.
@@ -64,8 +74,10 @@ void OSSM::startHomingTask(void *pvParameters) {
         uint32_t msPassed = xTicksPassed * portTICK_PERIOD_MS;
 
         if (msPassed > 30000) {
-            ESP_LOGE("Homing", "Homing took too long. Check power and restart");
+            DEFERRED_LOGE("Homing",
+                          "Homing took too long. Check power and restart");
             ossm->errorMessage = UserConfig::language.HomingTookTooLong;
+            motionSupervisor.disarm();
             ossm->sm->process_event(Error{});
             break;
         }
@@ -75,47 +87,62 @@ void OSSM::startHomingTask(void *pvParameters) {
                             SampleOnPin{Pins::Driver::currentSensorPin, 200}) -
                         ossm->currentSensorOffset;
 
-        ESP_LOGV("Homing", "Current: %f", current);
+        DEFERRED_LOGV("Homing", "Current: %f", current);
 
         bool isCurrentOverLimit =
-            current > Config::Driver::sensorlessCurrentLimit;
+            current > machine.profile.sensorlessCurrentLimit;
 
         if (!isCurrentOverLimit) {
             vTaskDelay(1);
             continue;
         }
 
-        ESP_LOGD("Homing", "Current over limit: %f", current);
+        DEFERRED_LOGD("Homing", "Current over limit: %f", current);
         ossm->stepper->stopMove();
+        recordFlightAdcPeak(Pins::Driver::currentSensorPin, current);
 
         // step away from the hard stop, with your hands in the air!
         int32_t currentPosition = ossm->stepper->getCurrentPosition();
+        recordFlightMotion(FlightSource::Homing, currentPosition - sign * 10_mm,
+                           25_mm);
         ossm->stepper->moveTo(currentPosition - sign * 10_mm, true);
 
         // measure and save the current position
         ossm->measuredStrokeSteps =
             min(float(abs(ossm->stepper->getCurrentPosition())),
-                Config::Driver::maxStrokeSteps);
+                machine.steps(Config::Driver::maxStrokeMm));
 
         ossm->stepper->setCurrentPosition(0);
         ossm->stepper->forceStopAndNewPosition(0);
 
+        metrics.recordHoming((xTaskGetTickCount() - xTaskStartTime) *
+                             portTICK_PERIOD_MS * 1000);
+
+        // The next state declares its own envelope.
+        motionSupervisor.disarm();
         ossm->sm->process_event(Done{});
         break;
     };
 
+    metrics.recordStackHeadroom(MetricsTask::Homing,
+                                uxTaskGetStackHighWaterMark(nullptr));
     vTaskDelete(nullptr);
 }
 
 void OSSM::startHoming() {
-    int stackSize = 10 * configMINIMAL_STACK_SIZE;
-    xTaskCreatePinnedToCore(startHomingTask, "startHomingTask", stackSize, this,
-                            configMAX_PRIORITIES - 1, &runHomingTaskH,
-                            operationTaskCore);
+    startTask(startHomingTask, "startHomingTask", taskLayout.homing, this,
+              &runHomingTaskH);
+}
+
+MotionEnvelope OSSM::homedEnvelope(float maxSpeedHz) const {
+    return envelopeFor(-measuredStrokeSteps, 0, maxSpeedHz,
+                       Config::Advanced::envelopeToleranceMm * (1_mm),
+                       Config::Advanced::envelopeSpeedTolerance);
 }
 
 auto OSSM::isStrokeTooShort() -> bool {
-    if (measuredStrokeSteps > Config::Driver::minStrokeLengthMm) {
+    if (measuredStrokeSteps >
+        machine.steps(Config::Driver::minStrokeLengthMm)) {
         return false;
     }
     this->errorMessage = UserConfig::language.StrokeTooShort;
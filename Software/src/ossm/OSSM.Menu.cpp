@@ -3,6 +3,7 @@
 #include "constants/Config.h"
 #include "constants/Images.h"
 #include "extensions/u8g2Extensions.h"
+#include "utils/Metrics.h"
 #include "utils/analog.h"
 
 void OSSM::drawMenuTask(void *pvParameters) {
@@ -136,11 +137,12 @@ void OSSM::drawMenuTask(void *pvParameters) {
         vTaskDelay(1);
     };
 
+    metrics.recordStackHeadroom(MetricsTask::Menu,
+                                uxTaskGetStackHighWaterMark(nullptr));
     vTaskDelete(nullptr);
 }
 
 void OSSM::drawMenu() {
-    int stackSize = 5 * configMINIMAL_STACK_SIZE;
-    xTaskCreate(drawMenuTask, "drawMenuTask", stackSize, this, 1,
-                &drawMenuTaskH);
+    startTask(drawMenuTask, "drawMenuTask", taskLayout.menu, this,
+              &drawMenuTaskH);
 }
\ No newline at end of file
@@ -7,7 +7,7 @@
 size_t numberOfDescriptions =
     sizeof(UserConfig::language.StrokeEngineDescriptions) /
     sizeof(UserConfig::language.StrokeEngineDescriptions[0]);
-size_t numberOfPatterns = 7;
+size_t numberOfPatterns = 17;
 
 void OSSM::drawPatternControlsTask(void *pvParameters) {
     // parse ossm from the parameters
@@ -68,7 +68,6 @@ void OSSM::drawPatternControlsTask(void *pvParameters) {
 };
 
 void OSSM::drawPatternControls() {
-    int stackSize = 3 * configMINIMAL_STACK_SIZE;
-    xTaskCreate(drawPatternControlsTask, "drawPatternControlsTask", stackSize,
-                this, 1, &drawPatternControlsTaskH);
+    startTask(drawPatternControlsTask, "drawPatternControlsTask",
+              taskLayout.display, this, &drawPatternControlsTaskH);
 }
@@ -2,6 +2,7 @@
 
 #include "extensions/u8g2Extensions.h"
 #include "services/tasks.h"
+#include "utils/Metrics.h"
 #include "utils/analog.h"
 #include "utils/format.h"
 
@@ -165,7 +166,8 @@ void OSSM::drawPlayControlsTask(void *pvParameters) {
          */
 
         if (!isStrokeEngine) {
-            strokeString = formatDistance(ossm->sessionDistanceMeters);
+            strokeString =
+                formatDistance(machine.mm(ossm->sessionDistanceSteps) / 1000);
             stringWidth = ossm->display.getUTF8Width(strokeString.c_str());
             ossm->display.drawUTF8(104 - stringWidth, lh3,
                                    strokeString.c_str());
@@ -182,11 +184,12 @@ void OSSM::drawPlayControlsTask(void *pvParameters) {
         vTaskDelay(200);
     }
 
+    metrics.recordStackHeadroom(MetricsTask::PlayControls,
+                                uxTaskGetStackHighWaterMark(nullptr));
     vTaskDelete(nullptr);
 };
 
 void OSSM::drawPlayControls() {
-    int stackSize = 3 * configMINIMAL_STACK_SIZE;
-    xTaskCreate(drawPlayControlsTask, "drawPlayControlsTask", stackSize, this,
-                1, &drawPlayControlsTaskH);
+    startTask(drawPlayControlsTask, "drawPlayControlsTask", taskLayout.display,
+              this, &drawPlayControlsTaskH);
 }
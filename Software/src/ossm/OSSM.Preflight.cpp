@@ -13,6 +13,7 @@ void OSSM::drawPreflightTask(void *pvParameters) {
     // Set the stepper to the home position
     ossm->stepper->setAcceleration(1000_mm);
     ossm->stepper->setSpeedInHz(25_mm);
+    motionSupervisor.setEnvelope(ossm->homedEnvelope(25_mm));
     ossm->stepper->moveTo(0, false);
 
     /**
@@ -57,7 +58,6 @@ void OSSM::drawPreflightTask(void *pvParameters) {
 };
 
 void OSSM::drawPreflight() {
-    int stackSize = 3 * configMINIMAL_STACK_SIZE;
-    xTaskCreate(drawPreflightTask, "drawPlayControlsTask", stackSize, this, 1,
-                &drawPreflightTaskH);
+    startTask(drawPreflightTask, "drawPlayControlsTask", taskLayout.display,
+              this, &drawPreflightTaskH);
 }
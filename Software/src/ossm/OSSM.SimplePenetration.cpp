@@ -1,10 +1,20 @@
 #include "OSSM.h"
 
+#include "DeferredLog.h"
 #include "constants/Config.h"
+#include "utils/Metrics.h"
 
 void OSSM::startSimplePenetrationTask(void *pvParameters) {
     OSSM *ossm = (OSSM *)pvParameters;
 
+    // Steps per second, and steps per second squared, for each percent of
+    // speed. Worked out once per session from the machine profile; everything
+    // in the loop below is float, the ESP32 has no double FPU.
+    const float stepsPerSecondPerPercent =
+        machine.maxSpeedStepsPerSecond / 100.0f;
+    const float accelerationPerPercentSquared =
+        machine.maxSpeedStepsPerSecond / Config::Advanced::accelerationScaling;
+
     int fullStrokeCount = 0;
     static int32_t targetPosition = 0;
 
@@ -14,21 +24,25 @@ void OSSM::startSimplePenetrationTask(void *pvParameters) {
                ossm->sm->is("simplePenetration.idle"_s);
     };
 
-    double lastSpeed = 0;
+    float lastSpeed = 0;
 
     bool stopped = false;
 
+    eStop.arm();
+    motionSupervisor.setEnvelope(
+        ossm->homedEnvelope(machine.maxSpeedStepsPerSecond));
+
     while (isInCorrectState(ossm)) {
-        auto speed = (1_mm) * Config::Driver::maxSpeedMmPerSecond *
-                     ossm->setting.speed / 100.0;
-        auto acceleration = (1_mm) * Config::Driver::maxSpeedMmPerSecond *
-                            ossm->setting.speed * ossm->setting.speed /
-                            Config::Advanced::accelerationScaling;
+        uint32_t loopStart = micros();
+
+        float speed = stepsPerSecondPerPercent * ossm->setting.speed;
+        float acceleration = accelerationPerPercentSquared *
+                             ossm->setting.speed * ossm->setting.speed;
 
         bool isSpeedZero = ossm->setting.speedKnob <
                            Config::Advanced::commandDeadZonePercentage;
         bool isSpeedChanged =
-            !isSpeedZero && abs(speed - lastSpeed) >
+            !isSpeedZero && fabsf(speed - lastSpeed) >
                                 5 * Config::Advanced::commandDeadZonePercentage;
         bool isAtTarget =
             abs(targetPosition - ossm->stepper->getCurrentPosition()) == 0;
@@ -37,6 +51,7 @@ void OSSM::startSimplePenetrationTask(void *pvParameters) {
         if (isSpeedZero) {
             ossm->stepper->stopMove();
             stopped = true;
+            metrics.clearStrokeRate();
             vTaskDelay(100);
             continue;
         } else if (stopped) {
@@ -51,10 +66,12 @@ void OSSM::startSimplePenetrationTask(void *pvParameters) {
             lastSpeed = speed;
             ossm->stepper->setAcceleration(acceleration);
             ossm->stepper->setSpeedInHz(speed);
+            recordFlightSetting(FlightSetting::Speed, ossm->setting.speed);
         }
 
         // If the stepper is not at the target, then wait for the next loop
         if (!isAtTarget) {
+            metrics.recordLoopLatency(micros() - loopStart);
             vTaskDelay(1);
             // more than zero
             continue;
@@ -63,43 +80,49 @@ void OSSM::startSimplePenetrationTask(void *pvParameters) {
         bool nextDirection = !ossm->isForward;
         ossm->isForward = nextDirection;
 
+        int32_t strokeSteps =
+            fabsf(ossm->setting.stroke * 0.01f * ossm->measuredStrokeSteps);
+
         if (ossm->isForward) {
-            targetPosition = -abs(((float)ossm->setting.stroke / 100.0) *
-                                  ossm->measuredStrokeSteps);
+            targetPosition = -strokeSteps;
         } else {
             targetPosition = 0;
         }
 
-        ESP_LOGV("SimplePenetration", "target: %f,\tspeed: %f,\tacc: %f",
-                 targetPosition, speed, acceleration);
+        DEFERRED_LOGV("SimplePenetration", "target: %d,\tspeed: %f,\tacc: %f",
+                 (int)targetPosition, speed, acceleration);
 
         ossm->stepper->moveTo(targetPosition, false);
+        recordFlightMotion(FlightSource::SimplePenetration, targetPosition,
+                           speed);
 
         if (ossm->setting.speed > Config::Advanced::commandDeadZonePercentage &&
             ossm->setting.stroke >
                 (long)Config::Advanced::commandDeadZonePercentage) {
             fullStrokeCount++;
-            ossm->sessionStrokeCount = floor(fullStrokeCount / 2);
+            ossm->sessionStrokeCount = fullStrokeCount / 2;
+            if (fullStrokeCount % 2 == 0) {
+                metrics.recordStroke(micros());
+            }
 
             // This calculation assumes that at the end of every stroke you have
             // a whole positive distance, equal to maximum target position.
-            ossm->sessionDistanceMeters +=
-                (((float)ossm->setting.stroke / 100.0) *
-                 ossm->measuredStrokeSteps / (1_mm)) /
-                1000.0;
+            ossm->sessionDistanceSteps += strokeSteps;
         }
 
+        metrics.recordLoopLatency(micros() - loopStart);
         vTaskDelay(1);
     }
 
+    eStop.disarm();
+    motionSupervisor.disarm();
+    metrics.clearStrokeRate();
+    metrics.recordStackHeadroom(MetricsTask::SimplePenetration,
+                                uxTaskGetStackHighWaterMark(nullptr));
     vTaskDelete(nullptr);
 }
 
 void OSSM::startSimplePenetration() {
-    int stackSize = 30 * configMINIMAL_STACK_SIZE;
-
-    xTaskCreatePinnedToCore(startSimplePenetrationTask,
-                            "startSimplePenetrationTask", stackSize, this,
-                            configMAX_PRIORITIES - 1,
-                            &runSimplePenetrationTaskH, operationTaskCore);
+    startTask(startSimplePenetrationTask, "startSimplePenetrationTask",
+              taskLayout.simplePenetration, this, &runSimplePenetrationTaskH);
 }
\ No newline at end of file
@@ -1,19 +1,102 @@
 #include "OSSM.h"
 
+#include "DeferredLog.h"
+#include "services/motionTable.h"
+#include "services/playlist.h"
+#include "services/sessionProgram.h"
 #include "services/stepper.h"
+#include "services/sync.h"
+#include "utils/Metrics.h"
+
+// A new instance of a plain pattern, the kind a playlist entry names.
+static Pattern *newPattern(StrokePatterns pattern) {
+    switch (pattern) {
+        case StrokePatterns::TeasingPounding:
+            return new TeasingPounding("Teasing Pounding");
+        case StrokePatterns::RoboStroke:
+            return new RoboStroke("Robo Stroke");
+        case StrokePatterns::HalfnHalf:
+            return new HalfnHalf("Half'n'Half");
+        case StrokePatterns::Deeper:
+            return new Deeper("Deeper");
+        case StrokePatterns::StopNGo:
+            return new StopNGo("Stop'n'Go");
+        case StrokePatterns::Insist:
+            return new Insist("Insist");
+        case StrokePatterns::Custom:
+            return new TableStroke("Custom", motionTable);
+        case StrokePatterns::HumanTouch:
+            // A new sequence every time it is chosen
+            return new Humanized<TeasingPounding>(
+                "Human Touch", (uint32_t)random(1, 0x7FFFFFFF));
+        case StrokePatterns::SineStroke:
+            return new SineStroke("Sine Stroke");
+        case StrokePatterns::BezierStroke:
+            return new BezierStroke("Bezier Stroke");
+        case StrokePatterns::SimpleStroke:
+        default:
+            return new SimpleStroke("Simple Stroke");
+    }
+}
 
 void OSSM::startStrokeEngineTask(void *pvParameters) {
     OSSM *ossm = (OSSM *)pvParameters;
-    float measuredStrokeMm = ossm->measuredStrokeSteps / (1_mm);
+    float measuredStrokeMm = machine.mm(ossm->measuredStrokeSteps);
+    servoMotor = servoMotorFor(machine);
 
     machineGeometry strokingMachine = {
-        .physicalTravel = abs(ossm->measuredStrokeSteps / (1_mm)),
+        .physicalTravel = abs(measuredStrokeMm),
         .keepoutBoundary = 6.0};
     SettingPercents lastSetting = ossm->setting;
 
+    // StrokeEngine inverts the direction and puts its zero one keepout
+    // boundary away from home, see StrokeEngine::thisIsHome().
+    float keepoutSteps =
+        strokingMachine.keepoutBoundary * servoMotor.stepsPerMillimeter;
+    motionSupervisor.setEnvelope(envelopeFor(
+        -keepoutSteps, abs(ossm->measuredStrokeSteps) - keepoutSteps,
+        machine.maxSpeedStepsPerSecond,
+        Config::Advanced::envelopeToleranceMm * (1_mm),
+        Config::Advanced::envelopeSpeedTolerance));
+
     Stroker.begin(&strokingMachine, &servoMotor, ossm->stepper);
+    Stroker.setStrokingTask(taskLayout.stroking.core,
+                            taskLayout.stroking.priority,
+                            taskLayout.stroking.stackSize);
     Stroker.thisIsHome();
 
+    Stroker.registerTelemetryCallback([](float position, float speed,
+                                         bool clipping) {
+        static bool isOutStroke = false;
+        recordFlightMotion(FlightSource::StrokeEngine, position * (1_mm),
+                           speed * (1_mm));
+        if (clipping) {
+            metrics.recordClip();
+        }
+        if (speed == 0) {
+            metrics.clearStrokeRate();
+            return;
+        }
+        // Every in and out pair is one stroke.
+        isOutStroke = !isOutStroke;
+        if (!isOutStroke) {
+            metrics.recordStroke(micros());
+        }
+    });
+    Stroker.registerLoopTimeCallback([](uint32_t loopMicros) {
+        static uint8_t loopCount = 0;
+        metrics.recordLoopLatency(loopMicros);
+        // Walking the stack is not free, so only sample it now and then.
+        if (loopCount++ == 0) {
+            metrics.recordStackHeadroom(MetricsTask::Stroking,
+                                        uxTaskGetStackHighWaterMark(nullptr));
+        }
+    });
+
+    if (syncConfig.role != SyncRole::Off) {
+        Stroker.registerStrokeGateCallback(syncStrokeGate);
+    }
+
     Stroker.setSensation(calculateSensation(ossm->setting.sensation), true);
 
     Stroker.setDepth(0.01f * ossm->setting.depth * abs(measuredStrokeMm), true);
@@ -28,90 +111,198 @@ void OSSM::startStrokeEngineTask(void *pvParameters) {
                ossm->sm->is("strokeEngine.pattern"_s);
     };
 
+    // The playlist chosen in the pattern menu. One entry plays while the
+    // next is queued behind it, and StrokeEngine hands over at the end of a
+    // stroke.
+    const Playlist *playlist = nullptr;
+    size_t playing = 0;
+    size_t queued = 0;
+    // Whether the entry at playing has been swapped in yet
+    bool isPlaying = false;
+
+    // Whether the playing entry holds a knob at its own setting
+    auto isHeld = [&](float PlaylistEntry::*value) {
+        return playlist != nullptr && isPlaying &&
+               !isnan(playlist->entries[playing].*value);
+    };
+    // What the entry overrides, and the knobs the playing entry held, which
+    // are let go. The others are where the knobs left them.
+    auto settingsFor = [&](const PlaylistEntry *entry,
+                           const SettingPercents &setting) {
+        auto pick = [&](float PlaylistEntry::*value, float knob) {
+            if (entry != nullptr && !isnan(entry->*value)) {
+                return entry->*value;
+            }
+            return isHeld(value) ? knob : NAN;
+        };
+        float strokeMm = abs(measuredStrokeMm);
+        return patternSettings{
+            .speed = 3 * pick(&PlaylistEntry::speed, setting.speed),
+            .depth = 0.01f * pick(&PlaylistEntry::depth, setting.depth) *
+                     strokeMm,
+            .stroke = 0.01f * pick(&PlaylistEntry::stroke, setting.stroke) *
+                      strokeMm,
+            .sensation = calculateSensation(
+                pick(&PlaylistEntry::sensation, setting.sensation))};
+    };
+
+    // Takes over at the end of a stroke. Knobs an entry of a playlist held
+    // go back to where they are.
+    auto choosePattern = [&](const SettingPercents &setting) {
+        if (isPlaylist(setting.pattern)) {
+            const Playlist *chosen =
+                &playlists[(size_t)setting.pattern -
+                           (size_t)StrokePatterns::Playlist1];
+            const PlaylistEntry &first = chosen->entries[0];
+            Stroker.queuePattern(newPattern((StrokePatterns)first.pattern),
+                                 settingsFor(&first, setting), 0, 0);
+            playlist = chosen;
+            queued = 0;
+        } else {
+            Stroker.queuePattern(newPattern(setting.pattern),
+                                 settingsFor(nullptr, setting), 0, 0);
+            playlist = nullptr;
+        }
+        isPlaying = false;
+    };
+
+    // The session program chosen in the pattern menu. It drives the
+    // settings like the knobs would and names the pattern it plays on.
+    ProgramPlayer program;
+    StrokePatterns chosenPattern = StrokePatterns::SimpleStroke;
+    uint32_t lastTickMillis = millis();
+    auto followProgram = [&](SettingPercents &setting,
+                             uint32_t elapsedMillis) {
+        if (setting.pattern != chosenPattern) {
+            chosenPattern = setting.pattern;
+            if (isProgram(chosenPattern)) {
+                program.start(sessionProgramFor(chosenPattern));
+            } else {
+                program.stop();
+            }
+        }
+        program.apply(setting, elapsedMillis);
+    };
+
+    // Fresh, whatever was left queued when the last session ended. Only
+    // the pattern of a program, its settings reach StrokeEngine through
+    // the loop like a turned knob.
+    SettingPercents first = lastSetting;
+    followProgram(first, 0);
+    lastSetting.pattern = first.pattern;
+    choosePattern(lastSetting);
+
+    eStop.arm();
+
     while (isInCorrectState(ossm)) {
-        if (isChangeSignificant(lastSetting.speed, ossm->setting.speed)) {
-            if (ossm->setting.speed == 0) {
+        // The program moves on only while stroking, then a follower plays
+        // the leader's settings and the leader announces its.
+        SettingPercents setting = ossm->setting;
+        uint32_t now = millis();
+        followProgram(setting, Stroker.getState() == PATTERN
+                                   ? now - lastTickMillis
+                                   : 0);
+        lastTickMillis = now;
+        followLeaderSetting(setting);
+        syncPublishSetting(setting);
+        bool isKnobTurned = false;
+
+        // The queued entry was swapped in, queue the one after it to take
+        // over once this one has played
+        if (playlist != nullptr && !Stroker.isPatternQueued()) {
+            playing = queued;
+            isPlaying = true;
+            queued = playlist->next(playing);
+            const PlaylistEntry &current = playlist->entries[playing];
+            const PlaylistEntry &entry = playlist->entries[queued];
+            Stroker.queuePattern(
+                newPattern((StrokePatterns)entry.pattern),
+                settingsFor(&entry, setting),
+                current.isTimed ? 0 : current.length,
+                current.isTimed ? 1000u * current.length : 0);
+        }
+
+        if (isChangeSignificant(lastSetting.speed, setting.speed)) {
+            if (setting.speed == 0) {
                 Stroker.stopMotion();
             } else if (Stroker.getState() == READY) {
                 Stroker.startPattern();
             }
 
-            Stroker.setSpeed(ossm->setting.speed * 3, true);
-            lastSetting.speed = ossm->setting.speed;
+            if (!isHeld(&PlaylistEntry::speed)) {
+                Stroker.setSpeed(setting.speed * 3, true);
+            }
+            lastSetting.speed = setting.speed;
+            isKnobTurned = true;
+            recordFlightSetting(FlightSetting::Speed, setting.speed);
         }
 
-        if (lastSetting.stroke != ossm->setting.stroke) {
-            float newStroke =
-                0.01f * ossm->setting.stroke * abs(measuredStrokeMm);
-            ESP_LOGD("UTILS", "change stroke: %f %f", ossm->setting.stroke,
+        if (lastSetting.stroke != setting.stroke) {
+            float newStroke = 0.01f * setting.stroke * abs(measuredStrokeMm);
+            DEFERRED_LOGD("UTILS", "change stroke: %f %f", setting.stroke,
                      newStroke);
-            Stroker.setStroke(newStroke, true);
-            lastSetting.stroke = ossm->setting.stroke;
+            if (!isHeld(&PlaylistEntry::stroke)) {
+                Stroker.setStroke(newStroke, true);
+            }
+            lastSetting.stroke = setting.stroke;
+            isKnobTurned = true;
+            recordFlightSetting(FlightSetting::Stroke, setting.stroke);
         }
 
-        if (lastSetting.depth != ossm->setting.depth) {
-            float newDepth =
-                0.01f * ossm->setting.depth * abs(measuredStrokeMm);
-            ESP_LOGD("UTILS", "change depth: %f %f", ossm->setting.depth,
+        if (lastSetting.depth != setting.depth) {
+            float newDepth = 0.01f * setting.depth * abs(measuredStrokeMm);
+            DEFERRED_LOGD("UTILS", "change depth: %f %f", setting.depth,
                      newDepth);
-            Stroker.setDepth(newDepth, false);
-            lastSetting.depth = ossm->setting.depth;
+            if (!isHeld(&PlaylistEntry::depth)) {
+                Stroker.setDepth(newDepth, false);
+            }
+            lastSetting.depth = setting.depth;
+            isKnobTurned = true;
+            recordFlightSetting(FlightSetting::Depth, setting.depth);
         }
 
-        if (lastSetting.sensation != ossm->setting.sensation) {
-            float newSensation = calculateSensation(ossm->setting.sensation);
-            ESP_LOGD("UTILS", "change sensation: %f %f",
-                     ossm->setting.sensation, newSensation);
-            Stroker.setSensation(newSensation, false);
-            lastSetting.sensation = ossm->setting.sensation;
+        if (lastSetting.sensation != setting.sensation) {
+            float newSensation = calculateSensation(setting.sensation);
+            DEFERRED_LOGD("UTILS", "change sensation: %f %f",
+                     setting.sensation, newSensation);
+            if (!isHeld(&PlaylistEntry::sensation)) {
+                Stroker.setSensation(newSensation, false);
+            }
+            lastSetting.sensation = setting.sensation;
+            isKnobTurned = true;
+            recordFlightSetting(FlightSetting::Sensation, setting.sensation);
         }
 
-        if (lastSetting.pattern != ossm->setting.pattern) {
-            ESP_LOGD("UTILS", "change pattern: %d", ossm->setting.pattern);
-
-            switch (ossm->setting.pattern) {
-                case StrokePatterns::SimpleStroke:
-                    Stroker.setPattern(new SimpleStroke("Simple Stroke"),
-                                       false);
-                    break;
-                case StrokePatterns::TeasingPounding:
-                    Stroker.setPattern(new TeasingPounding("Teasing Pounding"),
-                                       false);
-                    break;
-                case StrokePatterns::RoboStroke:
-                    Stroker.setPattern(new RoboStroke("Robo Stroke"), false);
-                    break;
-                case StrokePatterns::HalfnHalf:
-                    Stroker.setPattern(new HalfnHalf("Half'n'Half"), false);
-                    break;
-                case StrokePatterns::Deeper:
-                    Stroker.setPattern(new Deeper("Deeper"), false);
-                    break;
-                case StrokePatterns::StopNGo:
-                    Stroker.setPattern(new StopNGo("Stop'n'Go"), false);
-                    break;
-                case StrokePatterns::Insist:
-                    Stroker.setPattern(new Insist("Insist"), false);
-                    break;
-                default:
-                    break;
-            }
+        if (lastSetting.pattern != setting.pattern) {
+            DEFERRED_LOGD("UTILS", "change pattern: %d", setting.pattern);
 
-            lastSetting.pattern = ossm->setting.pattern;
+            choosePattern(setting);
+
+            lastSetting.pattern = setting.pattern;
+            recordFlightSetting(FlightSetting::Pattern, (float)setting.pattern);
+        }
+
+        // A held knob is let go at the handover where it is now
+        if (playlist != nullptr && isKnobTurned) {
+            Stroker.setQueuedSettings(
+                settingsFor(&playlist->entries[queued], setting));
         }
 
-        vTaskDelay(400);
+        // Often enough to queue the next entry before a short one ends, and
+        // for a program's steps to land on time
+        vTaskDelay(playlist != nullptr || program.isRunning() ? 50 : 400);
     }
 
     Stroker.stopMotion();
+    eStop.disarm();
+    motionSupervisor.disarm();
 
+    metrics.recordStackHeadroom(MetricsTask::StrokeEngine,
+                                uxTaskGetStackHighWaterMark(nullptr));
     vTaskDelete(nullptr);
 }
 
 void OSSM::startStrokeEngine() {
-    int stackSize = 10 * configMINIMAL_STACK_SIZE;
-
-    xTaskCreatePinnedToCore(startStrokeEngineTask, "startStrokeEngineTask",
-                            stackSize, this, configMAX_PRIORITIES - 1,
-                            &runStrokeEngineTaskH, operationTaskCore);
+    startTask(startStrokeEngineTask, "startStrokeEngineTask",
+              taskLayout.strokeEngine, this, &runStrokeEngineTaskH);
 }
\ No newline at end of file
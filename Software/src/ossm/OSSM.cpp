@@ -4,6 +4,12 @@
 #include "constants/UserConfig.h"
 #include "extensions/u8g2Extensions.h"
 #include "services/encoder.h"
+#include "services/machineProfile.h"
+#include "services/motionTable.h"
+#include "services/playlist.h"
+#include "services/servo.h"
+#include "services/sessionProgram.h"
+#include "services/sync.h"
 
 namespace sml = boost::sml;
 using namespace sml;
@@ -18,6 +24,24 @@ OSSM::OSSM(U8G2_SSD1306_128X64_NONAME_F_HW_I2C &display,
       sm(std::make_unique<
           sml::sm<OSSMStateMachine, sml::thread_safe<ESP32RecursiveMutex>,
                   sml::logger<StateLogger>>>(logger, *this)) {
+    // Offer the machine profile, sync settings, motion table, playlists,
+    // session program and servo drive on the portal, next to the
+    // credentials. WiFiManager keeps a single save callback.
+    addMachineProfileParameters(wm);
+    addSyncParameters(wm);
+    addMotionTableParameters(wm);
+    addPlaylistParameters(wm);
+    addSessionProgramParameter(wm);
+    addServoParameters(wm);
+    wm.setSaveParamsCallback([]() {
+        saveMachineProfileParameters();
+        saveSyncParameters();
+        saveMotionTableParameters();
+        savePlaylistParameters();
+        saveSessionProgramParameter();
+        saveServoParameters();
+    });
+
     // NOTE: This is a hack to get the wifi credentials loaded early.
     wm.setConfigPortalBlocking(false);
     wm.startConfigPortal();
@@ -114,10 +138,13 @@ void OSSM::drawHelloTask(void *pvParameters) {
 }
 
 void OSSM::drawHello() {
-    // 3 x minimum stack
-    int stackSize = 3 * configMINIMAL_STACK_SIZE;
-    xTaskCreate(drawHelloTask, "drawHello", stackSize, this, 1,
-                &drawHelloTaskH);
+    startTask(drawHelloTask, "drawHello", taskLayout.display, this,
+              &drawHelloTaskH);
+}
+
+void OSSM::setMotionFault() {
+    errorMessage = UserConfig::language.MotionOutOfBounds;
+    isHomed = false;
 }
 
 void OSSM::drawError() {
@@ -12,8 +12,11 @@
 #include "constants/Config.h"
 #include "constants/Menu.h"
 #include "constants/Pins.h"
+#include "services/eStop.h"
+#include "services/flightRecorder.h"
 #include "services/tasks.h"
 #include "structs/SettingPercents.h"
+#include "utils/MotionSupervisor.h"
 #include "utils/RecusiveMutex.h"
 #include "utils/StateLogger.h"
 #include "utils/StrokeEngineHelper.h"
@@ -81,7 +84,7 @@ class OSSM {
                 // record session start time rounded to the nearest second
                 o.sessionStartTime = millis();
                 o.sessionStrokeCount = 0;
-                o.sessionDistanceMeters = 0;
+                o.sessionDistanceSteps = 0;
             };
 
             auto incrementControl = [](OSSM &o) {
@@ -108,6 +111,12 @@ class OSSM {
             auto emergencyStop = [](OSSM &o) {
                 o.stepper->forceStop();
                 o.stepper->disableOutputs();
+                // services/eStop.h has normally stopped and recorded this
+                // already, this is the fallback.
+                if (!eStop.acknowledge()) {
+                    saveFlightRecording(FlightEvent::EmergencyStop,
+                                        o.stepper->getCurrentPosition());
+                }
             };
             auto drawHelp = [](OSSM &o) { o.drawHelp(); };
             auto drawWiFi = [](OSSM &o) { o.drawWiFi(); };
@@ -115,7 +124,11 @@ class OSSM {
             auto drawNoUpdate = [](OSSM &o) { o.drawNoUpdate(); };
             auto drawUpdating = [](OSSM &o) { o.drawUpdating(); };
             auto stopWifiPortal = [](OSSM &o) { o.wm.stopConfigPortal(); };
-            auto drawError = [](OSSM &o) { o.drawError(); };
+            auto setMotionFault = [](OSSM &o) { o.setMotionFault(); };
+            auto drawError = [](OSSM &o) {
+                saveFlightRecording(FlightEvent::Error);
+                o.drawError();
+            };
 
             auto startWifi = [](OSSM &o) {
                 if (WiFiClass::status() == WL_CONNECTED) {
@@ -174,6 +187,8 @@ class OSSM {
                 "homing.forward"_s + error = "error"_s,
                 "homing.forward"_s + done / startHoming = "homing.backward"_s,
                 "homing.backward"_s + error = "error"_s,
+                "homing.forward"_s + motionFault / setMotionFault = "error"_s,
+                "homing.backward"_s + motionFault / setMotionFault = "error"_s,
                 "homing.backward"_s + done[(isStrokeTooShort)] = "error"_s,
                 "homing.backward"_s + done[isFirstHomed] / setHomed = "menu"_s,
                 "homing.backward"_s + done[(isOption(Menu::SimplePenetration))] / setHomed = "simplePenetration"_s,
@@ -192,6 +207,8 @@ class OSSM {
                 "simplePenetration"_s / drawPreflight = "simplePenetration.preflight"_s,
                 "simplePenetration.preflight"_s + done / (resetSettings, drawPlayControls, startSimplePenetration) = "simplePenetration.idle"_s,
                 "simplePenetration.idle"_s + longPress / (emergencyStop, setNotHomed) = "menu"_s,
+                "simplePenetration.preflight"_s + motionFault / setMotionFault = "error"_s,
+                "simplePenetration.idle"_s + motionFault / setMotionFault = "error"_s,
 
                 "strokeEngine"_s [isNotHomed] = "homing"_s,
                 "strokeEngine"_s [isPreflightSafe] / (resetSettings, drawPlayControls, startStrokeEngine) = "strokeEngine.idle"_s,
@@ -203,6 +220,9 @@ class OSSM {
                 "strokeEngine.pattern"_s + doublePress / drawPlayControls = "strokeEngine.idle"_s,
                 "strokeEngine.pattern"_s + longPress / (emergencyStop, setNotHomed) = "menu"_s,
                 "strokeEngine.idle"_s + longPress / (emergencyStop, setNotHomed) = "menu"_s,
+                "strokeEngine.preflight"_s + motionFault / setMotionFault = "error"_s,
+                "strokeEngine.idle"_s + motionFault / setMotionFault = "error"_s,
+                "strokeEngine.pattern"_s + motionFault / setMotionFault = "error"_s,
 
                 "update"_s [isOnline] / drawUpdate = "update.checking"_s,
                 "update"_s = "wifi"_s,
@@ -265,7 +285,9 @@ class OSSM {
 
     unsigned long sessionStartTime = 0;
     int sessionStrokeCount = 0;
-    double sessionDistanceMeters = 0;
+    // Whole steps, so adding a stroke never loses precision however long the
+    // session runs.
+    uint64_t sessionDistanceSteps = 0;
 
     PlayControls playControl = PlayControls::STROKE;
 
@@ -284,6 +306,11 @@ class OSSM {
 
     bool isStrokeTooShort();
 
+    // The measured stroke, in the frame homing leaves the stepper in.
+    MotionEnvelope homedEnvelope(float maxSpeedHz) const;
+
+    void setMotionFault();
+
     void drawError();
 
     void drawHello();
@@ -0,0 +1,44 @@
+#ifndef OSSM_SOFTWARE_DEFERRED_LOG_SERVICE_H
+#define OSSM_SOFTWARE_DEFERRED_LOG_SERVICE_H
+
+#include <Arduino.h>
+
+#include "DeferredLog.h"
+#include "services/tasks.h"
+
+/**
+ * Prints what the motion tasks logged with DEFERRED_LOGx.
+ *
+ * The task runs at idle priority, so formatting and the wait for the UART
+ * happen when nothing else wants the core. Lost messages are reported once
+ * the ring has room again.
+ */
+static void deferredLogTask(void *pvParameters) {
+    static char line[192];
+    uint32_t reportedDrops = 0;
+    DeferredLogMessage message;
+
+    while (true) {
+        while (deferredLog.pop(message)) {
+            message.render(line, sizeof(line));
+            Serial.print(line);
+        }
+
+        uint32_t dropped = deferredLog.dropped();
+        if (dropped != reportedDrops) {
+            Serial.printf("[%8u][W][DeferredLog] %u messages dropped\n",
+                          (unsigned)micros(),
+                          (unsigned)(dropped - reportedDrops));
+            reportedDrops = dropped;
+        }
+
+        vTaskDelay(10);
+    }
+}
+
+static void initDeferredLog() {
+    startTask(deferredLogTask, "deferredLogTask", taskLayout.deferredLog,
+              nullptr, &deferredLogTaskH);
+}
+
+#endif  // OSSM_SOFTWARE_DEFERRED_LOG_SERVICE_H
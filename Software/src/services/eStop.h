@@ -0,0 +1,91 @@
+#ifndef OSSM_SOFTWARE_ESTOP_SERVICE_H
+#define OSSM_SOFTWARE_ESTOP_SERVICE_H
+
+#include <Arduino.h>
+
+#include "DeferredLog.h"
+#include "FastAccelStepper.h"
+#include "constants/Config.h"
+#include "constants/Pins.h"
+#include "services/flightRecorder.h"
+#include "services/tasks.h"
+#include "utils/EStop.h"
+#include "utils/Metrics.h"
+
+/**
+ * The dedicated emergency stop path.
+ *
+ * Holding the encoder button stops the motor from a max priority task, without
+ * waiting for loop(), OneButton or the state machine mutex. The LongPress
+ * event still reaches the state machine afterwards, which only does the
+ * bookkeeping (leaving the mode and forgetting the home position).
+ *
+ * Motion tasks arm the stop while they run, so a long press in the menu keeps
+ * its normal meaning.
+ */
+inline EmergencyStop eStop{Config::Advanced::eStopHoldMs * 1000};
+
+namespace EStopService {
+    static FastAccelStepper *stepper = nullptr;
+
+    static void stop() {
+        stepper->forceStop();
+        stepper->disableOutputs();
+
+        uint32_t latency = eStop.trip(micros());
+        if (latency == 0) {
+            return;
+        }
+
+        // Everything below happens after the motor is already disabled.
+        uint32_t overhead = eStop.overheadMicros(latency);
+        metrics.recordEStop(latency, overhead);
+        saveFlightRecording(FlightEvent::EmergencyStop,
+                            stepper->getCurrentPosition(), latency);
+        if (overhead > EmergencyStop::latencyBudgetMicros) {
+            DEFERRED_LOGW("EStop", "Stop took %u us longer than the hold",
+                     (unsigned)overhead);
+        }
+    }
+}
+
+static void IRAM_ATTR eStopISR() {
+    eStop.onEdge(digitalRead(Pins::Remote::encoderSwitch) == HIGH, micros());
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(eStopTaskH, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void eStopTask(void *pvParameters) {
+    while (true) {
+        // Sleep until the button changes.
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Wait out the hold time, a release wakes us early.
+        while (eStop.pressed()) {
+            uint32_t remaining = eStop.remainingHoldMicros(micros());
+            if (remaining > 0) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((remaining + 999) / 1000));
+                continue;
+            }
+            if (eStop.isArmed()) {
+                EStopService::stop();
+            }
+            break;
+        }
+    }
+}
+
+static void initEStop(FastAccelStepper *stepper) {
+    EStopService::stepper = stepper;
+
+    // At the top priority, so no motion task can starve it.
+    startTask(eStopTask, "eStopTask", taskLayout.eStop, nullptr, &eStopTaskH);
+    attachInterrupt(digitalPinToInterrupt(Pins::Remote::encoderSwitch),
+                    eStopISR, CHANGE);
+}
+
+#endif  // OSSM_SOFTWARE_ESTOP_SERVICE_H
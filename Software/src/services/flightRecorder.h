@@ -0,0 +1,154 @@
+#ifndef OSSM_SOFTWARE_FLIGHTRECORDER_SERVICE_H
+#define OSSM_SOFTWARE_FLIGHTRECORDER_SERVICE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+
+#include "services/tasks.h"
+#include "utils/FlightRecorder.h"
+
+/**
+ * Saves the flight recorder to the "coredump" partition.
+ *
+ * The firmware does not write core dumps, so the partition is split into
+ * slots and the most recent dumps are kept round robin. Read it back with:
+ *  esptool.py read_flash 0x3F0000 0x10000 flightrec.bin
+ *  pio run -e flightrec && .pio/build/flightrec/program flightrec.bin
+ *
+ * Flash writes stall both cores, so they only happen from a low priority task
+ * after the machine has been stopped, or during boot.
+ */
+
+// Defined in main.cpp, in RAM that survives a software reset.
+extern FlightRecorder flightRecorder;
+
+namespace FlightRecorderStorage {
+    // Slots are erased independently, so round them up to a flash sector.
+    static constexpr size_t sectorSize = 4096;
+    static constexpr size_t slotSize =
+        (FlightRecorder::dumpSize + sectorSize - 1) & ~(sectorSize - 1);
+
+    inline const esp_partition_t *partition = nullptr;
+    inline uint32_t nextSequence = 1;
+    inline uint32_t nextSlot = 0;
+    inline uint8_t dump[FlightRecorder::dumpSize];
+
+    static void find() {
+#if CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH
+        // The core dump owns the partition, keep the recording in RAM only.
+        ESP_LOGW("FlightRecorder", "Core dumps are enabled, not saving dumps");
+        return;
+#endif
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                             ESP_PARTITION_SUBTYPE_DATA_COREDUMP,
+                                             nullptr);
+        if (partition == nullptr || partition->size < slotSize) {
+            ESP_LOGW("FlightRecorder", "No partition to save dumps to");
+            partition = nullptr;
+            return;
+        }
+
+        // Continue after the newest dump already in flash.
+        uint32_t slots = partition->size / slotSize;
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            FlightDump::Header header;
+            if (esp_partition_read(partition, slot * slotSize, &header,
+                                   sizeof(header)) != ESP_OK ||
+                header.magic != FlightDump::magic) {
+                continue;
+            }
+            if (header.sequence >= nextSequence) {
+                nextSequence = header.sequence + 1;
+                nextSlot = (slot + 1) % slots;
+            }
+        }
+    }
+
+    static bool save() {
+        if (partition == nullptr) {
+            return false;
+        }
+        size_t length = flightRecorder.serialize(dump, nextSequence);
+        size_t offset = nextSlot * slotSize;
+        if (esp_partition_erase_range(partition, offset, slotSize) != ESP_OK ||
+            esp_partition_write(partition, offset, dump, length) != ESP_OK) {
+            ESP_LOGE("FlightRecorder", "Could not write dump %u",
+                     (unsigned)nextSequence);
+            return false;
+        }
+        ESP_LOGI("FlightRecorder", "Saved dump %u to slot %u",
+                 (unsigned)nextSequence, (unsigned)nextSlot);
+        nextSequence++;
+        nextSlot = (nextSlot + 1) % (partition->size / slotSize);
+        return true;
+    }
+}
+
+static void recordFlightState(const char *state) {
+    flightRecorder.recordState(state, millis());
+}
+
+static void recordFlightSetting(FlightSetting setting, float value) {
+    flightRecorder.record(FlightEvent::Setting, (uint8_t)setting,
+                          (int32_t)(value * 100), 0, millis());
+}
+
+static void recordFlightMotion(FlightSource source, int32_t targetSteps,
+                               int32_t speedHz) {
+    flightRecorder.record(FlightEvent::Motion, (uint8_t)source, targetSteps,
+                          speedHz, millis());
+}
+
+static void recordFlightAdcPeak(uint8_t pin, float percent) {
+    flightRecorder.record(FlightEvent::AdcPeak, pin, (int32_t)(percent * 1000),
+                          0, millis());
+}
+
+/**
+ * Freeze the recorder and save it to flash in the background.
+ * Cheap enough to call straight from a state machine action.
+ * @param reason the event that stopped the machine.
+ * @param code extra detail, for example the position at an emergency stop.
+ * @param detail more detail, for example the emergency stop latency.
+ */
+static void saveFlightRecording(FlightEvent reason, int32_t code = 0,
+                                int32_t detail = 0) {
+    uint32_t now = millis();
+    flightRecorder.record(reason, 0, code, detail, now);
+    if (flightRecorder.freeze(reason, now) && flightRecorderTaskH != nullptr) {
+        xTaskNotifyGive(flightRecorderTaskH);
+    }
+}
+
+static void flightRecorderTask(void *pvParameters) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        FlightRecorderStorage::save();
+        flightRecorder.thaw();
+    }
+}
+
+static void initFlightRecorder() {
+    FlightRecorderStorage::find();
+
+    // After a crash the ring still holds the moments before it, save them
+    // before anything else is recorded.
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT ||
+                   reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT;
+    if (crashed && flightRecorder.isValid()) {
+        uint32_t lastTime = flightRecorder.lastTimeMs();
+        flightRecorder.record(FlightEvent::Panic, 0, reason, 0, lastTime);
+        flightRecorder.freeze(FlightEvent::Panic, lastTime);
+        FlightRecorderStorage::save();
+    }
+
+    flightRecorder.reset();
+    flightRecorder.record(FlightEvent::Boot, 0, reason, 0, millis());
+
+    startTask(flightRecorderTask, "flightRecorderTask",
+              taskLayout.flightRecorder, nullptr, &flightRecorderTaskH);
+}
+
+#endif  // OSSM_SOFTWARE_FLIGHTRECORDER_SERVICE_H
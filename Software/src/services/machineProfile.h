@@ -0,0 +1,140 @@
+#ifndef OSSM_SOFTWARE_MACHINE_PROFILE_SERVICE_H
+#define OSSM_SOFTWARE_MACHINE_PROFILE_SERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiManager.h>
+
+#include "constants/Config.h"
+#include "utils/MachineProfile.h"
+
+/**
+ * Keeps the machine profile in NVS and lets owners edit it in the WiFi
+ * portal, next to the network credentials.
+ *
+ * The profile is loaded once at boot, before any motion task starts. A saved
+ * profile takes effect after a restart: homing measured the stroke with the
+ * old one, so changing it mid session would put the rail limits in the wrong
+ * place.
+ */
+
+namespace MachineProfileStore {
+    static constexpr const char *nvsNamespace = "machine";
+    static constexpr const char *nvsKey = "profile";
+    // Bump when MachineProfile changes layout, older blobs are then ignored.
+    static constexpr uint32_t version = 1;
+
+    struct Blob {
+        uint32_t version;
+        MachineProfile profile;
+    };
+}
+
+/**
+ * Reads the saved profile, if there is a valid one.
+ * @return false if the default is used.
+ */
+static bool readMachineProfile(MachineProfile &profile) {
+    Preferences preferences;
+    if (!preferences.begin(MachineProfileStore::nvsNamespace, true)) {
+        return false;
+    }
+    MachineProfileStore::Blob blob{};
+    size_t length = preferences.getBytesLength(MachineProfileStore::nvsKey);
+    bool isRead =
+        length == sizeof(blob) &&
+        preferences.getBytes(MachineProfileStore::nvsKey, &blob,
+                             sizeof(blob)) == sizeof(blob);
+    preferences.end();
+
+    if (!isRead || blob.version != MachineProfileStore::version ||
+        !blob.profile.isValid()) {
+        return false;
+    }
+    profile = blob.profile;
+    return true;
+}
+
+static bool saveMachineProfile(const MachineProfile &profile) {
+    if (!profile.isValid()) {
+        return false;
+    }
+    Preferences preferences;
+    if (!preferences.begin(MachineProfileStore::nvsNamespace, false)) {
+        return false;
+    }
+    MachineProfileStore::Blob blob{MachineProfileStore::version, profile};
+    bool isSaved = preferences.putBytes(MachineProfileStore::nvsKey, &blob,
+                                        sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return isSaved;
+}
+
+/**
+ * Applies the saved profile. Must run before the first motion task, which
+ * derive their constants from machine when they start.
+ */
+static void loadMachineProfile() {
+#ifdef MACHINE_PROFILE_FIXED
+    ESP_LOGI("MachineProfile", "Fixed at compile time");
+#else
+    MachineProfile profile;
+    if (readMachineProfile(profile)) {
+        machine = MachineKinematics(profile);
+        ESP_LOGI("MachineProfile", "Loaded, %.3f steps/mm",
+                 machine.stepsPerMm);
+    } else {
+        ESP_LOGI("MachineProfile", "Using the default, %.3f steps/mm",
+                 machine.stepsPerMm);
+    }
+#endif
+}
+
+#ifndef MACHINE_PROFILE_FIXED
+static WiFiManagerParameter
+    *machineProfileParameters[MachineProfileText::fieldCount];
+#endif
+
+/**
+ * Adds one portal field per profile value, filled with the profile in use.
+ */
+static void addMachineProfileParameters(WiFiManager &wm) {
+#ifndef MACHINE_PROFILE_FIXED
+    for (size_t i = 0; i < MachineProfileText::fieldCount; i++) {
+        char value[16];
+        MachineProfileText::format(machine.profile, i, value, sizeof(value));
+        machineProfileParameters[i] = new WiFiManagerParameter(
+            MachineProfileText::fields[i].key,
+            MachineProfileText::fields[i].label, value, sizeof(value) - 1);
+        wm.addParameter(machineProfileParameters[i]);
+    }
+#endif
+}
+
+/**
+ * What the owner submitted in the portal is validated as a whole and saved
+ * for the next boot; anything invalid leaves the saved profile as it was.
+ */
+static void saveMachineProfileParameters() {
+#ifndef MACHINE_PROFILE_FIXED
+    MachineProfile profile = machine.profile;
+    for (size_t i = 0; i < MachineProfileText::fieldCount; i++) {
+        if (!MachineProfileText::parse(profile, i,
+                                       machineProfileParameters[i]->getValue())) {
+            ESP_LOGW("MachineProfile", "Not a number: %s",
+                     MachineProfileText::fields[i].key);
+            return;
+        }
+    }
+    if (profile == machine.profile) {
+        return;
+    }
+    if (!saveMachineProfile(profile)) {
+        ESP_LOGW("MachineProfile", "Rejected, out of range");
+        return;
+    }
+    ESP_LOGI("MachineProfile", "Saved, applied after a restart");
+#endif
+}
+
+#endif  // OSSM_SOFTWARE_MACHINE_PROFILE_SERVICE_H
@@ -0,0 +1,58 @@
+#ifndef OSSM_SOFTWARE_METRICS_SERVICE_H
+#define OSSM_SOFTWARE_METRICS_SERVICE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "constants/Config.h"
+#include "services/tasks.h"
+#include "utils/Metrics.h"
+#include "utils/MetricsServer.h"
+
+// Where the endpoint listens. The SIL moves it to run many boards on one host.
+inline uint16_t metricsPort = Config::Web::metricsPort;
+
+/**
+ * Serves the local Prometheus "/metrics" endpoint.
+ *
+ * The task runs at idle priority and only reads from the preallocated
+ * counters in utils/Metrics.h, so a scrape can never stall motion.
+ *
+ * Try it with:
+ *  curl http://<ossm-ip>:9100/metrics
+ */
+static void metricsTask(void *pvParameters) {
+    static MetricsServer server;
+
+    // Wait for the network before opening the socket.
+    while (WiFiClass::status() != WL_CONNECTED) {
+        vTaskDelay(1000);
+    }
+
+    if (!server.begin(metricsPort)) {
+        ESP_LOGE("Metrics", "Could not listen on port %d", metricsPort);
+        vTaskDelete(nullptr);
+    }
+    ESP_LOGD("Metrics", "Listening on port %d", server.port());
+
+    while (true) {
+        int client = server.accept();
+        if (client < 0) {
+            vTaskDelay(50);
+            continue;
+        }
+
+        metrics.recordHeap(ESP.getFreeHeap(), heap_caps_get_largest_free_block(
+                                                  MALLOC_CAP_8BIT));
+        metrics.recordStackHeadroom(MetricsTask::Metrics,
+                                    uxTaskGetStackHighWaterMark(nullptr));
+        MetricsServer::serve(client, metrics, millis());
+    }
+}
+
+static void initMetrics() {
+    startTask(metricsTask, "metricsTask", taskLayout.metrics, nullptr,
+              &metricsTaskH);
+}
+
+#endif  // OSSM_SOFTWARE_METRICS_SERVICE_H
@@ -0,0 +1,110 @@
+#ifndef OSSM_SOFTWARE_MOTION_TABLE_SERVICE_H
+#define OSSM_SOFTWARE_MOTION_TABLE_SERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiManager.h>
+
+#include "MotionTable.h"
+
+/**
+ * The motion table the "Custom" pattern plays, see MotionTable.h.
+ *
+ * Tables are written and checked on a computer with the patternlab tool,
+ * which prints the line to paste into the WiFi portal. The table is read
+ * once at boot, like the machine profile, so a new one takes a restart.
+ */
+
+inline MotionTable motionTable;
+
+namespace MotionTableStore {
+    static constexpr const char *nvsNamespace = "pattern";
+    static constexpr const char *nvsKey = "table";
+    // Bump when MotionTable changes layout, older blobs are then ignored.
+    static constexpr uint32_t version = 1;
+    // Until one is saved, Custom plays like Simple Stroke.
+    static constexpr const char *defaultTable = "100 1; 0 1";
+
+    struct Blob {
+        uint32_t version;
+        MotionTable table;
+    };
+}
+
+static bool readMotionTable(MotionTable &table) {
+    Preferences preferences;
+    if (!preferences.begin(MotionTableStore::nvsNamespace, true)) {
+        return false;
+    }
+    MotionTableStore::Blob blob{};
+    bool isRead = preferences.getBytesLength(MotionTableStore::nvsKey) ==
+                      sizeof(blob) &&
+                  preferences.getBytes(MotionTableStore::nvsKey, &blob,
+                                       sizeof(blob)) == sizeof(blob);
+    preferences.end();
+
+    if (!isRead || blob.version != MotionTableStore::version ||
+        !blob.table.isValid()) {
+        return false;
+    }
+    table = blob.table;
+    return true;
+}
+
+static bool saveMotionTable(const MotionTable &table) {
+    Preferences preferences;
+    if (!preferences.begin(MotionTableStore::nvsNamespace, false)) {
+        return false;
+    }
+    MotionTableStore::Blob blob{MotionTableStore::version, table};
+    bool isSaved = preferences.putBytes(MotionTableStore::nvsKey, &blob,
+                                        sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return isSaved;
+}
+
+static void loadMotionTable() {
+    if (readMotionTable(motionTable)) {
+        ESP_LOGI("MotionTable", "Loaded, %u keyframes",
+                 (unsigned)motionTable.count);
+    } else {
+        motionTable.parse(MotionTableStore::defaultTable);
+    }
+}
+
+static WiFiManagerParameter *motionTableParameter;
+
+/**
+ * Adds the table, as one line of text, to the portal.
+ */
+static void addMotionTableParameters(WiFiManager &wm) {
+    char text[MotionTable::formatLength + 1];
+    motionTable.format(text, sizeof(text));
+    motionTableParameter = new WiFiManagerParameter(
+        "motion_table", "Custom pattern motion table", text,
+        MotionTable::formatLength);
+    wm.addParameter(motionTableParameter);
+}
+
+/**
+ * Saves the submitted table for the next boot. A table that does not parse
+ * leaves the saved one as it was.
+ */
+static void saveMotionTableParameters() {
+    MotionTable table;
+    const char *text = motionTableParameter->getValue();
+    if (!table.parse(text)) {
+        ESP_LOGW("MotionTable", "Rejected: %s", text);
+        return;
+    }
+    if (memcmp(&table, &motionTable, sizeof(table)) == 0) {
+        return;
+    }
+    if (!saveMotionTable(table)) {
+        ESP_LOGW("MotionTable", "Could not save");
+        return;
+    }
+    ESP_LOGI("MotionTable", "Saved, applied after a restart");
+}
+
+#endif  // OSSM_SOFTWARE_MOTION_TABLE_SERVICE_H
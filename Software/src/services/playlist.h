@@ -0,0 +1,130 @@
+#ifndef OSSM_SOFTWARE_PLAYLIST_SERVICE_H
+#define OSSM_SOFTWARE_PLAYLIST_SERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiManager.h>
+
+#include "utils/Playlist.h"
+
+/**
+ * The playlists the pattern menu offers as Playlist 1 to 3, see
+ * utils/Playlist.h.
+ *
+ * They are edited in the WiFi portal, one line of text each, and read once
+ * at boot like the motion table, so new ones take a restart.
+ */
+
+namespace PlaylistStore {
+    static constexpr size_t slots = 3;
+    static constexpr const char *nvsNamespace = "playlist";
+    static constexpr const char *nvsKey = "lists";
+    // Bump when Playlist changes layout, older blobs are then ignored.
+    static constexpr uint32_t version = 1;
+    // Until they are saved, a few of the built in patterns.
+    static constexpr const char *defaults[slots] = {
+        "0 10x; 1 20x; 4 20x; 2 10x speed=60",
+        "6 30s; 5 30s; 3 30s",
+        "8 60s sensation=30; 8 60s sensation=70",
+    };
+
+    struct Blob {
+        uint32_t version;
+        Playlist playlists[slots];
+    };
+}
+
+inline Playlist playlists[PlaylistStore::slots];
+
+static bool readPlaylists(Playlist (&lists)[PlaylistStore::slots]) {
+    Preferences preferences;
+    if (!preferences.begin(PlaylistStore::nvsNamespace, true)) {
+        return false;
+    }
+    // Too large for the stack of the tasks that call this.
+    static PlaylistStore::Blob blob;
+    bool isRead = preferences.getBytesLength(PlaylistStore::nvsKey) ==
+                      sizeof(blob) &&
+                  preferences.getBytes(PlaylistStore::nvsKey, &blob,
+                                       sizeof(blob)) == sizeof(blob);
+    preferences.end();
+
+    if (!isRead || blob.version != PlaylistStore::version) {
+        return false;
+    }
+    for (const Playlist &playlist : blob.playlists) {
+        if (!playlist.isValid()) {
+            return false;
+        }
+    }
+    memcpy(lists, blob.playlists, sizeof(blob.playlists));
+    return true;
+}
+
+static bool savePlaylists(const Playlist (&lists)[PlaylistStore::slots]) {
+    Preferences preferences;
+    if (!preferences.begin(PlaylistStore::nvsNamespace, false)) {
+        return false;
+    }
+    static PlaylistStore::Blob blob;
+    blob.version = PlaylistStore::version;
+    memcpy(blob.playlists, lists, sizeof(blob.playlists));
+    bool isSaved = preferences.putBytes(PlaylistStore::nvsKey, &blob,
+                                        sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return isSaved;
+}
+
+static void loadPlaylists() {
+    if (readPlaylists(playlists)) {
+        ESP_LOGI("Playlist", "Loaded");
+        return;
+    }
+    for (size_t i = 0; i < PlaylistStore::slots; i++) {
+        playlists[i].parse(PlaylistStore::defaults[i]);
+    }
+}
+
+static WiFiManagerParameter *playlistParameters[PlaylistStore::slots];
+
+/**
+ * Adds each playlist, as one line of text, to the portal.
+ */
+static void addPlaylistParameters(WiFiManager &wm) {
+    static const char *const ids[PlaylistStore::slots] = {
+        "playlist_1", "playlist_2", "playlist_3"};
+    static const char *const labels[PlaylistStore::slots] = {
+        "Playlist 1", "Playlist 2", "Playlist 3"};
+    for (size_t i = 0; i < PlaylistStore::slots; i++) {
+        char text[Playlist::formatLength + 1];
+        playlists[i].format(text, sizeof(text));
+        playlistParameters[i] = new WiFiManagerParameter(
+            ids[i], labels[i], text, Playlist::formatLength);
+        wm.addParameter(playlistParameters[i]);
+    }
+}
+
+/**
+ * Saves the submitted playlists for the next boot. One that does not parse
+ * keeps the one saved before.
+ */
+static void savePlaylistParameters() {
+    static Playlist lists[PlaylistStore::slots];
+    memcpy(lists, playlists, sizeof(lists));
+    for (size_t i = 0; i < PlaylistStore::slots; i++) {
+        const char *text = playlistParameters[i]->getValue();
+        if (!lists[i].parse(text)) {
+            ESP_LOGW("Playlist", "Rejected: %s", text);
+        }
+    }
+    if (memcmp(lists, playlists, sizeof(lists)) == 0) {
+        return;
+    }
+    if (!savePlaylists(lists)) {
+        ESP_LOGW("Playlist", "Could not save");
+        return;
+    }
+    ESP_LOGI("Playlist", "Saved, applied after a restart");
+}
+
+#endif  // OSSM_SOFTWARE_PLAYLIST_SERVICE_H
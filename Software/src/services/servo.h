@@ -0,0 +1,241 @@
+#ifndef OSSM_SOFTWARE_SERVO_SERVICE_H
+#define OSSM_SOFTWARE_SERVO_SERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiManager.h>
+#include <esp_timer.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "constants/Config.h"
+#include "constants/Pins.h"
+#include "services/tasks.h"
+#include "utils/MotionSupervisor.h"
+#include "utils/ServoMonitor.h"
+
+/**
+ * Reads the servo drive over its Modbus port, see utils/ServoMonitor.h.
+ *
+ * The readings go to the supervisor, which stops the motor on a drive
+ * alarm or when it lags too far behind the steps, and to the telemetry.
+ * Polling runs in a task of its own at a low priority, so a slow or silent
+ * drive never holds up motion.
+ *
+ * Off by default, the model is set in the WiFi portal and read at boot.
+ * Tried on a computer against tools/servomock.
+ */
+
+struct ServoConfig {
+    // 1 + the index into ServoModels::all, 0 when off.
+    uint8_t model = 0;
+    uint8_t slave = 1;
+    // 0 for the model's default.
+    uint32_t baud = 0;
+    uint16_t pollIntervalMs = Config::Servo::pollIntervalMs;
+    float maxFollowingErrorMm = Config::Servo::maxFollowingErrorMm;
+};
+
+inline ServoConfig servoConfig;
+// Set up by initServo(), if a model is set.
+inline ServoMonitor<HardwareSerial> *servoMonitor = nullptr;
+
+namespace ServoStore {
+    static constexpr const char *nvsNamespace = "servo";
+    static constexpr const char *nvsKey = "config";
+    // Bump when ServoConfig changes layout, older blobs are then ignored.
+    static constexpr uint32_t version = 1;
+
+    struct Blob {
+        uint32_t version;
+        ServoConfig config;
+    };
+}
+
+static const ServoModel *servoModel(const ServoConfig &config) {
+    if (config.model == 0 || config.model > ServoModels::count) {
+        return nullptr;
+    }
+    return ServoModels::all[config.model - 1];
+}
+
+static bool readServoConfig(ServoConfig &config) {
+    Preferences preferences;
+    if (!preferences.begin(ServoStore::nvsNamespace, true)) {
+        return false;
+    }
+    ServoStore::Blob blob{};
+    bool isRead = preferences.getBytesLength(ServoStore::nvsKey) ==
+                      sizeof(blob) &&
+                  preferences.getBytes(ServoStore::nvsKey, &blob,
+                                       sizeof(blob)) == sizeof(blob);
+    preferences.end();
+
+    if (!isRead || blob.version != ServoStore::version ||
+        blob.config.pollIntervalMs == 0) {
+        return false;
+    }
+    config = blob.config;
+    return true;
+}
+
+static bool saveServoConfig(const ServoConfig &config) {
+    Preferences preferences;
+    if (!preferences.begin(ServoStore::nvsNamespace, false)) {
+        return false;
+    }
+    ServoStore::Blob blob{ServoStore::version, config};
+    bool isSaved = preferences.putBytes(ServoStore::nvsKey, &blob,
+                                        sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return isSaved;
+}
+
+static void loadServoConfig() {
+    if (!readServoConfig(servoConfig)) {
+        servoConfig = ServoConfig();
+    }
+}
+
+/**
+ * The latest reading, for the supervisor task only.
+ * @return true if it is new since the last call.
+ */
+static bool latestServoReading(ServoReading &reading) {
+    static uint32_t lastSequence = 0;
+    if (servoMonitor == nullptr) {
+        return false;
+    }
+    uint32_t sequence = servoMonitor->snapshot().read(reading);
+    bool isNew = sequence != lastSequence;
+    lastSequence = sequence;
+    return isNew;
+}
+
+static void servoTask(void *pvParameters) {
+    // Long enough for a few polls to fail in a row before it is worth a log.
+    const uint64_t silentMicros = 1000000;
+    uint64_t lastAnswer = esp_timer_get_time();
+    uint32_t polls = 0;
+    bool isSilent = false;
+
+    while (true) {
+        uint64_t now = esp_timer_get_time();
+        servoMonitor->poll(now);
+
+        const ServoLinkStats &stats = servoMonitor->stats();
+        if (stats.polls != polls) {
+            polls = stats.polls;
+            lastAnswer = now;
+            if (isSilent) {
+                ESP_LOGI("Servo", "Answering again");
+                isSilent = false;
+            }
+        } else if (!isSilent && now - lastAnswer > silentMicros) {
+            ESP_LOGW("Servo",
+                     "No answer: %u timeouts, %u bad CRCs, %u exceptions",
+                     (unsigned)stats.timeouts, (unsigned)stats.badCrcs,
+                     (unsigned)stats.exceptions);
+            isSilent = true;
+        }
+
+        // The UART buffers what arrives in between.
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * Opens the UART and starts polling, if a model is set.
+ */
+static void initServo() {
+    const ServoModel *model = servoModel(servoConfig);
+    if (model == nullptr) {
+        return;
+    }
+    uint32_t baud = servoConfig.baud != 0 ? servoConfig.baud : model->baud;
+    Serial2.begin(baud,
+                  model->parity == ServoParity::Even ? SERIAL_8E1
+                                                     : SERIAL_8N1,
+                  Pins::Servo::rxPin, Pins::Servo::txPin);
+    servoMonitor = new ServoMonitor<HardwareSerial>(
+        Serial2, *model, servoConfig.slave, baud,
+        servoConfig.pollIntervalMs * 1000,
+        Config::Servo::responseTimeoutMs * 1000);
+
+    if (model->hasFollowingError) {
+        motionSupervisor.setFollowingErrorLimit(
+            (uint32_t)(servoConfig.maxFollowingErrorMm * machine.stepsPerMm));
+    }
+    ESP_LOGI("Servo", "Polling %s at %u baud every %u ms", model->name,
+             (unsigned)baud, (unsigned)servoConfig.pollIntervalMs);
+    startTask(servoTask, "servoTask", taskLayout.servo, nullptr, &servoTaskH);
+}
+
+static WiFiManagerParameter *servoParameters[4];
+
+/**
+ * Adds the model, address, baud rate and following error limit to the
+ * portal.
+ */
+static void addServoParameters(WiFiManager &wm) {
+    const ServoModel *model = servoModel(servoConfig);
+    // Room for any value, the portal may have saved anything: "%g" of a
+    // float takes up to 13 characters, a 32-bit "%u" 10
+    char slave[4], baud[11], limit[16];
+    snprintf(slave, sizeof(slave), "%u", (unsigned)servoConfig.slave);
+    snprintf(baud, sizeof(baud), "%u", (unsigned)servoConfig.baud);
+    snprintf(limit, sizeof(limit), "%g", servoConfig.maxFollowingErrorMm);
+
+    servoParameters[0] = new WiFiManagerParameter(
+        "servo_model", "Servo Modbus (off, ihsv57, 57aim)",
+        model == nullptr ? "off" : model->name, 8);
+    servoParameters[1] = new WiFiManagerParameter(
+        "servo_slave", "Servo Modbus address", slave, sizeof(slave) - 1);
+    servoParameters[2] = new WiFiManagerParameter(
+        "servo_baud", "Servo baud rate, 0 for the model's", baud,
+        sizeof(baud) - 1);
+    servoParameters[3] = new WiFiManagerParameter(
+        "servo_limit", "Servo following error limit (mm), 0 for none",
+        limit, sizeof(limit) - 1);
+    for (auto *parameter : servoParameters) {
+        wm.addParameter(parameter);
+    }
+}
+
+/**
+ * Saves what the owner submitted in the portal for the next boot. An unknown
+ * model or address leaves the saved settings as they were.
+ */
+static void saveServoParameters() {
+    ServoConfig config = servoConfig;
+    const char *name = servoParameters[0]->getValue();
+    int model = ServoModels::find(name);
+    if (strcmp(name, "off") == 0) {
+        config.model = 0;
+    } else if (model >= 0) {
+        config.model = (uint8_t)(model + 1);
+    } else {
+        ESP_LOGW("Servo", "Unknown model: %s", name);
+        return;
+    }
+
+    int slave = atoi(servoParameters[1]->getValue());
+    if (slave < 1 || slave > 247) {
+        ESP_LOGW("Servo", "Not a Modbus address: %d", slave);
+        return;
+    }
+    config.slave = (uint8_t)slave;
+    config.baud = (uint32_t)strtoul(servoParameters[2]->getValue(), nullptr,
+                                    10);
+    config.maxFollowingErrorMm =
+        max(0.0f, (float)atof(servoParameters[3]->getValue()));
+
+    if (!saveServoConfig(config)) {
+        ESP_LOGW("Servo", "Could not save");
+        return;
+    }
+    ESP_LOGI("Servo", "Saved, applied after a restart");
+}
+
+#endif  // OSSM_SOFTWARE_SERVO_SERVICE_H
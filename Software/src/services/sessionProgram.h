@@ -0,0 +1,180 @@
+#ifndef OSSM_SOFTWARE_SESSION_PROGRAM_SERVICE_H
+#define OSSM_SOFTWARE_SESSION_PROGRAM_SERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiManager.h>
+
+#include "utils/SessionProgram.h"
+
+/**
+ * The session programs the pattern menu offers, see utils/SessionProgram.h.
+ *
+ * Warm Up and Waves are built in and stay in flash as blobs. Program is
+ * edited in the WiFi portal as one line of text, saved as its blob and read
+ * once at boot like the playlists, so a new one takes a restart.
+ */
+
+namespace SessionProgramStore {
+    static constexpr const char *nvsNamespace = "program";
+    static constexpr const char *nvsKey = "program";
+    // Bump when the blob changes layout, older ones are then ignored.
+    static constexpr uint32_t version = 1;
+    // Until one is saved, ten minutes of speeding up.
+    static constexpr const char *defaultText =
+        "pattern 0; speed 0 20, 600 60 ease";
+
+    struct Blob {
+        uint32_t version;
+        uint32_t size;
+        uint8_t program[SessionProgram::maxSize];
+    };
+
+    // Ramps up over three minutes, then bursts of speed every minute.
+    static const uint8_t warmUp[] = {
+        SessionProgram::version,
+        (uint8_t)StrokePatterns::SimpleStroke,
+        0,
+        0,
+        10,  // speed
+        2,   // stroke
+        2,   // depth
+        0,   // sensation
+        PROGRAM_KEYFRAME(0, 15, Linear),
+        PROGRAM_KEYFRAME(180, 50, Ease),
+        PROGRAM_KEYFRAME(240, 85, Step),
+        PROGRAM_KEYFRAME(250, 50, Step),
+        PROGRAM_KEYFRAME(300, 90, Step),
+        PROGRAM_KEYFRAME(310, 50, Step),
+        PROGRAM_KEYFRAME(360, 90, Step),
+        PROGRAM_KEYFRAME(375, 50, Step),
+        PROGRAM_KEYFRAME(420, 95, Step),
+        PROGRAM_KEYFRAME(440, 55, Step),
+        PROGRAM_KEYFRAME(0, 30, Linear),
+        PROGRAM_KEYFRAME(180, 80, Ease),
+        PROGRAM_KEYFRAME(0, 40, Linear),
+        PROGRAM_KEYFRAME(180, 90, Ease),
+    };
+
+    // Speed and sensation rise and fall, out of step, every 90 seconds.
+    static const uint8_t waves[] = {
+        SessionProgram::version,
+        (uint8_t)StrokePatterns::TeasingPounding,
+        SessionProgram::loopFlag,
+        0,
+        3,  // speed
+        0,  // stroke
+        0,  // depth
+        3,  // sensation
+        PROGRAM_KEYFRAME(0, 30, Linear),
+        PROGRAM_KEYFRAME(45, 70, Ease),
+        PROGRAM_KEYFRAME(90, 30, Ease),
+        PROGRAM_KEYFRAME(0, 80, Linear),
+        PROGRAM_KEYFRAME(45, 20, Ease),
+        PROGRAM_KEYFRAME(90, 80, Ease),
+    };
+}
+
+// The saved one, copied out of NVS so the player can keep a view of it.
+inline SessionProgramStore::Blob savedProgram;
+
+static bool readSessionProgram(SessionProgramStore::Blob &blob) {
+    Preferences preferences;
+    if (!preferences.begin(SessionProgramStore::nvsNamespace, true)) {
+        return false;
+    }
+    static SessionProgramStore::Blob read;
+    bool isRead = preferences.getBytesLength(SessionProgramStore::nvsKey) ==
+                      sizeof(read) &&
+                  preferences.getBytes(SessionProgramStore::nvsKey, &read,
+                                       sizeof(read)) == sizeof(read);
+    preferences.end();
+
+    if (!isRead || read.version != SessionProgramStore::version ||
+        read.size > sizeof(read.program) ||
+        !SessionProgram(read.program, read.size).isValid()) {
+        return false;
+    }
+    blob = read;
+    return true;
+}
+
+static bool saveSessionProgram(const SessionProgramStore::Blob &blob) {
+    Preferences preferences;
+    if (!preferences.begin(SessionProgramStore::nvsNamespace, false)) {
+        return false;
+    }
+    bool isSaved = preferences.putBytes(SessionProgramStore::nvsKey, &blob,
+                                        sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return isSaved;
+}
+
+static void loadSessionProgram() {
+    if (readSessionProgram(savedProgram)) {
+        ESP_LOGI("SessionProgram", "Loaded");
+        return;
+    }
+    size_t size = 0;
+    SessionProgram::parse(SessionProgramStore::defaultText,
+                          savedProgram.program, size);
+    savedProgram.version = SessionProgramStore::version;
+    savedProgram.size = size;
+}
+
+//! The program a pattern menu entry from Program1 on plays.
+static SessionProgram sessionProgramFor(StrokePatterns pattern) {
+    switch (pattern) {
+        case StrokePatterns::Program1:
+            return {SessionProgramStore::warmUp,
+                    sizeof(SessionProgramStore::warmUp)};
+        case StrokePatterns::Program2:
+            return {SessionProgramStore::waves,
+                    sizeof(SessionProgramStore::waves)};
+        default:
+            return {savedProgram.program, savedProgram.size};
+    }
+}
+
+static WiFiManagerParameter *sessionProgramParameter = nullptr;
+
+/**
+ * Adds the saved program, as one line of text, to the portal.
+ */
+static void addSessionProgramParameter(WiFiManager &wm) {
+    char text[SessionProgram::formatLength + 1];
+    SessionProgram(savedProgram.program, savedProgram.size)
+        .format(text, sizeof(text));
+    sessionProgramParameter =
+        new WiFiManagerParameter("session_program", "Session program", text,
+                                 SessionProgram::formatLength);
+    wm.addParameter(sessionProgramParameter);
+}
+
+/**
+ * Saves the submitted program for the next boot. One that does not parse
+ * keeps the one saved before.
+ */
+static void saveSessionProgramParameter() {
+    const char *text = sessionProgramParameter->getValue();
+    static SessionProgramStore::Blob blob;
+    blob = {};
+    blob.version = SessionProgramStore::version;
+    size_t size = 0;
+    if (!SessionProgram::parse(text, blob.program, size)) {
+        ESP_LOGW("SessionProgram", "Rejected: %s", text);
+        return;
+    }
+    blob.size = size;
+    if (blob.size == savedProgram.size &&
+        memcmp(blob.program, savedProgram.program, blob.size) == 0) {
+        return;
+    }
+    if (!saveSessionProgram(blob)) {
+        ESP_LOGW("SessionProgram", "Could not save");
+        return;
+    }
+    ESP_LOGI("SessionProgram", "Saved, applied after a restart");
+}
+
+#endif  // OSSM_SOFTWARE_SESSION_PROGRAM_SERVICE_H
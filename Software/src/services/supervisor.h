@@ -0,0 +1,111 @@
+#ifndef OSSM_SOFTWARE_SUPERVISOR_SERVICE_H
+#define OSSM_SOFTWARE_SUPERVISOR_SERVICE_H
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "DeferredLog.h"
+#include "FastAccelStepper.h"
+#include "services/flightRecorder.h"
+#include "services/servo.h"
+#include "services/tasks.h"
+#include "services/telemetry.h"
+#include "utils/Metrics.h"
+#include "utils/MotionSupervisor.h"
+
+/**
+ * Runs the motion supervisor at 1 kHz, and samples the telemetry while it
+ * has the motor's state at hand. Readings of the servo drive are checked as
+ * they come in, at the rate it is polled.
+ *
+ * On a violation the motor is stopped and disabled right here, and nothing
+ * else: the state machine's mutex may be held by any task and the error
+ * screen draws. handleMotionViolation() logs, records and hands it to the
+ * state machine from loop().
+ */
+namespace SupervisorService {
+    static FastAccelStepper *stepper = nullptr;
+    static void (*onViolation)(MotionViolation) = nullptr;
+    // The last violation, until loop() takes it. Position first, the
+    // violation publishes it.
+    static std::atomic<int32_t> violationPosition{0};
+    static std::atomic<MotionViolation> pendingViolation{
+        MotionViolation::None};
+}
+
+static void supervisorTask(void *pvParameters) {
+    FastAccelStepper *stepper = SupervisorService::stepper;
+    TickType_t lastWake = xTaskGetTickCount();
+    const TickType_t period = max((TickType_t)1, pdMS_TO_TICKS(1));
+    // Kept between readings, for the telemetry.
+    ServoReading servo = {};
+
+    while (true) {
+        vTaskDelayUntil(&lastWake, period);
+
+        int32_t position = stepper->getCurrentPosition();
+        int32_t speedMilliHz = stepper->getCurrentSpeedInMilliHz();
+        MotionViolation violation =
+            motionSupervisor.check(position, speedMilliHz);
+        if (latestServoReading(servo) &&
+            violation == MotionViolation::None) {
+            violation =
+                motionSupervisor.checkServo(servo.followingError, servo.alarm);
+        }
+        recordTelemetry(stepper, position, speedMilliHz, servo,
+                        violation != MotionViolation::None);
+        if (violation == MotionViolation::None) {
+            continue;
+        }
+
+        stepper->forceStop();
+        stepper->disableOutputs();
+
+        SupervisorService::violationPosition.store(position,
+                                                   std::memory_order_relaxed);
+        SupervisorService::pendingViolation.store(violation,
+                                                  std::memory_order_release);
+        metrics.recordStackHeadroom(MetricsTask::Supervisor,
+                                    uxTaskGetStackHighWaterMark(nullptr));
+    }
+}
+
+/**
+ * Call from loop(). Logs and records a violation the supervisor stopped the
+ * motor for, then hands it to the state machine.
+ */
+static void handleMotionViolation() {
+    MotionViolation violation = SupervisorService::pendingViolation.exchange(
+        MotionViolation::None, std::memory_order_acquire);
+    if (violation == MotionViolation::None) {
+        return;
+    }
+    int32_t position =
+        SupervisorService::violationPosition.load(std::memory_order_relaxed);
+
+    DEFERRED_LOGE("Supervisor", "Stopped: %s at %d steps",
+             motionViolationNames[(int)violation], position);
+    metrics.recordViolation();
+    saveFlightRecording(FlightEvent::Violation, (int32_t)violation, position);
+
+    if (SupervisorService::onViolation != nullptr) {
+        SupervisorService::onViolation(violation);
+    }
+}
+
+/**
+ * @param stepper the stepper to watch.
+ * @param onViolation called from loop() after the motor stopped, see
+ * handleMotionViolation().
+ */
+static void initMotionSupervisor(FastAccelStepper *stepper,
+                                 void (*onViolation)(MotionViolation)) {
+    SupervisorService::stepper = stepper;
+    SupervisorService::onViolation = onViolation;
+
+    startTask(supervisorTask, "supervisorTask", taskLayout.supervisor, nullptr,
+              &supervisorTaskH);
+}
+
+#endif  // OSSM_SOFTWARE_SUPERVISOR_SERVICE_H
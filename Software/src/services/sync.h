@@ -0,0 +1,216 @@
+#ifndef OSSM_SOFTWARE_SYNC_SERVICE_H
+#define OSSM_SOFTWARE_SYNC_SERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiManager.h>
+#include <esp_timer.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "constants/Config.h"
+#include "services/tasks.h"
+#include "structs/SettingPercents.h"
+#include "utils/SyncLink.h"
+
+/**
+ * Plays strokes in step with other OSSMs on the same network.
+ *
+ * One machine is the leader, the others follow it, chosen in the WiFi portal.
+ * The leader announces every stroke start on the shared clock, see
+ * utils/SyncLink.h, and the followers start theirs in the same direction at
+ * the same time, shifted by their phase offset. Followers play the leader's
+ * pattern, speed, stroke and sensation while their own speed knob is up;
+ * depth stays local, it depends on how each machine is mounted.
+ *
+ * Off by default. The role is read at boot, changing it takes a restart.
+ */
+
+struct SyncConfig {
+    SyncRole role = SyncRole::Off;
+    uint16_t port = Config::Sync::port;
+    // IPv4 address of the leader, empty to find it by broadcast.
+    char leaderAddress[16] = "";
+    // Added to the leader's start times, e.g. half a stroke to alternate.
+    int32_t phaseOffsetMicros = 0;
+    uint32_t leadMicros = Config::Sync::leadMicros;
+};
+
+inline SyncConfig syncConfig;
+inline SyncLink syncLink;
+// What the leader plays, as last handed over by the stroke engine task.
+inline SettingPercents syncSetting = {};
+
+namespace SyncStore {
+    static constexpr const char *nvsNamespace = "sync";
+    static constexpr const char *nvsKey = "config";
+    // Bump when SyncConfig changes layout, older blobs are then ignored.
+    static constexpr uint32_t version = 1;
+
+    struct Blob {
+        uint32_t version;
+        SyncConfig config;
+    };
+}
+
+static bool readSyncConfig(SyncConfig &config) {
+    Preferences preferences;
+    if (!preferences.begin(SyncStore::nvsNamespace, true)) {
+        return false;
+    }
+    SyncStore::Blob blob{};
+    bool isRead = preferences.getBytesLength(SyncStore::nvsKey) ==
+                      sizeof(blob) &&
+                  preferences.getBytes(SyncStore::nvsKey, &blob,
+                                       sizeof(blob)) == sizeof(blob);
+    preferences.end();
+
+    if (!isRead || blob.version != SyncStore::version) {
+        return false;
+    }
+    blob.config.leaderAddress[sizeof(blob.config.leaderAddress) - 1] = '\0';
+    config = blob.config;
+    return true;
+}
+
+static bool saveSyncConfig(const SyncConfig &config) {
+    Preferences preferences;
+    if (!preferences.begin(SyncStore::nvsNamespace, false)) {
+        return false;
+    }
+    SyncStore::Blob blob{SyncStore::version, config};
+    bool isSaved = preferences.putBytes(SyncStore::nvsKey, &blob,
+                                        sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return isSaved;
+}
+
+static void loadSyncConfig() {
+    if (!readSyncConfig(syncConfig)) {
+        syncConfig = SyncConfig();
+    }
+}
+
+static void syncTask(void *pvParameters) {
+    while (true) {
+        // The receive time is when this runs, so poll every tick.
+        syncLink.poll(esp_timer_get_time());
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * Opens the socket, if this machine takes part. LwIP takes the socket before
+ * WiFi connects, packets flow once it does.
+ */
+static void initSync() {
+    if (syncConfig.role == SyncRole::Off) {
+        return;
+    }
+    const char *leader = syncConfig.role == SyncRole::Follower
+                             ? syncConfig.leaderAddress
+                             : nullptr;
+    if (!syncLink.begin(syncConfig.role, syncConfig.port, leader)) {
+        ESP_LOGE("Sync", "Could not open port %d", syncConfig.port);
+        return;
+    }
+    ESP_LOGI("Sync", "%s on port %d",
+             syncConfig.role == SyncRole::Leader ? "Leading" : "Following",
+             syncConfig.port);
+    startTask(syncTask, "syncTask", taskLayout.sync, nullptr, &syncTaskH);
+}
+
+// Stroke gate for StrokeEngine::registerStrokeGateCallback().
+static uint32_t syncStrokeGate(int index) {
+    int64_t now = esp_timer_get_time();
+    if (syncConfig.role == SyncRole::Leader) {
+        return syncLink.leaderGate(now, index, syncConfig.leadMicros,
+                                   syncSetting);
+    }
+    return syncLink.followerGate(now, index, syncConfig.phaseOffsetMicros);
+}
+
+// The leader hands over what it plays, for the announcements.
+static void syncPublishSetting(const SettingPercents &setting) {
+    if (syncConfig.role == SyncRole::Leader) {
+        syncSetting = setting;
+    }
+}
+
+/**
+ * A follower plays what the leader plays, as long as its own speed knob is
+ * up, so turning it down still stops this machine.
+ */
+static void followLeaderSetting(SettingPercents &setting) {
+    SettingPercents leader;
+    if (syncConfig.role != SyncRole::Follower || setting.speed == 0 ||
+        !syncLink.leaderSetting(esp_timer_get_time(), leader)) {
+        return;
+    }
+    setting.speed = leader.speed;
+    setting.stroke = leader.stroke;
+    setting.sensation = leader.sensation;
+    setting.pattern = leader.pattern;
+}
+
+static WiFiManagerParameter *syncParameters[3];
+
+/**
+ * Adds the role, leader address and phase offset to the portal.
+ */
+static void addSyncParameters(WiFiManager &wm) {
+    static const char *roles[] = {"off", "leader", "follower"};
+    char offset[12];
+    snprintf(offset, sizeof(offset), "%d",
+             (int)(syncConfig.phaseOffsetMicros / 1000));
+
+    syncParameters[0] = new WiFiManagerParameter(
+        "sync_role", "Sync role (off, leader, follower)",
+        roles[(int)syncConfig.role], 8);
+    syncParameters[1] = new WiFiManagerParameter(
+        "sync_leader", "Sync leader IP, empty to search",
+        syncConfig.leaderAddress, sizeof(syncConfig.leaderAddress) - 1);
+    syncParameters[2] = new WiFiManagerParameter(
+        "sync_offset", "Sync phase offset (ms)", offset, sizeof(offset) - 1);
+    for (auto *parameter : syncParameters) {
+        wm.addParameter(parameter);
+    }
+}
+
+/**
+ * Saves what the owner submitted in the portal for the next boot. An unknown
+ * role or address leaves the saved settings as they were.
+ */
+static void saveSyncParameters() {
+    SyncConfig config = syncConfig;
+    const char *role = syncParameters[0]->getValue();
+    if (strcmp(role, "off") == 0) {
+        config.role = SyncRole::Off;
+    } else if (strcmp(role, "leader") == 0) {
+        config.role = SyncRole::Leader;
+    } else if (strcmp(role, "follower") == 0) {
+        config.role = SyncRole::Follower;
+    } else {
+        ESP_LOGW("Sync", "Unknown role: %s", role);
+        return;
+    }
+
+    const char *leader = syncParameters[1]->getValue();
+    in_addr address;
+    if (strlen(leader) >= sizeof(config.leaderAddress) ||
+        (leader[0] != '\0' && inet_pton(AF_INET, leader, &address) != 1)) {
+        ESP_LOGW("Sync", "Not an IPv4 address: %s", leader);
+        return;
+    }
+    strcpy(config.leaderAddress, leader);
+    config.phaseOffsetMicros = atoi(syncParameters[2]->getValue()) * 1000;
+
+    if (!saveSyncConfig(config)) {
+        ESP_LOGW("Sync", "Could not save");
+        return;
+    }
+    ESP_LOGI("Sync", "Saved, applied after a restart");
+}
+
+#endif  // OSSM_SOFTWARE_SYNC_SERVICE_H
@@ -1,6 +1,7 @@
 #ifndef OSSM_SOFTWARE_TASKS_H
 #define OSSM_SOFTWARE_TASKS_H
 
+#include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
 /**
@@ -22,7 +23,123 @@ static TaskHandle_t runHomingTaskH = nullptr;
 static TaskHandle_t runSimplePenetrationTaskH = nullptr;
 static TaskHandle_t runStrokeEngineTaskH = nullptr;
 
-static const int stepperCore = 1;
-static const int operationTaskCore = 0;
+static TaskHandle_t metricsTaskH = nullptr;
+static TaskHandle_t eStopTaskH = nullptr;
+static TaskHandle_t supervisorTaskH = nullptr;
+static TaskHandle_t deferredLogTaskH = nullptr;
+static TaskHandle_t syncTaskH = nullptr;
+static TaskHandle_t telemetryTaskH = nullptr;
+static TaskHandle_t servoTaskH = nullptr;
+// Notified from several translation units, so it must not be a per-file copy.
+inline TaskHandle_t flightRecorderTaskH = nullptr;
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Task Layout
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Where every task runs: core, priority and stack. Pick one with
+ * -D TASK_LAYOUT=<name> in platformio.ini, and measure it with
+ * tools/jitterbench.
+ *
+ * The ESP32 runs WiFi (priority 23) and LwIP (18) on core 0 and the Arduino
+ * loop on core 1.
+ */
+struct TaskSlot {
+    BaseType_t core;
+    UBaseType_t priority;
+    uint32_t stackSize;
+};
+
+struct TaskLayout {
+    const char *name;
+
+    // Motion
+    TaskSlot homing;
+    TaskSlot simplePenetration;
+    // Feeds settings to StrokeEngine, which moves in its stroking task.
+    TaskSlot strokeEngine;
+    TaskSlot stroking;
+
+    // Safety
+    TaskSlot supervisor;
+    TaskSlot eStop;
+
+    // Everything else
+    TaskSlot display;
+    TaskSlot menu;
+    TaskSlot metrics;
+    TaskSlot telemetry;
+    TaskSlot flightRecorder;
+    TaskSlot deferredLog;
+    // Times sync packets as they arrive, so above the UI.
+    TaskSlot sync;
+    // Polls the servo drive at a steady rate, so above the UI too.
+    TaskSlot servo;
+};
+
+namespace TaskLayouts {
+    // Motion shares core 0 with WiFi at the top priority, StrokeEngine strokes
+    // on core 1. The layout OSSM always had.
+    static constexpr TaskLayout wifiCore{
+        .name = "wifiCore",
+        .homing = {0, configMAX_PRIORITIES - 1, 10 * configMINIMAL_STACK_SIZE},
+        .simplePenetration = {0, configMAX_PRIORITIES - 1,
+                              30 * configMINIMAL_STACK_SIZE},
+        .strokeEngine = {0, configMAX_PRIORITIES - 1,
+                         10 * configMINIMAL_STACK_SIZE},
+        .stroking = {1, configMAX_PRIORITIES - 1, 4096},
+        .supervisor = {0, configMAX_PRIORITIES - 1,
+                       4 * configMINIMAL_STACK_SIZE},
+        .eStop = {0, configMAX_PRIORITIES - 1, 3 * configMINIMAL_STACK_SIZE},
+        .display = {tskNO_AFFINITY, 1, 3 * configMINIMAL_STACK_SIZE},
+        .menu = {tskNO_AFFINITY, 1, 5 * configMINIMAL_STACK_SIZE},
+        .metrics = {0, 1, 5 * configMINIMAL_STACK_SIZE},
+        .telemetry = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .flightRecorder = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .deferredLog = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .sync = {0, 10, 4 * configMINIMAL_STACK_SIZE},
+        .servo = {0, 5, 3 * configMINIMAL_STACK_SIZE}};
+
+    // Everything that moves the motor on core 1, away from WiFi. The safety
+    // tasks stay on core 0, so a stuck motion loop cannot keep them from
+    // stopping it. The StrokeEngine bridge only polls settings and drops
+    // below the stroking task it feeds.
+    static constexpr TaskLayout appCore{
+        .name = "appCore",
+        .homing = {1, configMAX_PRIORITIES - 1, 10 * configMINIMAL_STACK_SIZE},
+        .simplePenetration = {1, configMAX_PRIORITIES - 1,
+                              30 * configMINIMAL_STACK_SIZE},
+        .strokeEngine = {1, 5, 10 * configMINIMAL_STACK_SIZE},
+        .stroking = {1, configMAX_PRIORITIES - 1, 4096},
+        .supervisor = {0, configMAX_PRIORITIES - 1,
+                       4 * configMINIMAL_STACK_SIZE},
+        .eStop = {0, configMAX_PRIORITIES - 1, 3 * configMINIMAL_STACK_SIZE},
+        .display = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .menu = {0, 1, 5 * configMINIMAL_STACK_SIZE},
+        .metrics = {0, 1, 5 * configMINIMAL_STACK_SIZE},
+        .telemetry = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .flightRecorder = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .deferredLog = {0, 1, 3 * configMINIMAL_STACK_SIZE},
+        .sync = {0, 10, 4 * configMINIMAL_STACK_SIZE},
+        .servo = {0, 5, 3 * configMINIMAL_STACK_SIZE}};
+
+    static constexpr const TaskLayout *all[] = {&wifiCore, &appCore};
+}
+
+#ifndef TASK_LAYOUT
+#define TASK_LAYOUT wifiCore
+#endif
+
+static constexpr const TaskLayout &taskLayout = TaskLayouts::TASK_LAYOUT;
+
+static BaseType_t startTask(TaskFunction_t task, const char *name,
+                            const TaskSlot &slot, void *parameters,
+                            TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(task, name, slot.stackSize, parameters,
+                                   slot.priority, handle, slot.core);
+}
 
 #endif  // OSSM_SOFTWARE_TASKS_H
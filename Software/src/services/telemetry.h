@@ -0,0 +1,93 @@
+#ifndef OSSM_SOFTWARE_TELEMETRY_SERVICE_H
+#define OSSM_SOFTWARE_TELEMETRY_SERVICE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_timer.h>
+
+#include "FastAccelStepper.h"
+#include "constants/Config.h"
+#include "services/tasks.h"
+#include "utils/ServoMonitor.h"
+#include "utils/Telemetry.h"
+#include "utils/TelemetryServer.h"
+
+// Where the stream listens. The SIL moves it to run many boards on one host.
+inline uint16_t telemetryPort = Config::Web::telemetryPort;
+
+// About a second of samples, for WiFi to catch up after a stall.
+inline TelemetryRing<16> telemetry;
+
+/**
+ * Records what the motor does, called by the supervisor every millisecond.
+ * Costs a few varints while someone listens and nothing otherwise.
+ * @param servo the latest reading of the servo drive, all 0 without one.
+ */
+static void recordTelemetry(FastAccelStepper *stepper, int32_t position,
+                            int32_t speedMilliHz, const ServoReading &servo,
+                            bool isViolation) {
+    uint8_t flags = (stepper->isRunning() ? Telemetry::Moving : 0) |
+                    (isViolation ? Telemetry::Violation : 0) |
+                    (servo.alarm != 0 ? Telemetry::ServoAlarm : 0);
+    telemetry.record({(uint64_t)esp_timer_get_time(), position,
+                      stepper->targetPos(), speedMilliHz / 1000, flags,
+                      servo.followingError, servo.load});
+}
+
+/**
+ * Streams telemetry to whoever connects, one client at a time.
+ *
+ * Record a capture with:
+ *  nc <ossm-ip> 9101 > capture.ostm
+ * and read it with tools/telemetry.
+ */
+static void telemetryTask(void *pvParameters) {
+    static TelemetryServer server;
+
+    // Wait for the network before opening the socket.
+    while (WiFiClass::status() != WL_CONNECTED) {
+        vTaskDelay(1000);
+    }
+
+    if (!server.begin(telemetryPort)) {
+        ESP_LOGE("Telemetry", "Could not listen on port %d", telemetryPort);
+        vTaskDelete(nullptr);
+    }
+    ESP_LOGD("Telemetry", "Listening on port %d", server.port());
+
+    while (true) {
+        int client = server.accept();
+        if (client < 0) {
+            vTaskDelay(100);
+            continue;
+        }
+
+        // The supervisor samples every millisecond.
+        Telemetry::StreamHeader header =
+            Telemetry::streamHeader(1000, machine.stepsPerMm);
+        uint32_t dropped = telemetry.dropped();
+        telemetry.start();
+        bool isOpen = TelemetryServer::send(client, &header, sizeof(header));
+        while (isOpen) {
+            const Telemetry::Block *block = telemetry.front();
+            if (block == nullptr) {
+                // A block fills in about 70 ms.
+                vTaskDelay(20);
+                continue;
+            }
+            isOpen = TelemetryServer::send(client, block, sizeof(*block));
+            telemetry.pop();
+        }
+        telemetry.stop();
+        close(client);
+        ESP_LOGD("Telemetry", "Client gone, %u blocks dropped",
+                 (unsigned)(telemetry.dropped() - dropped));
+    }
+}
+
+static void initTelemetry() {
+    startTask(telemetryTask, "telemetryTask", taskLayout.telemetry, nullptr,
+              &telemetryTaskH);
+}
+
+#endif  // OSSM_SOFTWARE_TELEMETRY_SERVICE_H
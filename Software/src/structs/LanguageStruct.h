@@ -12,6 +12,7 @@ struct LanguageStruct {
     String Idle;
     String InDevelopment;
     String MeasuringStroke;
+    String MotionOutOfBounds;
     String NoInternalLoop;
     String Restart;
     String Settings;
@@ -30,8 +31,8 @@ struct LanguageStruct {
     String WiFiSetupLine1;
     String WiFiSetupLine2;
     String YouShouldNotBeHere;
-    String StrokeEngineDescriptions[7];
-    String StrokeEngineNames[7];
+    String StrokeEngineDescriptions[17];
+    String StrokeEngineNames[17];
 };
 
 #endif  // OSSM_SOFTWARE_LANGUAGESTRUCT_H
@@ -9,8 +9,43 @@ enum class StrokePatterns {
     Deeper,
     StopNGo,
     Insist,
+    Custom,
+    HumanTouch,
+    // The saved playlists, see utils/Playlist.h.
+    Playlist1,
+    Playlist2,
+    Playlist3,
+    // Session programs, see utils/SessionProgram.h: two built in, then the
+    // saved one.
+    Program1,
+    Program2,
+    Program3,
+    // Curves of position over time, see CurvePattern in pattern.h. Added
+    // after the programs so the playlists and programs keep their numbers.
+    SineStroke,
+    BezierStroke,
 };
 
+//! Whether a pattern menu entry is one of the saved playlists.
+inline bool isPlaylist(StrokePatterns pattern) {
+    return pattern >= StrokePatterns::Playlist1 &&
+           pattern <= StrokePatterns::Playlist3;
+}
+
+//! Whether a pattern menu entry is one of the session programs.
+inline bool isProgram(StrokePatterns pattern) {
+    return pattern >= StrokePatterns::Program1 &&
+           pattern <= StrokePatterns::Program3;
+}
+
+//! Whether a pattern number is a pattern StrokeEngine plays itself, not a
+//! playlist or a program.
+inline bool isPlainPattern(unsigned pattern) {
+    return pattern <= (unsigned)StrokePatterns::BezierStroke &&
+           !isPlaylist((StrokePatterns)pattern) &&
+           !isProgram((StrokePatterns)pattern);
+}
+
 struct SettingPercents {
     float speed;
     float stroke;
@@ -0,0 +1,176 @@
+#ifndef OSSM_SOFTWARE_CLOCKSYNC_H
+#define OSSM_SOFTWARE_CLOCKSYNC_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Clock Sync
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Estimates the offset and drift of a leader's clock from NTP style
+ * exchanges, so a follower can convert between its own clock and the shared
+ * one, the leader's.
+ *
+ * Each exchange gives four timestamps: t1 the follower sends, t2 the leader
+ * receives, t3 the leader replies, t4 the follower receives. Queueing only
+ * ever adds delay, so the exchanges with the shortest round trip carry the
+ * most accurate offsets. The estimate keeps those from a sliding window and
+ * fits a line through them, whose slope is the drift.
+ *
+ * All times are in microseconds. Adding samples does the math; converting a
+ * time is one multiplication, cheap enough for the stroking task.
+ */
+
+/**
+ * The line ClockSync fitted, all a conversion needs and small enough to
+ * copy out from under a lock.
+ */
+struct ClockEstimate {
+    // Whether there are enough samples to trust the offset.
+    bool isSynced() const { return synced; }
+
+    int64_t toShared(int64_t localMicros) const {
+        return localMicros + offsetAt(localMicros);
+    }
+
+    int64_t toLocal(int64_t sharedMicros) const {
+        // The offset changes by drift per microsecond, far below one
+        // microsecond over a round trip, so evaluating it at the shared time
+        // is close enough.
+        return sharedMicros - offsetAt(sharedMicros - baseOffset);
+    }
+
+    // Shared minus local, at the last sample.
+    int64_t offsetMicros() const { return offsetAt(lastLocal); }
+    // How much faster the leader's clock runs, in parts per million.
+    float driftPpm() const { return slope * 1e6f; }
+    // The shortest round trip in the window.
+    int64_t roundTripMicros() const { return minDelay; }
+
+    int64_t offsetAt(int64_t localMicros) const {
+        return baseOffset + int64_t(slope * float(localMicros - baseLocal));
+    }
+
+    bool synced = false;
+    int64_t minDelay = 0;
+    int64_t lastLocal = 0;
+    int64_t baseLocal = 0;
+    int64_t baseOffset = 0;
+    float slope = 0;
+};
+
+class ClockSync {
+  public:
+    static constexpr size_t window = 64;
+    // Samples within this much of the shortest round trip count as good.
+    static constexpr int64_t delaySlackMicros = 300;
+    // Below this span the drift is not fitted, only the offset.
+    static constexpr int64_t minFitSpanMicros = 2000000;
+
+    void addSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+        int64_t delay = (t4 - t1) - (t3 - t2);
+        if (delay < 0) {
+            // The leader took longer than the round trip, a clock jumped.
+            return;
+        }
+        Sample &sample = samples[next];
+        sample.localMicros = t1 + (t4 - t1) / 2;
+        sample.offsetMicros = ((t2 - t1) + (t3 - t4)) / 2;
+        sample.delayMicros = delay;
+        next = (next + 1) % window;
+        count = count < window ? count + 1 : window;
+        fit();
+    }
+
+    void reset() { *this = ClockSync(); }
+
+    const ClockEstimate &estimate() const { return line; }
+
+    bool isSynced() const { return line.isSynced(); }
+
+    int64_t toShared(int64_t localMicros) const {
+        return line.toShared(localMicros);
+    }
+
+    int64_t toLocal(int64_t sharedMicros) const {
+        return line.toLocal(sharedMicros);
+    }
+
+    int64_t offsetMicros() const { return line.offsetMicros(); }
+    float driftPpm() const { return line.driftPpm(); }
+    int64_t roundTripMicros() const { return line.roundTripMicros(); }
+
+  private:
+    struct Sample {
+        int64_t localMicros;
+        int64_t offsetMicros;
+        int64_t delayMicros;
+    };
+
+    void fit() {
+        line.synced = count >= 4;
+        int64_t minDelay = INT64_MAX;
+        for (size_t i = 0; i < count; i++) {
+            if (samples[i].delayMicros < minDelay) {
+                minDelay = samples[i].delayMicros;
+            }
+        }
+        line.minDelay = minDelay;
+        int64_t limit = minDelay + delaySlackMicros + minDelay / 2;
+
+        // Least squares around the first good sample, in double since this
+        // runs a few times per second outside the motion tasks.
+        const Sample *good[window];
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (samples[i].delayMicros <= limit) {
+                good[n++] = &samples[i];
+            }
+        }
+        if (n == 0) {
+            return;
+        }
+        int64_t originLocal = good[0]->localMicros;
+        int64_t originOffset = good[0]->offsetMicros;
+        double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+        int64_t first = INT64_MAX, last = INT64_MIN;
+        for (size_t i = 0; i < n; i++) {
+            double x = double(good[i]->localMicros - originLocal);
+            double y = double(good[i]->offsetMicros - originOffset);
+            sumX += x;
+            sumY += y;
+            sumXX += x * x;
+            sumXY += x * y;
+            first = good[i]->localMicros < first ? good[i]->localMicros : first;
+            last = good[i]->localMicros > last ? good[i]->localMicros : last;
+        }
+        double meanX = sumX / n;
+        double meanY = sumY / n;
+        double varX = sumXX / n - meanX * meanX;
+        double b = 0;
+        if (n >= 3 && last - first >= minFitSpanMicros && varX > 0) {
+            b = (sumXY / n - meanX * meanY) / varX;
+        }
+
+        // Keep the line anchored near now, so the float slope only ever
+        // multiplies short spans.
+        int64_t lastLocal = samples[(next + window - 1) % window].localMicros;
+        line.lastLocal = lastLocal;
+        line.baseLocal = lastLocal;
+        line.baseOffset =
+            originOffset +
+            int64_t(meanY + b * (double(lastLocal - originLocal) - meanX));
+        line.slope = float(b);
+    }
+
+    Sample samples[window] = {};
+    size_t next = 0;
+    size_t count = 0;
+    ClockEstimate line;
+};
+
+#endif  // OSSM_SOFTWARE_CLOCKSYNC_H
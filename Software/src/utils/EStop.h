@@ -0,0 +1,94 @@
+#ifndef OSSM_SOFTWARE_ESTOP_H
+#define OSSM_SOFTWARE_ESTOP_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Emergency Stop
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Bookkeeping for the dedicated emergency stop path in services/eStop.h.
+ *
+ * The button interrupt stamps press and release edges, a max priority task
+ * waits out the hold time and stops the motor without going through the
+ * state machine or its mutex. Everything here is a 32 bit atomic so it can be
+ * touched from the interrupt.
+ *
+ * Times are in microseconds and are allowed to wrap.
+ */
+class EmergencyStop {
+  public:
+    // Time allowed between the hold expiring and the outputs being disabled.
+    static constexpr uint32_t latencyBudgetMicros = 2000;
+
+    explicit EmergencyStop(uint32_t holdMicros) : holdMicros(holdMicros) {}
+
+    // Only trip while something is moving.
+    void arm() { armed.store(true); }
+    void disarm() { armed.store(false); }
+    bool isArmed() const { return armed.load(); }
+
+    /**
+     * Record a button edge. Safe to call from an interrupt.
+     * @param pressed the new button level.
+     * @param nowMicros time of the edge.
+     */
+    void onEdge(bool pressed, uint32_t nowMicros) {
+        pressedAtMicros.store(nowMicros, std::memory_order_relaxed);
+        isPressed.store(pressed, std::memory_order_release);
+    }
+
+    bool pressed() const { return isPressed.load(std::memory_order_acquire); }
+
+    /**
+     * @return how much longer the button must be held, 0 once the hold time
+     * has passed.
+     */
+    uint32_t remainingHoldMicros(uint32_t nowMicros) const {
+        uint32_t held = nowMicros - pressedAtMicros.load();
+        return held >= holdMicros ? 0 : holdMicros - held;
+    }
+
+    /**
+     * Latch the trip once the outputs are disabled.
+     * @param nowMicros time the outputs were disabled.
+     * @return the latency from the press edge, or 0 if this press had already
+     * tripped.
+     */
+    uint32_t trip(uint32_t nowMicros) {
+        if (tripped.exchange(true)) {
+            return 0;
+        }
+        uint32_t latency = nowMicros - pressedAtMicros.load();
+        lastLatencyMicros.store(latency);
+        return latency;
+    }
+
+    /**
+     * Clear the latch, called when the state machine catches up.
+     * @return true if the dedicated path stopped the machine.
+     */
+    bool acknowledge() { return tripped.exchange(false); }
+
+    // Latency beyond the hold time, which is what the budget applies to.
+    uint32_t overheadMicros(uint32_t latencyMicros) const {
+        return latencyMicros > holdMicros ? latencyMicros - holdMicros : 0;
+    }
+
+    uint32_t lastLatency() const { return lastLatencyMicros.load(); }
+
+    const uint32_t holdMicros;
+
+  private:
+    std::atomic<bool> armed{false};
+    std::atomic<bool> isPressed{false};
+    std::atomic<bool> tripped{false};
+    std::atomic<uint32_t> pressedAtMicros{0};
+    std::atomic<uint32_t> lastLatencyMicros{0};
+};
+
+#endif  // OSSM_SOFTWARE_ESTOP_H
@@ -0,0 +1,277 @@
+#ifndef OSSM_SOFTWARE_FLIGHTRECORDER_H
+#define OSSM_SOFTWARE_FLIGHTRECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Flight Recorder
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * A fixed-size binary ring buffer of the most recent state transitions,
+ * settings changes, motion commands and ADC peaks.
+ *
+ * Recording is a single atomic increment plus a 16 byte store, so it is cheap
+ * enough for the motion tasks. When something goes wrong the recorder is
+ * frozen and serialized into a dump, which services/flightRecorder.h writes to
+ * flash and tools/flightrec turns back into a readable timeline.
+ *
+ * The recorder has no constructor on purpose: it lives in RAM that is not
+ * cleared on a software reset, so the ring survives a panic and can be saved
+ * on the next boot. Call reset() to start a fresh recording.
+ */
+
+enum class FlightEvent : uint8_t {
+    None,
+    Boot,
+    State,
+    Setting,
+    Motion,
+    AdcPeak,
+    EmergencyStop,
+    Error,
+    Panic,
+    Violation,
+    NUM_EVENTS
+};
+
+static const char *const flightEventNames[(int)FlightEvent::NUM_EVENTS] = {
+    "none", "boot",   "state", "setting", "motion",
+    "adc",  "e-stop", "error", "panic",   "envelope"};
+
+enum class FlightSetting : uint8_t {
+    Speed,
+    Stroke,
+    Depth,
+    Sensation,
+    Pattern,
+    NUM_SETTINGS
+};
+
+static const char *const flightSettingNames[(int)FlightSetting::NUM_SETTINGS] = {
+    "speed", "stroke", "depth", "sensation", "pattern"};
+
+enum class FlightSource : uint8_t {
+    Homing,
+    SimplePenetration,
+    StrokeEngine,
+    NUM_SOURCES
+};
+
+static const char *const flightSourceNames[(int)FlightSource::NUM_SOURCES] = {
+    "homing", "simplePenetration", "strokeEngine"};
+
+/**
+ * One entry in the ring. The meaning of id, a and b depends on the type:
+ *
+ *  State:          id = index into the name table.
+ *  Setting:        id = FlightSetting, a = value * 100.
+ *  Motion:         id = FlightSource, a = target in steps, b = speed in Hz.
+ *  AdcPeak:        id = pin, a = peak in percent * 1000.
+ *  EmergencyStop:  a = position in steps, b = latency from the press in us.
+ *  Error / Panic:  a = reason code.
+ *  Violation:      a = MotionViolation, b = position in steps.
+ */
+struct FlightRecord {
+    uint32_t timeMs;
+    FlightEvent type;
+    uint8_t id;
+    uint16_t reserved;
+    int32_t a;
+    int32_t b;
+};
+static_assert(sizeof(FlightRecord) == 16, "FlightRecord must stay 16 bytes");
+
+namespace FlightDump {
+    static constexpr uint32_t magic = 0x5246534F;  // "OSFR"
+    static constexpr uint16_t version = 1;
+    static constexpr size_t maxNames = 32;
+    static constexpr size_t nameLength = 24;
+
+    // Header of a serialized dump. The records follow, oldest first.
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t sequence;
+        uint32_t frozenAtMs;
+        FlightEvent reason;
+        uint8_t nameCount;
+        uint16_t recordCount;
+        uint32_t checksum;
+        char names[maxNames][nameLength];
+    };
+
+    // FNV-1a, small and good enough to reject torn or erased dumps.
+    static uint32_t checksum(const uint8_t *data, size_t length,
+                             uint32_t hash = 2166136261u) {
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    /**
+     * Validate a dump and locate its records.
+     * @return the header, or nullptr if the buffer does not hold a valid dump.
+     */
+    static const Header *parse(const uint8_t *data, size_t length,
+                               const FlightRecord **records) {
+        if (length < sizeof(Header)) {
+            return nullptr;
+        }
+        const auto *header = reinterpret_cast<const Header *>(data);
+        if (header->magic != magic || header->version != version ||
+            header->recordSize != sizeof(FlightRecord) ||
+            header->nameCount > maxNames ||
+            sizeof(Header) + header->recordCount * sizeof(FlightRecord) >
+                length) {
+            return nullptr;
+        }
+        const uint8_t *body = data + offsetof(Header, names);
+        size_t bodyLength = sizeof(header->names) +
+                            header->recordCount * sizeof(FlightRecord);
+        if (checksum(body, bodyLength) != header->checksum) {
+            return nullptr;
+        }
+        *records = reinterpret_cast<const FlightRecord *>(data + sizeof(Header));
+        return header;
+    }
+}
+
+template <uint16_t Capacity>
+class FlightRecorderRing {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+  public:
+    static constexpr size_t dumpSize =
+        sizeof(FlightDump::Header) + Capacity * sizeof(FlightRecord);
+
+    // Whether the ring holds a recording from before the last reset.
+    bool isValid() const { return magic == FlightDump::magic; }
+
+    bool isFrozen() const { return __atomic_load_n(&frozen, __ATOMIC_ACQUIRE); }
+
+    // Time of the newest record, used to stamp a crash found after reboot.
+    uint32_t lastTimeMs() const {
+        return head == 0 ? 0 : records[(head - 1) & (Capacity - 1)].timeMs;
+    }
+
+    void reset() {
+        __atomic_store_n(&frozen, 0, __ATOMIC_RELEASE);
+        head = 0;
+        nameCount = 0;
+        frozenReason = FlightEvent::None;
+        frozenAtMs = 0;
+        memset(records, 0, sizeof(records));
+        magic = FlightDump::magic;
+    }
+
+    void record(FlightEvent type, uint8_t id, int32_t a, int32_t b,
+                uint32_t timeMs) {
+        if (isFrozen()) {
+            return;
+        }
+        uint32_t index = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+        FlightRecord &slot = records[index & (Capacity - 1)];
+        slot.timeMs = timeMs;
+        slot.type = type;
+        slot.id = id;
+        slot.reserved = 0;
+        slot.a = a;
+        slot.b = b;
+    }
+
+    /**
+     * Record a state transition. State names are copied into a small table
+     * the first time they are seen, so the dump is self describing.
+     *
+     * State changes are serialized by the state machine mutex, so interning
+     * does not need to be lock free.
+     */
+    void recordState(const char *state, uint32_t timeMs) {
+        uint8_t idx = 0;
+        while (idx < nameCount &&
+               strncmp(names[idx], state, FlightDump::nameLength - 1) != 0) {
+            idx++;
+        }
+        if (idx == nameCount && nameCount < FlightDump::maxNames) {
+            strncpy(names[idx], state, FlightDump::nameLength - 1);
+            names[idx][FlightDump::nameLength - 1] = '\0';
+            __atomic_store_n(&nameCount, nameCount + 1, __ATOMIC_RELEASE);
+        }
+        // 0xFF marks a state that did not fit in the table.
+        record(FlightEvent::State, idx < nameCount ? idx : 0xFF, 0, 0, timeMs);
+    }
+
+    // Stop recording so the ring can be saved. The first reason wins.
+    bool freeze(FlightEvent reason, uint32_t timeMs) {
+        uint32_t expected = 0;
+        if (!__atomic_compare_exchange_n(&frozen, &expected, 1, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        frozenReason = reason;
+        frozenAtMs = timeMs;
+        return true;
+    }
+
+    // Resume recording after the dump was saved.
+    void thaw() { __atomic_store_n(&frozen, 0, __ATOMIC_RELEASE); }
+
+    /**
+     * Serialize the frozen ring into a dump, oldest record first.
+     * @param out destination of at least dumpSize bytes.
+     * @param sequence dump number, to tell dumps apart in flash.
+     * @return the number of bytes written.
+     */
+    size_t serialize(uint8_t *out, uint32_t sequence) const {
+        auto *header = reinterpret_cast<FlightDump::Header *>(out);
+        memset(header, 0, sizeof(FlightDump::Header));
+        header->magic = FlightDump::magic;
+        header->version = FlightDump::version;
+        header->recordSize = sizeof(FlightRecord);
+        header->sequence = sequence;
+        header->frozenAtMs = frozenAtMs;
+        header->reason = frozenReason;
+        // A ring recovered after a crash is not trusted blindly.
+        uint8_t nameTotal =
+            nameCount < FlightDump::maxNames ? nameCount : FlightDump::maxNames;
+        header->nameCount = nameTotal;
+        memcpy(header->names, names, sizeof(names[0]) * nameTotal);
+
+        uint32_t end = head;
+        uint32_t count = end < Capacity ? end : Capacity;
+        auto *dst =
+            reinterpret_cast<FlightRecord *>(out + sizeof(FlightDump::Header));
+        for (uint32_t i = 0; i < count; i++) {
+            dst[i] = records[(end - count + i) & (Capacity - 1)];
+        }
+        header->recordCount = count;
+
+        const uint8_t *body = out + offsetof(FlightDump::Header, names);
+        header->checksum = FlightDump::checksum(
+            body, sizeof(header->names) + count * sizeof(FlightRecord));
+        return sizeof(FlightDump::Header) + count * sizeof(FlightRecord);
+    }
+
+  private:
+    uint32_t magic;
+    uint32_t head;
+    uint32_t frozen;
+    uint32_t frozenAtMs;
+    FlightEvent frozenReason;
+    uint8_t nameCount;
+    char names[FlightDump::maxNames][FlightDump::nameLength];
+    FlightRecord records[Capacity];
+};
+
+// 256 records cover roughly the last minute of a session.
+using FlightRecorder = FlightRecorderRing<256>;
+
+#endif  // OSSM_SOFTWARE_FLIGHTRECORDER_H
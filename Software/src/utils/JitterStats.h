@@ -0,0 +1,73 @@
+#ifndef OSSM_SOFTWARE_JITTERSTATS_H
+#define OSSM_SOFTWARE_JITTERSTATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Jitter Stats
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * How late a periodic task woke up, in microseconds, with exact percentiles.
+ *
+ * One counter per microsecond up to Range, everything later goes into one
+ * overflow counter and only moves the maximum. Recording is an increment and
+ * never allocates, so it can run inside the loop it measures.
+ */
+template <size_t Range = 2000>
+class JitterStats {
+  public:
+    void record(uint32_t lateMicros) {
+        if (lateMicros < Range) {
+            buckets[lateMicros]++;
+        } else {
+            overflow++;
+        }
+        samples++;
+        sum += lateMicros;
+        if (lateMicros > worst) {
+            worst = lateMicros;
+        }
+    }
+
+    void reset() { *this = JitterStats(); }
+
+    uint32_t count() const { return samples; }
+    uint32_t max() const { return worst; }
+    float mean() const { return samples == 0 ? 0 : float(sum) / samples; }
+    // Wake ups at least Range late.
+    uint32_t overflowed() const { return overflow; }
+
+    /**
+     * The lateness that percent of the wake ups stayed within.
+     * @return Range if that lies in the overflow, 0 without samples.
+     */
+    uint32_t percentile(float percent) const {
+        if (samples == 0) {
+            return 0;
+        }
+        // Nearest rank: the smallest value with at least percent below it.
+        auto rank = uint32_t(percent / 100.0f * samples + 0.999f);
+        rank = rank == 0 ? 1 : rank;
+        uint32_t seen = 0;
+        for (uint32_t i = 0; i < Range; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return i;
+            }
+        }
+        return Range;
+    }
+
+  private:
+    uint32_t buckets[Range] = {};
+    uint32_t overflow = 0;
+    uint32_t samples = 0;
+    uint64_t sum = 0;
+    uint32_t worst = 0;
+};
+
+#endif  // OSSM_SOFTWARE_JITTERSTATS_H
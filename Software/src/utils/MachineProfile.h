@@ -0,0 +1,130 @@
+#ifndef OSSM_SOFTWARE_MACHINEPROFILE_H
+#define OSSM_SOFTWARE_MACHINEPROFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Machine Profile
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * The mechanics of one machine: motor, pulley and belt, and its limits. The
+ * compiled default lives in Config::Driver; owners with another pulley or
+ * servo save their own in NVS, see services/machineProfile.h.
+ *
+ * Motion code never works with the profile directly but with the
+ * MachineKinematics derived from it, where every conversion is a
+ * precomputed factor, so converting a move costs one multiplication.
+ */
+struct MachineProfile {
+    // This should match the step/rev of your stepper or servo.
+    float motorStepPerRevolution;
+    // Number of teeth of the pulley on the motor shaft.
+    float pulleyToothCount;
+    // Distance between two teeth on the belt, 2 mm on GT2.
+    float beltPitchMm;
+    // Top linear speed.
+    float maxSpeedMmPerSecond;
+    // Top acceleration.
+    float maxAcceleration;
+    // Current, in percent of the sensor range, that marks a hard stop
+    // during homing.
+    float sensorlessCurrentLimit;
+
+    // Whether the values make a machine that can be driven at all.
+    bool isValid() const {
+        auto within = [](float value, float low, float high) {
+            return value >= low && value <= high;
+        };
+        return within(motorStepPerRevolution, 200, 51200) &&
+               within(pulleyToothCount, 8, 80) &&
+               within(beltPitchMm, 1, 10) &&
+               within(maxSpeedMmPerSecond, 10, 2000) &&
+               within(maxAcceleration, 100, 100000) &&
+               within(sensorlessCurrentLimit, 0.1f, 50);
+    }
+
+    bool operator==(const MachineProfile &other) const {
+        return motorStepPerRevolution == other.motorStepPerRevolution &&
+               pulleyToothCount == other.pulleyToothCount &&
+               beltPitchMm == other.beltPitchMm &&
+               maxSpeedMmPerSecond == other.maxSpeedMmPerSecond &&
+               maxAcceleration == other.maxAcceleration &&
+               sensorlessCurrentLimit == other.sensorlessCurrentLimit;
+    }
+};
+
+/**
+ * Everything the motion code needs, derived once from a profile.
+ */
+struct MachineKinematics {
+    MachineProfile profile;
+    float stepsPerMm;
+    float mmPerStep;
+    float maxSpeedStepsPerSecond;
+    float maxAccelerationStepsPerSecond2;
+
+    constexpr explicit MachineKinematics(const MachineProfile &profile)
+        : profile(profile),
+          stepsPerMm(profile.motorStepPerRevolution /
+                     (profile.pulleyToothCount * profile.beltPitchMm)),
+          mmPerStep((profile.pulleyToothCount * profile.beltPitchMm) /
+                    profile.motorStepPerRevolution),
+          maxSpeedStepsPerSecond(profile.maxSpeedMmPerSecond * stepsPerMm),
+          maxAccelerationStepsPerSecond2(profile.maxAcceleration * stepsPerMm) {
+    }
+
+    constexpr float steps(float mm) const { return mm * stepsPerMm; }
+    constexpr float mm(float steps) const { return steps * mmPerStep; }
+};
+
+/**
+ * The profile as text, one "key=value" per field, and back. This is what
+ * the WiFi portal shows and what owners paste into it.
+ */
+namespace MachineProfileText {
+    struct Field {
+        const char *key;
+        const char *label;
+        float MachineProfile::*value;
+    };
+
+    static constexpr Field fields[] = {
+        {"steps", "Motor steps per revolution",
+         &MachineProfile::motorStepPerRevolution},
+        {"teeth", "Pulley teeth", &MachineProfile::pulleyToothCount},
+        {"pitch", "Belt pitch (mm)", &MachineProfile::beltPitchMm},
+        {"speed", "Max speed (mm/s)", &MachineProfile::maxSpeedMmPerSecond},
+        {"accel", "Max acceleration (mm/s²)",
+         &MachineProfile::maxAcceleration},
+        {"current", "Homing current limit (%)",
+         &MachineProfile::sensorlessCurrentLimit},
+    };
+    static constexpr size_t fieldCount = sizeof(fields) / sizeof(fields[0]);
+
+    // Formats one field, "%g" keeps 800 as "800" and 1.5 as "1.5".
+    inline void format(const MachineProfile &profile, size_t field, char *out,
+                       size_t size) {
+        snprintf(out, size, "%g", (double)(profile.*fields[field].value));
+    }
+
+    /**
+     * Parses one field into profile.
+     * @return false, leaving profile as it was, if text is not a number.
+     */
+    inline bool parse(MachineProfile &profile, size_t field, const char *text) {
+        char *end = nullptr;
+        float value = strtof(text, &end);
+        if (end == text || *end != '\0') {
+            return false;
+        }
+        profile.*fields[field].value = value;
+        return true;
+    }
+}
+
+#endif  // OSSM_SOFTWARE_MACHINEPROFILE_H
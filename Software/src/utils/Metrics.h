@@ -0,0 +1,339 @@
+#ifndef OSSM_SOFTWARE_METRICS_H
+#define OSSM_SOFTWARE_METRICS_H
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Metrics
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Preallocated counters that back the local "/metrics" endpoint.
+ *
+ * Every value is a fixed-size atomic, so recording is a handful of
+ * instructions and can be done from any task, including the stroking loop.
+ * The metrics server only ever reads these values, it never calls into the
+ * stepper, StrokeEngine or the state machine.
+ *
+ * Rendering writes Prometheus text format into a caller provided buffer and
+ * never allocates.
+ */
+
+// Tasks that report their stack headroom.
+enum class MetricsTask {
+    Homing,
+    SimplePenetration,
+    StrokeEngine,
+    Stroking,
+    PlayControls,
+    Menu,
+    Metrics,
+    Supervisor,
+    NUM_TASKS
+};
+
+static const char *metricsTaskNames[(int)MetricsTask::NUM_TASKS] = {
+    "homing",     "simplePenetration", "strokeEngine", "stroking",
+    "playControls", "menu",            "metrics",      "supervisor"};
+
+/**
+ * A Prometheus histogram with fixed bucket bounds.
+ *
+ * Values are recorded in integer micro-units (microseconds for durations) and
+ * rendered in base units (seconds). The sum is 64 bits wide, 32 bits of
+ * microseconds would wrap after 71 minutes and Prometheus would see it go
+ * backwards.
+ */
+template <size_t N>
+class MetricsHistogram {
+  public:
+    explicit constexpr MetricsHistogram(const uint32_t (&bounds)[N])
+        : bounds(bounds) {}
+
+    void record(uint32_t value) {
+        size_t idx = 0;
+        while (idx < N && value > bounds[idx]) {
+            idx++;
+        }
+        buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint32_t count() const {
+        uint32_t total = 0;
+        for (const auto &bucket : buckets) {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    const uint32_t (&bounds)[N];
+    std::atomic<uint32_t> buckets[N + 1] = {};
+    std::atomic<uint64_t> sum{0};
+};
+
+namespace MetricsBuckets {
+    // Stroking loop latency in microseconds.
+    static constexpr uint32_t loopLatencyUs[] = {50,   100,  250,  500,
+                                                 1000, 2500, 5000, 10000};
+    // Emergency stop overhead beyond the hold time, in microseconds.
+    static constexpr uint32_t eStopUs[] = {100, 250, 500, 1000, 2000, 5000};
+    // Homing duration in microseconds.
+    static constexpr uint32_t homingUs[] = {2000000,  5000000,  10000000,
+                                            15000000, 20000000, 30000000};
+}
+
+class Metrics {
+  public:
+    static constexpr size_t maxStates = 48;
+
+    /**
+     * Record the time one pass of a stroking loop took.
+     * @param micros duration of the loop body in microseconds.
+     */
+    void recordLoopLatency(uint32_t micros) { loopLatency.record(micros); }
+
+    /**
+     * Record a completed in and out stroke.
+     * @param nowMicros the current time in microseconds.
+     */
+    void recordStroke(uint32_t nowMicros) {
+        uint32_t last = lastStrokeMicros.exchange(nowMicros);
+        strokes.fetch_add(1, std::memory_order_relaxed);
+        if (last != 0 && nowMicros > last) {
+            // strokes per minute, stored as milli-strokes per minute.
+            strokesPerMinuteMilli.store(
+                (uint32_t)(60000000000ULL / (nowMicros - last)),
+                std::memory_order_relaxed);
+        }
+    }
+
+    // Reset the strokes per minute gauge, for example when motion stops.
+    void clearStrokeRate() {
+        lastStrokeMicros.store(0);
+        strokesPerMinuteMilli.store(0);
+    }
+
+    void recordClip() { clips.fetch_add(1, std::memory_order_relaxed); }
+
+    void recordViolation() {
+        violations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recordHoming(uint32_t durationMicros) {
+        homing.record(durationMicros);
+    }
+
+    /**
+     * Record an emergency stop.
+     * @param latencyMicros time from the button press to outputs disabled.
+     * @param overheadMicros the part of the latency beyond the hold time.
+     */
+    void recordEStop(uint32_t latencyMicros, uint32_t overheadMicros) {
+        eStopOverhead.record(overheadMicros);
+        eStopLatency.store(latencyMicros, std::memory_order_relaxed);
+    }
+
+    /**
+     * Count a state machine transition into a state.
+     * @param state name of the destination state. Must have static storage.
+     */
+    void recordTransition(const char *state) {
+        for (auto &slot : states) {
+            const char *name = slot.name.load(std::memory_order_acquire);
+            if (name == nullptr) {
+                // claim an empty slot, if another task won the race then
+                // check whether it claimed it for the same state.
+                const char *expected = nullptr;
+                if (slot.name.compare_exchange_strong(expected, state)) {
+                    name = state;
+                } else {
+                    name = expected;
+                }
+            }
+            if (name == state || strcmp(name, state) == 0) {
+                slot.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        droppedTransitions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recordStackHeadroom(MetricsTask task, uint32_t bytes) {
+        stackHeadroom[(int)task].store(bytes, std::memory_order_relaxed);
+    }
+
+    void recordHeap(uint32_t freeBytes, uint32_t largestFreeBlock) {
+        heapFree.store(freeBytes, std::memory_order_relaxed);
+        heapLargestFreeBlock.store(largestFreeBlock,
+                                   std::memory_order_relaxed);
+    }
+
+    /**
+     * Render all metrics in Prometheus text format.
+     * @param buffer destination, always null terminated.
+     * @param size size of the destination.
+     * @param uptimeMillis the current uptime.
+     * @return number of characters written, or size if the output was
+     * truncated.
+     */
+    size_t render(char *buffer, size_t size, uint32_t uptimeMillis) const {
+        Writer w{buffer, size};
+
+        w.header("ossm_uptime_seconds", "gauge", "Time since boot.");
+        w.line("ossm_uptime_seconds %u.%03u\n", (unsigned)(uptimeMillis / 1000),
+               (unsigned)(uptimeMillis % 1000));
+
+        w.histogram("ossm_stroking_loop_latency_seconds",
+                    "Time spent in one pass of the stroking loop.",
+                    loopLatency);
+
+        w.header("ossm_strokes_total", "counter",
+                 "Completed in and out strokes.");
+        w.line("ossm_strokes_total %u\n", (unsigned)strokes.load());
+
+        uint32_t spm = strokesPerMinuteMilli.load();
+        w.header("ossm_strokes_per_minute", "gauge",
+                 "Stroke rate measured over the last stroke.");
+        w.line("ossm_strokes_per_minute %u.%03u\n", (unsigned)(spm / 1000),
+               (unsigned)(spm % 1000));
+
+        w.header("ossm_clips_total", "counter",
+                 "Moves clipped to the machine speed or acceleration limit.");
+        w.line("ossm_clips_total %u\n", (unsigned)clips.load());
+
+        w.header("ossm_envelope_violations_total", "counter",
+                 "Motion stopped by the supervisor.");
+        w.line("ossm_envelope_violations_total %u\n",
+               (unsigned)violations.load());
+
+        w.histogram("ossm_homing_duration_seconds",
+                    "Duration of each successful homing pass.", homing);
+
+        w.histogram("ossm_estop_overhead_seconds",
+                    "Emergency stop latency beyond the button hold time.",
+                    eStopOverhead);
+        uint32_t eStop = eStopLatency.load();
+        w.header("ossm_estop_last_latency_seconds", "gauge",
+                 "Time from button press to motor disabled, last stop.");
+        w.line("ossm_estop_last_latency_seconds %u.%06u\n",
+               (unsigned)(eStop / 1000000), (unsigned)(eStop % 1000000));
+
+        w.header("ossm_state_transitions_total", "counter",
+                 "State machine transitions by destination state.");
+        for (const auto &slot : states) {
+            const char *name = slot.name.load(std::memory_order_acquire);
+            if (name == nullptr) {
+                break;
+            }
+            w.line("ossm_state_transitions_total{state=\"%s\"} %u\n", name,
+                   (unsigned)slot.count.load());
+        }
+        w.header("ossm_state_transitions_dropped_total", "counter",
+                 "Transitions not counted because the state table is full.");
+        w.line("ossm_state_transitions_dropped_total %u\n",
+               (unsigned)droppedTransitions.load());
+
+        w.header("ossm_heap_free_bytes", "gauge", "Free heap.");
+        w.line("ossm_heap_free_bytes %u\n", (unsigned)heapFree.load());
+        w.header("ossm_heap_largest_free_block_bytes", "gauge",
+                 "Largest allocatable heap block.");
+        w.line("ossm_heap_largest_free_block_bytes %u\n",
+               (unsigned)heapLargestFreeBlock.load());
+
+        w.header("ossm_task_stack_headroom_bytes", "gauge",
+                 "Minimum free stack seen for a task.");
+        for (int i = 0; i < (int)MetricsTask::NUM_TASKS; i++) {
+            uint32_t headroom = stackHeadroom[i].load();
+            if (headroom == 0) {
+                // task has not reported yet.
+                continue;
+            }
+            w.line("ossm_task_stack_headroom_bytes{task=\"%s\"} %u\n",
+                   metricsTaskNames[i], (unsigned)headroom);
+        }
+
+        return w.truncated ? size : w.used;
+    }
+
+  private:
+    struct StateSlot {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint32_t> count{0};
+    };
+
+    struct Writer {
+        char *buffer;
+        size_t size;
+        size_t used = 0;
+        bool truncated = false;
+
+        void line(const char *format, ...) {
+            if (truncated || size == 0) {
+                truncated = true;
+                return;
+            }
+            va_list args;
+            va_start(args, format);
+            int n = vsnprintf(buffer + used, size - used, format, args);
+            va_end(args);
+            if (n < 0 || (size_t)n >= size - used) {
+                // drop the partial line so the output stays parseable.
+                buffer[used] = '\0';
+                truncated = true;
+                return;
+            }
+            used += n;
+        }
+
+        void header(const char *name, const char *type, const char *help) {
+            line("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+        }
+
+        template <size_t N>
+        void histogram(const char *name, const char *help,
+                       const MetricsHistogram<N> &h) {
+            header(name, "histogram", help);
+            uint32_t cumulative = 0;
+            for (size_t i = 0; i < N; i++) {
+                cumulative += h.buckets[i].load(std::memory_order_relaxed);
+                line("%s_bucket{le=\"%u.%06u\"} %u\n", name,
+                     (unsigned)(h.bounds[i] / 1000000),
+                     (unsigned)(h.bounds[i] % 1000000), (unsigned)cumulative);
+            }
+            cumulative += h.buckets[N].load(std::memory_order_relaxed);
+            uint64_t sum = h.sum.load(std::memory_order_relaxed);
+            line("%s_bucket{le=\"+Inf\"} %u\n", name, (unsigned)cumulative);
+            line("%s_sum %llu.%06u\n", name,
+                 (unsigned long long)(sum / 1000000),
+                 (unsigned)(sum % 1000000));
+            line("%s_count %u\n", name, (unsigned)cumulative);
+        }
+    };
+
+    MetricsHistogram<8> loopLatency{MetricsBuckets::loopLatencyUs};
+    MetricsHistogram<6> homing{MetricsBuckets::homingUs};
+    MetricsHistogram<6> eStopOverhead{MetricsBuckets::eStopUs};
+    std::atomic<uint32_t> eStopLatency{0};
+    std::atomic<uint32_t> strokes{0};
+    std::atomic<uint32_t> lastStrokeMicros{0};
+    std::atomic<uint32_t> strokesPerMinuteMilli{0};
+    std::atomic<uint32_t> clips{0};
+    std::atomic<uint32_t> violations{0};
+    StateSlot states[maxStates];
+    std::atomic<uint32_t> droppedTransitions{0};
+    std::atomic<uint32_t> heapFree{0};
+    std::atomic<uint32_t> heapLargestFreeBlock{0};
+    std::atomic<uint32_t> stackHeadroom[(int)MetricsTask::NUM_TASKS] = {};
+};
+
+// The one and only metrics registry, shared by every translation unit.
+inline Metrics metrics;
+
+#endif  // OSSM_SOFTWARE_METRICS_H
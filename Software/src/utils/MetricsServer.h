@@ -0,0 +1,155 @@
+#ifndef OSSM_SOFTWARE_METRICSSERVER_H
+#define OSSM_SOFTWARE_METRICSSERVER_H
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "utils/Metrics.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/**
+ * @brief A tiny HTTP server that answers "GET /metrics" and nothing else.
+ *
+ * It talks to the BSD socket API directly, which is provided by LwIP on the
+ * ESP32 and by the OS in the native build, so the same code can be scraped on
+ * the device and in a host test. All buffers are static members, a scrape
+ * never touches the heap.
+ *
+ * Usage:
+ *  1. begin() once the network is up.
+ *  2. call accept() periodically; it never blocks.
+ *  3. when it returns a client, refresh any sampled gauges and call serve().
+ */
+class MetricsServer {
+  public:
+    static constexpr size_t bodySize = 8192;
+
+    /**
+     * Open the listening socket.
+     * @param port TCP port, 0 picks a free port (see port()).
+     * @return true on success.
+     */
+    bool begin(uint16_t port) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+
+        if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(listenFd, 2) < 0) {
+            end();
+            return false;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd, (sockaddr *)&addr, &len);
+        boundPort = ntohs(addr.sin_port);
+
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL, 0) | O_NONBLOCK);
+        return true;
+    }
+
+    void end() {
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        listenFd = -1;
+    }
+
+    uint16_t port() const { return boundPort; }
+
+    /**
+     * @return a connected client, or -1 if nobody is waiting.
+     */
+    int accept() const {
+        if (listenFd < 0) {
+            return -1;
+        }
+        int client = ::accept(listenFd, nullptr, nullptr);
+        if (client < 0) {
+            return -1;
+        }
+
+        // The client socket is blocking, but never for long.
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) & ~O_NONBLOCK);
+        timeval timeout = {.tv_sec = 0, .tv_usec = 200000};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        return client;
+    }
+
+    /**
+     * Answer one request and close the connection.
+     * @param client socket returned by accept().
+     * @param registry the metrics to render.
+     * @param uptimeMillis the current uptime.
+     */
+    static void serve(int client, const Metrics &registry,
+                      uint32_t uptimeMillis) {
+        // The request line may come in pieces, read up to its end or until
+        // the client goes quiet for the receive timeout
+        size_t received = 0;
+        request[0] = '\0';
+        while (received < sizeof(request) - 1 &&
+               strstr(request, "\r\n") == nullptr) {
+            ssize_t n = recv(client, request + received,
+                             sizeof(request) - 1 - received, 0);
+            if (n <= 0) {
+                break;
+            }
+            received += n;
+            request[received] = '\0';
+        }
+
+        if (strncmp(request, "GET /metrics ", 13) != 0) {
+            static const char notFound[] =
+                "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n"
+                "Connection: close\r\n\r\n";
+            send(client, notFound, sizeof(notFound) - 1, MSG_NOSIGNAL);
+            close(client);
+            return;
+        }
+
+        size_t length = registry.render(body, sizeof(body), uptimeMillis);
+        if (length >= sizeof(body)) {
+            length = strlen(body);
+        }
+
+        int headerLength =
+            snprintf(header, sizeof(header),
+                     "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %u\r\n"
+                     "Connection: close\r\n\r\n",
+                     (unsigned)length);
+
+        send(client, header, headerLength, MSG_NOSIGNAL);
+        send(client, body, length, MSG_NOSIGNAL);
+        close(client);
+    }
+
+  private:
+    int listenFd = -1;
+    uint16_t boundPort = 0;
+
+    static inline char request[128];
+    static inline char header[128];
+    static inline char body[bodySize];
+};
+
+#endif  // OSSM_SOFTWARE_METRICSSERVER_H
@@ -0,0 +1,268 @@
+#ifndef OSSM_SOFTWARE_MODBUS_H
+#define OSSM_SOFTWARE_MODBUS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Modbus RTU
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Just enough Modbus RTU to read registers from a servo drive: the frames of
+ * function 0x03, read holding registers, and a client that never waits.
+ *
+ * A frame is the slave address, the function, its data and a CRC-16 sent
+ * low byte first. Registers are big endian.
+ */
+namespace Modbus {
+    static constexpr uint8_t readHoldingRegisters = 0x03;
+    // Set in the function of a response that reports an exception.
+    static constexpr uint8_t exceptionFlag = 0x80;
+    // The most one read may ask for, the spec's limit.
+    static constexpr uint16_t maxRegisters = 125;
+    static constexpr size_t requestSize = 8;
+    static constexpr size_t maxResponseSize = 5 + 2 * maxRegisters;
+
+    static inline uint16_t crc16(const uint8_t *data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+            }
+        }
+        return crc;
+    }
+
+    /**
+     * @return the size of the request written to out, always requestSize.
+     */
+    static inline size_t readRequest(uint8_t *out, uint8_t slave,
+                                     uint16_t address, uint16_t count) {
+        out[0] = slave;
+        out[1] = readHoldingRegisters;
+        out[2] = uint8_t(address >> 8);
+        out[3] = uint8_t(address);
+        out[4] = uint8_t(count >> 8);
+        out[5] = uint8_t(count);
+        uint16_t crc = crc16(out, 6);
+        out[6] = uint8_t(crc);
+        out[7] = uint8_t(crc >> 8);
+        return requestSize;
+    }
+
+    //! @return 0 if count is not 1 to maxRegisters.
+    static inline size_t readResponseSize(uint16_t count) {
+        if (count == 0 || count > maxRegisters) {
+            return 0;
+        }
+        return 5 + 2 * size_t(count);
+    }
+
+    enum class Status : uint8_t {
+        Ok,
+        // Too short to tell yet, wait for more bytes.
+        Incomplete,
+        BadCrc,
+        // The slave answered with an exception code.
+        Exception,
+        // Another slave, function or length than asked for.
+        Mismatch,
+    };
+
+    /**
+     * Reads the response to a read of count registers, Mismatch if count
+     * is not 1 to maxRegisters.
+     * @param registers filled with count values on Ok.
+     * @param exception the slave's exception code on Exception.
+     */
+    static inline Status parseReadResponse(const uint8_t *frame,
+                                           size_t length, uint8_t slave,
+                                           uint16_t count,
+                                           uint16_t *registers,
+                                           uint8_t &exception) {
+        if (count == 0 || count > maxRegisters) {
+            return Status::Mismatch;
+        }
+        if (length < 2) {
+            return Status::Incomplete;
+        }
+        if (frame[0] != slave) {
+            return Status::Mismatch;
+        }
+
+        size_t size;
+        if (frame[1] == (readHoldingRegisters | exceptionFlag)) {
+            size = 5;
+        } else if (frame[1] == readHoldingRegisters) {
+            size = readResponseSize(count);
+            if (length >= 3 && frame[2] != uint8_t(2 * count)) {
+                return Status::Mismatch;
+            }
+        } else {
+            return Status::Mismatch;
+        }
+        if (length < size) {
+            return Status::Incomplete;
+        }
+        if (length > size) {
+            return Status::Mismatch;
+        }
+
+        uint16_t crc = crc16(frame, size - 2);
+        if (frame[size - 2] != uint8_t(crc) ||
+            frame[size - 1] != uint8_t(crc >> 8)) {
+            return Status::BadCrc;
+        }
+        if (size == 5) {
+            exception = frame[2];
+            return Status::Exception;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            registers[i] = uint16_t(frame[3 + 2 * i] << 8 | frame[4 + 2 * i]);
+        }
+        return Status::Ok;
+    }
+
+    /**
+     * The silence between two frames, 3.5 characters of 11 bits, and the
+     * fixed 1750 us the spec allows above 19200 baud.
+     */
+    static inline uint32_t frameGapMicros(uint32_t baud) {
+        return baud > 19200 ? 1750 : uint32_t(38500000ULL / baud);
+    }
+}
+
+/**
+ * Reads registers over a serial port without ever waiting for it.
+ *
+ * request() sends a read and returns, poll() collects what arrived since and
+ * tells when the response is complete, bad or late. Anything else the task
+ * does in between goes on, and a slave that never answers costs nothing but
+ * the timeout.
+ *
+ * Port is anything with the calls of the Arduino HardwareSerial that take
+ * bytes:
+ *  int available();
+ *  int read();
+ *  size_t write(const uint8_t *data, size_t length);
+ */
+template <typename Port>
+class ModbusClient {
+  public:
+    enum class Result : uint8_t {
+        // Still waiting, poll again.
+        Pending,
+        Ok,
+        Timeout,
+        BadCrc,
+        Exception,
+        Mismatch,
+        NUM_RESULTS
+    };
+
+    /**
+     * @param responseTimeoutMicros how long after the request the whole
+     * response has to be in.
+     */
+    ModbusClient(Port &port, uint32_t baud, uint32_t responseTimeoutMicros)
+        : _port(port),
+          _gapMicros(Modbus::frameGapMicros(baud)),
+          _timeoutMicros(responseTimeoutMicros) {}
+
+    // Whether a request may go out: none is pending and the line was quiet.
+    bool isIdle(uint64_t nowMicros) const {
+        return !_isPending && nowMicros - _lastMicros >= _gapMicros;
+    }
+
+    /**
+     * Sends a read of count registers. Whatever the port still held, late
+     * bytes of an earlier response, is thrown away first.
+     * @return false if not idle or count is out of range.
+     */
+    bool request(uint8_t slave, uint16_t address, uint16_t count,
+                 uint64_t nowMicros) {
+        if (!isIdle(nowMicros) || count == 0 ||
+            count > Modbus::maxRegisters) {
+            return false;
+        }
+        while (_port.available() > 0) {
+            _port.read();
+        }
+        uint8_t frame[Modbus::requestSize];
+        _port.write(frame, Modbus::readRequest(frame, slave, address, count));
+        _slave = slave;
+        _count = count;
+        _length = 0;
+        _sentMicros = nowMicros;
+        _isPending = true;
+        return true;
+    }
+
+    /**
+     * Collects the response of the pending request.
+     * @return Pending until it is complete or late, then the outcome once.
+     */
+    Result poll(uint64_t nowMicros) {
+        if (!_isPending) {
+            return Result::Pending;
+        }
+        while (_port.available() > 0 && _length < sizeof(_frame)) {
+            _frame[_length++] = uint8_t(_port.read());
+            _lastMicros = nowMicros;
+        }
+
+        Modbus::Status status = Modbus::parseReadResponse(
+            _frame, _length, _slave, _count, _registers, _exception);
+        if (status == Modbus::Status::Incomplete) {
+            if (nowMicros - _sentMicros < _timeoutMicros) {
+                return Result::Pending;
+            }
+            _lastMicros = nowMicros;
+            return finish(Result::Timeout);
+        }
+        switch (status) {
+            case Modbus::Status::Ok:
+                return finish(Result::Ok);
+            case Modbus::Status::BadCrc:
+                return finish(Result::BadCrc);
+            case Modbus::Status::Exception:
+                return finish(Result::Exception);
+            default:
+                return finish(Result::Mismatch);
+        }
+    }
+
+    // The registers of the last Ok response.
+    const uint16_t *registers() const { return _registers; }
+
+    // The exception code of the last Exception response.
+    uint8_t exception() const { return _exception; }
+
+  private:
+    Result finish(Result result) {
+        _isPending = false;
+        return result;
+    }
+
+    Port &_port;
+    const uint32_t _gapMicros;
+    const uint32_t _timeoutMicros;
+
+    bool _isPending = false;
+    uint8_t _slave = 0;
+    uint16_t _count = 0;
+    uint64_t _sentMicros = 0;
+    // When the line was last busy, for the gap before the next request.
+    uint64_t _lastMicros = 0;
+
+    uint8_t _frame[Modbus::maxResponseSize];
+    size_t _length = 0;
+    uint16_t _registers[Modbus::maxRegisters];
+    uint8_t _exception = 0;
+};
+
+#endif  // OSSM_SOFTWARE_MODBUS_H
@@ -0,0 +1,185 @@
+#ifndef OSSM_SOFTWARE_MOTIONSUPERVISOR_H
+#define OSSM_SOFTWARE_MOTIONSUPERVISOR_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Motion Supervisor
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * An independent check of where the carriage is and how fast it moves.
+ *
+ * Every mode computes its own targets, so a bug in one of them can drive the
+ * carriage into the hard stops. The supervisor does not trust any of that:
+ * services/supervisor.h samples the stepper at 1 kHz and compares it to the
+ * envelope the active mode declared when it started.
+ *
+ * A check is a handful of loads and compares. The envelope is published with
+ * a sequence counter so a check never sees half of an old and half of a new
+ * envelope.
+ *
+ * With a servo monitor, the drive's own readings are checked too: how far
+ * the motor lags behind the steps, and whether the drive raised an alarm.
+ */
+
+enum class MotionViolation : uint8_t {
+    None,
+    BelowEnvelope,
+    AboveEnvelope,
+    OverSpeed,
+    FollowingError,
+    ServoAlarm,
+    NUM_VIOLATIONS
+};
+
+static const char *const
+    motionViolationNames[(int)MotionViolation::NUM_VIOLATIONS] = {
+        "none",       "below envelope",  "above envelope",
+        "over speed", "following error", "servo alarm"};
+
+// Allowed positions, inclusive, and top speed of the current mode.
+struct MotionEnvelope {
+    int32_t minSteps;
+    int32_t maxSteps;
+    uint32_t maxSpeedHz;
+};
+
+/**
+ * The envelope of a mode that moves from minSteps to maxSteps at up to
+ * maxSpeedHz, widened by toleranceSteps at both ends and by the factor
+ * speedTolerance in speed.
+ */
+inline MotionEnvelope envelopeFor(float minSteps, float maxSteps,
+                                  float maxSpeedHz, float toleranceSteps,
+                                  float speedTolerance) {
+    return {.minSteps = int32_t(minSteps - toleranceSteps),
+            .maxSteps = int32_t(maxSteps + toleranceSteps),
+            .maxSpeedHz = uint32_t(maxSpeedHz * speedTolerance)};
+}
+
+class MotionSupervisor {
+  public:
+    /**
+     * Start supervising against a new envelope.
+     * Only one task may publish at a time, the modes take turns.
+     */
+    void setEnvelope(const MotionEnvelope &envelope) {
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        minSteps.store(envelope.minSteps, std::memory_order_relaxed);
+        maxSteps.store(envelope.maxSteps, std::memory_order_relaxed);
+        maxSpeedMilliHz.store(envelope.maxSpeedHz * 1000,
+                              std::memory_order_relaxed);
+        sequence.store(seq + 2, std::memory_order_release);
+        armed.store(true, std::memory_order_release);
+    }
+
+    void disarm() { armed.store(false, std::memory_order_release); }
+
+    bool isArmed() const { return armed.load(std::memory_order_acquire); }
+
+    /**
+     * Compare one sample to the envelope. The supervisor disarms itself on
+     * the first violation, so a fault is reported once.
+     * @param positionSteps the stepper position.
+     * @param speedMilliHz the current stepper speed, either sign.
+     */
+    MotionViolation check(int32_t positionSteps, int32_t speedMilliHz) {
+        if (!isArmed()) {
+            return MotionViolation::None;
+        }
+
+        int32_t min, max;
+        uint32_t maxSpeed;
+        uint32_t seq;
+        do {
+            seq = sequence.load(std::memory_order_acquire);
+            min = minSteps.load(std::memory_order_relaxed);
+            max = maxSteps.load(std::memory_order_relaxed);
+            maxSpeed = maxSpeedMilliHz.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) != 0 ||
+                 seq != sequence.load(std::memory_order_relaxed));
+
+        uint32_t speed = speedMilliHz < 0 ? (uint32_t)(-(int64_t)speedMilliHz)
+                                          : (uint32_t)speedMilliHz;
+
+        MotionViolation violation = MotionViolation::None;
+        if (positionSteps < min) {
+            violation = MotionViolation::BelowEnvelope;
+        } else if (positionSteps > max) {
+            violation = MotionViolation::AboveEnvelope;
+        } else if (speed > maxSpeed) {
+            violation = MotionViolation::OverSpeed;
+        } else {
+            return MotionViolation::None;
+        }
+        return disarmFor(violation);
+    }
+
+    /**
+     * Largest following error the drive may report while armed, in steps.
+     * 0, the default, leaves it unchecked. Set once at boot.
+     */
+    void setFollowingErrorLimit(uint32_t steps) {
+        maxFollowingError.store(steps, std::memory_order_relaxed);
+    }
+
+    /**
+     * Compare a fresh reading of the servo drive, see utils/ServoMonitor.h.
+     * Disarms on the first violation like check().
+     * @param followingErrorSteps commanded minus actual position.
+     * @param alarm the drive's alarm code, 0 if none.
+     */
+    MotionViolation checkServo(int32_t followingErrorSteps, uint16_t alarm) {
+        if (!isArmed()) {
+            return MotionViolation::None;
+        }
+
+        uint32_t limit = maxFollowingError.load(std::memory_order_relaxed);
+        uint32_t error = followingErrorSteps < 0
+                             ? (uint32_t)(-(int64_t)followingErrorSteps)
+                             : (uint32_t)followingErrorSteps;
+
+        MotionViolation violation = MotionViolation::None;
+        if (alarm != 0) {
+            violation = MotionViolation::ServoAlarm;
+        } else if (limit != 0 && error > limit) {
+            violation = MotionViolation::FollowingError;
+        } else {
+            return MotionViolation::None;
+        }
+        return disarmFor(violation);
+    }
+
+    uint32_t violationCount() const { return violations.load(); }
+
+  private:
+    MotionViolation disarmFor(MotionViolation violation) {
+        // Another task may have disarmed in the meantime, that wins.
+        bool expected = true;
+        if (!armed.compare_exchange_strong(expected, false)) {
+            return MotionViolation::None;
+        }
+        violations.fetch_add(1, std::memory_order_relaxed);
+        return violation;
+    }
+
+    std::atomic<bool> armed{false};
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<int32_t> minSteps{0};
+    std::atomic<int32_t> maxSteps{0};
+    std::atomic<uint32_t> maxSpeedMilliHz{0};
+    std::atomic<uint32_t> maxFollowingError{0};
+    std::atomic<uint32_t> violations{0};
+};
+
+// Shared by every mode and the supervisor task.
+inline MotionSupervisor motionSupervisor;
+
+#endif  // OSSM_SOFTWARE_MOTIONSUPERVISOR_H
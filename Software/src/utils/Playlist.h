@@ -0,0 +1,207 @@
+#ifndef OSSM_SOFTWARE_PLAYLIST_H
+#define OSSM_SOFTWARE_PLAYLIST_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "structs/SettingPercents.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Playlist
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Patterns played one after the other, each for a number of strokes or
+ * seconds and with its own settings, then around again. StrokeEngine swaps
+ * from one to the next at the end of a stroke, see
+ * StrokeEngine::queuePattern().
+ *
+ * Playlists are written as text, one entry per line or separated by ';':
+ * "pattern length [setting=percent ...]". The pattern is its number in the
+ * pattern menu, from 0 for Simple Stroke. The length is "20x" for 20
+ * strokes or "30s" for 30 seconds; a timed entry hands over at the end of
+ * the stroke it runs out in. Settings are in percent like the knobs, speed,
+ * stroke, depth and sensation, and override the knob until the entry ends.
+ * "#" starts a comment.
+ *
+ *  1 20x speed=40; 0 30s depth=80 sensation=70; 5 10x
+ */
+
+struct PlaylistEntry {
+    uint8_t pattern;
+    // Length in seconds, otherwise in strokes.
+    bool isTimed;
+    uint16_t length;
+    // Percent, NAN leaves the knob's.
+    float speed;
+    float stroke;
+    float depth;
+    float sensation;
+};
+
+struct Playlist {
+    static constexpr size_t maxEntries = 16;
+    // "18 65535x speed=100 stroke=100 depth=100 sensation=100; " for every
+    // entry.
+    static constexpr size_t formatLength = 56 * maxEntries;
+
+    struct Setting {
+        const char *key;
+        float PlaylistEntry::*value;
+    };
+    static constexpr Setting settings[] = {
+        {"speed", &PlaylistEntry::speed},
+        {"stroke", &PlaylistEntry::stroke},
+        {"depth", &PlaylistEntry::depth},
+        {"sensation", &PlaylistEntry::sensation},
+    };
+
+    uint32_t count = 0;
+    PlaylistEntry entries[maxEntries] = {};
+
+    //! The entry after index, the first after the last.
+    size_t next(size_t index) const {
+        return count == 0 ? 0 : (index + 1) % count;
+    }
+
+    //! Whether the playlist can be played: one entry or more, each a plain
+    //! pattern with a length and settings within 0 to 100, speed above 0.
+    bool isValid() const {
+        if (count < 1 || count > maxEntries) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const PlaylistEntry &e = entries[i];
+            if (!isPlainPattern(e.pattern) || e.length == 0) {
+                return false;
+            }
+            for (const Setting &setting : settings) {
+                float value = e.*setting.value;
+                if (!std::isnan(value) && !(value >= 0 && value <= 100)) {
+                    return false;
+                }
+            }
+            if (e.speed == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*!
+      @brief Reads a playlist from text.
+      @return false, leaving the playlist as it was, if the text is not a
+      valid playlist.
+    */
+    bool parse(const char *text) {
+        Playlist playlist;
+        const char *p = text;
+        while (*p != '\0') {
+            // One entry up to the next separator.
+            size_t length = strcspn(p, ";\n");
+            char entry[96];
+            if (length >= sizeof(entry)) {
+                return false;
+            }
+            memcpy(entry, p, length);
+            entry[length] = '\0';
+            p += length + (p[length] != '\0');
+
+            char *comment = strchr(entry, '#');
+            if (comment != nullptr) {
+                *comment = '\0';
+            }
+            if (entry[strspn(entry, " \t\r")] == '\0') {
+                continue;
+            }
+            if (playlist.count == maxEntries ||
+                !parseEntry(entry, playlist.entries[playlist.count])) {
+                return false;
+            }
+            playlist.count++;
+        }
+        if (!playlist.isValid()) {
+            return false;
+        }
+        *this = playlist;
+        return true;
+    }
+
+    /*!
+      @brief Writes the playlist as one line of text that parse() reads
+      back, at most formatLength long.
+      @return the length, as snprintf(); the text is cut if it is longer
+      than size.
+    */
+    size_t format(char *out, size_t size) const {
+        size_t length = 0;
+        if (size > 0) {
+            out[0] = '\0';
+        }
+        auto append = [&](const char *fmt, auto... args) {
+            bool fits = length < size;
+            length += snprintf(fits ? out + length : nullptr,
+                               fits ? size - length : 0, fmt, args...);
+        };
+        for (uint32_t i = 0; i < count; i++) {
+            const PlaylistEntry &e = entries[i];
+            append("%s%u %u%c", i == 0 ? "" : "; ", (unsigned)e.pattern,
+                   (unsigned)e.length, e.isTimed ? 's' : 'x');
+            for (const Setting &setting : settings) {
+                if (!std::isnan(e.*setting.value)) {
+                    append(" %s=%g", setting.key, (double)(e.*setting.value));
+                }
+            }
+        }
+        return length;
+    }
+
+  private:
+    static bool parseEntry(char *text, PlaylistEntry &entry) {
+        entry = {0, false, 0, NAN, NAN, NAN, NAN};
+        unsigned pattern, length;
+        char unit;
+        int consumed = 0;
+        if (sscanf(text, " %u %u%c%n", &pattern, &length, &unit, &consumed) !=
+                3 ||
+            (unit != 'x' && unit != 's') || pattern > 255 || length > 65535) {
+            return false;
+        }
+        entry.pattern = (uint8_t)pattern;
+        entry.length = (uint16_t)length;
+        entry.isTimed = unit == 's';
+
+        // The settings, "key=value" each.
+        char *p = text + consumed;
+        while (true) {
+            char key[16];
+            float value;
+            int n = 0;
+            p += strspn(p, " \t\r");
+            if (*p == '\0') {
+                return true;
+            }
+            if (sscanf(p, "%15[a-z]=%f%n", key, &value, &n) != 2 ||
+                (p[n] != '\0' && strchr(" \t\r", p[n]) == nullptr)) {
+                return false;
+            }
+            const Setting *found = nullptr;
+            for (const Setting &setting : settings) {
+                if (strcmp(setting.key, key) == 0) {
+                    found = &setting;
+                }
+            }
+            if (found == nullptr) {
+                return false;
+            }
+            entry.*found->value = value;
+            p += n;
+        }
+    }
+};
+
+#endif  // OSSM_SOFTWARE_PLAYLIST_H
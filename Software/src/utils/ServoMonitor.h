@@ -0,0 +1,294 @@
+#ifndef OSSM_SOFTWARE_SERVOMONITOR_H
+#define OSSM_SOFTWARE_SERVOMONITOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/Modbus.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Servo Monitor
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * What the servo drive itself says about the motor, read over its Modbus
+ * port while the OSSM steps it.
+ *
+ * The step pulses only tell the drive where to go. Whether the motor got
+ * there, how hard it pulls and whether the drive has given up are on the
+ * drive's side of the cable. ServoMonitor polls them at a steady rate,
+ * one read at a time, and publishes the latest set for the supervisor and
+ * the telemetry to pick up without waiting.
+ */
+
+// One poll's worth of what the drive reports.
+struct ServoReading {
+    // When the last read of the poll completed.
+    uint64_t timeMicros;
+    // Where the drive's encoder puts the motor, in the drive's units.
+    int32_t position;
+    // Commanded minus actual position, in steps. 0 if not reported.
+    int32_t followingError;
+    int16_t speedRpm;
+    // Torque in 0.1 % of rated, or the drive's current reading.
+    int16_t load;
+    // The drive's alarm code, 0 while it is happy.
+    uint16_t alarm;
+};
+
+enum class ServoParity : uint8_t { None, Even };
+
+/**
+ * Where a drive keeps its readings. A poll reads every block of registers
+ * in turn and hands each to its decode function.
+ */
+struct ServoModel {
+    struct Read {
+        uint16_t address;
+        uint16_t count;
+        void (*decode)(const uint16_t *registers, ServoReading &reading);
+    };
+
+    const char *name;
+    uint32_t baud;
+    ServoParity parity;
+    // Whether the drive reports following error, or only position.
+    bool hasFollowingError;
+    uint8_t readCount;
+    Read reads[2];
+};
+
+namespace ServoModels {
+    static inline int32_t highFirst(const uint16_t *registers) {
+        return int32_t(uint32_t(registers[0]) << 16 | registers[1]);
+    }
+
+    /**
+     * JMC iHSV57 and iHSV60, from the monitor table of the JMC tuning
+     * software in Hardware/Servo Tools/IHV57. 32 bit values are two
+     * registers, high word first. The drive has no alarm register, an alarm
+     * shows as the following error it causes.
+     */
+    static constexpr ServoModel jmc{
+        "ihsv57",
+        57600,
+        ServoParity::Even,
+        true,
+        2,
+        {// 0x0836 feedback position, 0x0838 position deviation.
+         {0x0836, 4,
+          [](const uint16_t *registers, ServoReading &reading) {
+              reading.position = highFirst(registers);
+              reading.followingError = highFirst(registers + 2);
+          }},
+         // 0x0842 speed in rpm, 0x0843 reserved, 0x0844 torque in 0.1 %.
+         {0x0842, 3,
+          [](const uint16_t *registers, ServoReading &reading) {
+              reading.speedRpm = int16_t(registers[0]);
+              reading.load = int16_t(registers[2]);
+          }}}};
+
+    /**
+     * Gold Motor 57AIM, from the register map of the script in
+     * Hardware/Servo Tools/Gold Motor. The absolute position is low word
+     * first, and in encoder counts rather than steps, so it is reported but
+     * there is no following error to check.
+     */
+    static constexpr ServoModel goldMotor{
+        "57aim",
+        19200,
+        ServoParity::None,
+        false,
+        2,
+        {// 0x0E alarm code, 0x0F current, 0x10 speed in rpm.
+         {0x0E, 3,
+          [](const uint16_t *registers, ServoReading &reading) {
+              reading.alarm = registers[0];
+              reading.load = int16_t(registers[1]);
+              reading.speedRpm = int16_t(registers[2]);
+          }},
+         {0x16, 2,
+          [](const uint16_t *registers, ServoReading &reading) {
+              reading.position =
+                  int32_t(uint32_t(registers[1]) << 16 | registers[0]);
+          }}}};
+
+    static constexpr const ServoModel *all[] = {&jmc, &goldMotor};
+
+    static constexpr size_t count = sizeof(all) / sizeof(all[0]);
+
+    // The index of the model of that name, or -1.
+    static inline int find(const char *name) {
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(all[i]->name, name) == 0) {
+                return int(i);
+            }
+        }
+        return -1;
+    }
+}
+
+/**
+ * The latest reading, handed from the polling task to any number of
+ * readers with a sequence counter, like the supervisor's envelope. A reader
+ * never waits, and never sees half of two readings.
+ */
+class ServoSnapshot {
+  public:
+    void publish(const ServoReading &reading) {
+        uint32_t seq = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _timeMicros.store(reading.timeMicros, std::memory_order_relaxed);
+        _position.store(reading.position, std::memory_order_relaxed);
+        _followingError.store(reading.followingError,
+                              std::memory_order_relaxed);
+        _speedRpm.store(reading.speedRpm, std::memory_order_relaxed);
+        _load.store(reading.load, std::memory_order_relaxed);
+        _alarm.store(reading.alarm, std::memory_order_relaxed);
+        _sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @return a number that changes with every reading, 0 before the first.
+     */
+    uint32_t read(ServoReading &reading) const {
+        uint32_t seq;
+        do {
+            seq = _sequence.load(std::memory_order_acquire);
+            reading.timeMicros = _timeMicros.load(std::memory_order_relaxed);
+            reading.position = _position.load(std::memory_order_relaxed);
+            reading.followingError =
+                _followingError.load(std::memory_order_relaxed);
+            reading.speedRpm = _speedRpm.load(std::memory_order_relaxed);
+            reading.load = _load.load(std::memory_order_relaxed);
+            reading.alarm = _alarm.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) != 0 ||
+                 seq != _sequence.load(std::memory_order_relaxed));
+        return seq / 2;
+    }
+
+  private:
+    std::atomic<uint32_t> _sequence{0};
+    std::atomic<uint64_t> _timeMicros{0};
+    std::atomic<int32_t> _position{0};
+    std::atomic<int32_t> _followingError{0};
+    std::atomic<int16_t> _speedRpm{0};
+    std::atomic<int16_t> _load{0};
+    std::atomic<uint16_t> _alarm{0};
+};
+
+struct ServoLinkStats {
+    uint32_t polls;
+    uint32_t timeouts;
+    uint32_t badCrcs;
+    uint32_t exceptions;
+    uint32_t mismatches;
+};
+
+/**
+ * Polls one drive, a step at a time.
+ *
+ * Call poll() as often as convenient, every millisecond or so. It starts a
+ * poll every interval, sends its reads one after the other as the previous
+ * answer comes in, and publishes the reading once all are in. A read that
+ * fails drops the rest of that poll, the next starts on time.
+ */
+template <typename Port>
+class ServoMonitor {
+  public:
+    /**
+     * @param slave the drive's Modbus address.
+     * @param intervalMicros from the start of one poll to the next.
+     * @param responseTimeoutMicros how long one read may take.
+     */
+    ServoMonitor(Port &port, const ServoModel &model, uint8_t slave,
+                 uint32_t baud, uint32_t intervalMicros,
+                 uint32_t responseTimeoutMicros)
+        : _client(port, baud, responseTimeoutMicros),
+          _model(model),
+          _slave(slave),
+          _intervalMicros(intervalMicros) {}
+
+    void poll(uint64_t nowMicros) {
+        using Result = typename ModbusClient<Port>::Result;
+
+        if (!_isPolling) {
+            if (nowMicros < _nextPollMicros) {
+                return;
+            }
+            // Late polls are not caught up on, the interval is a rate.
+            _nextPollMicros =
+                _nextPollMicros + _intervalMicros > nowMicros
+                    ? _nextPollMicros + _intervalMicros
+                    : nowMicros + _intervalMicros;
+            _isPolling = true;
+            _read = 0;
+            _isSent = false;
+        }
+
+        if (!_isSent) {
+            const ServoModel::Read &read = _model.reads[_read];
+            _isSent = _client.request(_slave, read.address, read.count,
+                                      nowMicros);
+            return;
+        }
+
+        Result result = _client.poll(nowMicros);
+        switch (result) {
+            case Result::Pending:
+                return;
+            case Result::Ok:
+                _model.reads[_read].decode(_client.registers(), _reading);
+                if (++_read < _model.readCount) {
+                    _isSent = false;
+                    return;
+                }
+                _reading.timeMicros = nowMicros;
+                _snapshot.publish(_reading);
+                _stats.polls++;
+                break;
+            case Result::Timeout:
+                _stats.timeouts++;
+                break;
+            case Result::BadCrc:
+                _stats.badCrcs++;
+                break;
+            case Result::Exception:
+                _stats.exceptions++;
+                break;
+            default:
+                _stats.mismatches++;
+                break;
+        }
+        _isPolling = false;
+    }
+
+    const ServoSnapshot &snapshot() const { return _snapshot; }
+
+    const ServoModel &model() const { return _model; }
+
+    // Only for the polling task, others read the snapshot.
+    const ServoLinkStats &stats() const { return _stats; }
+
+  private:
+    ModbusClient<Port> _client;
+    const ServoModel &_model;
+    const uint8_t _slave;
+    const uint32_t _intervalMicros;
+
+    bool _isPolling = false;
+    bool _isSent = false;
+    uint8_t _read = 0;
+    uint64_t _nextPollMicros = 0;
+    ServoReading _reading = {};
+    ServoLinkStats _stats = {};
+    ServoSnapshot _snapshot;
+};
+
+#endif  // OSSM_SOFTWARE_SERVOMONITOR_H
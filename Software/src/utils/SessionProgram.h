@@ -0,0 +1,492 @@
+#ifndef OSSM_SOFTWARE_SESSIONPROGRAM_H
+#define OSSM_SOFTWARE_SESSIONPROGRAM_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "structs/SettingPercents.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Session Program
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * A timed program that moves the settings along keyframed curves over
+ * minutes, e.g. a slow warm up followed by bursts, and the pattern or
+ * playlist it plays them on. Speed, stroke, depth and sensation each have a
+ * track of keyframes; a track without any leaves its knob alone.
+ *
+ * A keyframe is a time in seconds, a value in percent like the knobs and
+ * the curve that leads to it: linear, ease, slow at both ends, or step,
+ * which holds the value before until its time. A track holds its first
+ * value before the first keyframe and its last after the last, unless the
+ * program loops.
+ *
+ * Programs are compact blobs, so the built in ones stay in flash as they
+ * are: an 8 byte header, the version, the pattern, flags, a spare byte and
+ * the keyframe count of each track, then 4 bytes per keyframe, track by
+ * track: the time, little endian, the value and the curve.
+ *
+ * As text, for the WiFi portal, one part per line or separated by ';'. "#"
+ * starts a comment.
+ *
+ *  pattern 0
+ *  loop
+ *  speed 0 10, 300 60 ease, 330 90 step, 345 60 step
+ */
+
+enum class ProgramCurve : uint8_t { Linear, Ease, Step };
+
+struct ProgramKeyframe {
+    uint16_t seconds;
+    uint8_t value;
+    ProgramCurve curve;
+};
+
+// The bytes of a keyframe, for the blobs of the built in programs.
+#define PROGRAM_KEYFRAME(seconds, value, curve)                          \
+    uint8_t((seconds) & 0xFF), uint8_t((seconds) >> 8), uint8_t(value), \
+        uint8_t(ProgramCurve::curve)
+
+/**
+ * A program blob, in flash or in RAM. It is not copied, the blob has to
+ * outlive the view.
+ */
+class SessionProgram {
+  public:
+    static constexpr uint8_t version = 1;
+    static constexpr size_t trackCount = 4;
+    static constexpr size_t headerSize = 4 + trackCount;
+    static constexpr size_t keyframeSize = 4;
+    static constexpr size_t maxKeyframes = 16;  // per track
+    static constexpr size_t maxSize =
+        headerSize + trackCount * maxKeyframes * keyframeSize;
+    static constexpr uint8_t loopFlag = 0x01;
+    // "pattern 18; loop; " and "sensation " with every keyframe as
+    // "65535 100 ease, " for each track.
+    static constexpr size_t formatLength =
+        24 + trackCount * (12 + 16 * maxKeyframes);
+
+    // The settings the tracks drive, in this order.
+    static constexpr float SettingPercents::*settings[trackCount] = {
+        &SettingPercents::speed, &SettingPercents::stroke,
+        &SettingPercents::depth, &SettingPercents::sensation};
+    static constexpr const char *trackNames[trackCount] = {
+        "speed", "stroke", "depth", "sensation"};
+    static constexpr const char *curveNames[] = {"linear", "ease", "step"};
+
+    SessionProgram() = default;
+    SessionProgram(const uint8_t *blob, size_t size)
+        : _blob(blob), _size(size) {}
+
+    /**
+     * Whether the blob is a program that can be played: this version,
+     * counts that match the size, times rising within a track, values up
+     * to 100, a speed of 1 or more and a plain pattern or a playlist.
+     */
+    bool isValid() const {
+        if (_blob == nullptr || _size < headerSize ||
+            _blob[0] != version ||
+            isProgram((StrokePatterns)_blob[1]) ||
+            _blob[1] > (uint8_t)StrokePatterns::BezierStroke) {
+            return false;
+        }
+        size_t keyframes = 0;
+        for (size_t track = 0; track < trackCount; track++) {
+            if (count(track) > maxKeyframes) {
+                return false;
+            }
+            keyframes += count(track);
+        }
+        if (keyframes == 0 || _size != headerSize + keyframes * keyframeSize) {
+            return false;
+        }
+        for (size_t track = 0; track < trackCount; track++) {
+            for (size_t i = 0; i < count(track); i++) {
+                ProgramKeyframe k = keyframe(track, i);
+                if (k.value > 100 || (track == 0 && k.value == 0) ||
+                    (uint8_t)k.curve > (uint8_t)ProgramCurve::Step ||
+                    (i > 0 && k.seconds <= keyframe(track, i - 1).seconds)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    StrokePatterns pattern() const { return (StrokePatterns)_blob[1]; }
+    bool isLooping() const { return (_blob[2] & loopFlag) != 0; }
+    uint8_t count(size_t track) const { return _blob[4 + track]; }
+
+    ProgramKeyframe keyframe(size_t track, size_t index) const {
+        size_t offset = headerSize;
+        for (size_t t = 0; t < track; t++) {
+            offset += count(t) * keyframeSize;
+        }
+        const uint8_t *p = _blob + offset + index * keyframeSize;
+        return {uint16_t(p[0] | p[1] << 8), p[2], (ProgramCurve)p[3]};
+    }
+
+    //! Seconds to the last keyframe of any track, one round of a loop.
+    uint32_t duration() const {
+        uint32_t longest = 0;
+        for (size_t track = 0; track < trackCount; track++) {
+            if (count(track) > 0) {
+                uint32_t last = keyframe(track, count(track) - 1).seconds;
+                longest = last > longest ? last : longest;
+            }
+        }
+        return longest;
+    }
+
+    const uint8_t *blob() const { return _blob; }
+    size_t size() const { return _size; }
+
+    /*!
+      @brief Reads a program from text into blob.
+      @return false, leaving blob and size as they were, if the text is not
+      a valid program.
+    */
+    static bool parse(const char *text, uint8_t (&blob)[maxSize],
+                      size_t &size) {
+        uint8_t pattern = 0;
+        uint8_t flags = 0;
+        ProgramKeyframe keyframes[trackCount][maxKeyframes];
+        uint8_t counts[trackCount] = {};
+
+        const char *p = text;
+        while (*p != '\0') {
+            // One part up to the next separator.
+            size_t length = strcspn(p, ";\n");
+            char part[512];
+            if (length >= sizeof(part)) {
+                return false;
+            }
+            memcpy(part, p, length);
+            part[length] = '\0';
+            p += length + (p[length] != '\0');
+
+            char *comment = strchr(part, '#');
+            if (comment != nullptr) {
+                *comment = '\0';
+            }
+            char name[16];
+            int consumed = 0;
+            if (sscanf(part, " %15s%n", name, &consumed) != 1) {
+                continue;
+            }
+            const char *rest = part + consumed;
+
+            if (strcmp(name, "loop") == 0) {
+                if (rest[strspn(rest, " \t\r")] != '\0') {
+                    return false;
+                }
+                flags |= loopFlag;
+            } else if (strcmp(name, "pattern") == 0) {
+                unsigned value;
+                char extra;
+                if (sscanf(rest, "%u %c", &value, &extra) != 1 ||
+                    value > (unsigned)StrokePatterns::BezierStroke ||
+                    isProgram((StrokePatterns)value)) {
+                    return false;
+                }
+                pattern = (uint8_t)value;
+            } else {
+                size_t track = 0;
+                while (track < trackCount &&
+                       strcmp(name, trackNames[track]) != 0) {
+                    track++;
+                }
+                if (track == trackCount || counts[track] != 0 ||
+                    !parseTrack(rest, keyframes[track], counts[track])) {
+                    return false;
+                }
+            }
+        }
+
+        uint8_t bytes[maxSize] = {version, pattern, flags, 0};
+        size_t written = headerSize;
+        for (size_t track = 0; track < trackCount; track++) {
+            bytes[4 + track] = counts[track];
+            for (size_t i = 0; i < counts[track]; i++) {
+                const ProgramKeyframe &k = keyframes[track][i];
+                bytes[written++] = uint8_t(k.seconds & 0xFF);
+                bytes[written++] = uint8_t(k.seconds >> 8);
+                bytes[written++] = k.value;
+                bytes[written++] = (uint8_t)k.curve;
+            }
+        }
+        if (!SessionProgram(bytes, written).isValid()) {
+            return false;
+        }
+        memcpy(blob, bytes, written);
+        size = written;
+        return true;
+    }
+
+    /*!
+      @brief Writes the program as one line of text that parse() reads
+      back, at most formatLength long.
+      @return the length, as snprintf(); the text is cut if it is longer
+      than size.
+    */
+    size_t format(char *out, size_t size) const {
+        size_t length = 0;
+        if (size > 0) {
+            out[0] = '\0';
+        }
+        auto append = [&](const char *fmt, auto... args) {
+            bool fits = length < size;
+            length += snprintf(fits ? out + length : nullptr,
+                               fits ? size - length : 0, fmt, args...);
+        };
+        append("pattern %u", (unsigned)_blob[1]);
+        if (isLooping()) {
+            append("; loop");
+        }
+        for (size_t track = 0; track < trackCount; track++) {
+            for (size_t i = 0; i < count(track); i++) {
+                ProgramKeyframe k = keyframe(track, i);
+                append(i == 0 ? "; %s " : ", ", trackNames[track]);
+                append("%u %u", (unsigned)k.seconds, (unsigned)k.value);
+                // Linear goes without saying.
+                if (k.curve != ProgramCurve::Linear) {
+                    append(" %s", curveNames[(uint8_t)k.curve]);
+                }
+            }
+        }
+        return length;
+    }
+
+  private:
+    const uint8_t *_blob = nullptr;
+    size_t _size = 0;
+
+    // "seconds value [curve]", separated by ','.
+    static bool parseTrack(const char *text,
+                           ProgramKeyframe (&keyframes)[maxKeyframes],
+                           uint8_t &count) {
+        const char *p = text;
+        while (true) {
+            size_t length = strcspn(p, ",");
+            char entry[32];
+            if (length >= sizeof(entry) || count == maxKeyframes) {
+                return false;
+            }
+            memcpy(entry, p, length);
+            entry[length] = '\0';
+
+            unsigned seconds, value;
+            char curve[8] = "linear";
+            char extra;
+            int n = sscanf(entry, "%u %u %7s %c", &seconds, &value, curve,
+                           &extra);
+            if (n < 2 || n > 3 || seconds > 65535 || value > 255) {
+                return false;
+            }
+            uint8_t shape = 0;
+            while (shape <= (uint8_t)ProgramCurve::Step &&
+                   strcmp(curve, curveNames[shape]) != 0) {
+                shape++;
+            }
+            if (shape > (uint8_t)ProgramCurve::Step) {
+                return false;
+            }
+            keyframes[count++] = {uint16_t(seconds), uint8_t(value),
+                                  (ProgramCurve)shape};
+
+            if (p[length] == '\0') {
+                return true;
+            }
+            p += length + 1;
+        }
+    }
+};
+
+/**
+ * Plays a program into the settings, a tick at a time.
+ *
+ * Each track keeps a cursor on the keyframes it is between, so a tick costs
+ * the same however long the program is: the cursor only moves on when a
+ * keyframe is passed, and the curve between two keyframes is evaluated
+ * from what was worked out when the cursor got there.
+ *
+ * The knobs stay live. Speed is capped by the knob, so turning it down
+ * slows the program and 0 still stops the machine. A stroke, depth or
+ * sensation knob that is turned takes over its track. The program picks
+ * the track up again once the knob rests and its curve comes within
+ * pickupPercent of the knob or crosses it.
+ */
+class ProgramPlayer {
+  public:
+    static constexpr float pickupPercent = 2;
+
+    void start(const SessionProgram &program) {
+        _program = program;
+        _isRunning = true;
+        _millis = 0;
+        _hasKnobs = false;
+        for (size_t track = 0; track < SessionProgram::trackCount; track++) {
+            _isOverridden[track] = false;
+        }
+        _rewind();
+    }
+
+    void stop() { _isRunning = false; }
+
+    bool isRunning() const { return _isRunning; }
+
+    /*!
+      @brief Moves the program on and drives the settings it has tracks
+      for, the way the knobs would. Time only moves while stroking, so the
+      program pauses when the machine does.
+      @param setting The knobs, overwritten with the program's values and
+      pattern
+      @param elapsedMillis Time stroked since the last tick
+    */
+    void apply(SettingPercents &setting, uint32_t elapsedMillis) {
+        if (!_isRunning) {
+            return;
+        }
+        _millis += elapsedMillis;
+        uint32_t round = _program.duration() * 1000;
+        if (_program.isLooping() && round > 0 && _millis >= round) {
+            _millis %= round;
+            _rewind();
+        }
+
+        for (size_t track = 0; track < SessionProgram::trackCount; track++) {
+            if (_program.count(track) == 0) {
+                continue;
+            }
+            _advance(track);
+            _values[track] = _evaluate(track);
+            // In whole percent like the knobs, so a slow ramp changes the
+            // settings now and then rather than every tick.
+            float value = roundf(_values[track]);
+            float &knob = setting.*SessionProgram::settings[track];
+
+            if (track == 0) {
+                // The speed knob is a ceiling
+                knob = knob < value ? knob : value;
+                continue;
+            }
+
+            float difference = knob - value;
+            if (_hasKnobs && knob != _knobs[track]) {
+                _isOverridden[track] = true;
+            } else if (_isOverridden[track] &&
+                       (fabsf(difference) <= pickupPercent ||
+                        difference * _differences[track] < 0)) {
+                _isOverridden[track] = false;
+            }
+            _knobs[track] = knob;
+            _differences[track] = difference;
+            if (!_isOverridden[track]) {
+                knob = value;
+            }
+        }
+        _hasKnobs = true;
+        setting.pattern = _program.pattern();
+    }
+
+    //! @return The value of a track at the last tick, in percent
+    float value(size_t track) const { return _values[track]; }
+
+    //! @return Whether a knob has taken the track over
+    bool isOverridden(size_t track) const { return _isOverridden[track]; }
+
+    //! @return Time into the program, or into the round of a loop
+    uint32_t millis() const { return _millis; }
+
+  private:
+    // The two keyframes a track is between, worked out once per segment
+    struct Cursor {
+        uint8_t next;
+        uint32_t fromMillis;
+        float from;
+        float change;
+        float perMillis;
+        ProgramCurve curve;
+    };
+
+    SessionProgram _program;
+    bool _isRunning = false;
+    uint32_t _millis = 0;
+    Cursor _cursors[SessionProgram::trackCount] = {};
+    float _values[SessionProgram::trackCount] = {};
+    bool _isOverridden[SessionProgram::trackCount] = {};
+    bool _hasKnobs = false;
+    float _knobs[SessionProgram::trackCount] = {};
+    float _differences[SessionProgram::trackCount] = {};
+
+    void _rewind() {
+        for (size_t track = 0; track < SessionProgram::trackCount; track++) {
+            _cursors[track].next = 0;
+            _setSegment(track);
+        }
+    }
+
+    // Moves the cursor past the keyframes that are due.
+    void _advance(size_t track) {
+        Cursor &cursor = _cursors[track];
+        bool isMoved = false;
+        while (cursor.next < _program.count(track) &&
+               _program.keyframe(track, cursor.next).seconds * 1000u <=
+                   _millis) {
+            cursor.next++;
+            isMoved = true;
+        }
+        if (isMoved) {
+            _setSegment(track);
+        }
+    }
+
+    void _setSegment(size_t track) {
+        Cursor &cursor = _cursors[track];
+        uint8_t count = _program.count(track);
+        if (count == 0) {
+            return;
+        }
+        if (cursor.next == 0 || cursor.next == count) {
+            // Before the first keyframe or after the last, hold
+            uint8_t held = cursor.next == 0 ? 0 : count - 1;
+            cursor.from = _program.keyframe(track, held).value;
+            cursor.change = 0;
+            cursor.perMillis = 0;
+            cursor.fromMillis = 0;
+            cursor.curve = ProgramCurve::Step;
+            return;
+        }
+        ProgramKeyframe from = _program.keyframe(track, cursor.next - 1);
+        ProgramKeyframe to = _program.keyframe(track, cursor.next);
+        cursor.fromMillis = from.seconds * 1000u;
+        cursor.from = from.value;
+        cursor.change = float(to.value) - float(from.value);
+        cursor.perMillis = 1.0f / (float(to.seconds - from.seconds) * 1000);
+        cursor.curve = to.curve;
+    }
+
+    float _evaluate(size_t track) const {
+        const Cursor &cursor = _cursors[track];
+        float u = float(_millis - cursor.fromMillis) * cursor.perMillis;
+        switch (cursor.curve) {
+            case ProgramCurve::Ease:
+                u = u * u * (3 - 2 * u);
+                break;
+            case ProgramCurve::Step:
+                u = 0;
+                break;
+            default:
+                break;
+        }
+        return cursor.from + cursor.change * u;
+    }
+};
+
+#endif  // OSSM_SOFTWARE_SESSIONPROGRAM_H
@@ -7,6 +7,8 @@
 
 #include "boost/sml.hpp"
 #include "constants/LogTags.h"
+#include "services/flightRecorder.h"
+#include "utils/Metrics.h"
 
 namespace sml = boost::sml;
 using namespace sml;
@@ -37,9 +39,9 @@ struct StateLogger {
     template <class SM, class TGuard, class TEvent>
     [[gnu::used]] void log_guard(const TGuard&, const TEvent&, bool result) {
         String resultString = result ? "[PASS]" : "[DO NOT PASS]";
-        ESP_LOGV(STATE_MACHINE_TAG, "%s: %s", resultString,
+        ESP_LOGV(STATE_MACHINE_TAG, "%s: %s", resultString.c_str(),
                  sml::aux::get_type_name<SM>());
-        ESP_LOGD(STATE_MACHINE_TAG, "%s: %s, %s", resultString,
+        ESP_LOGD(STATE_MACHINE_TAG, "%s: %s, %s", resultString.c_str(),
                  sml::aux::get_type_name<TGuard>(),
                  sml::aux::get_type_name<TEvent>());
     }
@@ -54,6 +56,8 @@ struct StateLogger {
                                         const TDstState& dst) {
         ESP_LOGV(STATE_MACHINE_TAG, "%s", sml::aux::get_type_name<SM>());
         ESP_LOGD(STATE_MACHINE_TAG, "%s -> %s", src.c_str(), dst.c_str());
+        metrics.recordTransition(dst.c_str());
+        recordFlightState(dst.c_str());
     }
 };
 #endif  // OSSM_SOFTWARE_STATELOGGER_H
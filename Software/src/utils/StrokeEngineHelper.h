@@ -15,19 +15,22 @@
 // enum of stroke engine states
 enum PlayControls { STROKE, DEPTH, SENSATION };
 
-static motorProperties servoMotor{
-    .maxSpeed =
-        60 * (Config::Driver::maxSpeedMmPerSecond /
-              (Config::Driver::pulleyToothCount * Config::Driver::beltPitchMm)),
-    .maxAcceleration = Config::Driver::maxAcceleration,
-    .stepsPerMillimeter =
-        Config::Driver::motorStepPerRevolution /
-        (Config::Driver::pulleyToothCount * Config::Driver::beltPitchMm),
-    .invertDirection = true,
-    .enableActiveLow = true,
-    .stepPin = Pins::Driver::motorStepPin,
-    .directionPin = Pins::Driver::motorDirectionPin,
-    .enablePin = Pins::Driver::motorEnablePin};
+// StrokeEngine's view of a machine, at the same top speed the motion
+// supervisor allows stroking.
+static motorProperties servoMotorFor(const MachineKinematics &kinematics) {
+    const MachineProfile &profile = kinematics.profile;
+    return {.maxSpeed = profile.maxSpeedMmPerSecond,
+            .maxAcceleration = profile.maxAcceleration,
+            .stepsPerMillimeter = kinematics.stepsPerMm,
+            .invertDirection = true,
+            .enableActiveLow = true,
+            .stepPin = Pins::Driver::motorStepPin,
+            .directionPin = Pins::Driver::motorDirectionPin,
+            .enablePin = Pins::Driver::motorEnablePin};
+}
+
+// Refreshed from the loaded profile each time StrokeEngine starts.
+static motorProperties servoMotor = servoMotorFor(machine);
 
 static bool isChangeSignificant(float oldPct, float newPct) {
     return oldPct != newPct &&
@@ -0,0 +1,439 @@
+#ifndef OSSM_SOFTWARE_SYNCLINK_H
+#define OSSM_SOFTWARE_SYNCLINK_H
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <mutex>
+
+#include "structs/SettingPercents.h"
+#include "utils/ClockSync.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Sync Link
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Lockstep playback of several OSSMs over UDP.
+ *
+ * The leader's clock is the shared clock. Followers estimate it with
+ * ClockSync from time requests they send twice per second. Whenever
+ * the leader is about to start a stroke it announces the shared time the
+ * stroke starts, a short lead time ahead, together with its pattern and
+ * settings. Both wait for that time before moving, the followers shifted by
+ * their phase offset.
+ *
+ * Like MetricsServer it talks to the BSD socket API, LwIP on the ESP32 and the
+ * OS on the host, and never blocks. poll() runs in a service task; the gates
+ * are called from the stroking task. Times are microseconds of the caller's
+ * local clock.
+ */
+
+enum class SyncRole : uint8_t { Off, Leader, Follower };
+
+namespace SyncWire {
+    static constexpr uint32_t magic = 0x5953534f;  // "OSSY"
+    static constexpr uint8_t version = 1;
+
+    enum Type : uint8_t { TimeRequest = 1, TimeReply = 2, Stroke = 3 };
+
+    // Sent as is, the ESP32 and PCs are both little endian.
+    struct Header {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t type;
+        uint16_t reserved;
+    };
+
+    struct TimeRequestPacket {
+        Header header;
+        int64_t t1;
+    };
+
+    struct TimeReplyPacket {
+        Header header;
+        int64_t t1;
+        int64_t t2;
+        int64_t t3;
+    };
+
+    struct StrokePacket {
+        Header header;
+        uint32_t sequence;
+        // The leader's stroke index, its parity is the direction.
+        int32_t index;
+        // Shared time the stroke starts.
+        int64_t startMicros;
+        float speed;
+        float stroke;
+        float sensation;
+        float depth;
+        uint8_t pattern;
+        uint8_t reserved[7];
+    };
+
+    static_assert(sizeof(TimeRequestPacket) == 16, "Wire format");
+    static_assert(sizeof(TimeReplyPacket) == 32, "Wire format");
+    static_assert(sizeof(StrokePacket) == 48, "Wire format");
+}
+
+struct SyncStats {
+    // Follower strokes started on the leader's schedule.
+    uint32_t aligned = 0;
+    // Started after their scheduled time, and by how much at most.
+    uint32_t late = 0;
+    int64_t worstLateMicros = 0;
+    // Started without a schedule, the leader was not heard in time.
+    uint32_t missed = 0;
+    // Announcements the leader sent.
+    uint32_t announced = 0;
+};
+
+class SyncLink {
+  public:
+    static constexpr size_t maxFollowers = 8;
+    // Followers that stay quiet this long are dropped.
+    static constexpr int64_t followerTimeoutMicros = 5000000;
+    // Time requests, faster until the clock is synced.
+    static constexpr int64_t requestIntervalMicros = 500000;
+    static constexpr int64_t fastRequestIntervalMicros = 50000;
+    // A follower waits this long for an announcement before it strokes on
+    // its own.
+    static constexpr int64_t maxWaitMicros = 1000000;
+    // Announcements further in the past are for a stroke already missed.
+    static constexpr int64_t staleMicros = 100000;
+    // How long leader settings are mirrored after the last announcement.
+    static constexpr int64_t settingTimeoutMicros = 2000000;
+
+    /**
+     * Open the socket.
+     * @param role Leader binds port, a follower any free port.
+     * @param port UDP port of the leader.
+     * @param leaderAddress IPv4 address of the leader for a follower, or
+     *        nullptr to broadcast until a leader answers.
+     * @return true on success.
+     */
+    bool begin(SyncRole role, uint16_t port, const char *leaderAddress) {
+        end();
+        this->role = role;
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(role == SyncRole::Leader ? port : 0);
+        if (bind(fd, (sockaddr *)&local, sizeof(local)) < 0) {
+            end();
+            return false;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        leader = {};
+        leader.sin_family = AF_INET;
+        leader.sin_port = htons(port);
+        leader.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+        if (leaderAddress != nullptr && leaderAddress[0] != '\0' &&
+            inet_pton(AF_INET, leaderAddress, &leader.sin_addr) != 1) {
+            end();
+            return false;
+        }
+        return true;
+    }
+
+    void end() {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = -1;
+    }
+
+    SyncRole getRole() const { return role; }
+
+    /**
+     * Answer and send time requests and take in announcements. Call often,
+     * at least every few milliseconds, the receive time is when it runs.
+     */
+    void poll(int64_t now) {
+        if (fd < 0) {
+            return;
+        }
+        union {
+            SyncWire::Header header;
+            SyncWire::TimeRequestPacket request;
+            SyncWire::TimeReplyPacket reply;
+            SyncWire::StrokePacket stroke;
+        } packet;
+        sockaddr_in from = {};
+        socklen_t fromLength = sizeof(from);
+        ssize_t length;
+        while ((length = recvfrom(fd, &packet, sizeof(packet), 0,
+                                  (sockaddr *)&from, &fromLength)) > 0) {
+            if ((size_t)length >= sizeof(SyncWire::Header) &&
+                packet.header.magic == SyncWire::magic &&
+                packet.header.version == SyncWire::version) {
+                handle(packet.header.type, &packet, (size_t)length, from, now);
+            }
+            fromLength = sizeof(from);
+        }
+
+        if (role == SyncRole::Follower) {
+            std::lock_guard<std::mutex> lock(mutex);
+            int64_t interval = clock.isSynced() ? requestIntervalMicros
+                                                : fastRequestIntervalMicros;
+            if (now - lastRequest >= interval) {
+                lastRequest = now;
+                SyncWire::TimeRequestPacket request = {
+                    header(SyncWire::TimeRequest), now};
+                send(request, leader);
+            }
+        }
+    }
+
+    /**
+     * The leader is ready to start a stroke. Announces it and says how long
+     * to wait, the lead time, so followers hear of it before it starts.
+     * Asking again for the same stroke counts down the same wait.
+     * @return microseconds to wait before asking again, 0 to start now.
+     */
+    uint32_t leaderGate(int64_t now, int index, uint32_t leadMicros,
+                        const SettingPercents &setting) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hasPending && pendingIndex == index &&
+            now - pendingStart <= staleMicros) {
+            if (pendingStart > now) {
+                return uint32_t(pendingStart - now);
+            }
+            hasPending = false;
+            return 0;
+        }
+        hasPending = false;
+
+        SyncWire::StrokePacket stroke = {};
+        stroke.header = header(SyncWire::Stroke);
+        stroke.sequence = ++sequence;
+        stroke.index = index;
+        stroke.startMicros = now + leadMicros;
+        stroke.speed = setting.speed;
+        stroke.stroke = setting.stroke;
+        stroke.sensation = setting.sensation;
+        stroke.depth = setting.depth;
+        stroke.pattern = (uint8_t)setting.pattern;
+
+        bool anyone = false;
+        for (auto &follower : followers) {
+            if (follower.lastHeard != 0 &&
+                now - follower.lastHeard < followerTimeoutMicros) {
+                send(stroke, follower.address);
+                anyone = true;
+            }
+        }
+        if (!anyone || leadMicros == 0) {
+            // Nobody to wait for.
+            return 0;
+        }
+        stats.announced++;
+        hasPending = true;
+        pendingIndex = index;
+        pendingStart = stroke.startMicros;
+        return leadMicros;
+    }
+
+    /**
+     * The follower is ready to start a stroke. It follows the leader's
+     * strokes that go the same way, index parity tells.
+     * @return how long to wait before asking again, 0 to start now.
+     */
+    uint32_t followerGate(int64_t now, int index, int32_t phaseOffsetMicros) {
+        ClockEstimate shared;
+        SyncWire::StrokePacket latest;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shared = clock;
+            latest = announcement;
+        }
+        if (!shared.isSynced()) {
+            return 0;
+        }
+
+        if (latest.sequence != consumed && (latest.index - index) % 2 != 0) {
+            // The leader goes the other way, wait for its next stroke.
+            consumed = latest.sequence;
+        }
+        if (latest.sequence != consumed) {
+            int64_t start =
+                shared.toLocal(latest.startMicros) + phaseOffsetMicros;
+            if (start > now) {
+                return uint32_t(start - now);
+            }
+            consumed = latest.sequence;
+            if (now - start <= staleMicros) {
+                waitingSince = 0;
+                countAligned(now - start);
+                return 0;
+            }
+            // That stroke is long gone, wait for the next one.
+        }
+
+        if (waitingSince == 0) {
+            waitingSince = now;
+        }
+        if (now - waitingSince >= maxWaitMicros) {
+            waitingSince = 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.missed++;
+            return 0;
+        }
+        return 1000;
+    }
+
+    /**
+     * The settings of the leader's last announcement, for a follower to
+     * play the same pattern.
+     * @return false if the leader has not been heard lately.
+     */
+    bool leaderSetting(int64_t now, SettingPercents &setting) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (announcement.sequence == 0 ||
+            now - announcementHeard > settingTimeoutMicros) {
+            return false;
+        }
+        setting.speed = announcement.speed;
+        setting.stroke = announcement.stroke;
+        setting.sensation = announcement.sensation;
+        setting.depth = announcement.depth;
+        setting.pattern = (StrokePatterns)announcement.pattern;
+        return true;
+    }
+
+    SyncStats getStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    ClockEstimate getClock() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return clock;
+    }
+
+    // Port the socket is bound to, for tests.
+    uint16_t port() const {
+        sockaddr_in local = {};
+        socklen_t length = sizeof(local);
+        getsockname(fd, (sockaddr *)&local, &length);
+        return ntohs(local.sin_port);
+    }
+
+  private:
+    struct Follower {
+        sockaddr_in address;
+        int64_t lastHeard;
+    };
+
+    static SyncWire::Header header(SyncWire::Type type) {
+        return {SyncWire::magic, SyncWire::version, type, 0};
+    }
+
+    template <class Packet>
+    void send(const Packet &packet, const sockaddr_in &to) {
+        sendto(fd, &packet, sizeof(packet), MSG_DONTWAIT, (const sockaddr *)&to,
+               sizeof(to));
+    }
+
+    void handle(uint8_t type, const void *packet, size_t length,
+                const sockaddr_in &from, int64_t now) {
+        if (role == SyncRole::Follower && type == SyncWire::TimeReply &&
+            length >= sizeof(SyncWire::TimeReplyPacket)) {
+            SyncWire::TimeReplyPacket reply;
+            memcpy(&reply, packet, sizeof(reply));
+            // Fitted outside the lock, only poll() touches the samples
+            clockSync.addSample(reply.t1, reply.t2, reply.t3, now);
+            std::lock_guard<std::mutex> lock(mutex);
+            // Found the leader, stop broadcasting.
+            leader = from;
+            clock = clockSync.estimate();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (role == SyncRole::Leader && type == SyncWire::TimeRequest &&
+            length >= sizeof(SyncWire::TimeRequestPacket)) {
+            SyncWire::TimeRequestPacket request;
+            memcpy(&request, packet, sizeof(request));
+            remember(from, now);
+            SyncWire::TimeReplyPacket reply = {header(SyncWire::TimeReply),
+                                               request.t1, now, now};
+            send(reply, from);
+        } else if (role == SyncRole::Follower && type == SyncWire::Stroke &&
+                   length >= sizeof(SyncWire::StrokePacket)) {
+            memcpy(&announcement, packet, sizeof(announcement));
+            announcementHeard = now;
+        }
+    }
+
+    // A follower stroke started on the leader's schedule, lateMicros after
+    // it.
+    void countAligned(int64_t lateMicros) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.aligned++;
+        // Woken late by the scheduler, or ready late.
+        if (lateMicros > 1000) {
+            stats.late++;
+            stats.worstLateMicros = lateMicros > stats.worstLateMicros
+                                        ? lateMicros
+                                        : stats.worstLateMicros;
+        }
+    }
+
+    void remember(const sockaddr_in &from, int64_t now) {
+        Follower *oldest = &followers[0];
+        for (auto &follower : followers) {
+            if (follower.lastHeard != 0 &&
+                follower.address.sin_addr.s_addr == from.sin_addr.s_addr &&
+                follower.address.sin_port == from.sin_port) {
+                follower.lastHeard = now;
+                return;
+            }
+            if (follower.lastHeard < oldest->lastHeard) {
+                oldest = &follower;
+            }
+        }
+        *oldest = {from, now};
+    }
+
+    int fd = -1;
+    SyncRole role = SyncRole::Off;
+    sockaddr_in leader = {};
+
+    // Only poll() adds samples and fits, outside the mutex.
+    ClockSync clockSync;
+
+    std::mutex mutex;
+    // The last fit, for the gates.
+    ClockEstimate clock;
+    Follower followers[maxFollowers] = {};
+    SyncWire::StrokePacket announcement = {};
+    int64_t announcementHeard = 0;
+    uint32_t sequence = 0;
+    bool hasPending = false;
+    int pendingIndex = 0;
+    int64_t pendingStart = 0;
+    int64_t lastRequest = INT64_MIN / 2;
+    SyncStats stats;
+
+    // Only the follower's gate, in the stroking task, keeps these.
+    uint32_t consumed = 0;
+    int64_t waitingSince = 0;
+};
+
+#endif  // OSSM_SOFTWARE_SYNCLINK_H
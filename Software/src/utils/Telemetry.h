@@ -0,0 +1,361 @@
+#ifndef OSSM_SOFTWARE_TELEMETRY_H
+#define OSSM_SOFTWARE_TELEMETRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/FlightRecorder.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Telemetry
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * What the motor does, sampled every millisecond, as a compact binary
+ * stream that a computer can capture for hours.
+ *
+ * A stream is a StreamHeader followed by blocks of blockSize bytes. A block
+ * starts with a keyframe, one sample in full, and the samples after it
+ * follow as differences from the one before, each field a varint. A block
+ * stands on its own: a torn block only loses its own samples, and a reader
+ * can jump straight to any block, by its index or by the time of its
+ * keyframe, without decoding the ones before. Block sequence numbers count
+ * every block the firmware started, so a gap shows what was dropped.
+ *
+ * All fields are little endian, as the ESP32 and the computers reading
+ * the captures are.
+ */
+namespace Telemetry {
+    static constexpr uint32_t magic = 0x4D54534F;  // "OSTM"
+    static constexpr uint16_t version = 2;
+    static constexpr size_t blockSize = 512;
+
+    enum SampleFlag : uint8_t {
+        Moving = 1 << 0,
+        // The supervisor stopped the motor at this sample.
+        Violation = 1 << 1,
+        // The servo drive reports an alarm.
+        ServoAlarm = 1 << 2,
+    };
+
+    struct Sample {
+        uint64_t timeMicros;
+        // Steps, as FastAccelStepper counts them.
+        int32_t position;
+        int32_t target;
+        // Steps per second, negative towards home.
+        int32_t speedHz;
+        uint8_t flags;
+        // The latest servo reading, see utils/ServoMonitor.h, 0 without one.
+        int32_t followingError;
+        int16_t load;
+    };
+
+    struct StreamHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t blockSize;
+        uint32_t sampleIntervalMicros;
+        // Of the machine that recorded it, to read positions in mm.
+        float stepsPerMm;
+        uint32_t reserved[4];
+    };
+    static_assert(sizeof(StreamHeader) == 32,
+                  "StreamHeader must stay 32 bytes");
+
+    struct BlockHeader {
+        uint32_t sequence;
+        // Samples in the block, the keyframe included.
+        uint16_t count;
+        // Bytes of deltas after the keyframe.
+        uint16_t length;
+        // FNV-1a of the keyframe and the deltas.
+        uint32_t checksum;
+        uint32_t reserved;
+    };
+
+    // A Sample with its padding spelled out, so every byte is defined.
+    struct Keyframe {
+        uint64_t timeMicros;
+        int32_t position;
+        int32_t target;
+        int32_t speedHz;
+        int32_t followingError;
+        int16_t load;
+        uint8_t flags;
+        uint8_t reserved[5];
+    };
+
+    struct Block {
+        BlockHeader header;
+        Keyframe keyframe;
+        uint8_t deltas[blockSize - sizeof(BlockHeader) - sizeof(Keyframe)];
+    };
+    static_assert(sizeof(Block) == blockSize, "Block must fill blockSize");
+
+    // A time delta of up to 10 bytes, four fields of up to 5, the load of up
+    // to 3 and flags.
+    static constexpr size_t maxDeltaSize = 10 + 4 * 5 + 3 + 1;
+
+    static inline uint32_t zigzag(int32_t value) {
+        return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+    }
+
+    static inline int32_t unzigzag(uint32_t value) {
+        return int32_t(value >> 1) ^ -int32_t(value & 1);
+    }
+
+    static inline uint8_t *putVarint(uint8_t *out, uint64_t value) {
+        while (value >= 0x80) {
+            *out++ = uint8_t(value) | 0x80;
+            value >>= 7;
+        }
+        *out++ = uint8_t(value);
+        return out;
+    }
+
+    /**
+     * @return the byte after the varint, or nullptr if it runs past end.
+     */
+    static inline const uint8_t *getVarint(const uint8_t *in,
+                                           const uint8_t *end,
+                                           uint64_t &value) {
+        value = 0;
+        for (int shift = 0; in < end && shift < 64; shift += 7) {
+            uint8_t byte = *in++;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return in;
+            }
+        }
+        return nullptr;
+    }
+
+    static inline uint32_t checksum(const Block &block) {
+        return FlightDump::checksum(
+            reinterpret_cast<const uint8_t *>(&block.keyframe),
+            sizeof(block.keyframe) + block.header.length);
+    }
+
+    /**
+     * Whether a block can be read: its counts are in range and it is what
+     * the firmware sealed.
+     */
+    static inline bool isIntact(const Block &block) {
+        return block.header.count > 0 &&
+               block.header.length <= sizeof(block.deltas) &&
+               checksum(block) == block.header.checksum;
+    }
+
+    static inline StreamHeader streamHeader(uint32_t sampleIntervalMicros,
+                                            float stepsPerMm) {
+        StreamHeader header = {};
+        header.magic = magic;
+        header.version = version;
+        header.blockSize = blockSize;
+        header.sampleIntervalMicros = sampleIntervalMicros;
+        header.stepsPerMm = stepsPerMm;
+        return header;
+    }
+
+    static inline bool isValid(const StreamHeader &header) {
+        return header.magic == magic && header.version == version &&
+               header.blockSize == blockSize;
+    }
+
+    /**
+     * Fills one block, sample by sample.
+     */
+    class BlockWriter {
+      public:
+        void begin(Block &block, uint32_t sequence, const Sample &first) {
+            memset(static_cast<void *>(&block), 0, sizeof(block));
+            block.header.sequence = sequence;
+            block.header.count = 1;
+            block.keyframe.timeMicros = first.timeMicros;
+            block.keyframe.position = first.position;
+            block.keyframe.target = first.target;
+            block.keyframe.speedHz = first.speedHz;
+            block.keyframe.followingError = first.followingError;
+            block.keyframe.load = first.load;
+            block.keyframe.flags = first.flags;
+            _block = &block;
+            _last = first;
+        }
+
+        /**
+         * @return false, leaving the block as it was, if the sample might not
+         * fit. Seal the block and begin the next with the sample then.
+         */
+        bool append(const Sample &sample) {
+            BlockHeader &header = _block->header;
+            if (header.length + maxDeltaSize > sizeof(_block->deltas) ||
+                header.count == UINT16_MAX) {
+                return false;
+            }
+            uint8_t *out = _block->deltas + header.length;
+            out = putVarint(out, sample.timeMicros - _last.timeMicros);
+            out = putVarint(out, zigzag(sample.position - _last.position));
+            out = putVarint(out, zigzag(sample.target - _last.target));
+            out = putVarint(out, zigzag(sample.speedHz - _last.speedHz));
+            out = putVarint(out, zigzag(sample.followingError -
+                                        _last.followingError));
+            out = putVarint(out, zigzag(sample.load - _last.load));
+            *out++ = sample.flags;
+            header.length = uint16_t(out - _block->deltas);
+            header.count++;
+            _last = sample;
+            return true;
+        }
+
+        void seal() { _block->header.checksum = checksum(*_block); }
+
+      private:
+        Block *_block = nullptr;
+        Sample _last = {};
+    };
+
+    /**
+     * Reads the samples of one block in order. Check isIntact() first, a
+     * damaged block only ends early.
+     */
+    class BlockReader {
+      public:
+        explicit BlockReader(const Block &block)
+            : _in(block.deltas),
+              _end(block.deltas + block.header.length),
+              _left(block.header.count) {
+            const Keyframe &k = block.keyframe;
+            _next = {k.timeMicros, k.position, k.target, k.speedHz,
+                     k.flags, k.followingError, k.load};
+        }
+
+        bool next(Sample &sample) {
+            if (_left == 0) {
+                return false;
+            }
+            sample = _next;
+            if (--_left == 0) {
+                return true;
+            }
+
+            uint64_t time, position, target, speed, error, load;
+            if (_in == nullptr ||
+                (_in = getVarint(_in, _end, time)) == nullptr ||
+                (_in = getVarint(_in, _end, position)) == nullptr ||
+                (_in = getVarint(_in, _end, target)) == nullptr ||
+                (_in = getVarint(_in, _end, speed)) == nullptr ||
+                (_in = getVarint(_in, _end, error)) == nullptr ||
+                (_in = getVarint(_in, _end, load)) == nullptr ||
+                _in == _end) {
+                _left = 0;
+                return true;
+            }
+            _next.timeMicros += time;
+            _next.position += unzigzag(uint32_t(position));
+            _next.target += unzigzag(uint32_t(target));
+            _next.speedHz += unzigzag(uint32_t(speed));
+            _next.followingError += unzigzag(uint32_t(error));
+            _next.load = int16_t(_next.load + unzigzag(uint32_t(load)));
+            _next.flags = *_in++;
+            return true;
+        }
+
+      private:
+        const uint8_t *_in;
+        const uint8_t *_end;
+        uint32_t _left;
+        Sample _next;
+    };
+}
+
+/**
+ * Blocks on their way from the task that samples the motor to the one that
+ * sends them, one of each.
+ *
+ * The sampling side only records while the sending side has someone to send
+ * to, between start() and stop(). It fills a block of its own and copies it
+ * into the ring once full. If the ring is full that block is dropped, the
+ * sampling side never waits.
+ */
+template <size_t Capacity>
+class TelemetryRing {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+  public:
+    /** ////  Sampling side  //// */
+
+    void record(const Telemetry::Sample &sample) {
+        if (!_isOn.load(std::memory_order_acquire)) {
+            _isWriting = false;
+            return;
+        }
+        if (!_isWriting) {
+            _writer.begin(_current, _sequence++, sample);
+            _isWriting = true;
+            return;
+        }
+        if (_writer.append(sample)) {
+            return;
+        }
+
+        _writer.seal();
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) < Capacity) {
+            _blocks[head & (Capacity - 1)] = _current;
+            _head.store(head + 1, std::memory_order_release);
+        } else {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        _writer.begin(_current, _sequence++, sample);
+    }
+
+    /** ////  Sending side  //// */
+
+    // Recording starts with a fresh block, older ones are thrown away.
+    void start() {
+        _tail.store(_head.load(std::memory_order_acquire),
+                    std::memory_order_release);
+        _isOn.store(true, std::memory_order_release);
+    }
+
+    void stop() { _isOn.store(false, std::memory_order_release); }
+
+    // The oldest full block, or nullptr. Stays valid until pop().
+    const Telemetry::Block *front() const {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &_blocks[tail & (Capacity - 1)];
+    }
+
+    void pop() {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+    uint32_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    Telemetry::Block _blocks[Capacity];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    std::atomic<uint32_t> _dropped{0};
+    std::atomic<bool> _isOn{false};
+
+    // Only touched by the sampling side.
+    Telemetry::Block _current;
+    Telemetry::BlockWriter _writer;
+    uint32_t _sequence = 0;
+    bool _isWriting = false;
+};
+
+#endif  // OSSM_SOFTWARE_TELEMETRY_H
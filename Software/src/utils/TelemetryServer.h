@@ -0,0 +1,117 @@
+#ifndef OSSM_SOFTWARE_TELEMETRYSERVER_H
+#define OSSM_SOFTWARE_TELEMETRYSERVER_H
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "utils/Telemetry.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/**
+ * @brief Streams telemetry to one client at a time over plain TCP.
+ *
+ * A client connects and receives a Telemetry::StreamHeader followed by
+ * blocks as they fill, until it disconnects. There is no request, so
+ * `nc <ossm-ip> 9101 > capture.ostm` records as well as any tool.
+ *
+ * Like MetricsServer it talks to the BSD socket API, which LwIP provides on
+ * the ESP32 and the OS in the native build.
+ *
+ * Usage:
+ *  1. begin() once the network is up.
+ *  2. call accept() periodically; it never blocks.
+ *  3. send the header, then every block, until send() fails.
+ */
+class TelemetryServer {
+  public:
+    /**
+     * Open the listening socket.
+     * @param port TCP port, 0 picks a free port (see port()).
+     * @return true on success.
+     */
+    bool begin(uint16_t port) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+
+        if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(listenFd, 1) < 0) {
+            end();
+            return false;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd, (sockaddr *)&addr, &len);
+        boundPort = ntohs(addr.sin_port);
+
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL, 0) | O_NONBLOCK);
+        return true;
+    }
+
+    void end() {
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        listenFd = -1;
+    }
+
+    uint16_t port() const { return boundPort; }
+
+    /**
+     * @return a connected client, or -1 if nobody is waiting.
+     */
+    int accept() const {
+        if (listenFd < 0) {
+            return -1;
+        }
+        int client = ::accept(listenFd, nullptr, nullptr);
+        if (client < 0) {
+            return -1;
+        }
+
+        // Blocking, but a client that stops reading is dropped within a
+        // second, before the ring behind it overflows for long.
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) & ~O_NONBLOCK);
+        timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        return client;
+    }
+
+    /**
+     * @return false once the client is gone, close it then.
+     */
+    static bool send(int client, const void *data, size_t length) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        while (length > 0) {
+            ssize_t n = ::send(client, bytes, length, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            bytes += n;
+            length -= n;
+        }
+        return true;
+    }
+
+  private:
+    int listenFd = -1;
+    uint16_t boundPort = 0;
+};
+
+#endif  // OSSM_SOFTWARE_TELEMETRYSERVER_H
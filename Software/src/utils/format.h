@@ -50,7 +50,7 @@ static String formatTime(unsigned int totalMillis) {
     return formattedTime;
 }
 
-static String formatImperial(double meters) {
+static String formatImperial(float meters) {
     // Convert meters to feet
     float feet = meters * 3.28084f;
 
@@ -67,9 +67,9 @@ static String formatImperial(double meters) {
     }
 }
 
-static String formatMetric(double meters) {
+static String formatMetric(float meters) {
     String sign = meters >= 0 ? "" : "-";
-    meters = abs(meters);
+    meters = fabsf(meters);
 
     if (meters == 0) {
         return "0.0 cm";
@@ -88,7 +88,7 @@ static String formatMetric(double meters) {
     }
 }
 
-static String formatDistance(double meters) {
+static String formatDistance(float meters) {
     if (UserConfig::displayMetric) {
         return formatMetric(meters);
     } else {
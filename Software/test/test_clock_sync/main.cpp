@@ -0,0 +1,211 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <random>
+
+#include "unity.h"
+#include "utils/ClockSync.h"
+#include "utils/SyncLink.h"
+
+namespace {
+    // The leader's clock, as seen from the follower's.
+    struct LeaderClock {
+        int64_t offsetMicros;
+        double driftPpm;
+
+        int64_t at(int64_t localMicros) const {
+            return localMicros + offsetMicros +
+                   int64_t(double(localMicros) * driftPpm * 1e-6);
+        }
+    };
+
+    // One exchange with the given one way delays, in follower time.
+    void exchange(ClockSync &clock, const LeaderClock &leader, int64_t t1,
+                  int64_t there, int64_t back) {
+        int64_t t2 = leader.at(t1 + there);
+        int64_t t3 = t2 + 100;
+        clock.addSample(t1, t2, t3, t1 + there + 100 + back);
+    }
+}
+
+void test_NotSyncedWithoutSamples() {
+    ClockSync clock;
+    TEST_ASSERT_FALSE(clock.isSynced());
+    TEST_ASSERT_EQUAL_INT64(1234, clock.toShared(1234));
+}
+
+void test_SymmetricDelayGivesTheOffset() {
+    ClockSync clock;
+    LeaderClock leader = {5000000, 0};
+    for (int i = 0; i < 4; i++) {
+        exchange(clock, leader, 1000000 + i * 250000, 2000, 2000);
+    }
+    TEST_ASSERT_TRUE(clock.isSynced());
+    TEST_ASSERT_EQUAL_INT64(5000000, clock.offsetMicros());
+    TEST_ASSERT_EQUAL_INT64(4000, clock.roundTripMicros());
+    TEST_ASSERT_EQUAL_INT64(6000000, clock.toShared(1000000));
+    TEST_ASSERT_EQUAL_INT64(1000000, clock.toLocal(6000000));
+}
+
+void test_ImpossibleSampleIsIgnored() {
+    ClockSync clock;
+    // The leader held it longer than the round trip took.
+    clock.addSample(1000, 5000, 9000, 2000);
+    TEST_ASSERT_FALSE(clock.isSynced());
+    TEST_ASSERT_EQUAL_INT64(0, clock.offsetMicros());
+}
+
+void test_QueueingDelayIsFilteredOut() {
+    ClockSync clock;
+    LeaderClock leader = {-3000000, 0};
+    for (int i = 0; i < 16; i++) {
+        // Every other reply sat in a queue for 20 ms.
+        int64_t back = i % 2 == 0 ? 1000 : 21000;
+        exchange(clock, leader, 1000000 + i * 250000, 1000, back);
+    }
+    TEST_ASSERT_INT64_WITHIN(1, -3000000, clock.offsetMicros());
+}
+
+void test_TracksDriftThroughJitter() {
+    ClockSync clock;
+    LeaderClock leader = {1500000, 80};
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> jitter(0, 3000);
+
+    int64_t t1 = 2000000;
+    for (int i = 0; i < 120; i++, t1 += SyncLink::requestIntervalMicros) {
+        exchange(clock, leader, t1, 1000 + jitter(random),
+                 1000 + jitter(random));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(30, 80, clock.driftPpm());
+
+    // A stroke scheduled on the shared clock a moment ahead.
+    int64_t local = t1 + 100000;
+    TEST_ASSERT_INT64_WITHIN(500, leader.at(local), clock.toShared(local));
+    TEST_ASSERT_INT64_WITHIN(500, local, clock.toLocal(leader.at(local)));
+}
+
+void test_ResetForgets() {
+    ClockSync clock;
+    LeaderClock leader = {5000000, 0};
+    for (int i = 0; i < 4; i++) {
+        exchange(clock, leader, 1000000 + i * 250000, 2000, 2000);
+    }
+    clock.reset();
+    TEST_ASSERT_FALSE(clock.isSynced());
+}
+
+/** Leader and follower over loopback, with the leader 1 s ahead. */
+namespace {
+    constexpr int64_t leaderAhead = 1000000;
+
+    // Polls both sides until the follower's clock is synced.
+    void syncUp(SyncLink &leader, SyncLink &follower, int64_t &now) {
+        for (int i = 0; i < 40 && !follower.getClock().isSynced(); i++) {
+            now += SyncLink::fastRequestIntervalMicros;
+            follower.poll(now);
+            usleep(1000);
+            leader.poll(now + leaderAhead);
+            usleep(1000);
+            follower.poll(now);
+        }
+    }
+
+    void settle(SyncLink &follower, int64_t now) {
+        usleep(2000);
+        follower.poll(now);
+    }
+}
+
+void test_FollowerStartsWithTheLeader() {
+    SyncLink leader, follower;
+    TEST_ASSERT_TRUE(leader.begin(SyncRole::Leader, 0, nullptr));
+    TEST_ASSERT_TRUE(
+        follower.begin(SyncRole::Follower, leader.port(), "127.0.0.1"));
+
+    int64_t now = 10000000;
+    syncUp(leader, follower, now);
+    TEST_ASSERT_TRUE(follower.getClock().isSynced());
+    TEST_ASSERT_INT64_WITHIN(1, leaderAhead,
+                             follower.getClock().offsetMicros());
+
+    SettingPercents setting = {40, 60, 50, 80, StrokePatterns::Deeper, 40};
+    TEST_ASSERT_EQUAL_UINT32(
+        20000, leader.leaderGate(now + leaderAhead, 2, 20000, setting));
+    // Asking again for the same stroke counts down, without a second
+    // announcement.
+    TEST_ASSERT_EQUAL_UINT32(
+        15000, leader.leaderGate(now + leaderAhead + 5000, 2, 20000, setting));
+    TEST_ASSERT_EQUAL_UINT32(1, leader.getStats().announced);
+    settle(follower, now);
+
+    TEST_ASSERT_EQUAL_UINT32(20000, follower.followerGate(now, 4, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, follower.followerGate(now + 20000, 4, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, follower.getStats().aligned);
+
+    SettingPercents mirrored = {};
+    TEST_ASSERT_TRUE(follower.leaderSetting(now, mirrored));
+    TEST_ASSERT_EQUAL_FLOAT(40, mirrored.speed);
+    TEST_ASSERT_EQUAL(StrokePatterns::Deeper, mirrored.pattern);
+}
+
+void test_FollowerWaitsForItsDirection() {
+    SyncLink leader, follower;
+    TEST_ASSERT_TRUE(leader.begin(SyncRole::Leader, 0, nullptr));
+    TEST_ASSERT_TRUE(
+        follower.begin(SyncRole::Follower, leader.port(), "127.0.0.1"));
+
+    int64_t now = 10000000;
+    syncUp(leader, follower, now);
+
+    SettingPercents setting = {};
+    leader.leaderGate(now + leaderAhead, 3, 20000, setting);
+    settle(follower, now);
+    // The leader goes the other way, keep waiting.
+    TEST_ASSERT_EQUAL_UINT32(1000, follower.followerGate(now + 20000, 4, 0));
+
+    // Nobody heard from the leader for too long, go alone.
+    TEST_ASSERT_EQUAL_UINT32(
+        0, follower.followerGate(
+               now + 20000 + SyncLink::maxWaitMicros, 4, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, follower.getStats().missed);
+}
+
+void test_LeaderAloneDoesNotWait() {
+    SyncLink leader;
+    TEST_ASSERT_TRUE(leader.begin(SyncRole::Leader, 0, nullptr));
+    SettingPercents setting = {};
+    TEST_ASSERT_EQUAL_UINT32(0, leader.leaderGate(1000000, 0, 20000, setting));
+}
+
+void test_PhaseOffsetShiftsTheStart() {
+    SyncLink leader, follower;
+    TEST_ASSERT_TRUE(leader.begin(SyncRole::Leader, 0, nullptr));
+    TEST_ASSERT_TRUE(
+        follower.begin(SyncRole::Follower, leader.port(), "127.0.0.1"));
+
+    int64_t now = 10000000;
+    syncUp(leader, follower, now);
+
+    SettingPercents setting = {};
+    leader.leaderGate(now + leaderAhead, 0, 20000, setting);
+    settle(follower, now);
+    TEST_ASSERT_EQUAL_UINT32(270000, follower.followerGate(now, 0, 250000));
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_NotSyncedWithoutSamples);
+    RUN_TEST(test_SymmetricDelayGivesTheOffset);
+    RUN_TEST(test_ImpossibleSampleIsIgnored);
+    RUN_TEST(test_QueueingDelayIsFilteredOut);
+    RUN_TEST(test_TracksDriftThroughJitter);
+    RUN_TEST(test_ResetForgets);
+    RUN_TEST(test_FollowerStartsWithTheLeader);
+    RUN_TEST(test_FollowerWaitsForItsDirection);
+    RUN_TEST(test_LeaderAloneDoesNotWait);
+    RUN_TEST(test_PhaseOffsetShiftsTheStart);
+    return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
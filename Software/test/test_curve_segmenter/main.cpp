@@ -0,0 +1,232 @@
+#include <math.h>
+
+#include <vector>
+
+#include "CurveSegmenter.h"
+#include "unity.h"
+
+/**
+ * The segments StrokeEngine feeds to the stepper's queue while it plays a
+ * curve pattern. tools/curvetrace plays them on the simulated stepper.
+ */
+
+namespace {
+    // The reference build, 20 steps/mm, 900 mm/s and 10000 mm/s^2.
+    constexpr int32_t maxPosition = 3760;
+    constexpr uint32_t maxSpeed = 18000;
+    constexpr uint32_t maxAcceleration = 200000;
+    // 0.1 mm
+    constexpr float tolerance = 2;
+
+    // A sine from bottom to top and back, starting at the bottom.
+    class Sine : public PositionCurve {
+      public:
+        Sine(float seconds, float bottom, float top)
+            : seconds(seconds), bottom(bottom), top(top) {}
+
+        float cycleTime() { return seconds; }
+
+        float positionAt(unsigned int, float phase) {
+            return bottom +
+                   (top - bottom) * 0.5f * (1 - cosf(2 * float(M_PI) * phase));
+        }
+
+        float seconds;
+        float bottom;
+        float top;
+    };
+
+    // Jumps between bottom and top every half cycle.
+    class Square : public Sine {
+      public:
+        using Sine::Sine;
+
+        float positionAt(unsigned int, float phase) {
+            return phase < 0.5f ? bottom : top;
+        }
+    };
+
+    CurveSegmenter segmenter(PositionCurve &curve, int32_t position) {
+        CurveSegmenter s;
+        s.setLimits(0, maxPosition, maxSpeed, maxAcceleration);
+        s.setTolerance(tolerance);
+        s.start(&curve, position);
+        return s;
+    }
+
+    struct Piece {
+        int32_t position;  // where it ends
+        double seconds;    // when it ends
+        float speed;
+    };
+
+    // Plays pieces for a while, going on at the end of every cycle.
+    std::vector<Piece> play(CurveSegmenter &s, int32_t from, double seconds) {
+        std::vector<Piece> pieces;
+        int32_t position = from;
+        double elapsed = 0;
+        while (elapsed < seconds) {
+            if (s.isAtCycleEnd()) {
+                s.nextCycle();
+            }
+            CurveSegmenter::Segment piece = s.next();
+            position += piece.steps;
+            elapsed += piece.durationMicros * 1e-6;
+            pieces.push_back({position, elapsed,
+                              piece.steps / (piece.durationMicros * 1e-6f)});
+        }
+        return pieces;
+    }
+
+    float curveAt(Sine &curve, double seconds) {
+        double cycles = seconds / curve.seconds;
+        unsigned int cycle = (unsigned int)cycles;
+        return curve.positionAt(cycle, float(cycles - cycle));
+    }
+}
+
+void test_FollowsTheCurve() {
+    Sine sine(1, 1000, 3000);
+    CurveSegmenter s = segmenter(sine, 1000);
+    float worst = 0;
+    for (const Piece &piece : play(s, 1000, 3.5)) {
+        float error = piece.position - curveAt(sine, piece.seconds);
+        worst = fmaxf(worst, fabsf(error));
+        TEST_ASSERT_TRUE(fabsf(piece.speed) <= maxSpeed);
+    }
+    // A piece ends on its segment, rounded to a step.
+    TEST_ASSERT_TRUE(worst <= tolerance + 0.5f);
+    TEST_ASSERT_EQUAL(3, s.cycle());
+}
+
+void test_KeepsTime() {
+    Sine sine(0.7f, 1000, 3000);
+    CurveSegmenter s = segmenter(sine, 1000);
+    double elapsed = 0;
+    // Without nextCycle() a cycle ends and waits.
+    while (s.hasNext()) {
+        elapsed += s.next().durationMicros * 1e-6;
+    }
+    TEST_ASSERT_TRUE(s.isAtCycleEnd());
+    TEST_ASSERT_FLOAT_WITHIN(50e-6, 0.7, elapsed);
+    TEST_ASSERT_FALSE(s.isIdle());
+
+    // Held there at rest, then from a standstill into the next.
+    s.pause();
+    TEST_ASSERT_EQUAL_FLOAT(0, s.velocity());
+    s.nextCycle();
+    TEST_ASSERT_TRUE(s.hasNext());
+    TEST_ASSERT_EQUAL(1, s.cycle());
+}
+
+void test_SegmentsFollowTheCurvature() {
+    // A slow curve takes long segments, near the longest of 32 ms.
+    Sine slow(2, 1000, 3000);
+    CurveSegmenter gentle = segmenter(slow, 1000);
+    play(gentle, 1000, 2);
+    TEST_ASSERT_TRUE(gentle.segments() < 2 * 40);
+
+    // A fast one bends more and takes shorter ones.
+    Sine fast(0.5f, 1000, 3000);
+    CurveSegmenter sharp = segmenter(fast, 1000);
+    play(sharp, 1000, 2);
+    TEST_ASSERT_TRUE(sharp.segments() > gentle.segments() + 20);
+
+    // A queue entry steps at least every 4 ms and takes at most 255 steps.
+    for (const Piece &piece : play(sharp, 1000, 0.5)) {
+        TEST_ASSERT_TRUE(fabsf(piece.speed) * 4e-3f <= 255 + 1);
+    }
+}
+
+void test_CatchesUpInTwoSegments() {
+    // Started 2.5 mm off the curve, where it stands still.
+    Square square(1, 1000, 3000);
+    CurveSegmenter s = segmenter(square, 1050);
+    int32_t position = 1050;
+    // Up to the first piece of the third, which stands still again
+    while (s.segments() < 3) {
+        position += s.next().steps;
+    }
+    TEST_ASSERT_INT_WITHIN(1, 1000, position);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, s.velocity());
+}
+
+void test_JoinsWhereTheCurveComesClosest() {
+    // Brought in by a move first, so halfway through the first cycle.
+    Sine sine(1, 1000, 3000);
+    CurveSegmenter s;
+    s.setLimits(0, maxPosition, maxSpeed, maxAcceleration);
+    s.setTolerance(tolerance);
+    s.join(&sine, 3000);
+    TEST_ASSERT_FLOAT_WITHIN(1 / 256.0f, 0.5f, s.phase());
+
+    // And follows it from there, without a jump to catch up.
+    int32_t position = 3000;
+    double elapsed = 0;
+    while (s.hasNext()) {
+        CurveSegmenter::Segment piece = s.next();
+        position += piece.steps;
+        elapsed += piece.durationMicros * 1e-6;
+        float error = position - sine.positionAt(0, 0.5f + float(elapsed));
+        TEST_ASSERT_TRUE(fabsf(error) <= tolerance + 0.5f);
+    }
+    TEST_ASSERT_TRUE(s.isAtCycleEnd());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0.5, elapsed);
+}
+
+void test_StaysInsideTheLimits() {
+    // Jumps the motor can't follow, and past the end of the range.
+    Square square(1, 100, maxPosition + 500);
+    CurveSegmenter s = segmenter(square, 100);
+    std::vector<Piece> pieces = play(s, 100, 2);
+    int32_t highest = 0;
+    float fastest = 0;
+    for (size_t i = 1; i < pieces.size(); i++) {
+        highest = std::max(highest, pieces[i].position);
+        fastest = fmaxf(fastest, fabsf(pieces[i].speed));
+        TEST_ASSERT_TRUE(pieces[i].position >= 0);
+        TEST_ASSERT_TRUE(pieces[i].position <= maxPosition);
+        // A piece may round to a step more.
+        float dt = pieces[i].seconds - pieces[i - 1].seconds;
+        TEST_ASSERT_TRUE(fabsf(pieces[i].speed) <= maxSpeed + 1 / dt);
+    }
+    // It still goes all the way.
+    TEST_ASSERT_TRUE(highest >= maxPosition - 1);
+    TEST_ASSERT_TRUE(fastest >= 0.9f * maxSpeed);
+}
+
+void test_StopBrakes() {
+    Sine sine(1, 1000, 3000);
+    CurveSegmenter s = segmenter(sine, 1000);
+    std::vector<Piece> pieces = play(s, 1000, 0.25);
+    float speed = s.velocity();
+    TEST_ASSERT_TRUE(speed > 5000);
+
+    s.stop();
+    double braking = 0;
+    while (s.hasNext()) {
+        braking += s.next().durationMicros * 1e-6;
+    }
+    TEST_ASSERT_TRUE(s.isIdle());
+    TEST_ASSERT_FALSE(s.isAtCycleEnd());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, speed / maxAcceleration, braking);
+    // The pieces already planned are played out first.
+    TEST_ASSERT_EQUAL_FLOAT(0, s.velocity());
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_FollowsTheCurve);
+    RUN_TEST(test_KeepsTime);
+    RUN_TEST(test_SegmentsFollowTheCurvature);
+    RUN_TEST(test_CatchesUpInTwoSegments);
+    RUN_TEST(test_JoinsWhereTheCurveComesClosest);
+    RUN_TEST(test_StaysInsideTheLimits);
+    RUN_TEST(test_StopBrakes);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,163 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeferredLog.h"
+#include "unity.h"
+
+enum class Pattern { Simple, Deeper };
+
+static std::string render(DeferredLogRing<16> &ring) {
+    DeferredLogMessage message;
+    if (!ring.pop(message)) {
+        return "";
+    }
+    char line[128];
+    message.render(line, sizeof(line));
+    return line;
+}
+
+void test_FormatsLikePrintf() {
+    DeferredLogRing<16> ring;
+    ring.log(DeferredLogLevel::Debug, "Homing", "Current over limit: %f", 42,
+             1.5f);
+    TEST_ASSERT_EQUAL_STRING(
+        "[      42][D][Homing] Current over limit: 1.500000\n",
+        render(ring).c_str());
+
+    ring.log(DeferredLogLevel::Error, "Supervisor", "Stopped: %s at %d steps",
+             7, "speed", -1200);
+    TEST_ASSERT_EQUAL_STRING("[       7][E][Supervisor] Stopped: speed at "
+                             "-1200 steps\n",
+                             render(ring).c_str());
+
+    ring.log(DeferredLogLevel::Info, "x", "%5.2f|%-4d|%04x|%u%%|%lu", 0,
+             3.14159, 12, 255u, 100u, (uint32_t)9);
+    TEST_ASSERT_EQUAL_STRING("[       0][I][x]  3.14|12  |00ff|100%|9\n",
+                             render(ring).c_str());
+}
+
+void test_ConvertsLikePromotion() {
+    DeferredLogRing<16> ring;
+    ring.log(DeferredLogLevel::Debug, "t", "%d %f %d", 0, Pattern::Deeper, 2,
+             2.75f);
+    TEST_ASSERT_EQUAL_STRING("[       0][D][t] 1 2.000000 2\n",
+                             render(ring).c_str());
+}
+
+void test_MissingArgumentsPrintAsIs() {
+    DeferredLogRing<16> ring;
+    ring.log(DeferredLogLevel::Warn, "t", "a %d b %d", 0, 1);
+    TEST_ASSERT_EQUAL_STRING("[       0][W][t] a 1 b %d\n",
+                             render(ring).c_str());
+}
+
+void test_TruncatesLongLines() {
+    DeferredLogRing<16> ring;
+    ring.log(DeferredLogLevel::Debug, "t", "%s %s", 0,
+             "0123456789012345678901234567890123456789",
+             "0123456789012345678901234567890123456789");
+    DeferredLogMessage message;
+    TEST_ASSERT_TRUE(ring.pop(message));
+    char line[32];
+    TEST_ASSERT_EQUAL(31, message.render(line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("[       0][D][t] 01234567890123", line);
+}
+
+void test_DropsWhenFull() {
+    DeferredLogRing<16> ring;
+    for (int i = 0; i < 20; i++) {
+        ring.log(DeferredLogLevel::Debug, "t", "%d", 0, i);
+    }
+    TEST_ASSERT_EQUAL(4, ring.dropped());
+
+    // The oldest messages are kept, in order.
+    for (int i = 0; i < 16; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "[       0][D][t] %d\n", i);
+        TEST_ASSERT_EQUAL_STRING(expected, render(ring).c_str());
+    }
+    TEST_ASSERT_EQUAL_STRING("", render(ring).c_str());
+
+    // And there is room again.
+    TEST_ASSERT_TRUE(ring.log(DeferredLogLevel::Debug, "t", "%d", 0, 20));
+}
+
+void test_ManyProducersLoseNothing() {
+    static DeferredLogRing<64> ring;
+    constexpr int producers = 4;
+    constexpr int perProducer = 20000;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([p]() {
+            for (int i = 0; i < perProducer;) {
+                // Retry instead of dropping, to check every message arrives.
+                if (ring.log(DeferredLogLevel::Debug, "t", "%d %d", 0, p, i)) {
+                    i++;
+                }
+            }
+        });
+    }
+
+    std::vector<int> next(producers, 0);
+    int received = 0;
+    bool inOrder = true;
+    DeferredLogMessage message;
+    while (received < producers * perProducer) {
+        if (!ring.pop(message)) {
+            continue;
+        }
+        auto p = (int)message.args[0];
+        auto i = (int)message.args[1];
+        inOrder = inOrder && i == next[p];
+        next[p] = i + 1;
+        received++;
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    TEST_ASSERT_TRUE(inOrder);
+}
+
+void test_LoggingIsCheap() {
+    static DeferredLogRing<1024> ring;
+    DeferredLogMessage message;
+    constexpr int calls = 1000;
+    double total = 0;
+    for (int round = 0; round < 100; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            ring.log(DeferredLogLevel::Debug, "UTILS", "change stroke: %f %f",
+                     0, 70.0f, 111.8f);
+        }
+        total += std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+        while (ring.pop(message)) {
+        }
+    }
+    double ns = total / (100.0 * calls);
+    printf("deferred log: %.1f ns\n", ns);
+    // The budget on the device is a few hundred cycles, a PC is far below.
+    TEST_ASSERT_LESS_THAN(200, (int)ns);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_FormatsLikePrintf);
+    RUN_TEST(test_ConvertsLikePromotion);
+    RUN_TEST(test_MissingArgumentsPrintAsIs);
+    RUN_TEST(test_TruncatesLongLines);
+    RUN_TEST(test_DropsWhenFull);
+    RUN_TEST(test_ManyProducersLoseNothing);
+    RUN_TEST(test_LoggingIsCheap);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "unity.h"
+#include "utils/EStop.h"
+
+static uint32_t nowMicros() {
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(
+               steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void test_TripsOnlyWhenArmedAndHeld() {
+    EmergencyStop stop(800000);
+
+    stop.onEdge(true, 1000);
+    TEST_ASSERT_EQUAL(800000 - 500, stop.remainingHoldMicros(1500));
+    TEST_ASSERT_EQUAL(0, stop.remainingHoldMicros(801000));
+    TEST_ASSERT_FALSE(stop.isArmed());
+
+    stop.arm();
+    TEST_ASSERT_EQUAL(800100, stop.trip(801100));
+    TEST_ASSERT_EQUAL(100, stop.overheadMicros(stop.lastLatency()));
+
+    // Latched until the state machine acknowledges it.
+    TEST_ASSERT_EQUAL(0, stop.trip(802000));
+    TEST_ASSERT_TRUE(stop.acknowledge());
+    TEST_ASSERT_FALSE(stop.acknowledge());
+}
+
+void test_ReleaseBeforeHold() {
+    EmergencyStop stop(800000);
+    stop.arm();
+    stop.onEdge(true, 0);
+    stop.onEdge(false, 300000);
+    TEST_ASSERT_FALSE(stop.pressed());
+}
+
+void test_HoldTimeSurvivesWrap() {
+    EmergencyStop stop(800000);
+    stop.onEdge(true, 0xFFFFFF00u);
+    TEST_ASSERT_EQUAL(800000 - 0x200, stop.remainingHoldMicros(0x100));
+}
+
+/**
+ * Host simulation of services/eStop.h: an "interrupt" thread presses the
+ * button and a worker mirrors eStopTask. The overhead it prints is the host
+ * scheduler's, not the firmware's, so it is for information only. The
+ * budget is checked on the virtual clock of the SIL build, see
+ * sil/scenarios/stroke_engine.txt.
+ */
+struct Notification {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int count = 0;
+
+    void give() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            count++;
+        }
+        cv.notify_one();
+    }
+
+    // Like ulTaskNotifyTake(pdTRUE, timeout), returns the count taken.
+    int take(std::chrono::microseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, timeout, [this] { return count > 0; });
+        int taken = count;
+        count = 0;
+        return taken;
+    }
+};
+
+void test_SimulatedStopLatency() {
+    constexpr int presses = 30;
+    EmergencyStop stop(20000);
+    Notification notification;
+    std::atomic<bool> running{true};
+    std::atomic<int> disabled{0};
+    std::vector<uint32_t> overheads;
+
+    std::thread worker([&] {
+        while (running) {
+            notification.take(std::chrono::milliseconds(100));
+            while (stop.pressed() && running) {
+                uint32_t remaining = stop.remainingHoldMicros(nowMicros());
+                if (remaining > 0) {
+                    notification.take(std::chrono::microseconds(remaining));
+                    continue;
+                }
+                if (stop.isArmed()) {
+                    disabled++;  // forceStop() and disableOutputs()
+                    uint32_t latency = stop.trip(nowMicros());
+                    if (latency != 0) {
+                        overheads.push_back(stop.overheadMicros(latency));
+                    }
+                }
+                break;
+            }
+        }
+    });
+
+    stop.arm();
+    for (int i = 0; i < presses; i++) {
+        // A short tap must never stop the machine.
+        stop.onEdge(true, nowMicros());
+        notification.give();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        stop.onEdge(false, nowMicros());
+        notification.give();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        stop.onEdge(true, nowMicros());
+        notification.give();
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        stop.onEdge(false, nowMicros());
+        notification.give();
+        stop.acknowledge();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    running = false;
+    notification.give();
+    worker.join();
+
+    printf("e-stop: %d of %d holds stopped\n", disabled.load(), presses);
+    if (overheads.empty()) {
+        return;
+    }
+    std::sort(overheads.begin(), overheads.end());
+    uint32_t median = overheads[overheads.size() / 2];
+    uint32_t p95 = overheads[overheads.size() * 95 / 100];
+    printf("e-stop overhead: median %u us, p95 %u us, max %u us of %u us\n",
+           median, p95, overheads.back(),
+           (unsigned)EmergencyStop::latencyBudgetMicros);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_TripsOnlyWhenArmedAndHeld);
+    RUN_TEST(test_ReleaseBeforeHold);
+    RUN_TEST(test_HoldTimeSurvivesWrap);
+    RUN_TEST(test_SimulatedStopLatency);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
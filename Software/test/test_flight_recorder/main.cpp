@@ -0,0 +1,108 @@
+#include <cstring>
+
+#include "unity.h"
+#include "utils/FlightRecorder.h"
+
+static FlightRecorder recorder;
+static uint8_t dump[FlightRecorder::dumpSize];
+
+void setUp() { recorder.reset(); }
+
+void tearDown() {}
+
+void test_RoundTrip() {
+    recorder.recordState("homing", 10);
+    recorder.record(FlightEvent::Setting, (uint8_t)FlightSetting::Speed, 4250,
+                    0, 20);
+    recorder.record(FlightEvent::Motion, (uint8_t)FlightSource::StrokeEngine,
+                    -1200, 3000, 30);
+    recorder.recordState("menu", 40);
+    recorder.recordState("homing", 50);
+    TEST_ASSERT_TRUE(recorder.freeze(FlightEvent::EmergencyStop, 60));
+
+    size_t length = recorder.serialize(dump, 7);
+    TEST_ASSERT_EQUAL(sizeof(FlightDump::Header) + 5 * sizeof(FlightRecord),
+                      length);
+
+    const FlightRecord *records = nullptr;
+    const FlightDump::Header *header =
+        FlightDump::parse(dump, length, &records);
+    TEST_ASSERT_NOT_NULL(header);
+    TEST_ASSERT_EQUAL(7, header->sequence);
+    TEST_ASSERT_EQUAL(60, header->frozenAtMs);
+    TEST_ASSERT_EQUAL((int)FlightEvent::EmergencyStop, (int)header->reason);
+    TEST_ASSERT_EQUAL(2, header->nameCount);
+    TEST_ASSERT_EQUAL(5, header->recordCount);
+
+    TEST_ASSERT_EQUAL_STRING("homing", header->names[records[0].id]);
+    TEST_ASSERT_EQUAL(4250, records[1].a);
+    TEST_ASSERT_EQUAL(-1200, records[2].a);
+    TEST_ASSERT_EQUAL(3000, records[2].b);
+    TEST_ASSERT_EQUAL_STRING("menu", header->names[records[3].id]);
+    TEST_ASSERT_EQUAL(records[0].id, records[4].id);
+}
+
+void test_WrapKeepsNewestOldestFirst() {
+    for (int i = 0; i < 1000; i++) {
+        recorder.record(FlightEvent::Motion, 0, i, 0, i);
+    }
+    recorder.freeze(FlightEvent::Error, 1000);
+    recorder.serialize(dump, 1);
+
+    const FlightRecord *records = nullptr;
+    const FlightDump::Header *header =
+        FlightDump::parse(dump, sizeof(dump), &records);
+    TEST_ASSERT_NOT_NULL(header);
+    TEST_ASSERT_EQUAL(256, header->recordCount);
+    TEST_ASSERT_EQUAL(1000 - 256, records[0].a);
+    TEST_ASSERT_EQUAL(999, records[255].a);
+}
+
+void test_FrozenIgnoresRecords() {
+    recorder.record(FlightEvent::Motion, 0, 1, 0, 1);
+    TEST_ASSERT_TRUE(recorder.freeze(FlightEvent::EmergencyStop, 2));
+    // The first reason wins, a second stop does not overwrite it.
+    TEST_ASSERT_FALSE(recorder.freeze(FlightEvent::Error, 3));
+    recorder.record(FlightEvent::Motion, 0, 2, 0, 4);
+
+    size_t length = recorder.serialize(dump, 1);
+    const FlightRecord *records = nullptr;
+    const FlightDump::Header *header =
+        FlightDump::parse(dump, length, &records);
+    TEST_ASSERT_EQUAL(1, header->recordCount);
+    TEST_ASSERT_EQUAL((int)FlightEvent::EmergencyStop, (int)header->reason);
+
+    recorder.thaw();
+    recorder.record(FlightEvent::Motion, 0, 2, 0, 4);
+    TEST_ASSERT_EQUAL(4, recorder.lastTimeMs());
+}
+
+void test_ParseRejectsCorruptDumps() {
+    recorder.record(FlightEvent::Motion, 0, 1, 0, 1);
+    recorder.freeze(FlightEvent::Panic, 1);
+    size_t length = recorder.serialize(dump, 1);
+
+    const FlightRecord *records = nullptr;
+    dump[length - 1] ^= 0x01;
+    TEST_ASSERT_NULL(FlightDump::parse(dump, length, &records));
+    dump[length - 1] ^= 0x01;
+    TEST_ASSERT_NULL(FlightDump::parse(dump, length - 1, &records));
+
+    // Erased flash reads as 0xFF.
+    memset(dump, 0xFF, sizeof(dump));
+    TEST_ASSERT_NULL(FlightDump::parse(dump, sizeof(dump), &records));
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_RoundTrip);
+    RUN_TEST(test_WrapKeepsNewestOldestFirst);
+    RUN_TEST(test_FrozenIgnoresRecords);
+    RUN_TEST(test_ParseRejectsCorruptDumps);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
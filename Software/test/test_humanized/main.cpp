@@ -0,0 +1,146 @@
+#include <Arduino.h>
+
+#include <vector>
+
+#include "pattern.h"
+#include "unity.h"
+
+/**
+ * The randomness of Humanized patterns: reproducible from the seed, and
+ * never outside the stroke window or the machine's limits.
+ */
+
+namespace {
+    constexpr int depth = 8000;
+    constexpr int stroke = 5000;
+    constexpr unsigned int maxSpeed = 40000;
+    constexpr unsigned int maxAcceleration = 200000;
+
+    template <class P>
+    void preparePattern(P &pattern, float timeOfStroke = 1.0f) {
+        pattern.setSpeedLimit(maxSpeed, maxAcceleration, 50);
+        pattern.setTimeOfStroke(timeOfStroke);
+        pattern.setStroke(stroke);
+        pattern.setDepth(depth);
+        pattern.setSensation(0);
+    }
+
+    template <class P>
+    std::vector<motionParameter> play(P &pattern, unsigned int moves) {
+        std::vector<motionParameter> played;
+        for (unsigned int i = 0; i < moves; i++) {
+            played.push_back(pattern.nextTarget(i));
+        }
+        return played;
+    }
+
+    bool isSame(const motionParameter &a, const motionParameter &b) {
+        return a.stroke == b.stroke && a.speed == b.speed &&
+               a.acceleration == b.acceleration && a.skip == b.skip;
+    }
+}
+
+void test_XorshiftSequence() {
+    // Marsaglia's first value for a seed of 1.
+    PatternRandom random(1);
+    TEST_ASSERT_EQUAL_UINT32(270369, random.next());
+
+    PatternRandom zero(0);
+    TEST_ASSERT_NOT_EQUAL(0, zero.next());
+
+    for (int i = 0; i < 10000; i++) {
+        float value = random.between(-2.0f, 3.0f);
+        TEST_ASSERT_TRUE(value >= -2.0f && value < 3.0f);
+    }
+}
+
+void test_SeedReproducesTheMoves() {
+    Humanized<TeasingPounding> first("Human Touch", 42);
+    Humanized<TeasingPounding> again("Human Touch", 42);
+    Humanized<TeasingPounding> other("Human Touch", 43);
+    preparePattern(first);
+    preparePattern(again);
+    preparePattern(other);
+
+    std::vector<motionParameter> a = play(first, 200);
+    std::vector<motionParameter> b = play(again, 200);
+    std::vector<motionParameter> c = play(other, 200);
+    int differences = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        TEST_ASSERT_TRUE(isSame(a[i], b[i]));
+        differences += isSame(a[i], c[i]) ? 0 : 1;
+    }
+    TEST_ASSERT_GREATER_THAN(150, differences);
+}
+
+void test_StaysInsideTheWindowAndLimits() {
+    // Fast enough that a faster move would go over the speed limit.
+    Humanized<TeasingPounding> pattern("Human Touch", 7);
+    preparePattern(pattern, 0.3f);
+    int shallowest = depth, deepest = 0;
+    for (const motionParameter &move : play(pattern, 1000)) {
+        TEST_ASSERT_FALSE(move.skip);
+        TEST_ASSERT_TRUE(move.stroke >= depth - stroke);
+        TEST_ASSERT_TRUE(move.stroke <= depth);
+        TEST_ASSERT_TRUE(move.speed >= 1 && move.speed <= (int)maxSpeed);
+        TEST_ASSERT_TRUE(move.acceleration >= 1 &&
+                         move.acceleration <= (int)maxAcceleration);
+        shallowest = min(shallowest, move.stroke);
+        deepest = max(deepest, move.stroke);
+    }
+    // The variation is used, all the way to the depth.
+    TEST_ASSERT_EQUAL(depth, deepest);
+    TEST_ASSERT_TRUE(shallowest < depth - stroke + stroke / 10);
+}
+
+void test_NoVariationPlaysThePattern() {
+    Humanized<TeasingPounding>::Variation none;
+    none.timing = 0;
+    none.depth = 0;
+    none.stroke = 0;
+    Humanized<TeasingPounding> humanized("Human Touch", 3, none);
+    TeasingPounding plain("Teasing Pounding");
+    // Slow enough that the fast move stays within the limits.
+    preparePattern(humanized, 4.0f);
+    preparePattern(plain, 4.0f);
+    humanized.setSensation(60);
+    plain.setSensation(60);
+
+    std::vector<motionParameter> a = play(humanized, 20);
+    std::vector<motionParameter> b = play(plain, 20);
+    // The first move starts at home and is longer than a stroke.
+    for (size_t i = 1; i < a.size(); i++) {
+        TEST_ASSERT_EQUAL(b[i].stroke, a[i].stroke);
+        TEST_ASSERT_INT_WITHIN(1, b[i].speed, a[i].speed);
+        TEST_ASSERT_INT_WITHIN(1, b[i].acceleration, a[i].acceleration);
+    }
+}
+
+void test_AskingAgainGivesTheSameMove() {
+    // StrokeEngine asks again while its stroke gate holds a move back, or
+    // for an update with the new settings.
+    Humanized<SimpleStroke> asked("Human Stroke", 9);
+    Humanized<SimpleStroke> twice("Human Stroke", 9);
+    preparePattern(asked);
+    preparePattern(twice);
+    for (unsigned int i = 0; i < 100; i++) {
+        motionParameter expected = asked.nextTarget(i);
+        twice.nextTarget(i);
+        TEST_ASSERT_TRUE(isSame(expected, twice.nextTarget(i)));
+    }
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_XorshiftSequence);
+    RUN_TEST(test_SeedReproducesTheMoves);
+    RUN_TEST(test_StaysInsideTheWindowAndLimits);
+    RUN_TEST(test_NoVariationPlaysThePattern);
+    RUN_TEST(test_AskingAgainGivesTheSameMove);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,72 @@
+#include "unity.h"
+#include "utils/JitterStats.h"
+
+void test_EmptyIsZero() {
+    JitterStats<> stats;
+    TEST_ASSERT_EQUAL(0, stats.count());
+    TEST_ASSERT_EQUAL(0, stats.max());
+    TEST_ASSERT_EQUAL(0, stats.percentile(99));
+    TEST_ASSERT_EQUAL_FLOAT(0, stats.mean());
+}
+
+void test_Percentiles() {
+    JitterStats<> stats;
+    // 1 to 100 us, once each.
+    for (uint32_t i = 1; i <= 100; i++) {
+        stats.record(i);
+    }
+    TEST_ASSERT_EQUAL(100, stats.count());
+    TEST_ASSERT_EQUAL(1, stats.percentile(0));
+    TEST_ASSERT_EQUAL(50, stats.percentile(50));
+    TEST_ASSERT_EQUAL(99, stats.percentile(99));
+    TEST_ASSERT_EQUAL(100, stats.percentile(100));
+    TEST_ASSERT_EQUAL(100, stats.max());
+    TEST_ASSERT_EQUAL_FLOAT(50.5f, stats.mean());
+}
+
+void test_RareSpikesShowInTheTail() {
+    JitterStats<> stats;
+    for (int i = 0; i < 990; i++) {
+        stats.record(3);
+    }
+    for (int i = 0; i < 10; i++) {
+        stats.record(400);
+    }
+    TEST_ASSERT_EQUAL(3, stats.percentile(50));
+    TEST_ASSERT_EQUAL(3, stats.percentile(99));
+    TEST_ASSERT_EQUAL(400, stats.percentile(99.9f));
+}
+
+void test_Overflow() {
+    JitterStats<100> stats;
+    stats.record(10);
+    stats.record(5000);
+    TEST_ASSERT_EQUAL(1, stats.overflowed());
+    TEST_ASSERT_EQUAL(5000, stats.max());
+    TEST_ASSERT_EQUAL(10, stats.percentile(50));
+    // Somewhere past the range, the maximum tells how far.
+    TEST_ASSERT_EQUAL(100, stats.percentile(100));
+}
+
+void test_Reset() {
+    JitterStats<> stats;
+    stats.record(7);
+    stats.reset();
+    TEST_ASSERT_EQUAL(0, stats.count());
+    TEST_ASSERT_EQUAL(0, stats.max());
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_EmptyIsZero);
+    RUN_TEST(test_Percentiles);
+    RUN_TEST(test_RareSpikesShowInTheTail);
+    RUN_TEST(test_Overflow);
+    RUN_TEST(test_Reset);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,132 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "unity.h"
+#include "utils/MachineProfile.h"
+
+// The reference build, as Config::Driver describes it.
+static constexpr MachineProfile reference{.motorStepPerRevolution = 800,
+                                          .pulleyToothCount = 20,
+                                          .beltPitchMm = 2,
+                                          .maxSpeedMmPerSecond = 900,
+                                          .maxAcceleration = 10000,
+                                          .sensorlessCurrentLimit = 1.5f};
+
+void test_DerivesConversions() {
+    constexpr MachineKinematics kinematics(reference);
+    static_assert(kinematics.stepsPerMm == 20.0f, "Computed at compile time");
+
+    TEST_ASSERT_EQUAL_FLOAT(20, kinematics.stepsPerMm);
+    TEST_ASSERT_EQUAL_FLOAT(0.05f, kinematics.mmPerStep);
+    TEST_ASSERT_EQUAL_FLOAT(18000, kinematics.maxSpeedStepsPerSecond);
+    TEST_ASSERT_EQUAL_FLOAT(200000, kinematics.maxAccelerationStepsPerSecond2);
+    TEST_ASSERT_EQUAL_FLOAT(6000, kinematics.steps(300));
+    TEST_ASSERT_EQUAL_FLOAT(300, kinematics.mm(6000));
+}
+
+void test_RoundTripsOtherMachines() {
+    // A 16 tooth pulley on a 1600 step servo, 20 mm per revolution.
+    MachineProfile profile = reference;
+    profile.pulleyToothCount = 16;
+    profile.beltPitchMm = 1.25f;
+    profile.motorStepPerRevolution = 1600;
+    MachineKinematics kinematics(profile);
+
+    TEST_ASSERT_EQUAL_FLOAT(80, kinematics.stepsPerMm);
+    for (float mm = 0; mm <= 300; mm += 0.5f) {
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, mm,
+                                 kinematics.mm(kinematics.steps(mm)));
+    }
+}
+
+void test_RejectsImpossibleProfiles() {
+    TEST_ASSERT_TRUE(reference.isValid());
+
+    MachineProfile profile = reference;
+    profile.pulleyToothCount = 0;
+    TEST_ASSERT_FALSE(profile.isValid());
+
+    profile = reference;
+    profile.motorStepPerRevolution = -800;
+    TEST_ASSERT_FALSE(profile.isValid());
+
+    profile = reference;
+    profile.maxSpeedMmPerSecond = 5000;
+    TEST_ASSERT_FALSE(profile.isValid());
+
+    profile = reference;
+    profile.sensorlessCurrentLimit = 0;
+    TEST_ASSERT_FALSE(profile.isValid());
+}
+
+void test_TextRoundTrips() {
+    MachineProfile profile{};
+    for (size_t i = 0; i < MachineProfileText::fieldCount; i++) {
+        char text[16];
+        MachineProfileText::format(reference, i, text, sizeof(text));
+        TEST_ASSERT_TRUE(MachineProfileText::parse(profile, i, text));
+    }
+    TEST_ASSERT_TRUE(profile == reference);
+
+    char text[16];
+    MachineProfileText::format(reference, 5, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("1.5", text);
+    MachineProfileText::format(reference, 0, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("800", text);
+}
+
+void test_TextRejectsGarbage() {
+    MachineProfile profile = reference;
+    TEST_ASSERT_FALSE(MachineProfileText::parse(profile, 1, ""));
+    TEST_ASSERT_FALSE(MachineProfileText::parse(profile, 1, "twenty"));
+    TEST_ASSERT_FALSE(MachineProfileText::parse(profile, 1, "20mm"));
+    TEST_ASSERT_TRUE(profile == reference);
+}
+
+static volatile float sink;
+
+/**
+ * Converting a position back to mm, as StrokeEngine does for every move:
+ * dividing by steps per mm against multiplying by the precomputed
+ * reciprocal.
+ */
+void test_ReciprocalIsCheaper() {
+    static volatile float stepsPerMm = 20;
+    static volatile float mmPerStep = 0.05f;
+    constexpr int calls = 1000000;
+
+    auto measure = [](auto convert) {
+        float sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            sum += convert(float(i));
+        }
+        sink = sum;
+        return std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - start)
+                   .count() /
+               calls;
+    };
+
+    double divide = measure([](float steps) { return steps / stepsPerMm; });
+    double multiply = measure([](float steps) { return steps * mmPerStep; });
+    printf("steps to mm: divide %.2f ns, multiply %.2f ns\n", divide,
+           multiply);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_DerivesConversions);
+    RUN_TEST(test_RoundTripsOtherMachines);
+    RUN_TEST(test_RejectsImpossibleProfiles);
+    RUN_TEST(test_TextRoundTrips);
+    RUN_TEST(test_TextRejectsGarbage);
+    RUN_TEST(test_ReciprocalIsCheaper);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
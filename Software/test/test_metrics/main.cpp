@@ -0,0 +1,212 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "unity.h"
+#include "utils/Metrics.h"
+#include "utils/MetricsServer.h"
+
+// Count heap allocations so we can prove a scrape never allocates.
+static std::atomic<int> allocations{0};
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// A very small Prometheus text parser: "name{labels} value" -> value.
+static std::map<std::string, double> parse(const std::string &text) {
+    std::map<std::string, double> samples;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+        if (line.empty() || line[0] == '#') continue;
+        size_t space = line.rfind(' ');
+        samples[line.substr(0, space)] = atof(line.c_str() + space + 1);
+    }
+    return samples;
+}
+
+// Sends request, and rest a little later if given, like a client whose
+// request arrives in two segments.
+static std::string scrape(MetricsServer &server, const Metrics &registry,
+                          const char *request, const char *rest = nullptr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server.port());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(0, connect(fd, (sockaddr *)&addr, sizeof(addr)));
+    send(fd, request, strlen(request), 0);
+
+    int client = -1;
+    for (int i = 0; i < 100 && client < 0; i++) {
+        client = server.accept();
+        if (client < 0) usleep(1000);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(0, client);
+    std::thread later([fd, rest] {
+        if (rest != nullptr) {
+            usleep(20000);
+            send(fd, rest, strlen(rest), 0);
+        }
+    });
+    MetricsServer::serve(client, registry, 1234);
+    later.join();
+
+    std::string response;
+    char chunk[512];
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        response.append(chunk, n);
+    }
+    close(fd);
+    return response;
+}
+
+void test_RenderCounters() {
+    Metrics m;
+    m.recordLoopLatency(40);
+    m.recordLoopLatency(300);
+    m.recordLoopLatency(20000);
+    m.recordClip();
+    m.recordClip();
+    m.recordStroke(1000000);
+    m.recordStroke(2000000);  // one second per stroke -> 60 SPM
+    m.recordHoming(4000000);
+    m.recordTransition("menu");
+    m.recordTransition("menu.idle");
+    m.recordTransition("menu");
+    m.recordHeap(120000, 65536);
+    m.recordStackHeadroom(MetricsTask::Homing, 1024);
+
+    char buffer[MetricsServer::bodySize];
+    size_t length = m.render(buffer, sizeof(buffer), 61500);
+    TEST_ASSERT_LESS_THAN(sizeof(buffer), length);
+
+    auto samples = parse(buffer);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 61.5, samples["ossm_uptime_seconds"]);
+    TEST_ASSERT_EQUAL(1, (int)samples["ossm_stroking_loop_latency_seconds_bucket{le=\"0.000050\"}"]);
+    TEST_ASSERT_EQUAL(2, (int)samples["ossm_stroking_loop_latency_seconds_bucket{le=\"0.000500\"}"]);
+    TEST_ASSERT_EQUAL(3, (int)samples["ossm_stroking_loop_latency_seconds_bucket{le=\"+Inf\"}"]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.02034, samples["ossm_stroking_loop_latency_seconds_sum"]);
+    TEST_ASSERT_EQUAL(2, (int)samples["ossm_strokes_total"]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 60.0, samples["ossm_strokes_per_minute"]);
+    TEST_ASSERT_EQUAL(2, (int)samples["ossm_clips_total"]);
+    TEST_ASSERT_EQUAL(1, (int)samples["ossm_homing_duration_seconds_bucket{le=\"5.000000\"}"]);
+    TEST_ASSERT_EQUAL(2, (int)samples["ossm_state_transitions_total{state=\"menu\"}"]);
+    TEST_ASSERT_EQUAL(1, (int)samples["ossm_state_transitions_total{state=\"menu.idle\"}"]);
+    TEST_ASSERT_EQUAL(120000, (int)samples["ossm_heap_free_bytes"]);
+    TEST_ASSERT_EQUAL(65536, (int)samples["ossm_heap_largest_free_block_bytes"]);
+    TEST_ASSERT_EQUAL(1024, (int)samples["ossm_task_stack_headroom_bytes{task=\"homing\"}"]);
+    // Tasks that never reported are left out.
+    TEST_ASSERT_EQUAL(0, (int)samples.count("ossm_task_stack_headroom_bytes{task=\"menu\"}"));
+}
+
+void test_HistogramSumDoesNotWrap() {
+    // 2^32 us are 71 minutes, homing alone gets there in a long day.
+    Metrics m;
+    for (int i = 0; i < 200; i++) {
+        m.recordHoming(30000000);
+    }
+    char buffer[MetricsServer::bodySize];
+    m.render(buffer, sizeof(buffer), 0);
+    auto samples = parse(buffer);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 6000.0,
+                             samples["ossm_homing_duration_seconds_sum"]);
+}
+
+void test_RenderDoesNotAllocate() {
+    static Metrics m;
+    static char buffer[MetricsServer::bodySize];
+    m.recordTransition("homing");
+    m.recordLoopLatency(100);
+
+    int before = allocations.load();
+    m.render(buffer, sizeof(buffer), 0);
+    TEST_ASSERT_EQUAL(before, allocations.load());
+}
+
+void test_RenderTruncatesCleanly() {
+    Metrics m;
+    char buffer[300];
+    size_t length = m.render(buffer, sizeof(buffer), 0);
+    TEST_ASSERT_EQUAL(sizeof(buffer), length);
+    // Only whole lines are kept.
+    size_t used = strlen(buffer);
+    TEST_ASSERT_TRUE(used > 0);
+    TEST_ASSERT_EQUAL('\n', buffer[used - 1]);
+}
+
+void test_StateTableOverflow() {
+    static const char *names[Metrics::maxStates + 2];
+    static char storage[Metrics::maxStates + 2][8];
+    Metrics m;
+    for (size_t i = 0; i < Metrics::maxStates + 2; i++) {
+        snprintf(storage[i], sizeof(storage[i]), "s%u", (unsigned)i);
+        names[i] = storage[i];
+        m.recordTransition(names[i]);
+    }
+    char buffer[MetricsServer::bodySize];
+    m.render(buffer, sizeof(buffer), 0);
+    auto samples = parse(buffer);
+    TEST_ASSERT_EQUAL(2, (int)samples["ossm_state_transitions_dropped_total"]);
+}
+
+void test_LocalScrape() {
+    Metrics m;
+    m.recordClip();
+
+    MetricsServer server;
+    TEST_ASSERT_TRUE(server.begin(0));
+    TEST_ASSERT_NOT_EQUAL(0, server.port());
+
+    std::string response =
+        scrape(server, m, "GET /metrics HTTP/1.1\r\nHost: ossm\r\n\r\n");
+    TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.0 200 OK"));
+    size_t bodyStart = response.find("\r\n\r\n");
+    TEST_ASSERT_TRUE(bodyStart != std::string::npos);
+    auto samples = parse(response.substr(bodyStart + 4));
+    TEST_ASSERT_EQUAL(1, (int)samples["ossm_clips_total"]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.234, samples["ossm_uptime_seconds"]);
+
+    response = scrape(server, m, "GET / HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.0 404 Not Found"));
+
+    // A request line split across segments is still understood.
+    response = scrape(server, m, "GET /met", "rics HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_EQUAL(0, (int)response.find("HTTP/1.0 200 OK"));
+
+    server.end();
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_RenderCounters);
+    RUN_TEST(test_HistogramSumDoesNotWrap);
+    RUN_TEST(test_RenderDoesNotAllocate);
+    RUN_TEST(test_RenderTruncatesCleanly);
+    RUN_TEST(test_StateTableOverflow);
+    RUN_TEST(test_LocalScrape);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,233 @@
+#include <deque>
+#include <vector>
+
+#include "unity.h"
+#include "utils/Modbus.h"
+#include "utils/ServoMonitor.h"
+
+/**
+ * Modbus frames, the client and the servo monitor against a scripted port,
+ * without a drive. tools/servomock tries them over a real tty.
+ */
+
+namespace {
+    // What the client sent, and what the drive is to answer, byte by byte.
+    struct ScriptedPort {
+        std::vector<uint8_t> sent;
+        std::deque<uint8_t> incoming;
+
+        int available() { return (int)incoming.size(); }
+
+        int read() {
+            if (incoming.empty()) {
+                return -1;
+            }
+            uint8_t byte = incoming.front();
+            incoming.pop_front();
+            return byte;
+        }
+
+        size_t write(const uint8_t *data, size_t length) {
+            sent.assign(data, data + length);
+            return length;
+        }
+
+        // Queues a response of registers, with a good CRC.
+        void answer(uint8_t slave, const std::vector<uint16_t> &registers) {
+            std::vector<uint8_t> frame = {slave, 0x03,
+                                          uint8_t(2 * registers.size())};
+            for (uint16_t value : registers) {
+                frame.push_back(uint8_t(value >> 8));
+                frame.push_back(uint8_t(value));
+            }
+            uint16_t crc = Modbus::crc16(frame.data(), frame.size());
+            frame.push_back(uint8_t(crc));
+            frame.push_back(uint8_t(crc >> 8));
+            incoming.insert(incoming.end(), frame.begin(), frame.end());
+        }
+    };
+
+    using Client = ModbusClient<ScriptedPort>;
+}
+
+void test_RequestMatchesTheSpec() {
+    // The example of the Modbus over serial line spec.
+    uint8_t frame[Modbus::requestSize];
+    TEST_ASSERT_EQUAL(8, Modbus::readRequest(frame, 1, 0x0000, 10));
+    const uint8_t expected[] = {0x01, 0x03, 0x00, 0x00,
+                                0x00, 0x0A, 0xC5, 0xCD};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, frame, sizeof(expected));
+    TEST_ASSERT_EQUAL_UINT32(1750, Modbus::frameGapMicros(57600));
+    TEST_ASSERT_EQUAL_UINT32(4010, Modbus::frameGapMicros(9600));
+}
+
+void test_ParseResponses() {
+    ScriptedPort port;
+    port.answer(1, {0x1234, 0xFFFF});
+    std::vector<uint8_t> frame(port.incoming.begin(), port.incoming.end());
+    // Room for any count, as parseReadResponse() may fill count values.
+    uint16_t registers[Modbus::maxRegisters] = {};
+    uint8_t exception = 0;
+    auto parse = [&](size_t length, uint8_t slave, uint16_t count) {
+        return (int)Modbus::parseReadResponse(frame.data(), length, slave,
+                                              count, registers, exception);
+    };
+
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Ok, parse(frame.size(), 1, 2));
+    TEST_ASSERT_EQUAL_UINT32(0x1234, registers[0]);
+    TEST_ASSERT_EQUAL_UINT32(0xFFFF, registers[1]);
+
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Incomplete, parse(6, 1, 2));
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Mismatch,
+                      parse(frame.size(), 2, 2));
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Mismatch,
+                      parse(frame.size(), 1, 3));
+    // Counts no read may ask for.
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Mismatch,
+                      parse(frame.size(), 1, 0));
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Mismatch,
+                      parse(frame.size(), 1, Modbus::maxRegisters + 1));
+    TEST_ASSERT_EQUAL(0, Modbus::readResponseSize(0));
+    TEST_ASSERT_EQUAL(0, Modbus::readResponseSize(Modbus::maxRegisters + 1));
+    TEST_ASSERT_EQUAL(Modbus::maxResponseSize,
+                      Modbus::readResponseSize(Modbus::maxRegisters));
+    frame[4] ^= 0x01;
+    TEST_ASSERT_EQUAL((int)Modbus::Status::BadCrc, parse(frame.size(), 1, 2));
+
+    // Illegal data address.
+    frame = {0x01, 0x83, 0x02};
+    uint16_t crc = Modbus::crc16(frame.data(), frame.size());
+    frame.push_back(uint8_t(crc));
+    frame.push_back(uint8_t(crc >> 8));
+    TEST_ASSERT_EQUAL((int)Modbus::Status::Exception,
+                      parse(frame.size(), 1, 2));
+    TEST_ASSERT_EQUAL(2, exception);
+}
+
+void test_ClientNeverWaits() {
+    ScriptedPort port;
+    Client client(port, 57600, 50000);
+    uint64_t now = 10000;
+
+    // Left over from an earlier answer, thrown away with the request.
+    port.incoming = {0x55, 0xAA};
+    TEST_ASSERT_TRUE(client.request(1, 0x0836, 2, now));
+    TEST_ASSERT_EQUAL(8, port.sent.size());
+    TEST_ASSERT_FALSE(client.isIdle(now));
+    TEST_ASSERT_FALSE(client.request(1, 0x0836, 2, now));
+
+    // The answer arrives a few bytes at a time.
+    port.answer(1, {0x0001, 0x0002});
+    std::deque<uint8_t> answer;
+    answer.swap(port.incoming);
+    TEST_ASSERT_EQUAL((int)Client::Result::Pending, (int)client.poll(now));
+    while (!answer.empty()) {
+        now += 1000;
+        port.incoming.push_back(answer.front());
+        answer.pop_front();
+        Client::Result result = client.poll(now);
+        TEST_ASSERT_EQUAL(answer.empty() ? (int)Client::Result::Ok
+                                         : (int)Client::Result::Pending,
+                          (int)result);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, client.registers()[1]);
+
+    // The line has to be quiet before the next request.
+    TEST_ASSERT_FALSE(client.isIdle(now + 1000));
+    TEST_ASSERT_TRUE(client.isIdle(now + 1750));
+
+    // A drive that never answers.
+    now += 2000;
+    TEST_ASSERT_TRUE(client.request(1, 0x0836, 2, now));
+    TEST_ASSERT_EQUAL((int)Client::Result::Pending,
+                      (int)client.poll(now + 49999));
+    TEST_ASSERT_EQUAL((int)Client::Result::Timeout,
+                      (int)client.poll(now + 50000));
+    TEST_ASSERT_EQUAL((int)Client::Result::Pending,
+                      (int)client.poll(now + 50001));
+}
+
+void test_MonitorReadsTheJmc() {
+    ScriptedPort port;
+    ServoMonitor<ScriptedPort> monitor(port, ServoModels::jmc, 1, 57600,
+                                       20000, 50000);
+    ServoReading reading;
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.snapshot().read(reading));
+
+    uint64_t now = 100000;
+    monitor.poll(now);
+    const uint8_t first[] = {0x01, 0x03, 0x08, 0x36, 0x00, 0x04};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(first, port.sent.data(), sizeof(first));
+    // Position -2, following error 70000.
+    port.answer(1, {0xFFFF, 0xFFFE, 0x0001, 0x1170});
+    monitor.poll(now += 1000);
+
+    // The second read waits for the line to go quiet.
+    monitor.poll(now += 1000);
+    TEST_ASSERT_EQUAL(0x36, port.sent[3]);
+    monitor.poll(now += 1000);
+    TEST_ASSERT_EQUAL(0x42, port.sent[3]);
+    // -300 rpm, torque 45.6 %.
+    port.answer(1, {uint16_t(-300), 0, 456});
+    monitor.poll(now += 1000);
+
+    TEST_ASSERT_EQUAL_UINT32(1, monitor.snapshot().read(reading));
+    TEST_ASSERT_EQUAL(-2, reading.position);
+    TEST_ASSERT_EQUAL(70000, reading.followingError);
+    TEST_ASSERT_EQUAL(-300, reading.speedRpm);
+    TEST_ASSERT_EQUAL(456, reading.load);
+    TEST_ASSERT_EQUAL(0, reading.alarm);
+    TEST_ASSERT_EQUAL_UINT32(1, monitor.stats().polls);
+
+    // Nothing until the next interval, then a damaged answer drops the
+    // poll and leaves the last reading as it was.
+    monitor.poll(now += 5000);
+    TEST_ASSERT_EQUAL(0x42, port.sent[3]);
+    monitor.poll(now = 120000);
+    TEST_ASSERT_EQUAL(0x36, port.sent[3]);
+    port.answer(1, {0, 0, 0, 0});
+    port.incoming[5] ^= 0x80;
+    monitor.poll(now += 1000);
+    TEST_ASSERT_EQUAL_UINT32(1, monitor.stats().badCrcs);
+    TEST_ASSERT_EQUAL_UINT32(1, monitor.snapshot().read(reading));
+    TEST_ASSERT_EQUAL(70000, reading.followingError);
+}
+
+void test_GoldMotorAlarm() {
+    ScriptedPort port;
+    ServoMonitor<ScriptedPort> monitor(port, ServoModels::goldMotor, 3,
+                                       19200, 20000, 50000);
+    uint64_t now = 100000;
+    monitor.poll(now);
+    port.answer(3, {0x0C, 25, 1500});
+    monitor.poll(now += 1000);
+    monitor.poll(now += 3000);
+    // Low word first.
+    port.answer(3, {0x0001, 0x0002});
+    monitor.poll(now += 1000);
+
+    ServoReading reading;
+    TEST_ASSERT_EQUAL_UINT32(1, monitor.snapshot().read(reading));
+    TEST_ASSERT_EQUAL(0x0C, reading.alarm);
+    TEST_ASSERT_EQUAL(25, reading.load);
+    TEST_ASSERT_EQUAL(1500, reading.speedRpm);
+    TEST_ASSERT_EQUAL(0x00020001, reading.position);
+    TEST_ASSERT_EQUAL(0, reading.followingError);
+    TEST_ASSERT_EQUAL(1, ServoModels::find("57aim"));
+    TEST_ASSERT_EQUAL(-1, ServoModels::find("ihsv60"));
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_RequestMatchesTheSpec);
+    RUN_TEST(test_ParseResponses);
+    RUN_TEST(test_ClientNeverWaits);
+    RUN_TEST(test_MonitorReadsTheJmc);
+    RUN_TEST(test_GoldMotorAlarm);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,185 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "unity.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+/**
+ * The per stroke arithmetic of startSimplePenetrationTask, as it was with
+ * long double "_mm" literals and a double session distance, and as it is with
+ * float steps and an integer session distance.
+ *
+ * The ESP32 FPU only does single precision, so on the device every double
+ * operation is a library call. Run it there to see the difference:
+ *
+ *   pio test -e development -f test_motion_math
+ *
+ * On a PC both versions run in hardware and only the results are checked.
+ */
+
+static constexpr float stepsPerMM = 800.0f / (20.0f * 2.0f);
+static constexpr float maxSpeedMmPerSecond = 900.0f;
+static constexpr float accelerationScaling = 100.0f;
+static constexpr float deadZone = 1.0f;
+
+struct Inputs {
+    float speed;
+    float stroke;
+    float measuredStrokeSteps;
+};
+
+struct Before {
+    double lastSpeed = 0;
+    double sessionDistanceMeters = 0;
+    int32_t target = 0;
+    int32_t acceleration = 0;
+
+    void iteration(const Inputs &in) {
+        constexpr long double mm = 1 * stepsPerMM;
+        auto speed = mm * maxSpeedMmPerSecond * in.speed / 100.0;
+        auto accel = mm * maxSpeedMmPerSecond * in.speed * in.speed /
+                     accelerationScaling;
+        if (std::abs(speed - lastSpeed) > 5 * deadZone) {
+            lastSpeed = speed;
+            acceleration = (int32_t)accel;
+        }
+        target =
+            -std::abs(((float)in.stroke / 100.0) * in.measuredStrokeSteps);
+        sessionDistanceMeters +=
+            (((float)in.stroke / 100.0) * in.measuredStrokeSteps / mm) /
+            1000.0;
+    }
+};
+
+struct After {
+    static constexpr float stepsPerSecondPerPercent =
+        maxSpeedMmPerSecond * stepsPerMM / 100.0f;
+    static constexpr float accelerationPerPercentSquared =
+        maxSpeedMmPerSecond * stepsPerMM / accelerationScaling;
+
+    float lastSpeed = 0;
+    uint64_t sessionDistanceSteps = 0;
+    int32_t target = 0;
+    int32_t acceleration = 0;
+
+    void iteration(const Inputs &in) {
+        float speed = stepsPerSecondPerPercent * in.speed;
+        float accel = accelerationPerPercentSquared * in.speed * in.speed;
+        if (fabsf(speed - lastSpeed) > 5 * deadZone) {
+            lastSpeed = speed;
+            acceleration = (int32_t)accel;
+        }
+        int32_t strokeSteps =
+            fabsf(in.stroke * 0.01f * in.measuredStrokeSteps);
+        target = -strokeSteps;
+        sessionDistanceSteps += strokeSteps;
+    }
+
+    float sessionDistanceMeters() const {
+        return sessionDistanceSteps / (1000 * stepsPerMM);
+    }
+};
+
+static uint32_t cycles() {
+#ifdef ARDUINO
+    return ESP.getCycleCount();
+#else
+    return 0;
+#endif
+}
+
+// Knob settings that change every iteration, so nothing folds away.
+static Inputs inputAt(int i) {
+    return {.speed = float(i % 100) + 0.5f,
+            .stroke = float((i * 7) % 100),
+            .measuredStrokeSteps = 3400.0f + float(i % 13)};
+}
+
+static volatile int32_t sink;
+
+template <class Loop>
+static void measure(const char *name, Loop &loop, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t startCycles = cycles();
+    for (int i = 0; i < iterations; i++) {
+        loop.iteration(inputAt(i));
+    }
+    uint32_t spent = cycles() - startCycles;
+    sink = loop.target + loop.acceleration;
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count() /
+                iterations;
+    if (spent != 0) {
+        printf("%s: %.1f cycles per iteration\n", name,
+               (double)spent / iterations);
+    } else {
+        printf("%s: %.1f ns per iteration\n", name, ns);
+    }
+}
+
+void test_SameMotion() {
+    Before before;
+    After after;
+    for (int i = 0; i < 10000; i++) {
+        Inputs in = inputAt(i);
+        before.iteration(in);
+        after.iteration(in);
+        TEST_ASSERT_INT32_WITHIN(1, before.target, after.target);
+        TEST_ASSERT_INT32_WITHIN(1, before.acceleration, after.acceleration);
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, (float)before.lastSpeed,
+                                 after.lastSpeed);
+    }
+}
+
+void test_SessionDistanceDoesNotDrift() {
+    // A day of 300 mm strokes at 200 strokes a minute.
+    Before before;
+    After after;
+    Inputs in = {.speed = 50, .stroke = 100, .measuredStrokeSteps = 6000};
+    for (long i = 0; i < 24L * 60 * 200 * 2; i++) {
+        before.iteration(in);
+        after.iteration(in);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, (float)before.sessionDistanceMeters,
+                             after.sessionDistanceMeters());
+    TEST_ASSERT_TRUE(after.sessionDistanceSteps ==
+                     24ULL * 60 * 200 * 2 * 6000);
+}
+
+void test_CyclesPerIteration() {
+    Before before;
+    After after;
+    measure("double", before, 20000);
+    measure("float", after, 20000);
+    TEST_ASSERT_INT32_WITHIN(1, before.acceleration, after.acceleration);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_SameMotion);
+    RUN_TEST(test_SessionDistanceDoesNotDrift);
+    RUN_TEST(test_CyclesPerIteration);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+    // Give the serial monitor time to attach.
+    delay(2000);
+    runUnityTests();
+}
+
+void loop() {}
+#else
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
+#endif
@@ -0,0 +1,201 @@
+#include <chrono>
+#include <cstdio>
+
+#include "unity.h"
+#include "utils/MachineProfile.h"
+#include "utils/MotionSupervisor.h"
+
+/**
+ * A simulated axis sampled at 1 kHz, like services/supervisor.h does.
+ * Faults are injected into the commanded motion, the supervisor must stop
+ * the axis on the first bad sample and never on a good one.
+ */
+struct SimulatedAxis {
+    MotionSupervisor supervisor;
+    double position = 0;
+    double speedHz = 0;
+    bool stopped = false;
+    MotionViolation violation = MotionViolation::None;
+    int stoppedAtMs = -1;
+
+    // Run a move profile for the given time, one supervisor sample per ms.
+    template <class Profile>
+    void run(int ms, Profile profile) {
+        for (int t = 0; t < ms && !stopped; t++) {
+            speedHz = profile(t);
+            position += speedHz / 1000.0;
+            MotionViolation v = supervisor.check(
+                (int32_t)position, (int32_t)(speedHz * 1000));
+            if (v != MotionViolation::None) {
+                // forceStop() and disableOutputs()
+                stopped = true;
+                violation = v;
+                stoppedAtMs = t;
+            }
+        }
+    }
+};
+
+// Simple penetration style envelope, 150 mm at 20 steps per mm.
+static const MotionEnvelope homed = {
+    .minSteps = -3000 - 60, .maxSteps = 60, .maxSpeedHz = 19800};
+
+// A triangle between 0 and -3000 steps at 12000 Hz.
+static double stroke(int t) { return (t / 250) % 2 == 0 ? -12000 : 12000; }
+
+void test_NormalStrokingNeverTrips() {
+    SimulatedAxis axis;
+    axis.supervisor.setEnvelope(homed);
+    axis.run(10000, stroke);
+    TEST_ASSERT_FALSE(axis.stopped);
+    TEST_ASSERT_EQUAL(0, axis.supervisor.violationCount());
+}
+
+void test_RunawayTargetTrips() {
+    SimulatedAxis axis;
+    axis.supervisor.setEnvelope(homed);
+    // A bad target keeps driving into the far end.
+    axis.run(1000, [](int) { return -12000.0; });
+    TEST_ASSERT_TRUE(axis.stopped);
+    TEST_ASSERT_EQUAL((int)MotionViolation::BelowEnvelope,
+                      (int)axis.violation);
+    // 3060 steps at 12 steps per ms, caught within a sample of crossing.
+    TEST_ASSERT_INT_WITHIN(1, 255, axis.stoppedAtMs);
+}
+
+void test_InvertedDirectionTrips() {
+    SimulatedAxis axis;
+    axis.supervisor.setEnvelope(homed);
+    // Direction pin mixed up: the first stroke heads for the home stop.
+    axis.run(1000, [](int t) { return -stroke(t); });
+    TEST_ASSERT_TRUE(axis.stopped);
+    TEST_ASSERT_EQUAL((int)MotionViolation::AboveEnvelope,
+                      (int)axis.violation);
+    TEST_ASSERT_LESS_THAN(10, axis.stoppedAtMs);
+}
+
+void test_OverSpeedTrips() {
+    SimulatedAxis axis;
+    axis.supervisor.setEnvelope(homed);
+    axis.position = -1500;
+    // Speed ramps past the limit while inside the envelope.
+    axis.run(1000, [](int t) { return t < 100 ? 0.0 : (t - 100) * 500.0; });
+    TEST_ASSERT_TRUE(axis.stopped);
+    TEST_ASSERT_EQUAL((int)MotionViolation::OverSpeed, (int)axis.violation);
+}
+
+void test_OverSpeedOfTheMachineTrips() {
+    // The reference build, 900 mm/s at 20 steps per mm. Stroking is
+    // supervised at its top speed and 10 % on top, see OSSM.StrokeEngine.cpp.
+    constexpr MachineKinematics kinematics(
+        {.motorStepPerRevolution = 800,
+         .pulleyToothCount = 20,
+         .beltPitchMm = 2,
+         .maxSpeedMmPerSecond = 900,
+         .maxAcceleration = 10000,
+         .sensorlessCurrentLimit = 1.5f});
+    const MotionEnvelope stroking =
+        envelopeFor(-120, 3000 - 120, kinematics.maxSpeedStepsPerSecond, 60,
+                    1.1f);
+    double limitHz = kinematics.maxSpeedStepsPerSecond * 1.1;
+
+    SimulatedAxis atLimit;
+    atLimit.supervisor.setEnvelope(stroking);
+    atLimit.position = 1500;
+    atLimit.run(100, [&](int t) { return t % 2 == 0 ? limitHz : -limitHz; });
+    TEST_ASSERT_FALSE(atLimit.stopped);
+
+    SimulatedAxis overLimit;
+    overLimit.supervisor.setEnvelope(stroking);
+    overLimit.position = 1500;
+    overLimit.run(100, [&](int t) {
+        return t % 2 == 0 ? limitHz + 50 : -limitHz - 50;
+    });
+    TEST_ASSERT_TRUE(overLimit.stopped);
+    TEST_ASSERT_EQUAL((int)MotionViolation::OverSpeed,
+                      (int)overLimit.violation);
+    TEST_ASSERT_EQUAL(0, overLimit.stoppedAtMs);
+}
+
+void test_ReportsOnceAndRearms() {
+    MotionSupervisor supervisor;
+    TEST_ASSERT_EQUAL((int)MotionViolation::None,
+                      (int)supervisor.check(1000000, 0));
+
+    supervisor.setEnvelope(homed);
+    TEST_ASSERT_EQUAL((int)MotionViolation::AboveEnvelope,
+                      (int)supervisor.check(1000, 0));
+    TEST_ASSERT_EQUAL((int)MotionViolation::None,
+                      (int)supervisor.check(1000, 0));
+    TEST_ASSERT_FALSE(supervisor.isArmed());
+
+    supervisor.setEnvelope({.minSteps = 0, .maxSteps = 2000, .maxSpeedHz = 1});
+    TEST_ASSERT_EQUAL((int)MotionViolation::None,
+                      (int)supervisor.check(1000, -1000));
+    TEST_ASSERT_EQUAL((int)MotionViolation::OverSpeed,
+                      (int)supervisor.check(1000, -1001));
+    TEST_ASSERT_EQUAL(2, supervisor.violationCount());
+}
+
+void test_ServoFaultsTrip() {
+    MotionSupervisor supervisor;
+    supervisor.setFollowingErrorLimit(200);
+    // Nothing is checked while no mode moves the motor.
+    TEST_ASSERT_EQUAL((int)MotionViolation::None,
+                      (int)supervisor.checkServo(5000, 12));
+
+    supervisor.setEnvelope(homed);
+    TEST_ASSERT_EQUAL((int)MotionViolation::None,
+                      (int)supervisor.checkServo(-200, 0));
+    TEST_ASSERT_EQUAL((int)MotionViolation::FollowingError,
+                      (int)supervisor.checkServo(-201, 0));
+    TEST_ASSERT_FALSE(supervisor.isArmed());
+
+    supervisor.setEnvelope(homed);
+    TEST_ASSERT_EQUAL((int)MotionViolation::ServoAlarm,
+                      (int)supervisor.checkServo(0, 12));
+
+    // Without a limit only alarms count.
+    supervisor.setFollowingErrorLimit(0);
+    supervisor.setEnvelope(homed);
+    TEST_ASSERT_EQUAL((int)MotionViolation::None,
+                      (int)supervisor.checkServo(INT32_MIN, 0));
+    TEST_ASSERT_EQUAL(2, supervisor.violationCount());
+}
+
+void test_CheckIsCheap() {
+    MotionSupervisor supervisor;
+    supervisor.setEnvelope(homed);
+    constexpr int samples = 1000000;
+    volatile int32_t position = -1500;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++) {
+        supervisor.check(position, 12000000);
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count() /
+                samples;
+    printf("supervisor check: %.1f ns\n", ns);
+    // 1 kHz leaves a full millisecond, stay far below that.
+    TEST_ASSERT_LESS_THAN(1000, (int)ns);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_NormalStrokingNeverTrips);
+    RUN_TEST(test_RunawayTargetTrips);
+    RUN_TEST(test_InvertedDirectionTrips);
+    RUN_TEST(test_OverSpeedTrips);
+    RUN_TEST(test_OverSpeedOfTheMachineTrips);
+    RUN_TEST(test_ReportsOnceAndRearms);
+    RUN_TEST(test_ServoFaultsTrip);
+    RUN_TEST(test_CheckIsCheap);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,77 @@
+#include <cstring>
+
+#include "MotionTable.h"
+#include "unity.h"
+
+/**
+ * The text form of motion tables, as the WiFi portal and patternlab read
+ * and write it.
+ */
+
+void test_ParsesKeyframes() {
+    MotionTable table;
+    TEST_ASSERT_TRUE(table.parse("# warm up\n100 1 40\n100 0.5\n\n0 1.5"));
+    TEST_ASSERT_EQUAL(3, table.count);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, table.keyframes[0].position);
+    TEST_ASSERT_EQUAL_FLOAT(0.4f, table.keyframes[0].ramp);
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, table.keyframes[1].time);
+    TEST_ASSERT_EQUAL_FLOAT(MotionTable::defaultRamp,
+                            table.keyframes[1].ramp);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, table.keyframes[2].position);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, table.totalTime());
+}
+
+void test_RejectsAndKeepsTable() {
+    MotionTable table;
+    TEST_ASSERT_TRUE(table.parse("100 1; 0 1"));
+    const char *invalid[] = {
+        "",                    // no keyframes
+        "100 1",               // a single one
+        "100 1; 0 0",          // no time
+        "101 1; 0 1",          // past the depth
+        "100 1 2; 0 1",        // ramp below minRamp
+        "100 1; 0 1 50 7",     // too many numbers
+        "100 1; zero 1",       // not a number
+    };
+    for (const char *text : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(table.parse(text), text);
+        TEST_ASSERT_EQUAL(2, table.count);
+    }
+
+    char text[512] = "";
+    for (size_t i = 0; i <= MotionTable::maxKeyframes; i++) {
+        strcat(text, i % 2 ? "0 1;" : "100 1;");
+    }
+    TEST_ASSERT_FALSE(table.parse(text));
+}
+
+void test_FormatReadsBack() {
+    MotionTable table;
+    TEST_ASSERT_TRUE(table.parse("100 1 40; 100 0.5; 33.5 1; 0 1.5 100"));
+    char text[MotionTable::formatLength + 1];
+    size_t length = table.format(text, sizeof(text));
+    TEST_ASSERT_EQUAL(strlen(text), length);
+    TEST_ASSERT_EQUAL_STRING("100 1 40; 100 0.5; 33.5 1; 0 1.5 100", text);
+
+    MotionTable copy;
+    TEST_ASSERT_TRUE(copy.parse(text));
+    TEST_ASSERT_EQUAL(table.count, copy.count);
+
+    // Cut short, but the length it needs is still told.
+    char small[8];
+    TEST_ASSERT_EQUAL(length, table.format(small, sizeof(small)));
+    TEST_ASSERT_EQUAL_STRING("100 1 4", small);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ParsesKeyframes);
+    RUN_TEST(test_RejectsAndKeepsTable);
+    RUN_TEST(test_FormatReadsBack);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,172 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "PatternMath.h"
+#include "unity.h"
+
+/**
+ * fscale() and mapSensationToFactor() against the double precision fscale()
+ * they replace, and the compile time tables against both.
+ */
+
+// The original, from https://playground.arduino.cc/Main/Fscale/
+static double referenceFscale(double originalMin, double originalMax,
+                              double newBegin, double newEnd,
+                              double inputValue, double curve) {
+    curve = std::max(-10.0, std::min(10.0, curve));
+    curve = pow(10, curve * -.1);
+    inputValue = std::max(originalMin, std::min(originalMax, inputValue));
+    double normalized =
+        (inputValue - originalMin) / (originalMax - originalMin);
+    if (newEnd > newBegin) {
+        return pow(normalized, curve) * (newEnd - newBegin) + newBegin;
+    }
+    return newBegin - pow(normalized, curve) * (newBegin - newEnd);
+}
+
+static double referenceFactor(double maximumFactor, double inputValue,
+                              double curve) {
+    if (inputValue == 0) {
+        return 1;
+    }
+    double value =
+        referenceFscale(0, 100, 1, maximumFactor, fabs(inputValue), curve);
+    return inputValue > 0 ? value : 1 / value;
+}
+
+// Largest error over the sensation range, relative to the output range.
+template <class Mapping>
+static double maxError(double newBegin, double newEnd, double curve,
+                       Mapping mapping) {
+    double worst = 0;
+    for (int i = 0; i <= 4000; i++) {
+        double input = i * 0.025;
+        double expected =
+            referenceFscale(0, 100, newBegin, newEnd, input, curve);
+        double error =
+            fabs(mapping(input) - expected) / fabs(newEnd - newBegin);
+        worst = std::max(worst, error);
+    }
+    return worst;
+}
+
+void test_FloatFscaleMatchesDouble() {
+    for (int curve = -10; curve <= 10; curve++) {
+        double error = maxError(1, 5, curve, [&](double input) {
+            return fscale(0, 100, 1, 5, input, curve);
+        });
+        TEST_ASSERT_LESS_THAN(1, (int)(error * 1e6));
+    }
+    // Inverted range
+    double error = maxError(1.0 / 3.0, 0.05, 2, [](double input) {
+        return fscale(0, 100, 1.0f / 3.0f, 0.05f, input, 2);
+    });
+    TEST_ASSERT_LESS_THAN(1, (int)(error * 1e6));
+}
+
+void test_FscaleClampsInput() {
+    TEST_ASSERT_EQUAL_FLOAT(1, fscale(0, 100, 1, 5, -20, 0));
+    TEST_ASSERT_EQUAL_FLOAT(5, fscale(0, 100, 1, 5, 120, 0));
+    TEST_ASSERT_EQUAL_FLOAT(0, fscale(100, 0, 1, 5, 50, 0));
+}
+
+void test_StraightTablesAreExact() {
+    constexpr auto speedup = makeFscaleTable(0.0f, 100.0f, 1.0f, 5.0f);
+    constexpr auto rampDown =
+        makeFscaleTable(0.0f, 100.0f, 1.0f / 3.0f, 0.05f);
+    TEST_ASSERT_LESS_THAN(1, (int)(maxError(1, 5, 0, speedup) * 1e6));
+    TEST_ASSERT_LESS_THAN(
+        1, (int)(maxError(1.0 / 3.0, 0.05, 0, rampDown) * 1e6));
+}
+
+/**
+ * Interpolating a curve is off most where it bends most. Negative curves
+ * bend towards originalMax and stay close with 32 segments. Positive curves
+ * start with an infinite slope at originalMin, which no table follows well;
+ * those are left to fscale().
+ */
+void test_CurvedTablesStayWithinBounds() {
+    constexpr auto gentle = makeFscaleTable(0.0f, 100.0f, 1.0f, 5.0f, -3.0f);
+    constexpr auto steepest =
+        makeFscaleTable(0.0f, 100.0f, 1.0f, 5.0f, -10.0f);
+    constexpr auto finer =
+        makeFscaleTable<128>(0.0f, 100.0f, 1.0f, 5.0f, -10.0f);
+    double gentleError = maxError(1, 5, -3, gentle);
+    double steepestError = maxError(1, 5, -10, steepest);
+    double finerError = maxError(1, 5, -10, finer);
+    printf("table error: curve -3 %.4f%%, -10 %.4f%%, -10 (128) %.4f%%\n",
+           gentleError * 100, steepestError * 100, finerError * 100);
+    // 0.05 %, 1 % and 0.1 % of the output range.
+    TEST_ASSERT_LESS_THAN(5, (int)(gentleError * 1e4));
+    TEST_ASSERT_LESS_THAN(100, (int)(steepestError * 1e4));
+    TEST_ASSERT_LESS_THAN(10, (int)(finerError * 1e4));
+}
+
+void test_SensationTableMatchesFactor() {
+    constexpr auto table = makeSensationTable(4.0f, -1.5f);
+    for (int i = -100; i <= 100; i++) {
+        double expected = referenceFactor(4, i, -1.5);
+        TEST_ASSERT_FLOAT_WITHIN(0.005f * expected, expected,
+                                 mapSensationToFactor(table, i));
+        TEST_ASSERT_FLOAT_WITHIN(1e-5f * expected, expected,
+                                 mapSensationToFactor(4, i, -1.5));
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1, mapSensationToFactor(table, 0));
+}
+
+static volatile float sink;
+
+template <class Mapping>
+static double nanosPerCall(Mapping mapping) {
+    constexpr int calls = 100000;
+    float sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+        sum += mapping(float(i % 2001) * 0.05f);
+    }
+    sink = sum;
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           calls;
+}
+
+void test_Speedup() {
+    constexpr auto straight = makeFscaleTable(0.0f, 100.0f, 1.0f, 5.0f);
+    constexpr auto curved = makeFscaleTable(0.0f, 100.0f, 1.0f, 5.0f, -3.0f);
+    double reference = nanosPerCall([](float input) {
+        return (float)referenceFscale(0, 100, 1, 5, input, 0);
+    });
+    double referenceCurved = nanosPerCall([](float input) {
+        return (float)referenceFscale(0, 100, 1, 5, input, -3);
+    });
+    double fast = nanosPerCall(
+        [](float input) { return fscale(0, 100, 1, 5, input, 0); });
+    double fastCurved = nanosPerCall(
+        [](float input) { return fscale(0, 100, 1, 5, input, -3); });
+    double table = nanosPerCall([&](float input) { return straight(input); });
+    double tableCurved =
+        nanosPerCall([&](float input) { return curved(input); });
+    printf("fscale ns      double   float   table\n");
+    printf("  curve 0  %9.1f %7.1f %7.1f\n", reference, fast, table);
+    printf("  curve -3 %9.1f %7.1f %7.1f\n", referenceCurved, fastCurved,
+           tableCurved);
+    TEST_ASSERT_TRUE(tableCurved < referenceCurved);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_FloatFscaleMatchesDouble);
+    RUN_TEST(test_FscaleClampsInput);
+    RUN_TEST(test_StraightTablesAreExact);
+    RUN_TEST(test_CurvedTablesStayWithinBounds);
+    RUN_TEST(test_SensationTableMatchesFactor);
+    RUN_TEST(test_Speedup);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
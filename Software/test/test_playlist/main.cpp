@@ -0,0 +1,105 @@
+#include <cmath>
+#include <cstring>
+
+#include "unity.h"
+#include "utils/Playlist.h"
+
+/**
+ * The text form of playlists, as the WiFi portal reads and writes it.
+ */
+
+void test_ParsesEntries() {
+    Playlist playlist;
+    TEST_ASSERT_TRUE(playlist.parse(
+        "# warm up\n1 20x speed=40\n\n0 30s depth=80 sensation=70; 5 10x"));
+    TEST_ASSERT_EQUAL(3, playlist.count);
+
+    const PlaylistEntry &first = playlist.entries[0];
+    TEST_ASSERT_EQUAL(1, first.pattern);
+    TEST_ASSERT_FALSE(first.isTimed);
+    TEST_ASSERT_EQUAL(20, first.length);
+    TEST_ASSERT_EQUAL_FLOAT(40, first.speed);
+    TEST_ASSERT_TRUE(std::isnan(first.depth));
+
+    const PlaylistEntry &second = playlist.entries[1];
+    TEST_ASSERT_TRUE(second.isTimed);
+    TEST_ASSERT_EQUAL(30, second.length);
+    TEST_ASSERT_EQUAL_FLOAT(80, second.depth);
+    TEST_ASSERT_EQUAL_FLOAT(70, second.sensation);
+    TEST_ASSERT_TRUE(std::isnan(second.speed));
+
+    // Around again after the last.
+    TEST_ASSERT_EQUAL(2, playlist.next(1));
+    TEST_ASSERT_EQUAL(0, playlist.next(2));
+}
+
+void test_RejectsAndKeepsPlaylist() {
+    Playlist playlist;
+    TEST_ASSERT_TRUE(playlist.parse("0 10x; 1 10x"));
+    const char *invalid[] = {
+        "",                  // no entries
+        "0 10",              // no unit
+        "0 10m",             // not strokes or seconds
+        "0 0x",              // no length
+        "9 10x",             // a playlist
+        "0 10x speed=0",     // would not move
+        "0 10x depth=101",   // past the knob
+        "0 10x tempo=50",    // no such setting
+        "0 10x speed=50%",   // not a number
+        "0 10x speed",       // no value
+    };
+    for (const char *text : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(playlist.parse(text), text);
+        TEST_ASSERT_EQUAL(2, playlist.count);
+    }
+
+    char text[512] = "";
+    for (size_t i = 0; i <= Playlist::maxEntries; i++) {
+        strcat(text, "0 1x;");
+    }
+    TEST_ASSERT_FALSE(playlist.parse(text));
+}
+
+void test_FormatReadsBack() {
+    Playlist playlist;
+    TEST_ASSERT_TRUE(playlist.parse(
+        "1 20x speed=40; 0 30s stroke=12.5 depth=80 sensation=70; 5 10x"));
+    char text[Playlist::formatLength + 1];
+    size_t length = playlist.format(text, sizeof(text));
+    TEST_ASSERT_EQUAL(strlen(text), length);
+    TEST_ASSERT_EQUAL_STRING(
+        "1 20x speed=40; 0 30s stroke=12.5 depth=80 sensation=70; 5 10x",
+        text);
+
+    Playlist copy;
+    TEST_ASSERT_TRUE(copy.parse(text));
+    TEST_ASSERT_EQUAL(0, memcmp(&copy, &playlist, sizeof(copy)));
+
+    // The longest there is still fits.
+    Playlist longest;
+    char full[Playlist::formatLength + 1] = "";
+    for (size_t i = 0; i < Playlist::maxEntries; i++) {
+        strcat(full, "8 65535x speed=100 stroke=100 depth=100 sensation=100;");
+    }
+    TEST_ASSERT_TRUE(longest.parse(full));
+    TEST_ASSERT_TRUE(longest.format(text, sizeof(text)) <=
+                     Playlist::formatLength);
+
+    // Cut short, but the length it needs is still told.
+    char shortText[8];
+    TEST_ASSERT_EQUAL(length, playlist.format(shortText, sizeof(shortText)));
+    TEST_ASSERT_EQUAL_STRING("1 20x s", shortText);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ParsesEntries);
+    RUN_TEST(test_RejectsAndKeepsPlaylist);
+    RUN_TEST(test_FormatReadsBack);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
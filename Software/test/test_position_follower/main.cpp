@@ -0,0 +1,117 @@
+#include "PositionFollower.h"
+#include "unity.h"
+
+/**
+ * The follower of StrokeEngine's streaming mode, without a motor.
+ * tools/followtrace measures how it tracks on the simulated stepper.
+ */
+
+namespace {
+    PositionFollower::Settings settings() {
+        PositionFollower::Settings s;
+        s.staleMicros = 50000;
+        s.extrapolateMicros = 20000;
+        s.leadMicros = 10000;
+        s.gain = 20;
+        s.smoothing = 1;
+        return s;
+    }
+
+    PositionFollower follower() {
+        PositionFollower f(settings());
+        f.setLimits(0, 10000, 20000, 100000);
+        f.reset(500);
+        return f;
+    }
+}
+
+void test_HoldsUntilTheFirstTarget() {
+    PositionFollower f = follower();
+    PositionFollower::Command command = f.update(1000000, 500);
+    TEST_ASSERT_EQUAL(500, command.position);
+    TEST_ASSERT_TRUE(command.isHolding);
+    TEST_ASSERT_EQUAL_UINT32(100000, command.acceleration);
+}
+
+void test_LatestTargetWins() {
+    PositionFollower f = follower();
+    // A burst that arrived late, only the last one counts.
+    f.setTarget(3000, 1000000);
+    f.setTarget(4000, 1000000);
+    f.setTarget(2000, 1000000);
+    PositionFollower::Command command = f.update(1000000, 500);
+    TEST_ASSERT_EQUAL(2000, command.position);
+    TEST_ASSERT_FALSE(command.isHolding);
+    // Far off, as fast as allowed.
+    TEST_ASSERT_EQUAL_UINT32(20000, command.speed);
+}
+
+void test_FeedsTheVelocityForward() {
+    PositionFollower f = follower();
+    // 1000 steps/s, a target every 10 ms.
+    uint64_t now = 1000000;
+    for (int i = 0; i < 10; i++, now += 10000) {
+        f.setTarget(1000 + 10 * i, now);
+    }
+    now -= 10000;
+    TEST_ASSERT_FLOAT_WITHIN(1, 1000, f.targetVelocity());
+
+    // On target, it moves at the target's speed, aimed where the target
+    // will be once the command takes effect.
+    PositionFollower::Command command = f.update(now + 5000, 1090);
+    TEST_ASSERT_EQUAL(1090 + 15, command.position);
+    TEST_ASSERT_INT_WITHIN(2, 1000 + 20 * 15, (int)command.speed);
+
+    // A late target is carried forward for a while, not forever.
+    command = f.update(now + 40000, 1110);
+    TEST_ASSERT_EQUAL(1090 + 30, command.position);
+}
+
+void test_StaleTargetHolds() {
+    PositionFollower f = follower();
+    uint64_t now = 1000000;
+    for (int i = 0; i < 10; i++, now += 10000) {
+        f.setTarget(1000 + 50 * i, now);
+    }
+    now -= 10000;
+    PositionFollower::Command command = f.update(now + 50001, 1500);
+    TEST_ASSERT_TRUE(command.isHolding);
+    TEST_ASSERT_EQUAL(1450, command.position);
+    // No feed forward, only what closes the distance.
+    TEST_ASSERT_EQUAL_UINT32(20 * 50, command.speed);
+
+    // A stream that starts again starts without a velocity.
+    f.setTarget(1500, now + 200000);
+    TEST_ASSERT_EQUAL_FLOAT(0, f.targetVelocity());
+}
+
+void test_StaysInsideTheLimits() {
+    PositionFollower f = follower();
+    f.setTarget(-300, 1000000);
+    PositionFollower::Command command = f.update(1000000, 500);
+    TEST_ASSERT_EQUAL(0, command.position);
+    f.setTarget(20000, 1010000);
+    command = f.update(1010000, 500);
+    TEST_ASSERT_EQUAL(10000, command.position);
+    TEST_ASSERT_EQUAL_UINT32(20000, command.speed);
+
+    // Close enough that nothing is left to close, but never a speed of 0.
+    f.setTarget(10000, 1100000);
+    command = f.update(1100000, 10000);
+    TEST_ASSERT_EQUAL_UINT32(1, command.speed);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_HoldsUntilTheFirstTarget);
+    RUN_TEST(test_LatestTargetWins);
+    RUN_TEST(test_FeedsTheVelocityForward);
+    RUN_TEST(test_StaleTargetHolds);
+    RUN_TEST(test_StaysInsideTheLimits);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
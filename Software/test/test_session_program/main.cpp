@@ -0,0 +1,228 @@
+#include <cmath>
+#include <cstring>
+
+#include "unity.h"
+#include "utils/SessionProgram.h"
+
+/**
+ * Session programs: the blob, its text form and playing it into the
+ * settings.
+ */
+
+static uint8_t blob[SessionProgram::maxSize];
+static size_t blobSize = 0;
+
+static bool parse(const char *text) {
+    return SessionProgram::parse(text, blob, blobSize);
+}
+
+static SessionProgram parsed() { return {blob, blobSize}; }
+
+static SettingPercents knobs(float speed) {
+    return {speed, 50, 50, 50, StrokePatterns::Program3, speed};
+}
+
+void test_BlobLayout() {
+    const uint8_t expected[] = {
+        SessionProgram::version, 2, SessionProgram::loopFlag, 0, 2, 0, 0, 1,
+        PROGRAM_KEYFRAME(0, 10, Linear),
+        PROGRAM_KEYFRAME(300, 60, Ease),
+        PROGRAM_KEYFRAME(20, 70, Step),
+    };
+    TEST_ASSERT_TRUE(parse("pattern 2\nloop # again\nspeed 0 10, 300 60 ease\n"
+                           "sensation 20 70 step"));
+    SessionProgram program = parsed();
+    TEST_ASSERT_EQUAL(sizeof(expected), program.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, program.blob(), sizeof(expected));
+    TEST_ASSERT_EQUAL(StrokePatterns::RoboStroke, program.pattern());
+    TEST_ASSERT_TRUE(program.isLooping());
+    TEST_ASSERT_EQUAL(300, program.duration());
+    TEST_ASSERT_EQUAL(300, program.keyframe(0, 1).seconds);
+    TEST_ASSERT_EQUAL(70, program.keyframe(3, 0).value);
+}
+
+void test_RejectsAndKeepsBlob() {
+    TEST_ASSERT_TRUE(parse("speed 0 10"));
+    const char *invalid[] = {
+        "",                            // no keyframes
+        "pattern 0",                   // still none
+        "speed 0 0",                   // would not move
+        "depth 0 101",                 // past the knob
+        "depth 10 50, 10 60",          // not later
+        "depth 0 50, 20 60 smooth",    // no such curve
+        "depth 0 50 ease extra",       // one too many
+        "depth 0",                     // no value
+        "tempo 0 50",                  // no such track
+        "depth 0 50; depth 10 60",     // twice
+        "pattern 12; depth 0 50",      // a program
+        "loop 2; depth 0 50",          // loops take no number
+    };
+    for (const char *text : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(parse(text), text);
+        TEST_ASSERT_EQUAL(SessionProgram::headerSize + 4, blobSize);
+    }
+
+    char text[1024] = "depth 0 50";
+    for (size_t i = 1; i <= SessionProgram::maxKeyframes; i++) {
+        sprintf(text + strlen(text), ", %u 50", (unsigned)i);
+    }
+    TEST_ASSERT_FALSE(parse(text));
+
+    // A blob from elsewhere is checked too.
+    uint8_t truncated[SessionProgram::maxSize];
+    memcpy(truncated, blob, blobSize);
+    TEST_ASSERT_FALSE(SessionProgram(truncated, blobSize - 1).isValid());
+    truncated[0] = SessionProgram::version + 1;
+    TEST_ASSERT_FALSE(SessionProgram(truncated, blobSize).isValid());
+}
+
+void test_FormatReadsBack() {
+    const char *text =
+        "pattern 9; loop; speed 0 10, 300 60 ease; stroke 5 40; "
+        "sensation 20 70, 40 20 step";
+    TEST_ASSERT_TRUE(parse(text));
+    SessionProgram program = parsed();
+    char formatted[SessionProgram::formatLength + 1];
+    size_t length = program.format(formatted, sizeof(formatted));
+    TEST_ASSERT_EQUAL(strlen(formatted), length);
+    TEST_ASSERT_EQUAL_STRING(text, formatted);
+
+    // The longest there is still fits.
+    char full[2048] = "pattern 11; loop";
+    for (const char *track : SessionProgram::trackNames) {
+        sprintf(full + strlen(full), "; %s ", track);
+        for (size_t i = 0; i < SessionProgram::maxKeyframes; i++) {
+            sprintf(full + strlen(full), "%s%u 100 ease", i == 0 ? "" : ", ",
+                    (unsigned)(65535 - SessionProgram::maxKeyframes + i));
+        }
+    }
+    TEST_ASSERT_TRUE(parse(full));
+    SessionProgram longest = parsed();
+    TEST_ASSERT_EQUAL(SessionProgram::maxSize, longest.size());
+    TEST_ASSERT_TRUE(longest.format(formatted, sizeof(formatted)) <=
+                     SessionProgram::formatLength);
+}
+
+void test_FollowsCurves() {
+    ProgramPlayer player;
+    TEST_ASSERT_TRUE(parse("speed 10 20, 20 60, 30 100 ease, 40 40 step"));
+    player.start(parsed());
+    SettingPercents setting = knobs(100);
+
+    // Held before the first keyframe.
+    player.apply(setting, 5000);
+    TEST_ASSERT_EQUAL_FLOAT(20, setting.speed);
+    // Linear halfway.
+    setting = knobs(100);
+    player.apply(setting, 10000);
+    TEST_ASSERT_EQUAL_FLOAT(40, setting.speed);
+    // Eased, slower at first.
+    setting = knobs(100);
+    player.apply(setting, 8000);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 60 + 40 * 0.216, player.value(0));
+    TEST_ASSERT_EQUAL_FLOAT(69, setting.speed);
+    setting = knobs(100);
+    player.apply(setting, 7000);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 100, setting.speed);
+    // A step holds until its time.
+    setting = knobs(100);
+    player.apply(setting, 9999);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 100, setting.speed);
+    setting = knobs(100);
+    player.apply(setting, 1);
+    TEST_ASSERT_EQUAL_FLOAT(40, setting.speed);
+    // And the last stays.
+    setting = knobs(100);
+    player.apply(setting, 600000);
+    TEST_ASSERT_EQUAL_FLOAT(40, setting.speed);
+    TEST_ASSERT_EQUAL(StrokePatterns::SimpleStroke, setting.pattern);
+}
+
+void test_IncrementalMatchesFresh() {
+    const char *text =
+        "loop; speed 0 10, 7 90 ease, 13 30, 20 80 step, 31 50; "
+        "depth 3 0, 11 100 ease, 25 40";
+    ProgramPlayer incremental;
+    TEST_ASSERT_TRUE(parse(text));
+    incremental.start(parsed());
+    for (uint32_t tick = 1; tick < 800; tick++) {
+        SettingPercents setting = knobs(100);
+        incremental.apply(setting, 97);
+
+        // Played from the start in one go to the same time.
+        ProgramPlayer fresh;
+        fresh.start({blob, blobSize});
+        SettingPercents expected = knobs(100);
+        fresh.apply(expected, incremental.millis());
+        TEST_ASSERT_FLOAT_WITHIN(0.001, expected.speed, setting.speed);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, expected.depth, setting.depth);
+    }
+    // Around a few times.
+    TEST_ASSERT_TRUE(incremental.millis() < 31000);
+}
+
+void test_SpeedKnobIsCeiling() {
+    ProgramPlayer player;
+    TEST_ASSERT_TRUE(parse("speed 0 80"));
+    player.start(parsed());
+    SettingPercents setting = knobs(30);
+    player.apply(setting, 1000);
+    TEST_ASSERT_EQUAL_FLOAT(30, setting.speed);
+    setting = knobs(0);
+    player.apply(setting, 1000);
+    TEST_ASSERT_EQUAL_FLOAT(0, setting.speed);
+    setting = knobs(100);
+    player.apply(setting, 1000);
+    TEST_ASSERT_EQUAL_FLOAT(80, setting.speed);
+}
+
+void test_KnobTakesOverAndIsPickedUp() {
+    ProgramPlayer player;
+    TEST_ASSERT_TRUE(parse("depth 0 20, 100 100"));
+    player.start(parsed());
+    SettingPercents setting = knobs(50);
+    player.apply(setting, 0);
+    TEST_ASSERT_EQUAL_FLOAT(20, setting.depth);
+
+    // Turned to 70, it stays there while the program goes on.
+    setting = knobs(50);
+    setting.depth = 70;
+    player.apply(setting, 10000);
+    TEST_ASSERT_TRUE(player.isOverridden(2));
+    TEST_ASSERT_EQUAL_FLOAT(70, setting.depth);
+    for (int i = 0; i < 30; i++) {
+        setting = knobs(50);
+        setting.depth = 70;
+        player.apply(setting, 1000);
+        TEST_ASSERT_EQUAL_FLOAT(70, setting.depth);
+    }
+
+    // The curve comes within pickupPercent of the knob at 60 s, and goes
+    // on from there.
+    for (int i = 0; i < 30; i++) {
+        setting = knobs(50);
+        setting.depth = 70;
+        player.apply(setting, 1000);
+        TEST_ASSERT_EQUAL(i < 19, player.isOverridden(2));
+    }
+    TEST_ASSERT_EQUAL_FLOAT(76, setting.depth);
+    // Other tracks were never driven.
+    TEST_ASSERT_EQUAL_FLOAT(50, setting.stroke);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_BlobLayout);
+    RUN_TEST(test_RejectsAndKeepsBlob);
+    RUN_TEST(test_FormatReadsBack);
+    RUN_TEST(test_FollowsCurves);
+    RUN_TEST(test_IncrementalMatchesFresh);
+    RUN_TEST(test_SpeedKnobIsCeiling);
+    RUN_TEST(test_KnobTakesOverAndIsPickedUp);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
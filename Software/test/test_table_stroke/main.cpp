@@ -0,0 +1,117 @@
+#include <ArduinoFake.h>
+
+#include "pattern.h"
+#include "unity.h"
+
+using namespace fakeit;
+
+/**
+ * TableStroke playing a motion table: the first move starts from where the
+ * carriage was headed as it took over, and a hold is waited out without a
+ * move.
+ */
+
+namespace {
+    constexpr int depth = 8000;
+    constexpr int stroke = 5000;
+
+    void preparePattern(TableStroke &pattern) {
+        pattern.setSpeedLimit(40000, 200000, 50);
+        pattern.setTimeOfStroke(1.0f);
+        pattern.setStroke(stroke);
+        pattern.setDepth(depth);
+        pattern.setSensation(0);
+    }
+
+    void setMillis(unsigned long now) {
+        When(Method(ArduinoFake(), millis)).AlwaysReturn(now);
+    }
+
+    MotionTable tableOf(const char *text) {
+        MotionTable table;
+        TEST_ASSERT_TRUE(table.parse(text));
+        return table;
+    }
+}
+
+void setUp(void) {
+    ArduinoFakeReset();
+    setMillis(0);
+}
+
+void test_StartsWhereItTakesOver() {
+    // In to the depth in half the stroke, out to 0 in the other half.
+    MotionTable table = tableOf("100 1; 0 1");
+    TableStroke fromHome("Custom", table);
+    preparePattern(fromHome);
+    TableStroke midDepth("Custom", table);
+    preparePattern(midDepth);
+    midDepth.setCurrentPosition(depth - stroke / 2);
+
+    motionParameter full = fromHome.nextTarget(0);
+    motionParameter half = midDepth.nextTarget(0);
+    TEST_ASSERT_FALSE(half.skip);
+    TEST_ASSERT_EQUAL(depth, half.stroke);
+    // Half the way in the same time.
+    TEST_ASSERT_INT_WITHIN(1, full.speed * (stroke / 2) / depth, half.speed);
+    TEST_ASSERT_INT_WITHIN(1, full.acceleration * (stroke / 2) / depth,
+                           half.acceleration);
+
+    // From there on the keyframes follow each other.
+    motionParameter out = midDepth.nextTarget(1);
+    TEST_ASSERT_EQUAL(depth - stroke, out.stroke);
+    TEST_ASSERT_INT_WITHIN(1, full.speed * stroke / depth, out.speed);
+}
+
+void test_HoldIsWaitedOutWithoutAMove() {
+    // In, hold for a third of the stroke, out.
+    TableStroke pattern("Custom", tableOf("100 1; 100 1; 0 1"));
+    preparePattern(pattern);
+
+    TEST_ASSERT_EQUAL(depth, pattern.nextTarget(0).stroke);
+    TEST_ASSERT_TRUE(pattern.nextTarget(1).skip);
+    setMillis(200);
+    TEST_ASSERT_TRUE(pattern.nextTarget(1).skip);
+
+    // Asking for the running move again does not end the hold.
+    TEST_ASSERT_EQUAL(depth, pattern.nextTarget(0).stroke);
+
+    // Once over, the hold still does not move, the next keyframe does.
+    setMillis(400);
+    TEST_ASSERT_TRUE(pattern.nextTarget(1).skip);
+    motionParameter out = pattern.nextTarget(1);
+    TEST_ASSERT_FALSE(out.skip);
+    TEST_ASSERT_EQUAL(depth - stroke, out.stroke);
+    TEST_ASSERT_GREATER_THAN(0, out.speed);
+    TEST_ASSERT_GREATER_THAN(0, out.acceleration);
+
+    // And around again.
+    TEST_ASSERT_EQUAL(depth, pattern.nextTarget(2).stroke);
+}
+
+void test_HoldsWhereItTakesOver() {
+    // Swapped in at the depth, the first keyframe is already reached.
+    TableStroke pattern("Custom", tableOf("100 1; 0 1"));
+    preparePattern(pattern);
+    pattern.setCurrentPosition(depth);
+
+    TEST_ASSERT_TRUE(pattern.nextTarget(0).skip);
+    setMillis(600);
+    TEST_ASSERT_TRUE(pattern.nextTarget(0).skip);
+    motionParameter out = pattern.nextTarget(0);
+    TEST_ASSERT_FALSE(out.skip);
+    TEST_ASSERT_EQUAL(depth - stroke, out.stroke);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_StartsWhereItTakesOver);
+    RUN_TEST(test_HoldIsWaitedOutWithoutAMove);
+    RUN_TEST(test_HoldsWhereItTakesOver);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,154 @@
+#include <random>
+#include <vector>
+
+#include "unity.h"
+#include "utils/Telemetry.h"
+
+/**
+ * Samples through the ring and the block format and back, as the firmware
+ * writes them and tools/telemetry reads them.
+ */
+
+namespace {
+    // A motor that strokes, with now and then a jump no real motor makes.
+    std::vector<Telemetry::Sample> samples(size_t count, uint32_t seed) {
+        std::mt19937 random(seed);
+        std::vector<Telemetry::Sample> result;
+        Telemetry::Sample sample = {5000000, 0, 2000, 0, 0};
+        for (size_t i = 0; i < count; i++) {
+            sample.timeMicros += 990 + random() % 20;
+            sample.speedHz += int32_t(random() % 401) - 200;
+            sample.position += sample.speedHz / 1000;
+            sample.flags = random() % 4 == 0 ? Telemetry::Moving : 0;
+            sample.followingError += int32_t(random() % 5) - 2;
+            sample.load = int16_t(sample.load + int16_t(random() % 21) - 10);
+            if (random() % 500 == 0) {
+                sample.position = int32_t(random());
+                sample.target = -int32_t(random());
+                sample.timeMicros += uint64_t(random()) << 20;
+                sample.followingError = int32_t(random());
+                sample.load = int16_t(random());
+            }
+            result.push_back(sample);
+        }
+        return result;
+    }
+
+    void assertSame(const Telemetry::Sample &expected,
+                    const Telemetry::Sample &actual) {
+        TEST_ASSERT_TRUE(expected.timeMicros == actual.timeMicros);
+        TEST_ASSERT_EQUAL(expected.position, actual.position);
+        TEST_ASSERT_EQUAL(expected.target, actual.target);
+        TEST_ASSERT_EQUAL(expected.speedHz, actual.speedHz);
+        TEST_ASSERT_EQUAL(expected.flags, actual.flags);
+        TEST_ASSERT_EQUAL(expected.followingError, actual.followingError);
+        TEST_ASSERT_EQUAL(expected.load, actual.load);
+    }
+}
+
+void test_ZigzagKeepsSmallNumbersSmall() {
+    TEST_ASSERT_EQUAL_UINT32(0, Telemetry::zigzag(0));
+    TEST_ASSERT_EQUAL_UINT32(1, Telemetry::zigzag(-1));
+    TEST_ASSERT_EQUAL_UINT32(2, Telemetry::zigzag(1));
+    for (int32_t value : {0, 1, -1, 63, -64, INT32_MAX, INT32_MIN}) {
+        TEST_ASSERT_EQUAL(value,
+                          Telemetry::unzigzag(Telemetry::zigzag(value)));
+    }
+}
+
+void test_RingRoundTrip() {
+    static TelemetryRing<4> ring;
+    std::vector<Telemetry::Sample> recorded = samples(20000, 1);
+
+    // Not recording until there is someone to send to.
+    ring.record(recorded[0]);
+    TEST_ASSERT_TRUE(ring.front() == nullptr);
+
+    ring.start();
+    std::vector<Telemetry::Sample> read;
+    uint32_t sequence = 0;
+    for (const Telemetry::Sample &sample : recorded) {
+        ring.record(sample);
+        while (const Telemetry::Block *block = ring.front()) {
+            TEST_ASSERT_TRUE(Telemetry::isIntact(*block));
+            TEST_ASSERT_EQUAL_UINT32(sequence++, block->header.sequence);
+            Telemetry::BlockReader reader(*block);
+            Telemetry::Sample sample;
+            while (reader.next(sample)) {
+                read.push_back(sample);
+            }
+            ring.pop();
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, ring.dropped());
+    // All but the block still filling.
+    TEST_ASSERT_TRUE(read.size() > recorded.size() - 100);
+    for (size_t i = 0; i < read.size(); i++) {
+        assertSame(recorded[i], read[i]);
+    }
+    TEST_ASSERT_TRUE(double(read.size()) / sequence > 50);
+}
+
+void test_FullRingDropsBlocks() {
+    static TelemetryRing<4> ring;
+    ring.start();
+    for (const Telemetry::Sample &sample : samples(2000, 2)) {
+        ring.record(sample);
+    }
+    TEST_ASSERT_TRUE(ring.dropped() > 0);
+
+    // The oldest blocks are kept, the ones after them dropped.
+    uint32_t sequence = 0;
+    while (const Telemetry::Block *block = ring.front()) {
+        TEST_ASSERT_EQUAL_UINT32(sequence++, block->header.sequence);
+        ring.pop();
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, sequence);
+
+    // A new client starts afresh.
+    ring.stop();
+    ring.record(samples(1, 3)[0]);
+    ring.start();
+    TEST_ASSERT_TRUE(ring.front() == nullptr);
+}
+
+void test_DamageIsDetected() {
+    Telemetry::Block block;
+    Telemetry::BlockWriter writer;
+    std::vector<Telemetry::Sample> recorded = samples(40, 4);
+    writer.begin(block, 7, recorded[0]);
+    for (size_t i = 1; i < recorded.size(); i++) {
+        TEST_ASSERT_TRUE(writer.append(recorded[i]));
+    }
+    writer.seal();
+    TEST_ASSERT_TRUE(Telemetry::isIntact(block));
+
+    Telemetry::Block torn = block;
+    torn.deltas[torn.header.length / 2] ^= 0x10;
+    TEST_ASSERT_FALSE(Telemetry::isIntact(torn));
+
+    // Cut short, a reader stops early instead of reading past the end.
+    torn = block;
+    torn.header.length /= 2;
+    Telemetry::BlockReader reader(torn);
+    Telemetry::Sample sample;
+    size_t count = 0;
+    while (reader.next(sample)) {
+        assertSame(recorded[count++], sample);
+    }
+    TEST_ASSERT_TRUE(count > 1 && count < recorded.size());
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ZigzagKeepsSmallNumbersSmall);
+    RUN_TEST(test_RingRoundTrip);
+    RUN_TEST(test_FullRingDropsBlocks);
+    RUN_TEST(test_DamageIsDetected);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
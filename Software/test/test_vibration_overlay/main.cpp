@@ -0,0 +1,179 @@
+#include <math.h>
+
+#include <vector>
+
+#include "VibrationOverlay.h"
+#include "unity.h"
+
+/**
+ * The segments StrokeEngine feeds to the stepper's queue while a vibration
+ * lies over a pattern. tools/vibrationtrace plays them on the simulated
+ * stepper.
+ */
+
+namespace {
+    // The reference build, 20 steps/mm, 900 mm/s and 10000 mm/s^2.
+    constexpr int32_t maxPosition = 3760;
+    constexpr uint32_t maxSpeed = 18000;
+    constexpr uint32_t maxAcceleration = 200000;
+    constexpr float dt = VibrationOverlay::segmentMicros * 1e-6f;
+
+    VibrationOverlay overlay(int32_t position) {
+        VibrationOverlay o;
+        o.setLimits(0, maxPosition, maxSpeed, maxAcceleration);
+        o.reset(position);
+        return o;
+    }
+
+    // Where the carriage is after each segment.
+    std::vector<int32_t> play(VibrationOverlay &o, int32_t from,
+                              int segments) {
+        std::vector<int32_t> positions;
+        int32_t position = from;
+        for (int i = 0; i < segments; i++) {
+            position += o.next().steps;
+            positions.push_back(position);
+        }
+        return positions;
+    }
+
+    // Over 10 ms, long enough that a step more or less hardly counts.
+    float peakAcceleration(const std::vector<int32_t> &positions) {
+        constexpr int h = 5;
+        float peak = 0;
+        for (size_t i = h; i + h < positions.size(); i++) {
+            float a = float(positions[i + h] - 2 * positions[i] +
+                            positions[i - h]) /
+                      (h * dt * h * dt);
+            peak = fmaxf(peak, fabsf(a));
+        }
+        return peak;
+    }
+
+    // Rounding to steps is off by up to 2 steps over 10 ms, 20000 steps/s^2.
+    constexpr float quantum = 2 / (25 * dt * dt);
+}
+
+void test_WithoutVibrationPlaysTheMove() {
+    VibrationOverlay o = overlay(0);
+    o.moveTo(2000, 10000, 100000);
+    int32_t position = 0;
+    int segments = 0;
+    while (o.isMoving()) {
+        VibrationOverlay::Segment segment = o.next();
+        TEST_ASSERT_TRUE(abs(segment.steps) <= 10000 * dt + 1);
+        position += segment.steps;
+        segments++;
+    }
+    TEST_ASSERT_EQUAL(2000, position);
+    TEST_ASSERT_TRUE(o.isIdle());
+    // 0.1 s at either end at 100000 steps/s^2, 0.1 s in between.
+    TEST_ASSERT_INT_WITHIN(3, 150, segments);
+}
+
+void test_AmplitudeFitsTheMachine() {
+    VibrationOverlay slow = overlay(1800);
+    slow.setVibration(5, 60);
+    // Five periods to fade in, from the segment after it was asked for.
+    play(slow, 1800, 501);
+    TEST_ASSERT_EQUAL_FLOAT(60, slow.amplitude());
+
+    // 3 mm at 30 Hz would take 10 times the acceleration the motor has.
+    VibrationOverlay fast = overlay(1800);
+    fast.setVibration(30, 60);
+    std::vector<int32_t> positions = play(fast, 1800, 500);
+    float omega = 2 * M_PI * 30;
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.5f * maxAcceleration / (omega * omega),
+                             fast.amplitude());
+    TEST_ASSERT_TRUE(peakAcceleration(positions) <=
+                     0.5f * maxAcceleration + quantum);
+
+    // The moves get what is left.
+    TEST_ASSERT_TRUE(fast.accelerationLimit() < 0.5f * maxAcceleration);
+    TEST_ASSERT_TRUE(fast.speedLimit() > maxSpeed - 0.5f * maxSpeed);
+}
+
+void test_FadesInAndOut() {
+    VibrationOverlay o = overlay(1800);
+    o.setVibration(10, 20);
+    std::vector<int32_t> positions = play(o, 1800, 10);
+    // No jump at the start.
+    TEST_ASSERT_INT_WITHIN(1, 1800, positions[0]);
+    TEST_ASSERT_TRUE(o.amplitude() < 2);
+
+    // Five periods later it is all there.
+    play(o, positions.back(), 241);
+    TEST_ASSERT_EQUAL_FLOAT(20, o.amplitude());
+
+    // And as long to go.
+    o.setVibration(10, 0);
+    play(o, 0, 240);
+    TEST_ASSERT_TRUE(o.amplitude() > 0);
+    play(o, 0, 10);
+    TEST_ASSERT_EQUAL_FLOAT(0, o.amplitude());
+    TEST_ASSERT_TRUE(o.isIdle());
+}
+
+void test_StaysInsideTheLimits() {
+    VibrationOverlay o = overlay(0);
+    o.setVibration(10, 40);
+    std::vector<int32_t> positions;
+    int32_t position = 0;
+    // End to end as fast as allowed, retargeted halfway now and then.
+    for (int move = 0; move < 12; move++) {
+        o.moveTo(move % 2 == 0 ? maxPosition : 0, maxSpeed, maxAcceleration);
+        for (int i = 0; o.isMoving() || i < 25; i++) {
+            if (move % 3 == 2 && i == 30) {
+                o.moveTo(maxPosition / 2, maxSpeed, maxAcceleration);
+            }
+            VibrationOverlay::Segment segment = o.next();
+            TEST_ASSERT_TRUE(abs(segment.steps) <= maxSpeed * dt);
+            position += segment.steps;
+            positions.push_back(position);
+            TEST_ASSERT_TRUE(position >= 0 && position <= maxPosition);
+        }
+    }
+    TEST_ASSERT_TRUE(o.amplitude() > 20);
+    TEST_ASSERT_TRUE(peakAcceleration(positions) <= maxAcceleration + quantum);
+}
+
+void test_StopComesToRest() {
+    VibrationOverlay o = overlay(100);
+    o.setVibration(10, 20);
+    o.moveTo(3000, maxSpeed, maxAcceleration);
+    int32_t position = 100;
+    // Speeding up for 0.1 s, with what the vibration leaves.
+    for (int i = 0; i < 50; i++) {
+        position += o.next().steps;
+    }
+    TEST_ASSERT_TRUE(o.isMoving());
+
+    o.stop();
+    int segments = 0;
+    while (!o.isIdle()) {
+        position += o.next().steps;
+        segments++;
+        TEST_ASSERT_TRUE(segments < 1000);
+    }
+    // The fade out takes longest, five periods.
+    TEST_ASSERT_INT_WITHIN(2, 250, segments);
+    // It takes as long and as far to brake as it took to speed up.
+    float accelerate = 0.5f * o.accelerationLimit() * 0.1f * 0.1f;
+    TEST_ASSERT_INT_WITHIN(5, 100 + 2 * accelerate, position);
+    TEST_ASSERT_FALSE(o.isMoving());
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_WithoutVibrationPlaysTheMove);
+    RUN_TEST(test_AmplitudeFitsTheMachine);
+    RUN_TEST(test_FadesInAndOut);
+    RUN_TEST(test_StaysInsideTheLimits);
+    RUN_TEST(test_StopComesToRest);
+    return UNITY_END();
+}
+
+/**
+ * For native dev-platform or for some embedded frameworks
+ */
+int main(void) { return runUnityTests(); }
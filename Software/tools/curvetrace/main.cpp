@@ -0,0 +1,451 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CurveSegmenter.h"
+#include "FastAccelStepper.h"
+#include "StrokeEngine.h"
+#include "pattern.h"
+#include "sil/Rail.h"
+#include "sil/VirtualTime.h"
+#include "utils/StrokeEngineHelper.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Curve Trace
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Curve patterns, sampled into the stepper's command queue, on the
+ * simulated stepper of the software-in-the-loop build.
+ *
+ * Each case strokes with a curve pattern and samples the carriage every
+ * 100 us. The curve starts with the first entry queued, from then on the
+ * carriage is compared to where the pattern's curve has it. For each case
+ * it reports
+ *  error      the largest and the RMS distance from the curve
+ *  speed      the top speed, over 10 ms
+ *  accel      the top acceleration, over 10 ms
+ *  min, max   where the carriage went
+ *  underruns  how often the queue ran dry while stroking
+ * and fails when a case leaves the limits, the queue runs dry, or a curve
+ * the limits allow is missed by more than maxErrorMm. Last it times the
+ * segment generator on this computer, and counts the segments and queue
+ * entries it makes of a second of each case.
+ *
+ *  pio run -e curvetrace
+ *  .pio/build/curvetrace/program
+ *  .pio/build/curvetrace/program dump bezier > bezier.csv
+ */
+
+namespace {
+    constexpr uint32_t sampleMicros = 100;
+    constexpr double caseSeconds = 4;
+    constexpr size_t samplesPerCase = caseSeconds * 1e6 / sampleMicros;
+    // Speed and acceleration over 10 ms, where a step more or less
+    // rounding hardly counts.
+    constexpr size_t window = 10000 / sampleMicros;
+    // How far the carriage may be off a curve the limits allow. The
+    // segmenter's tolerance, and half a step of rounding on either side.
+    constexpr double maxErrorMm = 0.25;
+
+    // The rail StrokeEngine gets from homing, as in OSSM.StrokeEngine.cpp.
+    constexpr float travelMm = 200;
+    constexpr float keepoutMm = 6;
+    constexpr float strokeTravelMm = travelMm - 2 * keepoutMm;
+
+    enum class Shape { Sine, Bezier };
+
+    struct Case {
+        const char *name;
+        Shape shape;
+        float sensation;
+        float strokesPerMinute;
+        float depthMm;
+        float strokeMm;
+        // Whether it asks for more than the limits allow
+        bool isClipped;
+        // When to stop the pattern, negative for never.
+        double stopSeconds;
+    };
+
+    const Case cases[] = {
+        {"sine", Shape::Sine, 0, 60, 150, 100, false, -1},
+        // In faster than out.
+        {"sine_skewed", Shape::Sine, 50, 60, 150, 100, false, -1},
+        {"bezier", Shape::Bezier, 0, 60, 150, 100, false, -1},
+        // Braking hard into depth.
+        {"bezier_late", Shape::Bezier, 100, 45, 150, 100, false, -1},
+        // End to end, slow enough for a curve still.
+        {"end_to_end", Shape::Sine, -30, 40, strokeTravelMm,
+         strokeTravelMm, false, -1},
+        // Faster than the motor, cut to the limits.
+        {"too_fast", Shape::Sine, 0, 300, strokeTravelMm, strokeTravelMm,
+         true, -1},
+        // Braked mid-stroke.
+        {"stop", Shape::Sine, 0, 60, 150, 100, false, 2.3},
+    };
+
+    CurvePattern *newPattern(const Case &c) {
+        if (c.shape == Shape::Bezier) {
+            return new BezierStroke("Bezier Stroke");
+        }
+        return new SineStroke("Sine Stroke");
+    }
+
+    struct Sample {
+        float position;
+        // Where the curve has the carriage, NAN before it started
+        float curve;
+        uint8_t queued;
+        bool isStroking;
+    };
+
+    class Sampler : public sil::Stimulus {
+      public:
+        const Case *current = nullptr;
+        CurvePattern *pattern = nullptr;
+        std::vector<Sample> samples;
+        uint64_t stopMicros = 0;
+
+        void start(uint64_t now) { next = now; }
+
+        uint64_t nextEventMicros() const override { return next; }
+
+        void fire(uint64_t nowMicros) override;
+
+      private:
+        uint64_t next = sil::never;
+        uint64_t curveStart = 0;
+        float startPhase = 0;
+        bool hasCurve = false;
+    };
+
+    struct Run {
+        Sampler sampler;
+        StrokeEngine engine;
+        machineGeometry geometry = {.physicalTravel = travelMm,
+                                    .keepoutBoundary = keepoutMm};
+    };
+
+    Run run;
+
+    void Sampler::fire(uint64_t nowMicros) {
+        FastAccelStepper &stepper = sil::stepper();
+        float stepsPerMm = servoMotor.stepsPerMillimeter;
+        uint8_t queued = stepper.queueEntries();
+        bool isStroking = run.engine.getState() == PATTERN;
+
+        // The curve starts with the first entry, which is played at once,
+        // where the segmenter joins it
+        if (!hasCurve && queued > 0) {
+            hasCurve = true;
+            curveStart = nowMicros - sampleMicros / 2;
+            startPhase = CurveSegmenter::nearestPhase(
+                pattern, float(stepper.getCurrentPosition()));
+        }
+        float curve = NAN;
+        if (hasCurve && isStroking) {
+            double cycles = startPhase + (nowMicros - curveStart) * 1e-6 /
+                                             pattern->cycleTime();
+            unsigned int cycle = (unsigned int)cycles;
+            curve = pattern->positionAt(cycle, float(cycles - cycle)) /
+                    stepsPerMm;
+        }
+
+        samples.push_back({float(stepper.getCurrentPosition() / stepsPerMm),
+                           curve, queued, isStroking});
+        next = nowMicros + sampleMicros;
+        if (samples.size() == samplesPerCase) {
+            next = sil::never;
+            sil::stop();
+        }
+    }
+
+    // Homes, starts the pattern and stops it, if asked.
+    void operatorTask(void *) {
+        FastAccelStepperEngine stepperEngine;
+        FastAccelStepper *stepper = stepperEngine.stepperConnectToPin(
+            Pins::Driver::motorStepPin);
+
+        const Case &c = *run.sampler.current;
+        StrokeEngine &engine = run.engine;
+        engine.begin(&run.geometry, &servoMotor, stepper);
+        engine.thisIsHome();
+        while (stepper->isRunning()) {
+            vTaskDelay(10);
+        }
+
+        engine.setSpeed(c.strokesPerMinute, false);
+        engine.setDepth(c.depthMm, false);
+        engine.setStroke(c.strokeMm, false);
+        engine.setSensation(c.sensation, false);
+        run.sampler.pattern = newPattern(c);
+        engine.setPattern(run.sampler.pattern, false);
+        run.sampler.start(sil::now());
+        uint64_t started = sil::now();
+        engine.startPattern();
+
+        if (c.stopSeconds >= 0) {
+            uint64_t stopAt = started + uint64_t(c.stopSeconds * 1e6);
+            vTaskDelay((stopAt - sil::now()) / 1000);
+            uint64_t stopping = sil::now();
+            engine.stopMotion();
+            run.sampler.stopMicros = sil::now() - stopping;
+        }
+        vTaskSuspend(nullptr);
+    }
+
+    struct Result {
+        std::vector<Sample> samples;
+        uint64_t stopMicros = 0;
+    };
+
+    /**
+     * Each case runs in a child process, so it starts from a fresh scheduler
+     * and clock.
+     */
+    bool simulate(const Case &c, Result &result) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return false;
+        }
+        fflush(stdout);
+        pid_t child = fork();
+        if (child < 0) {
+            return false;
+        }
+        if (child == 0) {
+            close(fds[0]);
+            run.sampler.current = &c;
+            sil::rail().reset();
+            sil::addStimulus(&run.sampler);
+            xTaskCreatePinnedToCore(operatorTask, "operator", 8192, nullptr,
+                                    1, nullptr, 1);
+            sil::run(60 * 1000000ULL);
+            const std::vector<Sample> &samples = run.sampler.samples;
+            size_t bytes = samples.size() * sizeof(Sample);
+            bool ok = write(fds[1], &run.sampler.stopMicros,
+                            sizeof(uint64_t)) == sizeof(uint64_t) &&
+                      write(fds[1], samples.data(), bytes) == (ssize_t)bytes;
+            _exit(ok ? 0 : 1);
+        }
+
+        close(fds[1]);
+        result.samples.clear();
+        bool ok = read(fds[0], &result.stopMicros, sizeof(uint64_t)) ==
+                  sizeof(uint64_t);
+        // A read may end within a sample
+        std::vector<char> bytes;
+        char buffer[4096];
+        ssize_t n;
+        while (ok && (n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + n);
+        }
+        close(fds[0]);
+        result.samples.resize(bytes.size() / sizeof(Sample));
+        memcpy(result.samples.data(), bytes.data(),
+               result.samples.size() * sizeof(Sample));
+        int status = 0;
+        waitpid(child, &status, 0);
+        return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+               result.samples.size() == samplesPerCase;
+    }
+
+    struct Measured {
+        double maxError = 0;
+        double rmsError = 0;
+        double topSpeed = 0;
+        double topAcceleration = 0;
+        double minMm = INFINITY;
+        double maxMm = -INFINITY;
+        int underruns = 0;
+        bool hasCurve = false;
+    };
+
+    Measured measure(const std::vector<Sample> &samples) {
+        Measured m;
+        double h = window * sampleMicros * 1e-6;
+        bool wasDry = false;
+        double squares = 0;
+        size_t compared = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            const Sample &s = samples[i];
+
+            // Once the curve started, the queue must never run dry while
+            // stroking.
+            if (!std::isnan(s.curve)) {
+                m.hasCurve = true;
+                bool isDry = s.queued == 0;
+                m.underruns += isDry && !wasDry ? 1 : 0;
+                wasDry = isDry;
+
+                double error = std::fabs(s.position - s.curve);
+                m.maxError = std::max(m.maxError, error);
+                squares += error * error;
+                compared++;
+            }
+            // From the curve on, the first move in is the stepper's own
+            if (m.hasCurve) {
+                m.minMm = std::min(m.minMm, double(s.position));
+                m.maxMm = std::max(m.maxMm, double(s.position));
+            }
+
+            if (i >= window && i + window < samples.size()) {
+                double before = samples[i - window].position;
+                double after = samples[i + window].position;
+                m.topSpeed =
+                    std::max(m.topSpeed, std::fabs(after - before) / (2 * h));
+                m.topAcceleration = std::max(
+                    m.topAcceleration,
+                    std::fabs(after - 2 * s.position + before) / (h * h));
+            }
+        }
+        m.rmsError = compared > 0 ? std::sqrt(squares / compared) : 0;
+        return m;
+    }
+
+    const Case *find(const std::string &name) {
+        for (const Case &c : cases) {
+            if (name == c.name) {
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    // A case's curve sampled by a segmenter of its own, without the
+    // simulation around it.
+    struct Segmented {
+        uint32_t segments = 0;
+        uint32_t pieces = 0;
+        double nanos = 0;
+    };
+
+    Segmented segment(const Case &c, double seconds) {
+        float stepsPerMm = servoMotor.stepsPerMillimeter;
+        CurvePattern *pattern = newPattern(c);
+        pattern->setTimeOfStroke(60 / c.strokesPerMinute);
+        pattern->setDepth(int(c.depthMm * stepsPerMm));
+        pattern->setStroke(int(c.strokeMm * stepsPerMm));
+        pattern->setSensation(c.sensation);
+
+        CurveSegmenter segmenter;
+        segmenter.setLimits(0, int32_t(strokeTravelMm * stepsPerMm),
+                            uint32_t(servoMotor.maxSpeed * stepsPerMm),
+                            uint32_t(servoMotor.maxAcceleration * stepsPerMm));
+        segmenter.setTolerance(0.1f * stepsPerMm);
+        segmenter.start(pattern, int32_t(pattern->positionAt(0, 0)));
+
+        Segmented s;
+        uint64_t micros = 0;
+        int32_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (micros < seconds * 1e6) {
+            if (segmenter.isAtCycleEnd()) {
+                segmenter.nextCycle();
+            }
+            CurveSegmenter::Segment piece = segmenter.next();
+            micros += piece.durationMicros;
+            sum += piece.steps;
+            s.pieces++;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        // Keep the loop from being optimized away.
+        if (sum == INT32_MIN) {
+            puts("");
+        }
+        s.segments = segmenter.segments();
+        s.nanos =
+            std::chrono::duration<double, std::nano>(elapsed).count() /
+            s.segments;
+        delete pattern;
+        return s;
+    }
+
+    bool report() {
+        bool allPassed = true;
+        // Rounding to steps, off by up to a step at either end of a window.
+        // Slow pieces step at the end of their time, so the middle may be
+        // off by a step too. And a hair for positions kept in mm.
+        double h = window * sampleMicros * 1e-6;
+        double speedTolerance = 2.01 / servoMotor.stepsPerMillimeter / (2 * h);
+        double accelerationTolerance =
+            4.01 / servoMotor.stepsPerMillimeter / (h * h);
+        printf("%-12s %9s %9s %7s %7s %6s %6s %9s %7s  %s\n", "case",
+               "max error", "rms error", "speed", "accel", "min", "max",
+               "underruns", "stop ms", "result");
+        for (const Case &c : cases) {
+            Result result;
+            if (!simulate(c, result)) {
+                fprintf(stderr, "%s: simulation failed\n", c.name);
+                allPassed = false;
+                continue;
+            }
+            Measured m = measure(result.samples);
+            bool passed = m.topSpeed <= servoMotor.maxSpeed + speedTolerance &&
+                          m.topAcceleration <= servoMotor.maxAcceleration +
+                                                   accelerationTolerance &&
+                          m.minMm >= 0 && m.maxMm <= strokeTravelMm &&
+                          m.underruns == 0 && m.hasCurve &&
+                          (c.isClipped || m.maxError <= maxErrorMm);
+            allPassed = allPassed && passed;
+            printf("%-12s %9.3f %9.3f %7.0f %7.0f %6.1f %6.1f %9d %7.0f  %s\n",
+                   c.name, m.maxError, m.rmsError, m.topSpeed,
+                   m.topAcceleration, m.minMm, m.maxMm, m.underruns,
+                   result.stopMicros * 1e-3, passed ? "ok" : "FAILED");
+        }
+
+        printf("\n%-12s %10s %12s %12s\n", "case", "segments/s",
+               "queue entries/s", "ns/segment");
+        for (const Case &c : cases) {
+            Segmented s = segment(c, 10);
+            printf("%-12s %10.0f %12.0f %12.0f\n", c.name, s.segments / 10.0,
+                   s.pieces / 10.0, s.nanos);
+        }
+        return allPassed;
+    }
+
+    bool dump(const std::string &name) {
+        const Case *c = find(name);
+        if (c == nullptr) {
+            fprintf(stderr, "curvetrace: no case %s\n", name.c_str());
+            return false;
+        }
+        Result result;
+        if (!simulate(*c, result)) {
+            fprintf(stderr, "curvetrace: simulation failed\n");
+            return false;
+        }
+        printf("seconds,position_mm,curve_mm,queued\n");
+        for (size_t i = 0; i < result.samples.size(); i++) {
+            const Sample &s = result.samples[i];
+            printf("%.4f,%.3f,%.3f,%d\n", i * sampleMicros * 1e-6, s.position,
+                   s.curve, s.queued);
+        }
+        return true;
+    }
+}
+
+static const char *usage =
+    "usage: curvetrace\n"
+    "       curvetrace dump <case>\n";
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        return report() ? 0 : 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "dump") == 0) {
+        return dump(argv[2]) ? 0 : 1;
+    }
+    fputs(usage, stderr);
+    return 2;
+}
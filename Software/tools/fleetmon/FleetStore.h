@@ -0,0 +1,305 @@
+#ifndef OSSM_TOOLS_FLEETMON_FLEETSTORE_H
+#define OSSM_TOOLS_FLEETMON_FLEETSTORE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "Scrape.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Fleet Store
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Time series of every OSSM fleetmon watches, in one file mapped into
+ * memory. Each device gets a ring of samples, the oldest is overwritten when
+ * it is full, so the file never grows after it is created.
+ *
+ *  Header | Device[maxDevices] | FleetSample[maxDevices][samplesPerDevice]
+ *
+ * One daemon writes, any number of readers map the same file read only and
+ * see new samples right away. A sample is complete before the ring's count
+ * moves past it. All values are little endian.
+ */
+
+/**
+ * What happened on a device between two scrapes. Counters are the change
+ * since the scrape before, so a reboot in between does not show up as a
+ * negative count.
+ */
+struct FleetSample {
+    int64_t unixMillis;
+    float uptimeSeconds;
+    float strokesPerMinute;
+    uint32_t strokes;
+    uint32_t clips;
+    uint32_t violations;
+    uint32_t eStops;
+    uint32_t errors;
+    uint32_t homings;
+    float homingSeconds;
+    uint32_t loops;
+    float loopMeanMicros;
+    // Upper bound of the bucket 99 % of the loops fit in, UINT32_MAX above
+    // the last bucket.
+    uint32_t loopP99Micros;
+    uint32_t heapFree;
+    uint32_t heapLargestBlock;
+    uint32_t rebooted;
+
+    /**
+     * @param now the scrape.
+     * @param before the scrape before, or nullptr for the first one.
+     */
+    static FleetSample between(int64_t unixMillis, const Scrape &now,
+                               const Scrape *before) {
+        // Uptime going back means the counters started over.
+        bool rebooted = before != nullptr &&
+                        now.uptimeSeconds < before->uptimeSeconds;
+        const Scrape zero;
+        const Scrape &from = before == nullptr || rebooted ? now : *before;
+        const Scrape &base = rebooted ? zero : from;
+
+        FleetSample sample = {};
+        sample.unixMillis = unixMillis;
+        sample.uptimeSeconds = (float)now.uptimeSeconds;
+        sample.strokesPerMinute = (float)now.strokesPerMinute;
+        sample.strokes = now.strokes - base.strokes;
+        sample.clips = now.clips - base.clips;
+        sample.violations = now.violations - base.violations;
+        sample.eStops = now.eStops - base.eStops;
+        sample.errors = now.errors - base.errors;
+        sample.homings = now.homingCount - base.homingCount;
+        sample.homingSeconds =
+            (float)(now.homingSumSeconds - base.homingSumSeconds);
+        sample.heapFree = now.heapFree;
+        sample.heapLargestBlock = now.heapLargestBlock;
+        sample.rebooted = rebooted;
+
+        constexpr size_t n = Scrape::loopBuckets;
+        sample.loops = now.loopBucket[n] - base.loopBucket[n];
+        if (sample.loops > 0) {
+            sample.loopMeanMicros =
+                (float)((now.loopSumSeconds - base.loopSumSeconds) * 1e6 /
+                        sample.loops);
+            auto rank = (uint32_t)(0.99 * sample.loops + 0.999);
+            sample.loopP99Micros = UINT32_MAX;
+            for (size_t i = 0; i < n; i++) {
+                if (now.loopBucket[i] - base.loopBucket[i] >= rank) {
+                    sample.loopP99Micros = Scrape::loopBoundsMicros[i];
+                    break;
+                }
+            }
+        }
+        return sample;
+    }
+};
+
+static_assert(sizeof(FleetSample) == 72, "File format");
+
+class FleetStore {
+  public:
+    static constexpr char magic[4] = {'O', 'S', 'F', 'M'};
+    static constexpr uint32_t version = 1;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t maxDevices;
+        uint32_t samplesPerDevice;
+        std::atomic<uint32_t> deviceCount;
+        uint32_t reserved;
+    };
+
+    struct Device {
+        // "address:port"
+        char name[56];
+        int64_t firstSeenMillis;
+        int64_t lastSeenMillis;
+        uint32_t scrapes;
+        uint32_t failures;
+        // Whether the last scrapes answered.
+        uint32_t up;
+        // Ring position of the next sample.
+        uint32_t next;
+        std::atomic<uint32_t> count;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(Header) == 24, "File format");
+    static_assert(sizeof(Device) == 96, "File format");
+
+    FleetStore() = default;
+    FleetStore(const FleetStore &) = delete;
+    FleetStore &operator=(const FleetStore &) = delete;
+    ~FleetStore() { close(); }
+
+    /**
+     * Create the file, or open it if it exists, keeping its sizes.
+     * @return false if it cannot be mapped or is not a store.
+     */
+    bool create(const char *path, uint32_t maxDevices,
+                uint32_t samplesPerDevice) {
+        int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        fstat(fd, &info);
+        if (info.st_size == 0) {
+            size_t size = sizeFor(maxDevices, samplesPerDevice);
+            // Sparse, pages are only backed once written.
+            if (ftruncate(fd, (off_t)size) < 0 || !map(fd, size, true)) {
+                ::close(fd);
+                return false;
+            }
+            memcpy(header->magic, magic, sizeof(magic));
+            header->version = version;
+            header->maxDevices = maxDevices;
+            header->samplesPerDevice = samplesPerDevice;
+            ::close(fd);
+            return true;
+        }
+        bool isMapped = map(fd, (size_t)info.st_size, true) && isValid();
+        ::close(fd);
+        return isMapped;
+    }
+
+    // Map an existing store read only, for summaries.
+    bool openReadOnly(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        fstat(fd, &info);
+        bool isMapped = map(fd, (size_t)info.st_size, false) && isValid();
+        ::close(fd);
+        return isMapped;
+    }
+
+    void close() {
+        if (base != nullptr) {
+            munmap(base, size);
+        }
+        base = nullptr;
+        header = nullptr;
+    }
+
+    // Write dirty pages back, e.g. before exiting.
+    void flush() {
+        if (base != nullptr) {
+            msync(base, size, MS_SYNC);
+        }
+    }
+
+    uint32_t deviceCount() const {
+        return header->deviceCount.load(std::memory_order_acquire);
+    }
+    uint32_t maxDevices() const { return header->maxDevices; }
+    uint32_t samplesPerDevice() const { return header->samplesPerDevice; }
+
+    Device &device(uint32_t index) { return devices()[index]; }
+    const Device &device(uint32_t index) const { return devices()[index]; }
+
+    /**
+     * The device with this name, added if it is new.
+     * @return its index, or -1 if the store is full.
+     */
+    int findOrAdd(const char *name, int64_t nowMillis) {
+        uint32_t count = deviceCount();
+        for (uint32_t i = 0; i < count; i++) {
+            if (strncmp(devices()[i].name, name, sizeof(Device::name)) == 0) {
+                return (int)i;
+            }
+        }
+        if (count == header->maxDevices) {
+            return -1;
+        }
+        Device &device = devices()[count];
+        memset(static_cast<void *>(&device), 0, sizeof(device));
+        strncpy(device.name, name, sizeof(device.name) - 1);
+        device.firstSeenMillis = nowMillis;
+        header->deviceCount.store(count + 1, std::memory_order_release);
+        return (int)count;
+    }
+
+    void append(uint32_t index, const FleetSample &sample) {
+        Device &device = devices()[index];
+        samplesOf(index)[device.next] = sample;
+        device.next = (device.next + 1) % header->samplesPerDevice;
+        uint32_t count = device.count.load(std::memory_order_relaxed);
+        if (count < header->samplesPerDevice) {
+            device.count.store(count + 1, std::memory_order_release);
+        }
+    }
+
+    uint32_t sampleCount(uint32_t index) const {
+        return devices()[index].count.load(std::memory_order_acquire);
+    }
+
+    // The i-th sample kept for a device, 0 is the oldest.
+    const FleetSample &sample(uint32_t index, uint32_t i) const {
+        const Device &device = devices()[index];
+        uint32_t count = device.count.load(std::memory_order_acquire);
+        uint32_t oldest = count < header->samplesPerDevice ? 0 : device.next;
+        return samplesOf(index)[(oldest + i) % header->samplesPerDevice];
+    }
+
+    static size_t sizeFor(uint32_t maxDevices, uint32_t samplesPerDevice) {
+        return sizeof(Header) + sizeof(Device) * maxDevices +
+               sizeof(FleetSample) * (size_t)maxDevices * samplesPerDevice;
+    }
+
+  private:
+    bool map(int fd, size_t length, bool writable) {
+        if (length < sizeof(Header)) {
+            return false;
+        }
+        void *mapped =
+            mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                 MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<uint8_t *>(mapped);
+        size = length;
+        header = reinterpret_cast<Header *>(base);
+        return true;
+    }
+
+    bool isValid() {
+        bool isValid =
+            memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+            header->version == version &&
+            size >= sizeFor(header->maxDevices, header->samplesPerDevice);
+        if (!isValid) {
+            close();
+        }
+        return isValid;
+    }
+
+    Device *devices() const {
+        return reinterpret_cast<Device *>(base + sizeof(Header));
+    }
+
+    FleetSample *samplesOf(uint32_t index) const {
+        auto *first = reinterpret_cast<FleetSample *>(
+            base + sizeof(Header) + sizeof(Device) * header->maxDevices);
+        return first + (size_t)index * header->samplesPerDevice;
+    }
+
+    uint8_t *base = nullptr;
+    size_t size = 0;
+    Header *header = nullptr;
+};
+
+#endif  // OSSM_TOOLS_FLEETMON_FLEETSTORE_H
@@ -0,0 +1,135 @@
+#ifndef OSSM_TOOLS_FLEETMON_SCRAPE_H
+#define OSSM_TOOLS_FLEETMON_SCRAPE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Scrape
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * What fleetmon reads from one scrape of an OSSM's "/metrics" endpoint, see
+ * src/utils/Metrics.h for the names and units.
+ *
+ * Counters and histograms are totals since boot. A sample for the store is
+ * made from two scrapes in a row, see FleetSample.
+ */
+struct Scrape {
+    // Bucket bounds of ossm_stroking_loop_latency_seconds, in microseconds.
+    static constexpr size_t loopBuckets = 8;
+    static constexpr uint32_t loopBoundsMicros[loopBuckets] = {
+        50, 100, 250, 500, 1000, 2500, 5000, 10000};
+
+    double uptimeSeconds = 0;
+    double strokesPerMinute = 0;
+    uint32_t strokes = 0;
+    uint32_t clips = 0;
+    uint32_t violations = 0;
+    // Cumulative, the last one is +Inf.
+    uint32_t loopBucket[loopBuckets + 1] = {};
+    double loopSumSeconds = 0;
+    uint32_t homingCount = 0;
+    double homingSumSeconds = 0;
+    uint32_t eStops = 0;
+    // Transitions into an error state.
+    uint32_t errors = 0;
+    uint32_t heapFree = 0;
+    uint32_t heapLargestBlock = 0;
+
+    /**
+     * Read the text format. Unknown lines are skipped, so newer firmware
+     * still parses.
+     * @return false if it is not an OSSM, no uptime.
+     */
+    bool parse(const char *text, size_t length) {
+        *this = Scrape();
+        bool hasUptime = false;
+        const char *end = text + length;
+        while (text < end) {
+            const char *lineEnd =
+                static_cast<const char *>(memchr(text, '\n', end - text));
+            if (lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            char line[256];
+            size_t lineLength = lineEnd - text;
+            if (lineLength < sizeof(line) && text[0] != '#') {
+                memcpy(line, text, lineLength);
+                line[lineLength] = '\0';
+                hasUptime |= parseLine(line);
+            }
+            text = lineEnd + 1;
+        }
+        return hasUptime;
+    }
+
+  private:
+    static constexpr const char *errorTransitions =
+        "ossm_state_transitions_total{state=\"error\"}";
+
+    static bool startsWith(const char *line, const char *prefix) {
+        return strncmp(line, prefix, strlen(prefix)) == 0;
+    }
+
+    // The value after the name and labels.
+    static double value(const char *line) {
+        const char *space = strrchr(line, ' ');
+        return space == nullptr ? 0 : strtod(space + 1, nullptr);
+    }
+
+    static uint32_t count(const char *line) { return (uint32_t)value(line); }
+
+    // Returns true for the uptime line.
+    bool parseLine(const char *line) {
+        if (startsWith(line, "ossm_uptime_seconds ")) {
+            uptimeSeconds = value(line);
+            return true;
+        }
+        if (startsWith(line, "ossm_stroking_loop_latency_seconds_bucket")) {
+            const char *le = strstr(line, "le=\"");
+            if (le == nullptr) {
+                return false;
+            }
+            if (strncmp(le + 4, "+Inf", 4) == 0) {
+                loopBucket[loopBuckets] = count(line);
+                return false;
+            }
+            auto bound = (uint32_t)(strtod(le + 4, nullptr) * 1e6 + 0.5);
+            for (size_t i = 0; i < loopBuckets; i++) {
+                if (loopBoundsMicros[i] == bound) {
+                    loopBucket[i] = count(line);
+                }
+            }
+        } else if (startsWith(line,
+                              "ossm_stroking_loop_latency_seconds_sum ")) {
+            loopSumSeconds = value(line);
+        } else if (startsWith(line, "ossm_strokes_total ")) {
+            strokes = count(line);
+        } else if (startsWith(line, "ossm_strokes_per_minute ")) {
+            strokesPerMinute = value(line);
+        } else if (startsWith(line, "ossm_clips_total ")) {
+            clips = count(line);
+        } else if (startsWith(line, "ossm_envelope_violations_total ")) {
+            violations = count(line);
+        } else if (startsWith(line, "ossm_homing_duration_seconds_sum ")) {
+            homingSumSeconds = value(line);
+        } else if (startsWith(line, "ossm_homing_duration_seconds_count ")) {
+            homingCount = count(line);
+        } else if (startsWith(line, "ossm_estop_overhead_seconds_count ")) {
+            eStops = count(line);
+        } else if (startsWith(line, errorTransitions)) {
+            errors += count(line);
+        } else if (startsWith(line, "ossm_heap_free_bytes ")) {
+            heapFree = count(line);
+        } else if (startsWith(line, "ossm_heap_largest_free_block_bytes ")) {
+            heapLargestBlock = count(line);
+        }
+        return false;
+    }
+};
+
+#endif  // OSSM_TOOLS_FLEETMON_SCRAPE_H
@@ -0,0 +1,653 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "FleetStore.h"
+#include "Scrape.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Fleet Monitor
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Watches many OSSMs from one Linux box.
+ *
+ * "run" looks for the "/metrics" endpoint of services/metrics.h on every
+ * address and port it is given, scrapes every OSSM that answers at a fixed
+ * interval and keeps what changed in between in a FleetStore file. All
+ * scrapes share one epoll loop, so hundreds of devices cost one thread.
+ * Addresses that did not answer are tried again every rescan, to pick up
+ * devices that join later. "summary" reads the file, also while "run" is
+ * writing it, and prints every device and the fleet as a whole.
+ *
+ *  pio run -e fleetmon
+ *  .pio/build/fleetmon/program run fleet.bin --scan 192.168.1.0/24
+ *  .pio/build/fleetmon/program summary fleet.bin --window 300
+ */
+
+namespace {
+    constexpr int maxConnections = 256;
+    constexpr int64_t timeoutMillis = 2000;
+    // A device is down after this many failed scrapes in a row.
+    constexpr uint32_t failuresUntilDown = 3;
+    constexpr size_t maxResponse = 64 * 1024;
+
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct Options {
+        std::string store;
+        std::vector<Range> scans;
+        uint16_t firstPort = 9100;
+        uint16_t lastPort = 9100;
+        int64_t intervalMillis = 5000;
+        int64_t rescanMillis = 60000;
+        int64_t summaryMillis = 60000;
+        int64_t windowMillis = 60000;
+        uint32_t maxDevices = 1024;
+        uint32_t samplesPerDevice = 17280;
+    };
+
+    const char *usage =
+        "usage: fleetmon run <store> --scan <address[/bits]>... [options]\n"
+        "       fleetmon summary <store> [--window <s>]\n"
+        "  --ports <a[-b]>     metrics ports, 9100 by default\n"
+        "  --interval <s>      between scrapes of a device, 5 by default\n"
+        "  --rescan <s>        between probes of silent addresses, 60 by "
+        "default\n"
+        "  --summary <s>       print a summary this often, 60 by default\n"
+        "  --window <s>        a summary covers this much, 60 by default\n"
+        "  --devices <n>       when creating the store, 1024 by default\n"
+        "  --samples <n>       kept per device, 17280 (a day) by default\n";
+
+    volatile sig_atomic_t stopping = 0;
+
+    int64_t monotonicMillis() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return int64_t(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    }
+
+    int64_t unixMillis() {
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        return int64_t(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    }
+
+    /** ////  Summary  //// */
+
+    struct DeviceSummary {
+        bool up = false;
+        float strokesPerMinute = 0;
+        uint32_t strokes = 0;
+        uint32_t clips = 0;
+        uint32_t violations = 0;
+        uint32_t eStops = 0;
+        uint32_t errors = 0;
+        uint32_t reboots = 0;
+        uint32_t homings = 0;
+        double homingSeconds = 0;
+        uint32_t loops = 0;
+        double loopMicros = 0;
+        // The worst sample in the window.
+        uint32_t loopP99Micros = 0;
+        // The lowest sample in the window, 0 if the device does not say.
+        uint32_t heapFree = 0;
+        uint32_t heapLargestBlock = 0;
+    };
+
+    DeviceSummary summarize(const FleetStore &store, uint32_t index,
+                            int64_t since) {
+        DeviceSummary summary;
+        summary.up = store.device(index).up != 0;
+        uint32_t count = store.sampleCount(index);
+        for (uint32_t i = 0; i < count; i++) {
+            const FleetSample &sample = store.sample(index, i);
+            if (sample.unixMillis < since) {
+                continue;
+            }
+            summary.strokesPerMinute = sample.strokesPerMinute;
+            summary.strokes += sample.strokes;
+            summary.clips += sample.clips;
+            summary.violations += sample.violations;
+            summary.eStops += sample.eStops;
+            summary.errors += sample.errors;
+            summary.reboots += sample.rebooted;
+            summary.homings += sample.homings;
+            summary.homingSeconds += sample.homingSeconds;
+            summary.loops += sample.loops;
+            summary.loopMicros += double(sample.loopMeanMicros) * sample.loops;
+            if (sample.loops > 0) {
+                summary.loopP99Micros =
+                    std::max(summary.loopP99Micros, sample.loopP99Micros);
+            }
+            if (sample.heapFree > 0 &&
+                (summary.heapFree == 0 || sample.heapFree < summary.heapFree)) {
+                summary.heapFree = sample.heapFree;
+                summary.heapLargestBlock = sample.heapLargestBlock;
+            }
+        }
+        if (summary.loops > 0) {
+            summary.loopMicros /= summary.loops;
+        }
+        if (!summary.up) {
+            summary.strokesPerMinute = 0;
+        }
+        return summary;
+    }
+
+    std::string formatLoop(uint32_t micros) {
+        if (micros == 0) {
+            return "-";
+        }
+        if (micros == UINT32_MAX) {
+            return ">10000";
+        }
+        return std::to_string(micros);
+    }
+
+    std::string formatHoming(const DeviceSummary &summary) {
+        if (summary.homings == 0) {
+            return "-";
+        }
+        char text[16];
+        snprintf(text, sizeof(text), "%.1f",
+                 summary.homingSeconds / summary.homings);
+        return text;
+    }
+
+    void printSummary(const FleetStore &store, int64_t windowMillis) {
+        int64_t since = unixMillis() - windowMillis;
+        uint32_t devices = store.deviceCount();
+
+        printf("%-22s %4s %6s %7s %5s %5s %5s %6s %8s %8s %9s %7s\n", "device",
+               "up", "spm", "strokes", "clips", "errs", "boots", "estops",
+               "loop_us", "p99_us", "heap", "homing");
+
+        DeviceSummary fleet;
+        std::vector<uint32_t> p99s;
+        uint32_t up = 0;
+        for (uint32_t i = 0; i < devices; i++) {
+            DeviceSummary summary = summarize(store, i, since);
+            printf("%-22s %4s %6.1f %7u %5u %5u %5u %6u %8.1f %8s %9u %7s\n",
+                   store.device(i).name, summary.up ? "yes" : "no",
+                   summary.strokesPerMinute, summary.strokes, summary.clips,
+                   summary.errors, summary.reboots, summary.eStops,
+                   summary.loopMicros,
+                   formatLoop(summary.loopP99Micros).c_str(), summary.heapFree,
+                   formatHoming(summary).c_str());
+
+            up += summary.up;
+            fleet.strokesPerMinute += summary.strokesPerMinute;
+            fleet.strokes += summary.strokes;
+            fleet.clips += summary.clips;
+            fleet.violations += summary.violations;
+            fleet.eStops += summary.eStops;
+            fleet.errors += summary.errors;
+            fleet.reboots += summary.reboots;
+            fleet.homings += summary.homings;
+            fleet.homingSeconds += summary.homingSeconds;
+            fleet.loops += summary.loops;
+            fleet.loopMicros += summary.loopMicros * summary.loops;
+            if (summary.loops > 0) {
+                p99s.push_back(summary.loopP99Micros);
+            }
+            if (summary.heapFree > 0 &&
+                (fleet.heapFree == 0 || summary.heapFree < fleet.heapFree)) {
+                fleet.heapFree = summary.heapFree;
+            }
+        }
+        if (fleet.loops > 0) {
+            fleet.loopMicros /= fleet.loops;
+        }
+
+        std::sort(p99s.begin(), p99s.end());
+        uint32_t worst = p99s.empty() ? 0 : p99s.back();
+        uint32_t p95 = p99s.empty() ? 0 : p99s[(p99s.size() * 95 - 1) / 100];
+
+        printf("\nfleet: %u of %u up over the last %lld s\n", up, devices,
+               (long long)(windowMillis / 1000));
+        printf("  %.1f strokes per minute, %u strokes\n",
+               fleet.strokesPerMinute, fleet.strokes);
+        printf("  %u clips, %u envelope violations, %u errors, %u e-stops, "
+               "%u reboots\n",
+               fleet.clips, fleet.violations, fleet.errors, fleet.eStops,
+               fleet.reboots);
+        printf("  loop %.1f us mean, p99 %s us on the worst device, %s us on "
+               "95 %% of them\n",
+               fleet.loopMicros, formatLoop(worst).c_str(),
+               formatLoop(p95).c_str());
+        printf("  lowest free heap %u bytes, homing %s s on average\n\n",
+               fleet.heapFree, formatHoming(fleet).c_str());
+        fflush(stdout);
+    }
+
+    /** ////  Scraping  //// */
+
+    struct Target {
+        sockaddr_in address;
+        std::string name;
+        // In the store once it answered, -1 before.
+        int device = -1;
+        Scrape last;
+        bool hasLast = false;
+        uint32_t failures = 0;
+        int64_t dueMillis = 0;
+        bool isBusy = false;
+    };
+
+    struct Connection {
+        int fd;
+        Target *target;
+        bool isSent = false;
+        int64_t deadlineMillis;
+        std::string response;
+    };
+
+    class Monitor {
+      public:
+        Monitor(FleetStore &store, const Options &options)
+            : store(store), options(options), random(std::random_device()()) {}
+
+        bool begin() {
+            epollFd = epoll_create1(0);
+            if (epollFd < 0) {
+                return false;
+            }
+            for (const Range &range : options.scans) {
+                for (uint32_t i = 0; i < range.count; i++) {
+                    for (uint32_t port = options.firstPort;
+                         port <= options.lastPort; port++) {
+                        addTarget(range.first + i, (uint16_t)port);
+                    }
+                }
+            }
+            // Spread the first round over an interval, so a big fleet does
+            // not connect all at once.
+            std::uniform_int_distribution<int64_t> spread(
+                0, options.intervalMillis);
+            int64_t now = monotonicMillis();
+            for (Target &target : targets) {
+                target.dueMillis = now + spread(random);
+            }
+            return true;
+        }
+
+        void run() {
+            int64_t nextSummary = monotonicMillis() + options.summaryMillis;
+            epoll_event events[64];
+            while (!stopping) {
+                int64_t now = monotonicMillis();
+                startDue(now);
+                expire(now);
+                if (now >= nextSummary) {
+                    printSummary(store, options.windowMillis);
+                    nextSummary = now + options.summaryMillis;
+                }
+
+                int ready = epoll_wait(epollFd, events, 64, 50);
+                for (int i = 0; i < ready; i++) {
+                    handle(static_cast<Connection *>(events[i].data.ptr),
+                           events[i].events);
+                }
+            }
+            for (Connection *connection : connections) {
+                ::close(connection->fd);
+                delete connection;
+            }
+            connections.clear();
+            ::close(epollFd);
+        }
+
+        size_t targetCount() const { return targets.size(); }
+
+      private:
+        void addTarget(uint32_t address, uint16_t port) {
+            Target target;
+            memset(&target.address, 0, sizeof(target.address));
+            target.address.sin_family = AF_INET;
+            target.address.sin_addr.s_addr = htonl(address);
+            target.address.sin_port = htons(port);
+            char text[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &target.address.sin_addr, text, sizeof(text));
+            target.name = std::string(text) + ":" + std::to_string(port);
+            target.device = -1;
+            targets.push_back(target);
+        }
+
+        void startDue(int64_t now) {
+            for (Target &target : targets) {
+                if (connections.size() >= maxConnections) {
+                    return;
+                }
+                if (!target.isBusy && now >= target.dueMillis) {
+                    start(target, now);
+                }
+            }
+        }
+
+        void start(Target &target, int64_t now) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (fd < 0) {
+                reschedule(target, now);
+                return;
+            }
+            int result = connect(fd, (sockaddr *)&target.address,
+                                 sizeof(target.address));
+            if (result < 0 && errno != EINPROGRESS) {
+                ::close(fd);
+                failed(target, now);
+                return;
+            }
+
+            auto *connection = new Connection();
+            connection->fd = fd;
+            connection->target = &target;
+            connection->deadlineMillis = now + timeoutMillis;
+            epoll_event event = {};
+            event.events = EPOLLOUT;
+            event.data.ptr = connection;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            connections.push_back(connection);
+            target.isBusy = true;
+        }
+
+        void handle(Connection *connection, uint32_t events) {
+            int64_t now = monotonicMillis();
+            if (!connection->isSent) {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error,
+                           &length);
+                static const char request[] =
+                    "GET /metrics HTTP/1.0\r\n\r\n";
+                if (error != 0 || (events & (EPOLLERR | EPOLLHUP)) ||
+                    send(connection->fd, request, sizeof(request) - 1,
+                         MSG_NOSIGNAL) != sizeof(request) - 1) {
+                    finish(connection, now, false);
+                    return;
+                }
+                connection->isSent = true;
+                epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.ptr = connection;
+                epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+                return;
+            }
+
+            char buffer[4096];
+            while (true) {
+                ssize_t n = recv(connection->fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    connection->response.append(buffer, n);
+                    if (connection->response.size() > maxResponse) {
+                        finish(connection, now, false);
+                        return;
+                    }
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return;
+                }
+                // The server closes once the body is out.
+                finish(connection, now, n == 0);
+                return;
+            }
+        }
+
+        void expire(int64_t now) {
+            // finish() edits the list, so collect first.
+            std::vector<Connection *> late;
+            for (Connection *connection : connections) {
+                if (now >= connection->deadlineMillis) {
+                    late.push_back(connection);
+                }
+            }
+            for (Connection *connection : late) {
+                finish(connection, now, false);
+            }
+        }
+
+        void finish(Connection *connection, int64_t now, bool isComplete) {
+            Target &target = *connection->target;
+            Scrape scrape;
+            bool isScraped = isComplete && parse(connection->response, scrape);
+
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+            ::close(connection->fd);
+            connections.erase(
+                std::find(connections.begin(), connections.end(), connection));
+            delete connection;
+            target.isBusy = false;
+
+            if (isScraped) {
+                scraped(target, scrape, now);
+            } else {
+                failed(target, now);
+            }
+        }
+
+        static bool parse(const std::string &response, Scrape &scrape) {
+            if (response.compare(0, 12, "HTTP/1.0 200") != 0 &&
+                response.compare(0, 12, "HTTP/1.1 200") != 0) {
+                return false;
+            }
+            size_t body = response.find("\r\n\r\n");
+            if (body == std::string::npos) {
+                return false;
+            }
+            body += 4;
+            return scrape.parse(response.data() + body,
+                                response.size() - body);
+        }
+
+        void scraped(Target &target, const Scrape &scrape, int64_t now) {
+            int64_t wallMillis = unixMillis();
+            if (target.device < 0) {
+                target.device =
+                    store.findOrAdd(target.name.c_str(), wallMillis);
+                if (target.device < 0) {
+                    if (!isFullReported) {
+                        fprintf(stderr, "fleetmon: the store is full, new "
+                                        "devices are not kept\n");
+                        isFullReported = true;
+                    }
+                    // Look again later, a restart with a bigger store helps.
+                    target.dueMillis = now + options.rescanMillis;
+                    return;
+                }
+                fprintf(stderr, "fleetmon: found %s\n", target.name.c_str());
+            }
+
+            store.append(target.device,
+                         FleetSample::between(wallMillis, scrape,
+                                              target.hasLast ? &target.last
+                                                             : nullptr));
+            FleetStore::Device &device = store.device(target.device);
+            device.lastSeenMillis = wallMillis;
+            device.scrapes++;
+            device.up = 1;
+
+            target.last = scrape;
+            target.hasLast = true;
+            target.failures = 0;
+            reschedule(target, now);
+        }
+
+        void failed(Target &target, int64_t now) {
+            if (target.device < 0) {
+                // Nothing there yet.
+                target.dueMillis = now + options.rescanMillis;
+                return;
+            }
+            FleetStore::Device &device = store.device(target.device);
+            device.failures++;
+            if (++target.failures == failuresUntilDown && device.up) {
+                device.up = 0;
+                fprintf(stderr, "fleetmon: lost %s\n", target.name.c_str());
+            }
+            reschedule(target, now);
+        }
+
+        void reschedule(Target &target, int64_t now) {
+            // A little jitter keeps devices found together from staying in
+            // lockstep.
+            std::uniform_int_distribution<int64_t> jitter(
+                0, options.intervalMillis / 20);
+            target.dueMillis = now + options.intervalMillis + jitter(random);
+        }
+
+        FleetStore &store;
+        const Options &options;
+        std::mt19937 random;
+        int epollFd = -1;
+        bool isFullReported = false;
+        std::vector<Target> targets;
+        std::vector<Connection *> connections;
+    };
+
+    /** ////  Command line  //// */
+
+    // "10.0.0.0/24" or a single address.
+    bool parseRange(const char *text, Range &range) {
+        std::string address = text;
+        int bits = 32;
+        size_t slash = address.find('/');
+        if (slash != std::string::npos) {
+            bits = atoi(address.c_str() + slash + 1);
+            address.resize(slash);
+        }
+        in_addr parsed;
+        if (bits < 16 || bits > 32 ||
+            inet_pton(AF_INET, address.c_str(), &parsed) != 1) {
+            return false;
+        }
+        uint32_t mask = bits == 32 ? UINT32_MAX : ~(UINT32_MAX >> bits);
+        range.first = ntohl(parsed.s_addr) & mask;
+        range.count = uint32_t(1) << (32 - bits);
+        // Skip the network and broadcast addresses.
+        if (bits < 31) {
+            range.first++;
+            range.count -= 2;
+        }
+        return true;
+    }
+
+    bool parsePorts(const char *text, Options &options) {
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = *end == '-' ? strtol(end + 1, &end, 10) : first;
+        if (*end != '\0' || first < 1 || last > 65535 || last < first) {
+            return false;
+        }
+        options.firstPort = (uint16_t)first;
+        options.lastPort = (uint16_t)last;
+        return true;
+    }
+
+    bool parse(int argc, char **argv, Options &options) {
+        if (argc < 3) {
+            return false;
+        }
+        options.store = argv[2];
+        for (int i = 3; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--scan" && hasValue) {
+                Range range;
+                if (!parseRange(argv[++i], range)) {
+                    return false;
+                }
+                options.scans.push_back(range);
+            } else if (arg == "--ports" && hasValue) {
+                if (!parsePorts(argv[++i], options)) {
+                    return false;
+                }
+            } else if (arg == "--interval" && hasValue) {
+                options.intervalMillis = int64_t(atof(argv[++i]) * 1000);
+            } else if (arg == "--rescan" && hasValue) {
+                options.rescanMillis = int64_t(atof(argv[++i]) * 1000);
+            } else if (arg == "--summary" && hasValue) {
+                options.summaryMillis = int64_t(atof(argv[++i]) * 1000);
+            } else if (arg == "--window" && hasValue) {
+                options.windowMillis = int64_t(atof(argv[++i]) * 1000);
+            } else if (arg == "--devices" && hasValue) {
+                options.maxDevices = (uint32_t)atoi(argv[++i]);
+            } else if (arg == "--samples" && hasValue) {
+                options.samplesPerDevice = (uint32_t)atoi(argv[++i]);
+            } else {
+                return false;
+            }
+        }
+        return options.intervalMillis > 0 && options.rescanMillis > 0 &&
+               options.summaryMillis > 0 && options.windowMillis > 0 &&
+               options.maxDevices > 0 && options.samplesPerDevice > 0;
+    }
+
+    void stop(int) { stopping = 1; }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    std::string command = argv[1];
+
+    FleetStore store;
+    if (command == "summary") {
+        if (!store.openReadOnly(options.store.c_str())) {
+            fprintf(stderr, "fleetmon: %s is not a fleet store\n",
+                    options.store.c_str());
+            return 1;
+        }
+        printSummary(store, options.windowMillis);
+        return 0;
+    }
+    if (command != "run" || options.scans.empty()) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    if (!store.create(options.store.c_str(), options.maxDevices,
+                      options.samplesPerDevice)) {
+        fprintf(stderr, "fleetmon: cannot open %s as a fleet store\n",
+                options.store.c_str());
+        return 1;
+    }
+
+    Monitor monitor(store, options);
+    if (!monitor.begin()) {
+        perror("fleetmon");
+        return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "fleetmon: watching %zu addresses\n",
+            monitor.targetCount());
+
+    monitor.run();
+    store.flush();
+    printSummary(store, options.windowMillis);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <vector>
+
+#include "utils/FlightRecorder.h"
+#include "utils/MotionSupervisor.h"
+
+/**
+ * Turns flight recorder dumps into a readable timeline.
+ *
+ * Accepts either a single dump or a raw copy of the whole partition, in which
+ * case every valid slot is printed, oldest dump first.
+ *
+ *  esptool.py read_flash 0x3F0000 0x10000 flightrec.bin
+ *  pio run -e flightrec && .pio/build/flightrec/program flightrec.bin
+ */
+
+static constexpr size_t slotAlignment = 4096;
+
+static const char *lookup(const char *const *names, size_t count,
+                          size_t index) {
+    return index < count ? names[index] : "?";
+}
+
+static void printTime(uint32_t ms) {
+    printf("%02u:%02u:%02u.%03u", (unsigned)(ms / 3600000),
+           (unsigned)(ms / 60000 % 60), (unsigned)(ms / 1000 % 60),
+           (unsigned)(ms % 1000));
+}
+
+// Values are stored as fixed point integers, e.g. 4250 / 100 = 42.50.
+static void printFixed(int32_t value, int32_t scale) {
+    int64_t magnitude = value < 0 ? -(int64_t)value : value;
+    printf("%s%lld.%0*lld", value < 0 ? "-" : "", (long long)(magnitude / scale),
+           scale == 100 ? 2 : 3, (long long)(magnitude % scale));
+}
+
+static void printRecord(const FlightDump::Header &header,
+                        const FlightRecord &r) {
+    printf("  ");
+    printTime(r.timeMs);
+    printf("  %-8s ", lookup(flightEventNames, (size_t)FlightEvent::NUM_EVENTS,
+                             (size_t)r.type));
+    switch (r.type) {
+        case FlightEvent::State:
+            printf("-> %s\n", r.id < header.nameCount
+                                  ? header.names[r.id]
+                                  : "(state table full)");
+            break;
+        case FlightEvent::Setting:
+            printf("%s = ", lookup(flightSettingNames,
+                                   (size_t)FlightSetting::NUM_SETTINGS, r.id));
+            printFixed(r.a, 100);
+            printf("\n");
+            break;
+        case FlightEvent::Motion:
+            printf("%s to %d steps at %d Hz\n",
+                   lookup(flightSourceNames, (size_t)FlightSource::NUM_SOURCES,
+                          r.id),
+                   (int)r.a, (int)r.b);
+            break;
+        case FlightEvent::AdcPeak:
+            printf("pin %u peak ", (unsigned)r.id);
+            printFixed(r.a, 1000);
+            printf("%%\n");
+            break;
+        case FlightEvent::EmergencyStop:
+            printf("at %d steps, %d us after the press\n", (int)r.a, (int)r.b);
+            break;
+        case FlightEvent::Boot:
+        case FlightEvent::Panic:
+            printf("reset reason %d\n", (int)r.a);
+            break;
+        case FlightEvent::Violation:
+            printf("%s at %d steps\n",
+                   lookup(motionViolationNames,
+                          (size_t)MotionViolation::NUM_VIOLATIONS, r.a),
+                   (int)r.b);
+            break;
+        default:
+            printf("%d %d %d\n", (int)r.id, (int)r.a, (int)r.b);
+            break;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <dump.bin>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == nullptr) {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(file);
+
+    // Find every valid dump, a partition image holds one per slot.
+    struct Found {
+        const FlightDump::Header *header;
+        const FlightRecord *records;
+    };
+    std::vector<Found> dumps;
+    for (size_t offset = 0; offset < data.size(); offset += slotAlignment) {
+        const FlightRecord *records = nullptr;
+        const FlightDump::Header *header = FlightDump::parse(
+            data.data() + offset, data.size() - offset, &records);
+        if (header != nullptr) {
+            dumps.push_back({header, records});
+        }
+    }
+    if (dumps.empty()) {
+        fprintf(stderr, "%s: no flight recorder dump found\n", argv[1]);
+        return 1;
+    }
+
+    // Insertion sort by sequence, there are only a handful of slots.
+    for (size_t i = 1; i < dumps.size(); i++) {
+        for (size_t j = i; j > 0 && dumps[j].header->sequence <
+                                        dumps[j - 1].header->sequence;
+             j--) {
+            std::swap(dumps[j], dumps[j - 1]);
+        }
+    }
+
+    for (const auto &dump : dumps) {
+        const FlightDump::Header &header = *dump.header;
+        printf("dump #%u: %s at ", (unsigned)header.sequence,
+               lookup(flightEventNames, (size_t)FlightEvent::NUM_EVENTS,
+                      (size_t)header.reason));
+        printTime(header.frozenAtMs);
+        printf(", %u records\n", (unsigned)header.recordCount);
+        for (size_t i = 0; i < header.recordCount; i++) {
+            printRecord(header, dump.records[i]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
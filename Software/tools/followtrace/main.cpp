@@ -0,0 +1,341 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "FastAccelStepper.h"
+#include "StrokeEngine.h"
+#include "sil/Rail.h"
+#include "sil/VirtualTime.h"
+#include "utils/StrokeEngineHelper.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Follow Trace
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * How closely StrokeEngine's streaming mode follows a stream of positions,
+ * on the simulated stepper of the software-in-the-loop build.
+ *
+ * Each case sends positions from an input task, the way a remote would, and
+ * samples the input and the carriage every millisecond. For each it reports
+ *  lag        the delay that lines the carriage up best with the input
+ *  rms        what is left of the error once the lag is taken out
+ *  overshoot  how far the carriage went past where the input stopped
+ *  settle     from the input stopping until the carriage is within 0.5 mm
+ * and fails when a case lags or overshoots more than it should.
+ *
+ *  pio run -e followtrace
+ *  .pio/build/followtrace/program
+ *  .pio/build/followtrace/program dump jitter > jitter.csv
+ */
+
+namespace {
+    constexpr uint32_t sampleMicros = 1000;
+    constexpr double caseSeconds = 4;
+    constexpr size_t samplesPerCase = caseSeconds * 1e6 / sampleMicros;
+    // The first second goes to getting there from home.
+    constexpr double steadyFromSeconds = 1.5;
+    constexpr double settledMm = 0.5;
+
+    // The rail StrokeEngine gets from homing, as in OSSM.StrokeEngine.cpp.
+    constexpr float travelMm = 200;
+    constexpr float keepoutMm = 6;
+
+    struct Case {
+        const char *name;
+        // Where the input is at a time, in mm.
+        double (*input)(double seconds);
+        // When the input stops changing, or negative for never.
+        double stopSeconds;
+        // How often it is sent.
+        uint32_t intervalMicros;
+        // Up to how much earlier or later a position is sent, and the share
+        // that is lost on the way.
+        uint32_t jitterMicros;
+        double dropped;
+        // When the stream ends, negative for never.
+        double endSeconds;
+        // How much the case may lag and overshoot.
+        double maxLagMs;
+        double maxOvershootMm;
+    };
+
+    double sine(double seconds, double hz, double amplitude) {
+        return 80 + amplitude * std::sin(2 * M_PI * hz * seconds);
+    }
+
+    const Case cases[] = {
+        {"sine_0.5hz", [](double t) { return sine(t, 0.5, 50); }, -1, 10000,
+         0, 0, -1, 30, 0.5},
+        {"sine_2hz", [](double t) { return sine(t, 2, 30); }, -1, 10000, 0,
+         0, -1, 30, 0.5},
+        {"sine_2hz_200", [](double t) { return sine(t, 2, 30); }, -1, 5000,
+         0, 0, -1, 30, 0.5},
+        // A remote that is slow and unreliable.
+        {"jitter", [](double t) { return sine(t, 1, 40); }, -1, 10000, 4000,
+         0.1, -1, 40, 0.5},
+        // The input jumps and stays there.
+        {"step", [](double t) { return t < 2 ? 40.0 : 140.0; }, 2, 10000, 0,
+         0, -1, -1, 0.5},
+        // At 100 mm/s when the stream breaks off after 1.99 s. The
+        // carriage runs on for as long as a lost position is made up for,
+        // then returns to where it ended.
+        {"cut_off",
+         [](double t) {
+             return t < 1 ? 30.0 : std::min(30 + 100 * (t - 1), 129.0);
+         },
+         1.99, 10000, 0, 0, 2, -1, 4},
+    };
+
+    struct Sample {
+        float input;
+        float position;
+    };
+
+    class Sampler : public sil::Stimulus {
+      public:
+        const Case *current = nullptr;
+        std::vector<Sample> samples;
+
+        void start(uint64_t now) {
+            startMicros = now;
+            next = now;
+        }
+
+        uint64_t nextEventMicros() const override { return next; }
+
+        void fire(uint64_t nowMicros) override {
+            double seconds = (nowMicros - startMicros) * 1e-6;
+            samples.push_back(
+                {float(current->input(seconds)),
+                 float(sil::stepper().getCurrentPosition() /
+                       servoMotor.stepsPerMillimeter)});
+            next = nowMicros + sampleMicros;
+            if (samples.size() == samplesPerCase) {
+                next = sil::never;
+                sil::stop();
+            }
+        }
+
+        uint64_t startMicros = 0;
+
+      private:
+        uint64_t next = sil::never;
+    };
+
+    struct Run {
+        Sampler sampler;
+        StrokeEngine engine;
+        machineGeometry geometry = {.physicalTravel = travelMm,
+                                    .keepoutBoundary = keepoutMm};
+    };
+
+    Run run;
+
+    // Homes, starts streaming and then is the remote.
+    void remoteTask(void *) {
+        FastAccelStepperEngine stepperEngine;
+        FastAccelStepper *stepper = stepperEngine.stepperConnectToPin(
+            Pins::Driver::motorStepPin);
+
+        StrokeEngine &engine = run.engine;
+        engine.begin(&run.geometry, &servoMotor, stepper);
+        engine.thisIsHome();
+        while (stepper->isRunning()) {
+            vTaskDelay(10);
+        }
+        engine.startStreaming();
+
+        const Case &c = *run.sampler.current;
+        srand(1);
+        run.sampler.start(sil::now());
+        for (uint64_t sent = 0;; sent += c.intervalMicros) {
+            double seconds = sent * 1e-6;
+            if (c.endSeconds >= 0 && seconds >= c.endSeconds) {
+                break;
+            }
+            // Taken on time, arrives up to the jitter early or late
+            int64_t spread = c.jitterMicros;
+            int64_t jitter = rand() % (2 * spread + 1) - spread;
+            int64_t arrival =
+                (int64_t)(run.sampler.startMicros + sent) + jitter;
+            int64_t wait = arrival - (int64_t)sil::now();
+            if (wait >= 1000) {
+                vTaskDelay(wait / 1000);
+            }
+            if (rand() < c.dropped * RAND_MAX) {
+                continue;
+            }
+            engine.streamPosition(c.input(seconds));
+        }
+        vTaskSuspend(nullptr);
+    }
+
+    /**
+     * Each case runs in a child process, so it starts from a fresh scheduler
+     * and clock.
+     */
+    bool simulate(const Case &c, std::vector<Sample> &samples) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return false;
+        }
+        fflush(stdout);
+        pid_t child = fork();
+        if (child < 0) {
+            return false;
+        }
+        if (child == 0) {
+            close(fds[0]);
+            run.sampler.current = &c;
+            sil::rail().reset();
+            sil::addStimulus(&run.sampler);
+            xTaskCreatePinnedToCore(remoteTask, "remote", 8192, nullptr, 1,
+                                    nullptr, 1);
+            sil::run(60 * 1000000ULL);
+            const std::vector<Sample> &result = run.sampler.samples;
+            size_t bytes = result.size() * sizeof(Sample);
+            bool ok = write(fds[1], result.data(), bytes) == (ssize_t)bytes;
+            _exit(ok ? 0 : 1);
+        }
+
+        close(fds[1]);
+        samples.clear();
+        Sample buffer[512];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            samples.insert(samples.end(), buffer, buffer + n / sizeof(Sample));
+        }
+        close(fds[0]);
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+               samples.size() == samplesPerCase;
+    }
+
+    struct Result {
+        double lagMs = 0;
+        double rmsMm = 0;
+        double overshootMm = 0;
+        double settleMs = 0;
+    };
+
+    Result measure(const Case &c, const std::vector<Sample> &samples) {
+        Result result;
+        size_t from = steadyFromSeconds * 1e6 / sampleMicros;
+        size_t until = samples.size();
+        if (c.stopSeconds >= 0) {
+            until = std::min(until, size_t(c.stopSeconds * 1e6 / sampleMicros));
+        }
+
+        // The shift of the input that fits the carriage best.
+        double best = INFINITY;
+        for (size_t lag = 0; lag < 200 && lag < from; lag++) {
+            double sum = 0;
+            for (size_t i = from; i < until; i++) {
+                double error = samples[i].position - samples[i - lag].input;
+                sum += error * error;
+            }
+            double rms = std::sqrt(sum / (until - from));
+            if (rms < best) {
+                best = rms;
+                result.lagMs = lag * sampleMicros * 1e-3;
+            }
+        }
+        result.rmsMm = best;
+
+        // Once the input stopped, how far past it and how long to get there.
+        if (c.stopSeconds >= 0) {
+            float final = samples.back().input;
+            float start = samples[until - 1].position;
+            double direction = final >= start ? 1 : -1;
+            result.settleMs = -1;
+            for (size_t i = until; i < samples.size(); i++) {
+                double past = direction * (samples[i].position - final);
+                result.overshootMm = std::max(result.overshootMm, past);
+                bool isSettled =
+                    std::fabs(samples[i].position - final) <= settledMm;
+                if (!isSettled) {
+                    result.settleMs = -1;
+                } else if (result.settleMs < 0) {
+                    result.settleMs = (i - until) * sampleMicros * 1e-3;
+                }
+            }
+        }
+        return result;
+    }
+
+    const Case *find(const std::string &name) {
+        for (const Case &c : cases) {
+            if (name == c.name) {
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    bool report() {
+        bool allPassed = true;
+        printf("%-14s %8s %8s %10s %10s  %s\n", "case", "lag ms", "rms mm",
+               "overshoot", "settle ms", "result");
+        for (const Case &c : cases) {
+            std::vector<Sample> samples;
+            if (!simulate(c, samples)) {
+                fprintf(stderr, "%s: simulation failed\n", c.name);
+                allPassed = false;
+                continue;
+            }
+            Result r = measure(c, samples);
+            bool passed = (c.maxLagMs < 0 || r.lagMs <= c.maxLagMs) &&
+                          r.overshootMm <= c.maxOvershootMm &&
+                          (c.stopSeconds < 0 || r.settleMs >= 0);
+            allPassed = allPassed && passed;
+            printf("%-14s %8.0f %8.2f %10.2f %10.0f  %s\n", c.name, r.lagMs,
+                   r.rmsMm, r.overshootMm, r.settleMs,
+                   passed ? "ok" : "FAILED");
+        }
+        return allPassed;
+    }
+
+    bool dump(const std::string &name) {
+        const Case *c = find(name);
+        std::vector<Sample> samples;
+        if (c == nullptr) {
+            fprintf(stderr, "followtrace: no case %s\n", name.c_str());
+            return false;
+        }
+        if (!simulate(*c, samples)) {
+            fprintf(stderr, "followtrace: simulation failed\n");
+            return false;
+        }
+        printf("seconds,input_mm,position_mm\n");
+        for (size_t i = 0; i < samples.size(); i++) {
+            printf("%.3f,%.2f,%.2f\n", i * sampleMicros * 1e-6,
+                   samples[i].input, samples[i].position);
+        }
+        return true;
+    }
+}
+
+static const char *usage =
+    "usage: followtrace\n"
+    "       followtrace dump <case>\n";
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        return report() ? 0 : 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "dump") == 0) {
+        return dump(argv[2]) ? 0 : 1;
+    }
+    fputs(usage, stderr);
+    return 2;
+}
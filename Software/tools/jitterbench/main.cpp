@@ -0,0 +1,169 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_timer.h>
+
+#include "services/tasks.h"
+#include "utils/JitterStats.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Jitter Bench
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * How late the motion loops wake up in every task layout of
+ * services/tasks.h, with WiFi connected but idle and with WiFi busy.
+ *
+ * A probe task takes the core and priority of a motion task and wakes every
+ * tick for ten seconds, recording how late each wake up came. Under traffic a
+ * second task sends UDP broadcasts as fast as LwIP takes them; flooding the
+ * board from a PC as well, e.g. "iperf -u -c <ossm-ip> -b 20M", adds receive
+ * load.
+ *
+ * Uses the network saved by the WiFi portal. Nothing moves, the motor
+ * outputs are never touched.
+ *
+ *  pio run -e jitterbench -t upload -t monitor
+ */
+
+namespace {
+    constexpr uint32_t wakeUps = 10000;
+    constexpr uint16_t trafficPort = 9;
+
+    struct Probe {
+        const TaskSlot *slot;
+        JitterStats<> stats;
+        TaskHandle_t caller;
+    };
+
+    // The tasks whose loop timing matters.
+    struct MotionTask {
+        const char *name;
+        TaskSlot TaskLayout::*slot;
+    };
+
+    const MotionTask motionTasks[] = {
+        {"simplePenetration", &TaskLayout::simplePenetration},
+        {"stroking", &TaskLayout::stroking},
+        {"homing", &TaskLayout::homing},
+    };
+
+    volatile float sink;
+    volatile bool isTrafficOn = false;
+    volatile uint32_t packetsSent = 0;
+
+    void probeTask(void *pvParameters) {
+        auto *probe = static_cast<Probe *>(pvParameters);
+        const int64_t periodMicros = portTICK_PERIOD_MS * 1000;
+
+        // Start on a tick, every later wake up is measured against it.
+        TickType_t lastWake = xTaskGetTickCount();
+        vTaskDelayUntil(&lastWake, 1);
+        int64_t start = esp_timer_get_time();
+
+        float position = 0;
+        for (uint32_t i = 1; i <= wakeUps; i++) {
+            vTaskDelayUntil(&lastWake, 1);
+            int64_t late = esp_timer_get_time() - start - i * periodMicros;
+            probe->stats.record(late < 0 ? 0 : uint32_t(late));
+
+            // About the float work of one pass of a motion loop.
+            for (int j = 0; j < 50; j++) {
+                position = position * 0.999f + float(j) * 0.5f;
+            }
+        }
+        sink = position;
+
+        xTaskNotifyGive(probe->caller);
+        vTaskDelete(nullptr);
+    }
+
+    void trafficTask(void *pvParameters) {
+        static WiFiUDP udp;
+        static uint8_t payload[1400];
+
+        while (true) {
+            if (!isTrafficOn || WiFiClass::status() != WL_CONNECTED) {
+                vTaskDelay(10);
+                continue;
+            }
+            udp.beginPacket(IPAddress(255, 255, 255, 255), trafficPort);
+            udp.write(payload, sizeof(payload));
+            if (udp.endPacket()) {
+                packetsSent = packetsSent + 1;
+            } else {
+                // LwIP is out of buffers, let it drain.
+                vTaskDelay(1);
+            }
+        }
+    }
+
+    void measure(const TaskLayout &layout, const MotionTask &task,
+                 bool traffic) {
+        static Probe probe;
+        probe.slot = &(layout.*task.slot);
+        probe.stats.reset();
+        probe.caller = xTaskGetCurrentTaskHandle();
+
+        isTrafficOn = traffic;
+        uint32_t packetsBefore = packetsSent;
+        vTaskDelay(500);
+
+        TaskHandle_t handle = nullptr;
+        startTask(probeTask, "jitterProbe", *probe.slot, &probe, &handle);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        isTrafficOn = false;
+        uint32_t packets = packetsSent - packetsBefore;
+        float seconds = wakeUps * portTICK_PERIOD_MS / 1000.0f + 0.5f;
+
+        Serial.printf("%-9s %-18s %4d %4u %-8s %6u %6u %6u %6u %10.0f\n",
+                      layout.name, task.name, (int)probe.slot->core,
+                      (unsigned)probe.slot->priority,
+                      traffic ? "traffic" : "idle",
+                      (unsigned)probe.stats.percentile(50),
+                      (unsigned)probe.stats.percentile(99),
+                      (unsigned)probe.stats.percentile(99.9f),
+                      (unsigned)probe.stats.max(), packets / seconds);
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+
+    WiFi.mode(WIFI_STA);
+    WiFi.begin();
+    for (int i = 0; i < 150 && WiFiClass::status() != WL_CONNECTED; i++) {
+        delay(100);
+    }
+    if (WiFiClass::status() != WL_CONNECTED) {
+        Serial.println("Not connected, set up WiFi with the OSSM firmware "
+                       "first. Measuring without traffic.");
+    } else {
+        Serial.printf("Connected, %s\n", WiFi.localIP().toString().c_str());
+    }
+
+    xTaskCreatePinnedToCore(trafficTask, "jitterTraffic", 4096, nullptr, 1,
+                            nullptr, 0);
+}
+
+void loop() {
+    Serial.println();
+    Serial.println("Wake up lateness in microseconds, "
+                   "over 10 s at one wake up per tick.");
+    Serial.printf("%-9s %-18s %4s %4s %-8s %6s %6s %6s %6s %10s\n", "layout",
+                  "task", "core", "prio", "wifi", "p50", "p99", "p99.9", "max",
+                  "packets/s");
+
+    for (const TaskLayout *layout : TaskLayouts::all) {
+        for (const MotionTask &task : motionTasks) {
+            measure(*layout, task, false);
+            measure(*layout, task, true);
+        }
+    }
+
+    Serial.printf("Built with TASK_LAYOUT=%s\n", taskLayout.name);
+    vTaskDelay(portMAX_DELAY);
+}
@@ -0,0 +1,451 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../patternsweep/Sweep.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Pattern Lab
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Writing a pattern without a machine on the desk. Plays a built-in pattern
+ * or a motion table, see MotionTable.h, on a machine profile the way the
+ * stroking loop would, see tools/patternsweep/Sweep.h, and tells whether it
+ * stays within what StrokeEngine allows that machine: every move the engine
+ * has to slow down plays slower than written. It also finds the fastest
+ * speed the pattern plays as written, and draws the position and velocity
+ * over time as CSV or SVG.
+ *
+ *  pio run -e patternlab
+ *  .pio/build/patternlab/program waves.txt --speed 90 --svg waves.svg
+ *
+ * A table that passes can be exported as the line to paste in the WiFi
+ * portal, where the "Custom" pattern plays it.
+ */
+
+namespace {
+    struct Options {
+        std::string pattern;
+        Sweep::Machine machine = {"default", Config::Driver::defaultProfile};
+        float railMm = 200;
+        float speed = 60;
+        float strokeMm = 100;
+        float depthMm = 150;
+        float sensation = 0;
+        float seconds = 10;
+        std::string csv;
+        std::string svg;
+        bool isExport = false;
+    };
+
+    const char *usage =
+        "usage: patternlab <pattern> [options]\n"
+        "  <pattern>           a pattern id, e.g. simple_stroke, or a motion\n"
+        "                      table file\n"
+        "  --profile <file>    machine profile, key=value lines as in the\n"
+        "                      WiFi portal, the built-in default otherwise\n"
+        "  --rail <mm>         measured rail length, 200 by default\n"
+        "  --speed <spm>       strokes per minute, 60 by default\n"
+        "  --stroke <mm>       100 by default\n"
+        "  --depth <mm>        150 by default\n"
+        "  --sensation <n>     -100 to 100, 0 by default\n"
+        "  --seconds <s>       played, 10 by default\n"
+        "  --csv <file>        position and velocity every millisecond\n"
+        "  --svg <file>        the same, drawn\n"
+        "  --export            print the table as the WiFi portal takes it\n"
+        "Exits with 1 if the pattern does not play as written.\n";
+
+    // Fastest speed looked at for the highest one that plays as written.
+    constexpr float maxSpeed = 600;
+
+    // One look at the trace every this many seconds.
+    constexpr double sampleTime = 0.001;
+
+    bool parse(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            bool isParsed = hasValue;
+            if (arg == "--profile" && hasValue) {
+                std::string error;
+                isParsed =
+                    Sweep::loadProfile(argv[++i], options.machine, error);
+                if (!isParsed) {
+                    fprintf(stderr, "patternlab: %s\n", error.c_str());
+                }
+            } else if (arg == "--rail" && hasValue) {
+                options.railMm = (float)atof(argv[++i]);
+            } else if (arg == "--speed" && hasValue) {
+                options.speed = (float)atof(argv[++i]);
+            } else if (arg == "--stroke" && hasValue) {
+                options.strokeMm = (float)atof(argv[++i]);
+            } else if (arg == "--depth" && hasValue) {
+                options.depthMm = (float)atof(argv[++i]);
+            } else if (arg == "--sensation" && hasValue) {
+                options.sensation = (float)atof(argv[++i]);
+            } else if (arg == "--seconds" && hasValue) {
+                options.seconds = (float)atof(argv[++i]);
+            } else if (arg == "--csv" && hasValue) {
+                options.csv = argv[++i];
+            } else if (arg == "--svg" && hasValue) {
+                options.svg = argv[++i];
+            } else if (arg == "--export") {
+                options.isExport = true;
+                isParsed = true;
+            } else if (arg[0] != '-' && options.pattern.empty()) {
+                options.pattern = arg;
+                isParsed = true;
+            } else {
+                isParsed = false;
+            }
+            if (!isParsed) {
+                return false;
+            }
+        }
+        return !options.pattern.empty() && options.speed > 0 &&
+               options.seconds > 0 && options.railMm > 12;
+    }
+
+    bool readTable(const char *path, MotionTable &table) {
+        FILE *file = fopen(path, "r");
+        if (file == nullptr) {
+            fprintf(stderr, "patternlab: no pattern %s and cannot read it\n",
+                    path);
+            return false;
+        }
+        std::string text;
+        char buffer[256];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            text.append(buffer, n);
+        }
+        fclose(file);
+        if (!table.parse(text.c_str())) {
+            fprintf(stderr,
+                    "patternlab: %s is not a motion table. It needs 2 to %zu "
+                    "keyframes of \"position time [ramp]\", positions and "
+                    "ramps in percent, ramps from %g, times above 0.\n",
+                    path, MotionTable::maxKeyframes,
+                    100 * MotionTable::minRamp);
+            return false;
+        }
+        return true;
+    }
+
+    // The motor at the given time, from the moves it was given.
+    class Playhead {
+      public:
+        explicit Playhead(const std::vector<Sweep::Move> &moves)
+            : _moves(moves) {}
+
+        // Times must not go back.
+        void seek(double time) {
+            while (_next < _moves.size() && _moves[_next].start <= time) {
+                _next++;
+            }
+            _time = time;
+        }
+
+        const Sweep::Move *move() const {
+            return _next == 0 ? nullptr : &_moves[_next - 1];
+        }
+
+        double position() const {
+            const Sweep::Move *m = move();
+            return m == nullptr ? 0 : m->position(_time - m->start);
+        }
+
+        double velocity() const {
+            const Sweep::Move *m = move();
+            return m == nullptr ? 0 : m->velocity(_time - m->start);
+        }
+
+      private:
+        const std::vector<Sweep::Move> &_moves;
+        size_t _next = 0;
+        double _time = 0;
+    };
+
+    bool writeCsv(const std::string &path,
+                  const std::vector<Sweep::Move> &moves,
+                  const Sweep::Limits &limits, double seconds) {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == nullptr) {
+            return false;
+        }
+        fprintf(out, "time_s,position_mm,velocity_mm_s,clipped\n");
+        Playhead playhead(moves);
+        for (long i = 0; i * sampleTime <= seconds; i++) {
+            playhead.seek(i * sampleTime);
+            const Sweep::Move *move = playhead.move();
+            fprintf(out, "%.3f,%.3f,%.2f,%d\n", i * sampleTime,
+                    playhead.position() / limits.stepsPerMm,
+                    playhead.velocity() / limits.stepsPerMm,
+                    move != nullptr && move->isClipped);
+        }
+        fclose(out);
+        return true;
+    }
+
+    /**
+     * Position above velocity, over the same time. Dashed lines are the
+     * ends of the rail and the speed limit, red bands the moves StrokeEngine
+     * slowed down.
+     */
+    bool writeSvg(const std::string &path,
+                  const std::vector<Sweep::Move> &moves,
+                  const Sweep::Limits &limits, double seconds,
+                  const char *title) {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == nullptr) {
+            return false;
+        }
+        constexpr double width = 1000, plotHeight = 200, left = 60,
+                         top = 30, gap = 40;
+        const double plotWidth = width - left - 20;
+        const double railMm = limits.maxStep / limits.stepsPerMm;
+        const double speedMm = limits.maxStepPerSecond / limits.stepsPerMm;
+        const double velocityRange = speedMm * 1.1;
+        const double velocityTop = top + plotHeight + gap;
+
+        auto x = [&](double t) { return left + plotWidth * t / seconds; };
+        auto yPosition = [&](double mm) {
+            return top + plotHeight * (1 - mm / railMm);
+        };
+        auto yVelocity = [&](double mmPerSecond) {
+            return velocityTop +
+                   plotHeight * (0.5 - 0.5 * mmPerSecond / velocityRange);
+        };
+
+        fprintf(out,
+                "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.0f\" "
+                "height=\"%.0f\" font-family=\"sans-serif\" "
+                "font-size=\"12\">\n",
+                width, velocityTop + plotHeight + 30);
+        fprintf(out,
+                "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+        fprintf(out, "<text x=\"%.0f\" y=\"18\">%s</text>\n", left, title);
+
+        for (const Sweep::Move &move : moves) {
+            if (!move.isClipped || move.start > seconds) {
+                continue;
+            }
+            double end = std::min(seconds, move.start + move.duration());
+            fprintf(out,
+                    "<rect x=\"%.1f\" y=\"%.0f\" width=\"%.1f\" "
+                    "height=\"%.0f\" fill=\"#fdd\"/>\n",
+                    x(move.start), velocityTop, x(end) - x(move.start),
+                    plotHeight);
+        }
+
+        // Frames, limits and labels.
+        for (double y0 : {top, velocityTop}) {
+            fprintf(out,
+                    "<rect x=\"%.0f\" y=\"%.0f\" width=\"%.0f\" "
+                    "height=\"%.0f\" fill=\"none\" stroke=\"#999\"/>\n",
+                    left, y0, plotWidth, plotHeight);
+        }
+        auto limit = [&](double y, const char *label) {
+            fprintf(out,
+                    "<line x1=\"%.0f\" x2=\"%.0f\" y1=\"%.1f\" y2=\"%.1f\" "
+                    "stroke=\"#c00\" stroke-dasharray=\"6,4\"/>\n"
+                    "<text x=\"4\" y=\"%.1f\">%s</text>\n",
+                    left, left + plotWidth, y, y, y + 4, label);
+        };
+        char label[32];
+        snprintf(label, sizeof(label), "%.0f mm", railMm);
+        limit(yPosition(railMm), label);
+        limit(yPosition(0), "0 mm");
+        snprintf(label, sizeof(label), "%.0f mm/s", speedMm);
+        limit(yVelocity(speedMm), label);
+        snprintf(label, sizeof(label), "-%.0f", speedMm);
+        limit(yVelocity(-speedMm), label);
+        fprintf(out,
+                "<text x=\"%.0f\" y=\"%.0f\" text-anchor=\"end\">%.1f s"
+                "</text>\n",
+                left + plotWidth, velocityTop + plotHeight + 18, seconds);
+
+        // One point per pixel is as fine as it can be drawn.
+        auto plot = [&](bool isVelocity, const char *colour) {
+            fprintf(out,
+                    "<polyline fill=\"none\" stroke=\"%s\" "
+                    "stroke-width=\"1.5\" points=\"",
+                    colour);
+            Playhead playhead(moves);
+            const int points = int(plotWidth);
+            for (int i = 0; i <= points; i++) {
+                double t = seconds * i / points;
+                playhead.seek(t);
+                double y =
+                    isVelocity
+                        ? yVelocity(playhead.velocity() / limits.stepsPerMm)
+                        : yPosition(playhead.position() / limits.stepsPerMm);
+                fprintf(out, "%.1f,%.1f ", x(t), y);
+            }
+            fprintf(out, "\"/>\n");
+        };
+        plot(false, "#06c");
+        plot(true, "#080");
+        fprintf(out, "</svg>\n");
+        fclose(out);
+        return true;
+    }
+
+    /**
+     * Moves StrokeEngine slowed down, but for the first. That one comes
+     * from wherever homing left the carriage, every pattern starts so.
+     */
+    uint32_t countClipped(const std::vector<Sweep::Move> &moves) {
+        uint32_t clipped = 0;
+        for (size_t i = 1; i < moves.size(); i++) {
+            clipped += moves[i].isClipped;
+        }
+        return clipped;
+    }
+
+    /**
+     * The highest speed, in strokes per minute, at which StrokeEngine
+     * slows no move down. 0 if it clips at any speed.
+     */
+    float cleanSpeed(const std::function<Pattern *()> &make,
+                     const Sweep::Limits &limits, Sweep::Case c,
+                     float seconds) {
+        std::vector<Sweep::Move> moves;
+        auto isClean = [&](float speed) {
+            std::unique_ptr<Pattern> pattern(make());
+            c.speed = speed;
+            moves.clear();
+            Sweep::simulate(*pattern, limits, c, seconds, &moves);
+            return countClipped(moves) == 0;
+        };
+        if (isClean(maxSpeed)) {
+            return maxSpeed;
+        }
+        float low = 0, high = maxSpeed;
+        while (high - low > 0.5f) {
+            float middle = 0.5f * (low + high);
+            (isClean(middle) ? low : high) = middle;
+        }
+        return std::floor(low);
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    std::function<Pattern *()> make;
+    std::string description;
+    MotionTable table;
+    bool isTable = true;
+    for (size_t i = 0; i < Sweep::patternCount; i++) {
+        if (options.pattern == Sweep::patterns[i].id) {
+            make = Sweep::patterns[i].make;
+            description = "built-in";
+            isTable = false;
+        }
+    }
+    if (isTable) {
+        if (!readTable(options.pattern.c_str(), table)) {
+            return 2;
+        }
+        make = [&table] { return new TableStroke("Custom", table); };
+        description = std::to_string(table.count) + " keyframes";
+    } else if (options.isExport) {
+        fprintf(stderr, "patternlab: %s is built in, only tables export\n",
+                options.pattern.c_str());
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Sweep::Limits limits(options.machine.profile, options.railMm);
+    Sweep::Case c = {0,
+                     0,
+                     options.speed,
+                     options.strokeMm,
+                     options.depthMm,
+                     options.sensation};
+    std::vector<Sweep::Move> moves;
+    std::unique_ptr<Pattern> pattern(make());
+    Sweep::Result result =
+        Sweep::simulate(*pattern, limits, c, options.seconds, &moves);
+    float clean = cleanSpeed(make, limits, c, options.seconds);
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    uint32_t clipped = countClipped(moves);
+    // A table plays one keyframe a move, and a loop of it is a stroke.
+    float strokesPerMinute =
+        isTable ? float(result.moves / table.count) * 60 / options.seconds
+                : result.strokesPerMinute;
+    const float railMm = limits.maxStep / limits.stepsPerMm;
+    printf("pattern   %s, %s\n", options.pattern.c_str(),
+           description.c_str());
+    printf("machine   %s, %.0f mm of travel\n",
+           options.machine.name.c_str(), railMm);
+    printf("setting   %g spm, stroke %g mm, depth %g mm, sensation %g\n",
+           options.speed, options.strokeMm, options.depthMm,
+           options.sensation);
+    if (options.depthMm > railMm) {
+        printf("warning   depth is past the end of travel, played at %.0f "
+               "mm\n",
+               railMm);
+    }
+    printf("played    %.1f spm, %u moves in %g s\n", strokesPerMinute,
+           result.moves, options.seconds);
+    printf("speed     peak %.0f of %.0f mm/s\n", result.peakSpeed,
+           limits.maxStepPerSecond / limits.stepsPerMm);
+    printf("accel     peak %.0f of %.0f mm/s2\n", result.peakAcceleration,
+           limits.maxStepAcceleration / limits.stepsPerMm);
+    printf("clipped   %u of %u moves\n", clipped, result.moves);
+    if (!moves.empty() && moves[0].isClipped) {
+        printf("note      the first move, from home, is slowed down\n");
+    }
+    if (clean >= maxSpeed) {
+        printf("clean     up to %.0f spm and beyond\n", maxSpeed);
+    } else if (clean > 0) {
+        printf("clean     up to %.0f spm\n", clean);
+    } else {
+        printf("clean     at no speed\n");
+    }
+    printf("preview   %.2f ms\n", elapsed * 1e3);
+
+    if (!options.csv.empty() &&
+        !writeCsv(options.csv, moves, limits, options.seconds)) {
+        fprintf(stderr, "patternlab: cannot write %s\n", options.csv.c_str());
+        return 2;
+    }
+    if (!options.svg.empty() &&
+        !writeSvg(options.svg, moves, limits, options.seconds,
+                  options.pattern.c_str())) {
+        fprintf(stderr, "patternlab: cannot write %s\n", options.svg.c_str());
+        return 2;
+    }
+
+    if (clipped > 0) {
+        printf("EXCEEDS   the machine's limits, %u moves play slower than "
+               "written\n",
+               clipped);
+        return 1;
+    }
+    printf("ok\n");
+    if (options.isExport) {
+        char text[MotionTable::formatLength + 1];
+        table.format(text, sizeof(text));
+        printf("%s\n", text);
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include <cstring>
+
+#include "Sweep.h"
+
+/** ////  What the patterns link against  //// */
+
+thread_local uint64_t Sweep::clockMicros = 0;
+
+unsigned long millis() { return (unsigned long)(Sweep::clockMicros / 1000); }
+unsigned long micros() { return (unsigned long)Sweep::clockMicros; }
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// The patterns' debug prints, dropped.
+HardwareSerial Serial;
+size_t HardwareSerial::write(const char *str) { return strlen(str); }
+size_t HardwareSerial::printf(const char *, ...) { return 0; }
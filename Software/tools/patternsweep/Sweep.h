@@ -0,0 +1,325 @@
+#ifndef OSSM_TOOLS_PATTERNSWEEP_SWEEP_H
+#define OSSM_TOOLS_PATTERNSWEEP_SWEEP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "utils/StrokeEngineHelper.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Pattern Sweep
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * One pattern at one setting on one machine, played for a while the way
+ * StrokeEngine plays it, and what came out.
+ *
+ * Instead of stepping a simulated motor, every move is solved as the
+ * trapezoid FastAccelStepper drives: the stroking loop looks at the motor
+ * every 10 ms, and once it stopped asks the pattern for the next target and
+ * applies StrokeEngine's limits. Each case has its own clock, the millis()
+ * the patterns see, so cases run on any thread in any order and always give
+ * the same result.
+ */
+namespace Sweep {
+    // The clock of the case running on this thread, read by millis().
+    extern thread_local uint64_t clockMicros;
+
+    // The stroking loop delays 10 ms between two looks at the motor.
+    constexpr uint64_t loopMicros = 10000;
+
+    struct Machine {
+        std::string name;
+        MachineProfile profile;
+    };
+
+    struct Case {
+        size_t pattern;
+        size_t machine;
+        // Strokes per minute, as the speed knob sets it.
+        float speed;
+        float strokeMm;
+        float depthMm;
+        float sensation;
+    };
+
+    // A built-in pattern, as the menu offers it.
+    struct PatternInfo {
+        const char *id;
+        Pattern *(*make)();
+    };
+
+    template <class P>
+    Pattern *make(const char *name) {
+        return new P(name);
+    }
+
+    // The built-in patterns of OSSM.StrokeEngine.cpp, in menu order. Custom
+    // plays a motion table, the tool that loads one makes it. Human Touch
+    // has a fixed seed, so a sweep gives the same results every run.
+    inline const PatternInfo patterns[] = {
+        {"simple_stroke", [] { return make<SimpleStroke>("Simple Stroke"); }},
+        {"teasing_pounding",
+         [] { return make<TeasingPounding>("Teasing Pounding"); }},
+        {"robo_stroke", [] { return make<RoboStroke>("Robo Stroke"); }},
+        {"half_n_half", [] { return make<HalfnHalf>("Half'n'Half"); }},
+        {"deeper", [] { return make<Deeper>("Deeper"); }},
+        {"stop_n_go", [] { return make<StopNGo>("Stop'n'Go"); }},
+        {"insist", [] { return make<Insist>("Insist"); }},
+        {"human_touch",
+         []() -> Pattern * {
+             return new Humanized<TeasingPounding>("Human Touch", 1);
+         }},
+    };
+    constexpr size_t patternCount = sizeof(patterns) / sizeof(patterns[0]);
+
+    struct Result {
+        // In and out pairs per minute that were played.
+        float strokesPerMinute = 0;
+        // Moves StrokeEngine had to slow down, of all moves.
+        float clipRatio = 0;
+        float peakSpeed = 0;
+        float peakAcceleration = 0;
+        // Time the motor moves, and the part of it at full torque, speeding
+        // up or braking. Both of the whole run.
+        float duty = 0;
+        float torqueDuty = 0;
+        uint32_t moves = 0;
+    };
+
+    // One move as the motor drives it, in steps and seconds.
+    struct Move {
+        double start;
+        double from;
+        double to;
+        // Reached at the end of the ramp, lower than asked on a short move.
+        double peakSpeed;
+        double acceleration;
+        double rampTime;
+        double cruiseTime;
+        bool isClipped;
+
+        double duration() const { return 2 * rampTime + cruiseTime; }
+
+        // Where the motor is, t seconds into the move.
+        double position(double t) const {
+            double direction = to < from ? -1 : 1;
+            double brake = 2 * rampTime + cruiseTime - t;
+            double travelled;
+            if (t <= 0) {
+                travelled = 0;
+            } else if (t < rampTime) {
+                travelled = 0.5 * acceleration * t * t;
+            } else if (brake > rampTime) {
+                travelled = peakSpeed * (t - 0.5 * rampTime);
+            } else if (brake > 0) {
+                travelled = std::fabs(to - from) -
+                            0.5 * acceleration * brake * brake;
+            } else {
+                travelled = std::fabs(to - from);
+            }
+            return from + direction * travelled;
+        }
+
+        double velocity(double t) const {
+            double direction = to < from ? -1 : 1;
+            double brake = 2 * rampTime + cruiseTime - t;
+            if (t <= 0 || brake <= 0) {
+                return 0;
+            }
+            return direction *
+                   std::min(peakSpeed, acceleration * std::min(t, brake));
+        }
+    };
+
+    /**
+     * StrokeEngine's limits on a machine, derived the way
+     * StrokeEngine::begin() does from what OSSM.StrokeEngine.cpp passes it.
+     */
+    struct Limits {
+        float stepsPerMm;
+        int maxStep;
+        int maxStepPerSecond;
+        int maxStepAcceleration;
+
+        Limits(const MachineProfile &profile, float railMm) {
+            motorProperties motor = servoMotorFor(MachineKinematics(profile));
+            constexpr float keepoutMm = 6;
+            stepsPerMm = motor.stepsPerMillimeter;
+            maxStep = int(0.5f + (railMm - 2 * keepoutMm) * stepsPerMm);
+            maxStepPerSecond = int(0.5f + motor.maxSpeed * stepsPerMm);
+            maxStepAcceleration =
+                int(0.5f + motor.maxAcceleration * stepsPerMm);
+        }
+    };
+
+    /**
+     * Reads a machine profile from key=value lines, as in the WiFi portal.
+     * Starts from the default, so a file only needs what differs.
+     */
+    inline bool loadProfile(const char *path, Machine &machine,
+                            std::string &error) {
+        FILE *file = fopen(path, "r");
+        if (file == nullptr) {
+            error = std::string("cannot read ") + path;
+            return false;
+        }
+        machine.profile = Config::Driver::defaultProfile;
+        std::string name = path;
+        size_t slash = name.find_last_of('/');
+        machine.name =
+            slash == std::string::npos ? name : name.substr(slash + 1);
+
+        char line[128];
+        bool isParsed = true;
+        while (isParsed && fgets(line, sizeof(line), file) != nullptr) {
+            line[strcspn(line, "\r\n")] = '\0';
+            char *equals = strchr(line, '=');
+            if (line[0] == '\0' || line[0] == '#') {
+                continue;
+            }
+            isParsed = false;
+            for (size_t i = 0; equals != nullptr &&
+                               i < MachineProfileText::fieldCount;
+                 i++) {
+                *equals = '\0';
+                if (strcmp(line, MachineProfileText::fields[i].key) == 0) {
+                    isParsed = MachineProfileText::parse(machine.profile, i,
+                                                         equals + 1);
+                }
+                *equals = '=';
+            }
+            if (!isParsed) {
+                error = std::string(path) + ": cannot read \"" + line + "\"";
+            }
+        }
+        fclose(file);
+        if (isParsed && !machine.profile.isValid()) {
+            error = std::string(path) + " is not a machine that can run";
+            return false;
+        }
+        return isParsed;
+    }
+
+    /**
+     * Plays a pattern from the home position.
+     * @param pattern a fresh instance, it keeps state between strokes.
+     * @param moves if given, gets every move that starts before the end.
+     */
+    inline Result simulate(Pattern &pattern, const Limits &limits,
+                           const Case &c, float seconds,
+                           std::vector<Move> *moves = nullptr) {
+        // StrokeEngine's setters and setPattern().
+        auto steps = [&](float mm) {
+            return constrain(int(mm * limits.stepsPerMm), 0, limits.maxStep);
+        };
+        clockMicros = 0;
+        pattern.setSpeedLimit(limits.maxStepPerSecond,
+                              limits.maxStepAcceleration,
+                              (unsigned int)limits.stepsPerMm);
+        pattern.setTimeOfStroke(constrain(60.0f / c.speed, 0.01f, 120.0f));
+        pattern.setStroke(steps(c.strokeMm));
+        pattern.setDepth(steps(c.depthMm));
+        pattern.setSensation(constrain(c.sensation, -100.0f, 100.0f));
+
+        // The motor as thisIsHome() leaves it. FastAccelStepper keeps the
+        // last speed and acceleration when given a zero.
+        double position = 0;
+        double speedHz = 5 * limits.stepsPerMm;
+        double acceleration = limits.maxStepAcceleration / 10;
+
+        const auto end = uint64_t(double(seconds) * 1e6);
+        uint64_t moveEnd = 0;
+        int index = -1;
+        uint32_t clips = 0, strokes = 0;
+        double movingMicros = 0, torqueMicros = 0;
+        Result result;
+
+        while (clockMicros < end) {
+            if (clockMicros >= moveEnd) {
+                index++;
+                motionParameter motion = pattern.nextTarget(index);
+                if (motion.skip) {
+                    index--;
+                } else {
+                    // StrokeEngine::_applyMotionProfile()
+                    bool clipping = false;
+                    if (motion.speed > limits.maxStepPerSecond) {
+                        motion.speed = limits.maxStepPerSecond;
+                        clipping = true;
+                    }
+                    if (motion.acceleration > limits.maxStepAcceleration) {
+                        motion.acceleration = limits.maxStepAcceleration;
+                        clipping = true;
+                    }
+                    if (motion.speed > 0) {
+                        speedHz = motion.speed;
+                    }
+                    if (motion.acceleration > 0) {
+                        acceleration = motion.acceleration;
+                    }
+                    int target = constrain(motion.stroke, 0, limits.maxStep);
+                    result.moves++;
+                    clips += clipping;
+
+                    // A trapezoid, or a triangle if it is too short to
+                    // reach full speed.
+                    double distance = std::fabs(target - position);
+                    double peak = std::min(speedHz,
+                                           std::sqrt(distance * acceleration));
+                    double rampMicros = 2e6 * peak / acceleration;
+                    double cruiseMicros =
+                        distance == 0
+                            ? 0
+                            : 1e6 * (distance - peak * peak / acceleration) /
+                                  peak;
+                    double moveMicros = rampMicros + cruiseMicros;
+                    if (moves != nullptr) {
+                        moves->push_back({clockMicros * 1e-6, position,
+                                          double(target), peak, acceleration,
+                                          rampMicros * 0.5e-6,
+                                          cruiseMicros * 1e-6, clipping});
+                    }
+                    position = target;
+                    moveEnd = clockMicros + uint64_t(moveMicros);
+
+                    // Only what happens before the end counts.
+                    double kept = std::min<double>(moveMicros,
+                                                   double(end - clockMicros));
+                    movingMicros += kept;
+                    torqueMicros += std::min(rampMicros, kept);
+                    if (distance > 0) {
+                        // A move that goes nowhere, like Insist at full
+                        // sensation, is no stroke.
+                        strokes++;
+                        result.peakSpeed = std::max(
+                            result.peakSpeed, float(peak / limits.stepsPerMm));
+                        result.peakAcceleration =
+                            std::max(result.peakAcceleration,
+                                     float(acceleration / limits.stepsPerMm));
+                    }
+                }
+            }
+            // Sleep a loop, or through the move to the first look after it.
+            uint64_t wake =
+                (moveEnd + loopMicros - 1) / loopMicros * loopMicros;
+            clockMicros = std::max(clockMicros + loopMicros, wake);
+        }
+
+        // Every in and out pair is one stroke, as in OSSM.StrokeEngine.cpp.
+        result.strokesPerMinute = float(strokes / 2) * 60 / seconds;
+        result.clipRatio = result.moves == 0 ? 0 : float(clips) / result.moves;
+        result.duty = float(movingMicros / double(end));
+        result.torqueDuty = float(torqueMicros / double(end));
+        return result;
+    }
+}
+
+#endif  // OSSM_TOOLS_PATTERNSWEEP_SWEEP_H
@@ -0,0 +1,112 @@
+#ifndef OSSM_TOOLS_PATTERNSWEEP_WORKSTEALINGPOOL_H
+#define OSSM_TOOLS_PATTERNSWEEP_WORKSTEALINGPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs job(i) for every i of [0, count) on a number of threads.
+ *
+ * Every worker starts with an equal slice of the range and takes a few
+ * indexes at a time from its front. A worker that runs dry steals the back
+ * half of what is left in another worker's slice, so a slice full of slow
+ * cases gets shared instead of holding everyone up. A worker only touches
+ * other slices when it is out of work, so with cases of a millisecond or
+ * more the locks cost nothing.
+ */
+class WorkStealingPool {
+  public:
+    template <class Job>
+    static void run(size_t count, unsigned threads, const Job &job) {
+        threads = std::max(1u, threads);
+        std::vector<Slice> slices(threads);
+        for (unsigned i = 0; i < threads; i++) {
+            slices[i].begin = count * i / threads;
+            slices[i].end = count * (i + 1) / threads;
+        }
+
+        auto work = [&](unsigned self) {
+            std::minstd_rand random(self + 1);
+            size_t begin, end;
+            while (true) {
+                if (take(slices[self], begin, end)) {
+                    for (size_t i = begin; i < end; i++) {
+                        job(i);
+                    }
+                } else if (!steal(slices, self, random)) {
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads; i++) {
+            workers.emplace_back(work, i);
+        }
+        work(0);
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+  private:
+    // Indexes taken at a time from a worker's own slice.
+    static constexpr size_t batch = 4;
+
+    // Apart, so two workers' slices never share a cache line.
+    struct alignas(64) Slice {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    static bool take(Slice &slice, size_t &begin, size_t &end) {
+        std::lock_guard<std::mutex> lock(slice.mutex);
+        if (slice.begin == slice.end) {
+            return false;
+        }
+        begin = slice.begin;
+        end = std::min(slice.end, begin + batch);
+        slice.begin = end;
+        return true;
+    }
+
+    /**
+     * Moves the back half of a busy slice into our own.
+     * @return false once every slice is empty.
+     */
+    static bool steal(std::vector<Slice> &slices, unsigned self,
+                      std::minstd_rand &random) {
+        size_t n = slices.size();
+        size_t first = random() % n;
+        for (size_t k = 0; k < n; k++) {
+            size_t victim = (first + k) % n;
+            if (victim == self) {
+                continue;
+            }
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(slices[victim].mutex);
+                size_t left = slices[victim].end - slices[victim].begin;
+                if (left == 0) {
+                    continue;
+                }
+                end = slices[victim].end;
+                begin = end - (left + 1) / 2;
+                slices[victim].end = begin;
+            }
+            std::lock_guard<std::mutex> lock(slices[self].mutex);
+            slices[self].begin = begin;
+            slices[self].end = end;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif  // OSSM_TOOLS_PATTERNSWEEP_WORKSTEALINGPOOL_H
@@ -0,0 +1,262 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Sweep.h"
+#include "WorkStealingPool.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Pattern Sweep
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Every StrokeEngine pattern across a grid of speeds, strokes, depths,
+ * sensations and machine profiles, on all cores. Each case plays for a
+ * while, see Sweep.h, and becomes one row of a CSV with the achieved
+ * strokes per minute, how many moves were clipped, peak speed and
+ * acceleration and how busy the motor was.
+ *
+ *  pio run -e patternsweep
+ *  .pio/build/patternsweep/program --speeds 10:300:10 --out sweep.csv
+ *
+ * Rows come out in grid order whatever the number of threads, so two
+ * sweeps can be diffed.
+ */
+
+namespace {
+    using Sweep::patternCount;
+    using Sweep::patterns;
+
+    struct Options {
+        std::vector<size_t> patterns;
+        std::vector<float> speeds;
+        std::vector<float> strokes;
+        std::vector<float> depths;
+        std::vector<float> sensations;
+        std::vector<Sweep::Machine> machines;
+        float railMm = 200;
+        float seconds = 60;
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        std::string out;
+    };
+
+    const char *usage =
+        "usage: patternsweep [options]\n"
+        "  --patterns <a,b,..>     pattern ids, all by default\n"
+        "  --speeds <from:to:step> strokes per minute, 20:240:20 by default\n"
+        "  --strokes <list>        mm, 40:160:40 by default\n"
+        "  --depths <list>         mm, 120,180 by default\n"
+        "  --sensations <list>     -100:100:50 by default\n"
+        "  --profile <file>        machine profile, key=value lines as in the\n"
+        "                          WiFi portal; repeat for more, the\n"
+        "                          built-in default otherwise\n"
+        "  --rail <mm>             measured rail length, 200 by default\n"
+        "  --seconds <s>           played per case, 60 by default\n"
+        "  --threads <n>           all cores by default\n"
+        "  --out <file>            CSV, stdout by default\n"
+        "A list is \"a,b,c\" or \"from:to:step\".\n";
+
+    bool parseList(const char *text, std::vector<float> &values) {
+        values.clear();
+        float from, to, step;
+        char extra;
+        if (sscanf(text, "%f:%f:%f%c", &from, &to, &step, &extra) == 3) {
+            if (step <= 0 || to < from) {
+                return false;
+            }
+            for (int i = 0; from + i * step <= to + step * 1e-3f; i++) {
+                values.push_back(from + i * step);
+            }
+            return true;
+        }
+        std::string list = text;
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t comma = list.find(',', start);
+            std::string item = list.substr(start, comma - start);
+            char *end;
+            float value = strtof(item.c_str(), &end);
+            if (item.empty() || *end != '\0') {
+                return false;
+            }
+            values.push_back(value);
+            if (comma == std::string::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
+        return !values.empty();
+    }
+
+    bool parsePatterns(const char *text, std::vector<size_t> &selected) {
+        std::string list = std::string(text) + ",";
+        size_t start = 0, comma;
+        while ((comma = list.find(',', start)) != std::string::npos) {
+            std::string id = list.substr(start, comma - start);
+            size_t i = 0;
+            while (i < patternCount && id != patterns[i].id) {
+                i++;
+            }
+            if (i == patternCount) {
+                fprintf(stderr, "patternsweep: no pattern %s\n", id.c_str());
+                return false;
+            }
+            selected.push_back(i);
+            start = comma + 1;
+        }
+        return true;
+    }
+
+    bool parse(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            bool isParsed = hasValue;
+            if (arg == "--patterns" && hasValue) {
+                isParsed = parsePatterns(argv[++i], options.patterns);
+            } else if (arg == "--speeds" && hasValue) {
+                isParsed = parseList(argv[++i], options.speeds);
+            } else if (arg == "--strokes" && hasValue) {
+                isParsed = parseList(argv[++i], options.strokes);
+            } else if (arg == "--depths" && hasValue) {
+                isParsed = parseList(argv[++i], options.depths);
+            } else if (arg == "--sensations" && hasValue) {
+                isParsed = parseList(argv[++i], options.sensations);
+            } else if (arg == "--profile" && hasValue) {
+                Sweep::Machine machine;
+                std::string error;
+                isParsed = Sweep::loadProfile(argv[++i], machine, error);
+                if (!isParsed) {
+                    fprintf(stderr, "patternsweep: %s\n", error.c_str());
+                }
+                options.machines.push_back(machine);
+            } else if (arg == "--rail" && hasValue) {
+                options.railMm = (float)atof(argv[++i]);
+            } else if (arg == "--seconds" && hasValue) {
+                options.seconds = (float)atof(argv[++i]);
+            } else if (arg == "--threads" && hasValue) {
+                options.threads = (unsigned)atoi(argv[++i]);
+            } else if (arg == "--out" && hasValue) {
+                options.out = argv[++i];
+            } else {
+                isParsed = false;
+            }
+            if (!isParsed) {
+                return false;
+            }
+        }
+
+        if (options.patterns.empty()) {
+            for (size_t i = 0; i < patternCount; i++) {
+                options.patterns.push_back(i);
+            }
+        }
+        if (options.speeds.empty()) {
+            parseList("20:240:20", options.speeds);
+        }
+        if (options.strokes.empty()) {
+            parseList("40:160:40", options.strokes);
+        }
+        if (options.depths.empty()) {
+            parseList("120,180", options.depths);
+        }
+        if (options.sensations.empty()) {
+            parseList("-100:100:50", options.sensations);
+        }
+        if (options.machines.empty()) {
+            options.machines.push_back(
+                {"default", Config::Driver::defaultProfile});
+        }
+        return options.seconds > 0 && options.railMm > 12 &&
+               options.threads > 0;
+    }
+
+    // Machine, pattern, speed, stroke, depth, sensation, the last changes
+    // fastest.
+    std::vector<Sweep::Case> grid(const Options &options) {
+        std::vector<Sweep::Case> cases;
+        for (size_t machine = 0; machine < options.machines.size(); machine++) {
+            for (size_t pattern : options.patterns) {
+                for (float speed : options.speeds) {
+                    for (float stroke : options.strokes) {
+                        for (float depth : options.depths) {
+                            for (float sensation : options.sensations) {
+                                cases.push_back({pattern, machine, speed,
+                                                 stroke, depth, sensation});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return cases;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    FILE *out = stdout;
+    if (!options.out.empty()) {
+        out = fopen(options.out.c_str(), "w");
+        if (out == nullptr) {
+            fprintf(stderr, "patternsweep: cannot write %s\n",
+                    options.out.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<Sweep::Limits> limits;
+    for (const Sweep::Machine &machine : options.machines) {
+        limits.emplace_back(machine.profile, options.railMm);
+    }
+    std::vector<Sweep::Case> cases = grid(options);
+    std::vector<Sweep::Result> results(cases.size());
+
+    auto start = std::chrono::steady_clock::now();
+    WorkStealingPool::run(cases.size(), options.threads, [&](size_t i) {
+        const Sweep::Case &c = cases[i];
+        std::unique_ptr<Pattern> pattern(patterns[c.pattern].make());
+        results[i] = Sweep::simulate(*pattern, limits[c.machine], c,
+                                     options.seconds);
+    });
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    fprintf(out,
+            "pattern,machine,speed,stroke_mm,depth_mm,sensation,spm,"
+            "clip_ratio,peak_speed_mm_s,peak_accel_mm_s2,duty,torque_duty,"
+            "moves\n");
+    for (size_t i = 0; i < cases.size(); i++) {
+        const Sweep::Case &c = cases[i];
+        const Sweep::Result &r = results[i];
+        fprintf(out, "%s,%s,%g,%g,%g,%g,%.2f,%.4f,%.1f,%.0f,%.4f,%.4f,%u\n",
+                patterns[c.pattern].id,
+                options.machines[c.machine].name.c_str(), c.speed, c.strokeMm,
+                c.depthMm, c.sensation, r.strokesPerMinute, r.clipRatio,
+                r.peakSpeed, r.peakAcceleration, r.duty, r.torqueDuty,
+                r.moves);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr,
+            "patternsweep: %zu cases of %g s on %u threads in %.2f s, %.0f "
+            "cases/s\n",
+            cases.size(), options.seconds, options.threads, elapsed,
+            cases.size() / elapsed);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#ifndef OSSM_TOOLS_PATTERNTRACE_TRACE_H
+#define OSSM_TOOLS_PATTERNTRACE_TRACE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Pattern Trace
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Position over time of one pattern across a grid of settings, one file per
+ * pattern. All values are little endian.
+ *
+ *  "OSTR" | u16 version | u16 case count | u32 sample micros | f32 steps/mm
+ *  per case:
+ *    f32 speed (strokes/min) | f32 depth mm | f32 stroke mm | f32 sensation
+ *    u32 samples | i32 first position | zigzag varint deltas, in steps
+ *
+ * Between two 5 ms samples the carriage moves less than 100 steps, so most
+ * samples take one or two bytes.
+ */
+namespace Trace {
+    static constexpr char magic[4] = {'O', 'S', 'T', 'R'};
+    static constexpr uint16_t version = 1;
+
+    struct Settings {
+        float speed;
+        float depthMm;
+        float strokeMm;
+        float sensation;
+    };
+
+    struct Case {
+        Settings settings;
+        std::vector<int32_t> positions;
+    };
+
+    struct File {
+        uint32_t sampleMicros = 0;
+        float stepsPerMm = 0;
+        std::vector<Case> cases;
+    };
+
+    class Writer {
+      public:
+        void u16(uint16_t v) { raw(&v, 2); }
+        void u32(uint32_t v) { raw(&v, 4); }
+        void f32(float v) { raw(&v, 4); }
+
+        void varint(uint32_t v) {
+            while (v >= 0x80) {
+                bytes.push_back((uint8_t)(v | 0x80));
+                v >>= 7;
+            }
+            bytes.push_back((uint8_t)v);
+        }
+
+        void raw(const void *data, size_t size) {
+            auto *p = (const uint8_t *)data;
+            bytes.insert(bytes.end(), p, p + size);
+        }
+
+        std::vector<uint8_t> bytes;
+    };
+
+    class Reader {
+      public:
+        explicit Reader(const std::vector<uint8_t> &bytes) : bytes(bytes) {}
+
+        bool u16(uint16_t &v) { return raw(&v, 2); }
+        bool u32(uint32_t &v) { return raw(&v, 4); }
+        bool f32(float &v) { return raw(&v, 4); }
+
+        bool varint(uint32_t &v) {
+            v = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                if (at >= bytes.size()) {
+                    return false;
+                }
+                uint8_t byte = bytes[at++];
+                v |= (uint32_t)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool raw(void *data, size_t size) {
+            if (bytes.size() - at < size) {
+                return false;
+            }
+            std::copy(bytes.begin() + at, bytes.begin() + at + size,
+                      (uint8_t *)data);
+            at += size;
+            return true;
+        }
+
+        bool done() const { return at == bytes.size(); }
+
+      private:
+        const std::vector<uint8_t> &bytes;
+        size_t at = 0;
+    };
+
+    inline uint32_t zigzag(int32_t v) {
+        return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t v) {
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+
+    inline void writeCase(Writer &out, const Case &c) {
+        out.f32(c.settings.speed);
+        out.f32(c.settings.depthMm);
+        out.f32(c.settings.strokeMm);
+        out.f32(c.settings.sensation);
+        out.u32((uint32_t)c.positions.size());
+        int32_t previous = 0;
+        for (size_t i = 0; i < c.positions.size(); i++) {
+            if (i == 0) {
+                out.u32((uint32_t)c.positions[0]);
+            } else {
+                out.varint(zigzag(c.positions[i] - previous));
+            }
+            previous = c.positions[i];
+        }
+    }
+
+    inline bool readCase(Reader &in, Case &c) {
+        uint32_t count, first;
+        if (!in.f32(c.settings.speed) || !in.f32(c.settings.depthMm) ||
+            !in.f32(c.settings.strokeMm) || !in.f32(c.settings.sensation) ||
+            !in.u32(count)) {
+            return false;
+        }
+        c.positions.clear();
+        if (count == 0) {
+            return true;
+        }
+        if (!in.u32(first)) {
+            return false;
+        }
+        c.positions.reserve(count);
+        c.positions.push_back((int32_t)first);
+        for (uint32_t i = 1; i < count; i++) {
+            uint32_t delta;
+            if (!in.varint(delta)) {
+                return false;
+            }
+            c.positions.push_back(c.positions.back() + unzigzag(delta));
+        }
+        return true;
+    }
+
+    inline bool save(const std::string &path, const File &file) {
+        Writer out;
+        out.raw(magic, sizeof(magic));
+        out.u16(version);
+        out.u16((uint16_t)file.cases.size());
+        out.u32(file.sampleMicros);
+        out.f32(file.stepsPerMm);
+        for (const Case &c : file.cases) {
+            writeCase(out, c);
+        }
+
+        FILE *f = fopen(path.c_str(), "wb");
+        if (f == nullptr) {
+            return false;
+        }
+        size_t written = fwrite(out.bytes.data(), 1, out.bytes.size(), f);
+        return fclose(f) == 0 && written == out.bytes.size();
+    }
+
+    inline bool load(const std::string &path, File &file) {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+        std::vector<uint8_t> bytes;
+        uint8_t chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            bytes.insert(bytes.end(), chunk, chunk + n);
+        }
+        fclose(f);
+
+        Reader in(bytes);
+        char head[4];
+        uint16_t fileVersion, count;
+        if (!in.raw(head, 4) || std::string(head, 4) != "OSTR" ||
+            !in.u16(fileVersion) || fileVersion != version ||
+            !in.u16(count) || !in.u32(file.sampleMicros) ||
+            !in.f32(file.stepsPerMm)) {
+            return false;
+        }
+        file.cases.resize(count);
+        for (Case &c : file.cases) {
+            if (!readCase(in, c)) {
+                return false;
+            }
+        }
+        return in.done();
+    }
+}
+
+#endif  // OSSM_TOOLS_PATTERNTRACE_TRACE_H
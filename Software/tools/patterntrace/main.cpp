@@ -0,0 +1,416 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "FastAccelStepper.h"
+#include "StrokeEngine.h"
+#include "Trace.h"
+#include "U8g2lib.h"
+#include "pattern.h"
+#include "sil/Rail.h"
+#include "sil/VirtualTime.h"
+#include "utils/StrokeEngineHelper.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Pattern Trace
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Golden trajectories for the StrokeEngine patterns.
+ *
+ * Runs every pattern through a fixed grid of settings on the simulated
+ * stepper of the software-in-the-loop build and records the position every
+ * 5 ms. "record" writes the traces, "check" runs them again and compares with
+ * the recorded ones, "dump" prints a trace as CSV.
+ *
+ *  pio run -e patterntrace
+ *  .pio/build/patterntrace/program check tools/patterntrace/golden
+ */
+
+namespace {
+    constexpr uint32_t sampleMicros = 5000;
+    constexpr size_t samplesPerCase = 12 * 1000000 / sampleMicros;
+
+    // The rail StrokeEngine gets from homing, as in OSSM.StrokeEngine.cpp.
+    constexpr float travelMm = 200;
+    constexpr float keepoutMm = 6;
+
+    struct PatternInfo {
+        const char *file;
+        Pattern *(*make)();
+    };
+
+    template <class P>
+    Pattern *make(const char *name) {
+        return new P(name);
+    }
+
+    // The built-in patterns of OSSM.StrokeEngine.cpp, in menu order. Human
+    // Touch with a fixed seed, so its trace is the same every run. The curve
+    // patterns by the strokes they play under a vibration, tools/curvetrace
+    // traces their curves.
+    const PatternInfo patterns[] = {
+        {"simple_stroke", [] { return make<SimpleStroke>("Simple Stroke"); }},
+        {"teasing_pounding",
+         [] { return make<TeasingPounding>("Teasing Pounding"); }},
+        {"robo_stroke", [] { return make<RoboStroke>("Robo Stroke"); }},
+        {"half_n_half", [] { return make<HalfnHalf>("Half'n'Half"); }},
+        {"deeper", [] { return make<Deeper>("Deeper"); }},
+        {"stop_n_go", [] { return make<StopNGo>("Stop'n'Go"); }},
+        {"insist", [] { return make<Insist>("Insist"); }},
+        {"human_touch",
+         []() -> Pattern * {
+             return new Humanized<TeasingPounding>("Human Touch", 1);
+         }},
+        {"sine_stroke", [] { return make<SineStroke>("Sine Stroke"); }},
+        {"bezier_stroke", [] { return make<BezierStroke>("Bezier Stroke"); }},
+    };
+
+    /**
+     * The grid every pattern runs through. Speeds are the firmware's 20 % and
+     * 80 % knob, stroke and depth a typical session on a 200 mm rail.
+     */
+    std::vector<Trace::Settings> grid() {
+        std::vector<Trace::Settings> settings;
+        for (float speed : {60.0f, 240.0f}) {
+            for (float sensation : {-100.0f, 0.0f, 100.0f}) {
+                settings.push_back({speed, 180, 120, sensation});
+            }
+        }
+        return settings;
+    }
+
+    /**
+     * Reads the stepper position on a fixed clock once the pattern runs, and
+     * ends the simulation after the last sample.
+     */
+    class Sampler : public sil::Stimulus {
+      public:
+        void start(uint64_t now) { next = now; }
+
+        uint64_t nextEventMicros() const override { return next; }
+
+        void fire(uint64_t nowMicros) override {
+            positions.push_back(sil::stepper().getCurrentPosition());
+            next = nowMicros + sampleMicros;
+            if (positions.size() == samplesPerCase) {
+                next = sil::never;
+                sil::stop();
+            }
+        }
+
+        std::vector<int32_t> positions;
+
+      private:
+        uint64_t next = sil::never;
+    };
+
+    struct Run {
+        const PatternInfo *pattern;
+        Trace::Settings settings;
+        Sampler sampler;
+        StrokeEngine engine;
+        machineGeometry geometry = {.physicalTravel = travelMm,
+                                    .keepoutBoundary = keepoutMm};
+    };
+
+    Run run;
+
+    // What OSSM::startStrokeEngineTask does, minus the state machine.
+    void driverTask(void *) {
+        FastAccelStepperEngine stepperEngine;
+        FastAccelStepper *stepper = stepperEngine.stepperConnectToPin(
+            Pins::Driver::motorStepPin);
+
+        StrokeEngine &engine = run.engine;
+        engine.begin(&run.geometry, &servoMotor, stepper);
+        engine.thisIsHome();
+        while (stepper->isRunning()) {
+            vTaskDelay(10);
+        }
+
+        engine.setSensation(run.settings.sensation, true);
+        engine.setDepth(run.settings.depthMm, true);
+        engine.setStroke(run.settings.strokeMm, true);
+        engine.setSpeed(run.settings.speed, true);
+        engine.setPattern(run.pattern->make(), false);
+
+        run.sampler.start(sil::now());
+        engine.startPattern();
+        vTaskSuspend(nullptr);
+    }
+
+    /**
+     * Each case runs in a child process, so every trace starts from a fresh
+     * scheduler and clock and does not depend on the cases before it.
+     */
+    bool simulate(const PatternInfo &pattern, const Trace::Settings &settings,
+                  std::vector<int32_t> &positions) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return false;
+        }
+        fflush(stdout);
+        pid_t child = fork();
+        if (child < 0) {
+            return false;
+        }
+        if (child == 0) {
+            close(fds[0]);
+            run.pattern = &pattern;
+            run.settings = settings;
+            sil::rail().reset();
+            sil::addStimulus(&run.sampler);
+            xTaskCreatePinnedToCore(driverTask, "driver", 8192, nullptr, 1,
+                                    nullptr, 1);
+            // A minute is far more than the setup and the samples take.
+            sil::run(60 * 1000000ULL);
+            const std::vector<int32_t> &samples = run.sampler.positions;
+            size_t bytes = samples.size() * sizeof(int32_t);
+            bool ok = write(fds[1], samples.data(), bytes) == (ssize_t)bytes;
+            _exit(ok ? 0 : 1);
+        }
+
+        close(fds[1]);
+        positions.clear();
+        int32_t buffer[1024];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            positions.insert(positions.end(), buffer,
+                             buffer + n / sizeof(int32_t));
+        }
+        close(fds[0]);
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+               positions.size() == samplesPerCase;
+    }
+
+    bool simulatePattern(const PatternInfo &pattern, Trace::File &file) {
+        file.sampleMicros = sampleMicros;
+        file.stepsPerMm = servoMotor.stepsPerMillimeter;
+        file.cases.clear();
+        for (const Trace::Settings &settings : grid()) {
+            Trace::Case c{settings, {}};
+            if (!simulate(pattern, settings, c.positions)) {
+                fprintf(stderr, "%s: simulation failed\n", pattern.file);
+                return false;
+            }
+            file.cases.push_back(std::move(c));
+        }
+        return true;
+    }
+
+    // What a session feels like, from one trace.
+    struct Shape {
+        // Direction changes and the mean time between them.
+        int reversals = 0;
+        double halfStrokeSeconds = 0;
+        double peakSpeed = 0;
+        double peakAcceleration = 0;
+    };
+
+    Shape shapeOf(const std::vector<int32_t> &positions, float stepsPerMm) {
+        Shape shape;
+        double dt = sampleMicros * 1e-6;
+        int direction = 0;
+        size_t firstReversal = 0, lastReversal = 0;
+        double previousSpeed = 0;
+        for (size_t i = 1; i < positions.size(); i++) {
+            double speed = (positions[i] - positions[i - 1]) / stepsPerMm / dt;
+            shape.peakSpeed = std::max(shape.peakSpeed, std::fabs(speed));
+            if (i > 1) {
+                shape.peakAcceleration =
+                    std::max(shape.peakAcceleration,
+                             std::fabs(speed - previousSpeed) / dt);
+            }
+            previousSpeed = speed;
+
+            int step = positions[i] > positions[i - 1]   ? 1
+                       : positions[i] < positions[i - 1] ? -1
+                                                         : 0;
+            if (step != 0 && step != direction) {
+                if (direction != 0) {
+                    if (shape.reversals == 0) {
+                        firstReversal = i;
+                    }
+                    lastReversal = i;
+                    shape.reversals++;
+                }
+                direction = step;
+            }
+        }
+        if (shape.reversals > 1) {
+            shape.halfStrokeSeconds = (double)(lastReversal - firstReversal) *
+                                      dt / (shape.reversals - 1);
+        }
+        return shape;
+    }
+
+    double percentChange(double golden, double actual) {
+        if (golden == 0) {
+            return actual == 0 ? 0 : 100;
+        }
+        return 100 * (actual - golden) / golden;
+    }
+
+    struct Tolerance {
+        double positionMm = 0.5;
+        double percent = 1;
+    };
+
+    bool check(const std::string &directory, const Tolerance &tolerance) {
+        bool allPassed = true;
+        printf("%-18s %5s %10s %10s %10s %10s %10s  %s\n", "pattern", "cases",
+               "max dx mm", "timing %", "speed %", "accel %", "reversals",
+               "result");
+        for (const PatternInfo &pattern : patterns) {
+            Trace::File golden, actual;
+            std::string path = directory + "/" + pattern.file + ".trace";
+            if (!Trace::load(path, golden)) {
+                printf("%-18s cannot read %s\n", pattern.file, path.c_str());
+                allPassed = false;
+                continue;
+            }
+            if (!simulatePattern(pattern, actual)) {
+                allPassed = false;
+                continue;
+            }
+
+            // The worst case of the grid, by magnitude.
+            double maxError = 0, timing = 0, speed = 0, acceleration = 0;
+            int reversals = 0;
+            bool sameGrid = golden.cases.size() == actual.cases.size() &&
+                            golden.sampleMicros == actual.sampleMicros;
+            auto worst = [](double &current, double value) {
+                if (std::fabs(value) > std::fabs(current)) {
+                    current = value;
+                }
+            };
+            for (size_t i = 0; sameGrid && i < golden.cases.size(); i++) {
+                const auto &g = golden.cases[i].positions;
+                const auto &a = actual.cases[i].positions;
+                if (memcmp(&golden.cases[i].settings,
+                           &actual.cases[i].settings,
+                           sizeof(Trace::Settings)) != 0 ||
+                    g.size() != a.size()) {
+                    sameGrid = false;
+                    break;
+                }
+                for (size_t j = 0; j < g.size(); j++) {
+                    maxError = std::max(maxError, (double)std::abs(g[j] - a[j]) /
+                                                      golden.stepsPerMm);
+                }
+                Shape gs = shapeOf(g, golden.stepsPerMm);
+                Shape as = shapeOf(a, golden.stepsPerMm);
+                worst(timing, percentChange(gs.halfStrokeSeconds,
+                                            as.halfStrokeSeconds));
+                worst(speed, percentChange(gs.peakSpeed, as.peakSpeed));
+                worst(acceleration,
+                      percentChange(gs.peakAcceleration, as.peakAcceleration));
+                if (std::abs(as.reversals - gs.reversals) >
+                    std::abs(reversals)) {
+                    reversals = as.reversals - gs.reversals;
+                }
+            }
+
+            if (!sameGrid) {
+                printf("%-18s settings or sampling changed, record again\n",
+                       pattern.file);
+                allPassed = false;
+                continue;
+            }
+            bool passed = maxError <= tolerance.positionMm &&
+                          std::fabs(timing) <= tolerance.percent &&
+                          std::fabs(speed) <= tolerance.percent &&
+                          std::fabs(acceleration) <= tolerance.percent &&
+                          reversals == 0;
+            allPassed = allPassed && passed;
+            printf("%-18s %5zu %10.2f %+10.2f %+10.2f %+10.2f %+10d  %s\n",
+                   pattern.file, golden.cases.size(), maxError, timing, speed,
+                   acceleration, reversals, passed ? "ok" : "CHANGED");
+        }
+        return allPassed;
+    }
+
+    bool record(const std::string &directory) {
+        for (const PatternInfo &pattern : patterns) {
+            Trace::File file;
+            std::string path = directory + "/" + pattern.file + ".trace";
+            if (!simulatePattern(pattern, file) || !Trace::save(path, file)) {
+                fprintf(stderr, "could not record %s\n", path.c_str());
+                return false;
+            }
+            printf("%s\n", path.c_str());
+        }
+        return true;
+    }
+
+    bool dump(const std::string &path) {
+        Trace::File file;
+        if (!Trace::load(path, file)) {
+            fprintf(stderr, "cannot read %s\n", path.c_str());
+            return false;
+        }
+        printf("case,speed,depth,stroke,sensation,seconds,position_mm\n");
+        for (size_t i = 0; i < file.cases.size(); i++) {
+            const Trace::Case &c = file.cases[i];
+            for (size_t j = 0; j < c.positions.size(); j++) {
+                printf("%zu,%g,%g,%g,%g,%.3f,%.2f\n", i, c.settings.speed,
+                       c.settings.depthMm, c.settings.strokeMm,
+                       c.settings.sensation, j * file.sampleMicros * 1e-6,
+                       c.positions[j] / file.stepsPerMm);
+            }
+        }
+        return true;
+    }
+}
+
+static const char *usage =
+    "usage: patterntrace record <dir>\n"
+    "       patterntrace check <dir> [--position <mm>] [--percent <pct>]\n"
+    "       patterntrace dump <file.trace>\n";
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    std::string command = argv[1];
+    std::string target = argv[2];
+
+    if (command == "record" && argc == 3) {
+        return record(target) ? 0 : 1;
+    }
+    if (command == "dump" && argc == 3) {
+        return dump(target) ? 0 : 1;
+    }
+    if (command == "check") {
+        Tolerance tolerance;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "--position") == 0) {
+                tolerance.positionMm = atof(argv[i + 1]);
+            } else if (strcmp(argv[i], "--percent") == 0) {
+                tolerance.percent = atof(argv[i + 1]);
+            } else {
+                fputs(usage, stderr);
+                return 2;
+            }
+        }
+        if (argc % 2 == 0) {
+            fputs(usage, stderr);
+            return 2;
+        }
+        return check(target, tolerance) ? 0 : 1;
+    }
+    fputs(usage, stderr);
+    return 2;
+}
@@ -0,0 +1,209 @@
+#ifndef OSSM_TOOLS_SERVOMOCK_MOCKSERVO_H
+#define OSSM_TOOLS_SERVOMOCK_MOCKSERVO_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/Modbus.h"
+#include "utils/ServoMonitor.h"
+
+/**
+ * A servo drive that answers Modbus reads like the ones in ServoModels,
+ * with readings from a motor stroking on its own.
+ *
+ * The motor strokes back and forth in a sine, lagging the steps a little
+ * as a tuned servo does. A fault can be set to start at a time: a stall,
+ * after which the motor stops while the steps go on, or an alarm, after
+ * which the drive cuts the motor and, if it has an alarm register, reports
+ * it there.
+ *
+ * Only the registers of the model can be read, anything else is answered
+ * with a Modbus exception, as a drive does.
+ */
+class MockServo {
+  public:
+    struct Settings {
+        const ServoModel *model = &ServoModels::jmc;
+        uint8_t slave = 1;
+        // The stroke, in steps either side of the middle.
+        double amplitudeSteps = 1000;
+        double strokeSeconds = 1;
+        // How far a healthy motor trails the steps.
+        double lagSeconds = 0.002;
+        // When the motor stalls, never if negative.
+        double stallAfterSeconds = -1;
+        // When the drive raises alarmCode, never if negative.
+        double alarmAfterSeconds = -1;
+        uint16_t alarmCode = 0x0C;
+    };
+
+    struct State {
+        double commanded;
+        double actual;
+        double speedHz;
+        double accelerationHz;
+        uint16_t alarm;
+    };
+
+    static constexpr double stepsPerRevolution = 800;
+    // The 57AIM counts its encoder, 4000 a revolution.
+    static constexpr double countsPerStep = 5;
+
+    explicit MockServo(const Settings &settings) : _settings(settings) {}
+
+    const Settings &settings() const { return _settings; }
+
+    State state(double seconds) const {
+        State state = {};
+        double omega = 2 * M_PI / _settings.strokeSeconds;
+        double a = _settings.amplitudeSteps;
+        state.commanded = a * std::sin(omega * seconds);
+        bool isAlarm = _settings.alarmAfterSeconds >= 0 &&
+                       seconds >= _settings.alarmAfterSeconds;
+        state.alarm = isAlarm ? _settings.alarmCode : 0;
+
+        // Where the motor stopped, if it did.
+        double stopped = -1;
+        if (_settings.stallAfterSeconds >= 0 &&
+            seconds >= _settings.stallAfterSeconds) {
+            stopped = _settings.stallAfterSeconds;
+        }
+        if (isAlarm &&
+            (stopped < 0 || _settings.alarmAfterSeconds < stopped)) {
+            stopped = _settings.alarmAfterSeconds;
+        }
+        if (stopped >= 0) {
+            state.actual =
+                a * std::sin(omega * (stopped - _settings.lagSeconds));
+            return state;
+        }
+        double t = seconds - _settings.lagSeconds;
+        state.actual = a * std::sin(omega * t);
+        state.speedHz = a * omega * std::cos(omega * t);
+        state.accelerationHz = -a * omega * omega * std::sin(omega * t);
+        return state;
+    }
+
+    /**
+     * The registers as the drive would report them at that time.
+     * @return false for an address the model does not have.
+     */
+    bool readRegisters(double seconds, uint16_t address, uint16_t count,
+                       uint16_t *registers) const {
+        const ServoModel &model = *_settings.model;
+        for (uint8_t i = 0; i < model.readCount; i++) {
+            const ServoModel::Read &read = model.reads[i];
+            if (address >= read.address &&
+                address + count <= read.address + read.count) {
+                uint16_t block[Modbus::maxRegisters] = {};
+                fill(seconds, read.address, block);
+                memcpy(registers, block + (address - read.address),
+                       count * sizeof(uint16_t));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Answers one request frame.
+     * @return the size of the response, 0 for none: a frame for another
+     * slave or a damaged one is ignored, like on a real bus.
+     */
+    size_t answer(double seconds, const uint8_t *request, size_t length,
+                  uint8_t *response) const {
+        if (length < 4 || request[0] != _settings.slave ||
+            Modbus::crc16(request, length - 2) !=
+                uint16_t(request[length - 2] | request[length - 1] << 8)) {
+            return 0;
+        }
+        uint16_t address = uint16_t(request[2] << 8 | request[3]);
+        uint16_t count = length >= 6 ? uint16_t(request[4] << 8 | request[5])
+                                     : 0;
+        uint16_t registers[Modbus::maxRegisters];
+
+        response[0] = _settings.slave;
+        size_t size;
+        if (request[1] != Modbus::readHoldingRegisters ||
+            length != Modbus::requestSize) {
+            size = exception(response, request[1], 0x01);
+        } else if (count == 0 || count > Modbus::maxRegisters ||
+                   !readRegisters(seconds, address, count, registers)) {
+            size = exception(response, request[1], 0x02);
+        } else {
+            response[1] = Modbus::readHoldingRegisters;
+            response[2] = uint8_t(2 * count);
+            for (uint16_t i = 0; i < count; i++) {
+                response[3 + 2 * i] = uint8_t(registers[i] >> 8);
+                response[4 + 2 * i] = uint8_t(registers[i]);
+            }
+            size = 3 + 2 * size_t(count);
+        }
+        uint16_t crc = Modbus::crc16(response, size);
+        response[size] = uint8_t(crc);
+        response[size + 1] = uint8_t(crc >> 8);
+        return size + 2;
+    }
+
+    /**
+     * What ServoMonitor should read at that time, rounded as the drive
+     * rounds it.
+     */
+    ServoReading expected(double seconds) const {
+        ServoReading reading = {};
+        const ServoModel &model = *_settings.model;
+        for (uint8_t i = 0; i < model.readCount; i++) {
+            uint16_t block[Modbus::maxRegisters] = {};
+            fill(seconds, model.reads[i].address, block);
+            model.reads[i].decode(block, reading);
+        }
+        return reading;
+    }
+
+  private:
+    static size_t exception(uint8_t *response, uint8_t function,
+                            uint8_t code) {
+        response[1] = function | Modbus::exceptionFlag;
+        response[2] = code;
+        return 3;
+    }
+
+    static void highFirst(uint16_t *registers, int32_t value) {
+        registers[0] = uint16_t(uint32_t(value) >> 16);
+        registers[1] = uint16_t(value);
+    }
+
+    // One block of registers of the model, by the address it starts at.
+    void fill(double seconds, uint16_t address, uint16_t *block) const {
+        State s = state(seconds);
+        auto rpm = int16_t(std::lround(s.speedHz * 60 / stepsPerRevolution));
+        // Torque follows the acceleration, 100 % at 50000 steps/s^2.
+        auto torque = int16_t(std::lround(s.accelerationHz / 50));
+
+        if (_settings.model == &ServoModels::jmc) {
+            if (address == 0x0836) {
+                highFirst(block, int32_t(std::lround(s.actual)));
+                highFirst(block + 2,
+                          int32_t(std::lround(s.commanded - s.actual)));
+            } else if (address == 0x0842) {
+                block[0] = uint16_t(rpm);
+                block[2] = uint16_t(torque);
+            }
+        } else if (address == 0x0E) {
+            block[0] = s.alarm;
+            // Current in 0.1 A, 3 A at full torque.
+            block[1] = uint16_t(std::abs(torque) * 30 / 1000);
+            block[2] = uint16_t(rpm);
+        } else if (address == 0x16) {
+            auto counts = int32_t(std::lround(s.actual * countsPerStep));
+            block[0] = uint16_t(counts);
+            block[1] = uint16_t(uint32_t(counts) >> 16);
+        }
+    }
+
+    Settings _settings;
+};
+
+#endif  // OSSM_TOOLS_SERVOMOCK_MOCKSERVO_H
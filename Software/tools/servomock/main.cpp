@@ -0,0 +1,454 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "MockServo.h"
+#include "utils/MotionSupervisor.h"
+#include "utils/ServoMonitor.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Servo Mock
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * A servo drive on a pseudo terminal, for services/servo.h without one on
+ * the bench, see MockServo.h.
+ *
+ * By itself it serves until stopped, for the SIL or anything else that
+ * talks Modbus:
+ *  pio run -e servomock
+ *  .pio/build/servomock/program --link /tmp/servo --stall-after 5
+ *  .pio/build/sil/program --realtime --servo /tmp/servo \
+ *      sil/scenarios/stroke_engine.txt
+ *
+ * With --stand it polls itself through the pty with the firmware's
+ * ServoMonitor and MotionSupervisor, and checks what they make of it: the
+ * readings match, the polls keep their rate, and a fault stops the motor in
+ * time. It exits 1 if any of that fails.
+ *  .pio/build/servomock/program --stand --noise 0.05 --stall-after 2
+ */
+
+namespace {
+    struct Options {
+        MockServo::Settings servo;
+        uint32_t baud = 0;
+        uint32_t latencyMicros = 500;
+        // Chance of a response with a damaged byte, and of none at all.
+        double noise = 0;
+        double silence = 0;
+        std::string link;
+        double seconds = 0;
+
+        bool isStand = false;
+        uint32_t intervalMicros = 20000;
+        uint32_t limitSteps = 200;
+    };
+
+    const char *usage =
+        "usage: servomock [options]\n"
+        "  --model <name>      ihsv57 (default) or 57aim\n"
+        "  --slave <address>   1 by default\n"
+        "  --baud <rate>       paces the answers, the model's by default\n"
+        "  --latency <us>      before the drive answers, 500 by default\n"
+        "  --stall-after <s>   the motor stops following the steps\n"
+        "  --alarm-after <s>   the drive raises an alarm and cuts the motor\n"
+        "  --alarm <code>      the alarm code, 12 by default\n"
+        "  --noise <p>         damage a byte of this share of the answers\n"
+        "  --silence <p>       leave this share of the requests unanswered\n"
+        "  --link <path>       symlink to the pty, e.g. /tmp/servo\n"
+        "  --seconds <s>       stop after that long, never by default\n"
+        "  --stand             poll the mock with ServoMonitor and check it\n"
+        "  --interval <ms>     with --stand, the poll interval, 20 by default\n"
+        "  --limit <steps>     with --stand, the following error limit, 200\n";
+
+    bool parse(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--model" && hasValue) {
+                int model = ServoModels::find(argv[++i]);
+                if (model < 0) {
+                    return false;
+                }
+                options.servo.model = ServoModels::all[model];
+            } else if (arg == "--slave" && hasValue) {
+                options.servo.slave = (uint8_t)atoi(argv[++i]);
+            } else if (arg == "--baud" && hasValue) {
+                options.baud = (uint32_t)atoi(argv[++i]);
+            } else if (arg == "--latency" && hasValue) {
+                options.latencyMicros = (uint32_t)atoi(argv[++i]);
+            } else if (arg == "--stall-after" && hasValue) {
+                options.servo.stallAfterSeconds = atof(argv[++i]);
+            } else if (arg == "--alarm-after" && hasValue) {
+                options.servo.alarmAfterSeconds = atof(argv[++i]);
+            } else if (arg == "--alarm" && hasValue) {
+                options.servo.alarmCode = (uint16_t)atoi(argv[++i]);
+            } else if (arg == "--noise" && hasValue) {
+                options.noise = atof(argv[++i]);
+            } else if (arg == "--silence" && hasValue) {
+                options.silence = atof(argv[++i]);
+            } else if (arg == "--link" && hasValue) {
+                options.link = argv[++i];
+            } else if (arg == "--seconds" && hasValue) {
+                options.seconds = atof(argv[++i]);
+            } else if (arg == "--stand") {
+                options.isStand = true;
+            } else if (arg == "--interval" && hasValue) {
+                options.intervalMicros = (uint32_t)(atof(argv[++i]) * 1000);
+            } else if (arg == "--limit" && hasValue) {
+                options.limitSteps = (uint32_t)atoi(argv[++i]);
+            } else {
+                return false;
+            }
+        }
+        if (options.baud == 0) {
+            options.baud = options.servo.model->baud;
+        }
+        if (options.isStand && options.seconds == 0) {
+            options.seconds = 5;
+        }
+        return options.servo.slave >= 1 && options.servo.slave <= 247 &&
+               options.baud > 0 && options.intervalMicros > 0;
+    }
+
+    uint64_t wallMicros() {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+    }
+
+    void sleepMicros(uint64_t micros) {
+        timespec time = {time_t(micros / 1000000),
+                         long(micros % 1000000 * 1000)};
+        nanosleep(&time, nullptr);
+    }
+
+    /**
+     * Opens a pty in raw mode.
+     * @return the master, with the path of the slave in path.
+     */
+    int openPty(std::string &path) {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            return -1;
+        }
+        path = ptsname(master);
+        termios settings;
+        if (tcgetattr(master, &settings) == 0) {
+            cfmakeraw(&settings);
+            tcsetattr(master, TCSANOW, &settings);
+        }
+        return master;
+    }
+
+    /**
+     * The drive's side of the line: collects a request, answers it after
+     * its latency, paced as if at the baud rate.
+     */
+    class Drive {
+      public:
+        Drive(const Options &options, int fd)
+            : _options(options),
+              _mock(options.servo),
+              _fd(fd),
+              _random(std::random_device()()) {}
+
+        void run(const std::atomic<bool> &isRunning) {
+            const uint64_t gapMicros = Modbus::frameGapMicros(_options.baud);
+            const uint64_t start = wallMicros();
+            uint8_t request[Modbus::maxResponseSize];
+            size_t length = 0;
+            while (isRunning.load()) {
+                pollfd in = {_fd, POLLIN, 0};
+                int ready = ::poll(&in, 1, int(gapMicros / 1000) + 1);
+                if (ready <= 0 || (in.revents & POLLIN) == 0) {
+                    // Silence ends a frame, a part of one is dropped.
+                    length = 0;
+                    if (ready > 0) {
+                        // The other end is closed, wait for it to open.
+                        sleepMicros(10000);
+                    }
+                    continue;
+                }
+                ssize_t n = read(_fd, request + length,
+                                 sizeof(request) - length);
+                if (n <= 0) {
+                    continue;
+                }
+                length += size_t(n);
+                if (length < Modbus::requestSize) {
+                    continue;
+                }
+                answer((wallMicros() - start) * 1e-6, request, length);
+                length = 0;
+            }
+        }
+
+        uint32_t answered() const { return _answered.load(); }
+
+        const MockServo &mock() const { return _mock; }
+
+      private:
+        void answer(double seconds, const uint8_t *request, size_t length) {
+            uint8_t response[Modbus::maxResponseSize + 2];
+            size_t size = _mock.answer(seconds, request, length, response);
+            std::uniform_real_distribution<double> chance(0, 1);
+            if (size == 0 || chance(_random) < _options.silence) {
+                return;
+            }
+            if (chance(_random) < _options.noise) {
+                response[_random() % size] ^= uint8_t(1 << (_random() % 8));
+            }
+            // 11 bits a character, 8E1 or 8N2 alike.
+            sleepMicros(_options.latencyMicros +
+                        uint64_t(size) * 11000000 / _options.baud);
+            if (write(_fd, response, size) == ssize_t(size)) {
+                _answered++;
+            }
+        }
+
+        const Options &_options;
+        MockServo _mock;
+        int _fd;
+        std::mt19937 _random;
+        std::atomic<uint32_t> _answered{0};
+    };
+
+    /**
+     * The OSSM's side of the line in the stand, a tty through the calls
+     * ModbusClient takes from HardwareSerial.
+     */
+    class TtyPort {
+      public:
+        explicit TtyPort(int fd) : _fd(fd) {}
+
+        int available() {
+            int count = 0;
+            return ioctl(_fd, FIONREAD, &count) == 0 ? count : 0;
+        }
+
+        int read() {
+            uint8_t byte;
+            return ::read(_fd, &byte, 1) == 1 ? byte : -1;
+        }
+
+        size_t write(const uint8_t *data, size_t length) {
+            ssize_t n = ::write(_fd, data, length);
+            return n < 0 ? 0 : size_t(n);
+        }
+
+      private:
+        int _fd;
+    };
+
+    /**
+     * How far a reading is from the position of the mock, at the time the
+     * drive read it: some time in the 100 ms before the poll completed.
+     */
+    uint32_t offTheMock(const MockServo &mock, const ServoReading &reading,
+                        double seconds) {
+        uint32_t best = UINT32_MAX;
+        for (double t = seconds; t > seconds - 0.1 && t >= 0; t -= 1e-4) {
+            int32_t position = mock.expected(t).position;
+            best = std::min(best,
+                            uint32_t(std::abs(position - reading.position)));
+        }
+        return best;
+    }
+
+    int serve(const Options &options, int master, const std::string &path) {
+        if (!options.link.empty()) {
+            unlink(options.link.c_str());
+            if (symlink(path.c_str(), options.link.c_str()) != 0) {
+                fprintf(stderr, "servomock: cannot link %s\n",
+                        options.link.c_str());
+                return 1;
+            }
+        }
+        printf("%s\n", options.link.empty() ? path.c_str()
+                                            : options.link.c_str());
+        fflush(stdout);
+
+        std::atomic<bool> isRunning{true};
+        Drive drive(options, master);
+        std::thread stopper([&]() {
+            if (options.seconds > 0) {
+                sleepMicros(uint64_t(options.seconds * 1e6));
+                isRunning = false;
+            }
+        });
+        drive.run(isRunning);
+        stopper.join();
+        if (!options.link.empty()) {
+            unlink(options.link.c_str());
+        }
+        fprintf(stderr, "servomock: %u answers\n", drive.answered());
+        return 0;
+    }
+
+    int stand(const Options &options, int master, const std::string &path) {
+        int fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0) {
+            fprintf(stderr, "servomock: cannot open %s\n", path.c_str());
+            return 1;
+        }
+        termios settings;
+        if (tcgetattr(fd, &settings) == 0) {
+            cfmakeraw(&settings);
+            tcsetattr(fd, TCSANOW, &settings);
+        }
+
+        std::atomic<bool> isRunning{true};
+        Drive drive(options, master);
+        std::thread driveThread([&]() { drive.run(isRunning); });
+
+        const ServoModel &model = *options.servo.model;
+        TtyPort port(fd);
+        ServoMonitor<TtyPort> monitor(port, model, options.servo.slave,
+                                      options.baud, options.intervalMicros,
+                                      50000);
+        MotionSupervisor supervisor;
+        supervisor.setEnvelope({INT32_MIN, INT32_MAX, UINT32_MAX / 1000});
+        supervisor.setFollowingErrorLimit(options.limitSteps);
+
+        // Like the supervisor task, every millisecond.
+        const uint64_t start = wallMicros();
+        const uint64_t end = start + uint64_t(options.seconds * 1e6);
+        uint32_t sequence = 0, readings = 0, worstError = 0;
+        uint64_t worstAgeMicros = 0, lastMicros = start;
+        double stoppedAt = -1;
+        MotionViolation violation = MotionViolation::None;
+        for (uint64_t now = start; now < end; now = wallMicros()) {
+            monitor.poll(now);
+            ServoReading reading;
+            uint32_t next = monitor.snapshot().read(reading);
+            if (next != sequence) {
+                sequence = next;
+                readings++;
+                worstAgeMicros =
+                    std::max(worstAgeMicros, reading.timeMicros - lastMicros);
+                lastMicros = reading.timeMicros;
+
+                worstError = std::max(
+                    worstError, offTheMock(drive.mock(), reading,
+                                           (reading.timeMicros - start) *
+                                               1e-6));
+                MotionViolation v = supervisor.checkServo(
+                    reading.followingError, reading.alarm);
+                if (v != MotionViolation::None) {
+                    violation = v;
+                    stoppedAt = (now - start) * 1e-6;
+                }
+            }
+            sleepMicros(1000);
+        }
+        isRunning = false;
+        driveThread.join();
+        close(fd);
+
+        const ServoLinkStats &stats = monitor.stats();
+        double expectedPolls = options.seconds * 1e6 / options.intervalMicros;
+        printf("model       %s, slave %u, %u baud\n", model.name,
+               options.servo.slave, options.baud);
+        printf("polls       %u of %.0f, %u timeouts, %u bad CRCs, "
+               "%u exceptions, %u mismatches\n",
+               stats.polls, expectedPolls, stats.timeouts, stats.badCrcs,
+               stats.exceptions, stats.mismatches);
+        printf("gaps        %.1f ms at most between readings\n",
+               worstAgeMicros / 1000.0);
+        printf("position    %u off the mock at most\n", worstError);
+        if (violation != MotionViolation::None) {
+            printf("stopped     %s at %.3f s\n",
+                   motionViolationNames[(int)violation], stoppedAt);
+        }
+
+        // Every poll that got an answer, bar what the noise and silence
+        // took, a few lost to scheduling.
+        double lost = 1 - (1 - options.noise) * (1 - options.silence);
+        bool isOk = stats.polls >= expectedPolls * (1 - 2 * lost) * 0.9;
+        if (!isOk) {
+            printf("FAILED      too few polls, for the baud rate?\n");
+        }
+        // Noise may hit the address or function, and make a mismatch.
+        if (stats.exceptions > 0 ||
+            (options.noise == 0 && stats.mismatches > 0)) {
+            printf("FAILED      the mock did not understand the monitor\n");
+            isOk = false;
+        }
+        // Within a step, for the rounding.
+        double unitsPerStep = options.servo.model == &ServoModels::goldMotor
+                                  ? MockServo::countsPerStep
+                                  : 1;
+        if (worstError > unitsPerStep) {
+            printf("FAILED      readings do not match the mock\n");
+            isOk = false;
+        }
+
+        // A fault has to stop the motor within a few polls, a stall once
+        // the steps ran off far enough.
+        double faultAt = -1;
+        const MockServo::Settings &servo = options.servo;
+        if (servo.alarmAfterSeconds >= 0 &&
+            servo.alarmAfterSeconds < options.seconds) {
+            faultAt = servo.alarmAfterSeconds;
+        }
+        if (servo.stallAfterSeconds >= 0 &&
+            servo.stallAfterSeconds < options.seconds &&
+            (faultAt < 0 || servo.stallAfterSeconds < faultAt)) {
+            faultAt = servo.stallAfterSeconds;
+        }
+        if (faultAt >= 0 && model.hasFollowingError) {
+            // The steps go on at up to amplitude * omega.
+            double speed = servo.amplitudeSteps * 2 * M_PI /
+                           servo.strokeSeconds;
+            faultAt += options.limitSteps / speed;
+        } else if (faultAt >= 0 && servo.alarmAfterSeconds < 0) {
+            // Without a following error a stall goes unseen.
+            faultAt = -1;
+        }
+        double allowed = 10 * options.intervalMicros * 1e-6;
+        if (faultAt >= 0 &&
+            (stoppedAt < 0 || stoppedAt > faultAt + allowed)) {
+            printf("FAILED      not stopped by %.3f s\n", faultAt + allowed);
+            isOk = false;
+        } else if (faultAt < 0 && stoppedAt >= 0) {
+            printf("FAILED      stopped without a fault\n");
+            isOk = false;
+        }
+        printf("%s\n", isOk ? "ok" : "FAILED");
+        return isOk ? 0 : 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    std::string path;
+    int master = openPty(path);
+    if (master < 0) {
+        fprintf(stderr, "servomock: cannot open a pty\n");
+        return 1;
+    }
+    int result = options.isStand ? stand(options, master, path)
+                                 : serve(options, master, path);
+    close(master);
+    return result;
+}
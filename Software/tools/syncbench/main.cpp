@@ -0,0 +1,430 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Sync Bench
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * How closely followers stroke in step with their leader, see
+ * services/sync.h, measured on one Linux box.
+ *
+ * Runs a leader and its followers as SIL processes in realtime, each with
+ * its own clock drift, all on the same scenario. Every follower talks to the
+ * leader through a relay that delays each packet by a base delay plus a
+ * random jitter, like a busy WiFi. Afterwards the position traces of the
+ * carriages are compared: every time the leader's carriage leaves a stop,
+ * the follower's should leave the same stop at the same host time.
+ *
+ *  pio run -e sil && pio run -e syncbench
+ *  .pio/build/syncbench/program --followers 2 --jitter 4000
+ */
+
+namespace {
+    struct Options {
+        std::string sil = ".pio/build/sil/program";
+        std::string scenario = "sil/scenarios/sync.txt";
+        int followers = 2;
+        uint16_t port = 7878;
+        int delayMicros = 2000;
+        int jitterMicros = 3000;
+        double driftPpm = 50;
+        bool sync = true;
+    };
+
+    const char *usage =
+        "usage: syncbench [options]\n"
+        "  --sil <program>     SIL build, .pio/build/sil/program by default\n"
+        "  --scenario <file>   sil/scenarios/sync.txt by default\n"
+        "  --followers <n>     2 by default\n"
+        "  --port <port>       leader port, followers use the ones above\n"
+        "  --delay <us>        one way network delay, 2000 by default\n"
+        "  --jitter <us>       plus up to this much, 3000 by default\n"
+        "  --drift <ppm>       follower clocks alternate fast and slow, 50\n"
+        "  --no-sync           free running, for comparison\n";
+
+    uint64_t wallMicros() {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+    }
+
+    sockaddr_in loopback(uint16_t port) {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        return address;
+    }
+
+    /**
+     * Sits between one follower and the leader. The follower sends to the
+     * relay's port, the relay sends on from the same socket, so the leader
+     * answers the relay.
+     */
+    class Relay {
+      public:
+        bool begin(uint16_t port, uint16_t leaderPort) {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+            sockaddr_in local = loopback(port);
+            if (fd < 0 || bind(fd, (sockaddr *)&local, sizeof(local)) < 0) {
+                return false;
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            leader = loopback(leaderPort);
+            return true;
+        }
+
+        // Take in what arrived and schedule it for delivery.
+        void receive(uint64_t now, std::mt19937 &random, int delayMicros,
+                     int jitterMicros) {
+            std::uniform_int_distribution<int> jitter(0, jitterMicros);
+            Packet packet;
+            sockaddr_in from = {};
+            socklen_t fromLength = sizeof(from);
+            ssize_t length;
+            while ((length = recvfrom(fd, packet.data, sizeof(packet.data), 0,
+                                      (sockaddr *)&from, &fromLength)) > 0) {
+                packet.length = (size_t)length;
+                packet.due = now + delayMicros + jitter(random);
+                if (from.sin_port == leader.sin_port) {
+                    packet.to = follower;
+                } else {
+                    follower = from;
+                    packet.to = leader;
+                }
+                pending.push(packet);
+                fromLength = sizeof(from);
+            }
+        }
+
+        // Deliver what is due, returns when the next one is.
+        uint64_t deliver(uint64_t now) {
+            while (!pending.empty() && pending.top().due <= now) {
+                const Packet &packet = pending.top();
+                sendto(fd, packet.data, packet.length, 0,
+                       (const sockaddr *)&packet.to, sizeof(packet.to));
+                pending.pop();
+            }
+            return pending.empty() ? UINT64_MAX : pending.top().due;
+        }
+
+        int socketFd() const { return fd; }
+
+      private:
+        struct Packet {
+            uint8_t data[256];
+            size_t length;
+            uint64_t due;
+            sockaddr_in to;
+
+            bool operator>(const Packet &other) const {
+                return due > other.due;
+            }
+        };
+
+        int fd = -1;
+        sockaddr_in leader = {};
+        sockaddr_in follower = {};
+        std::priority_queue<Packet, std::vector<Packet>, std::greater<Packet>>
+            pending;
+    };
+
+    struct Machine {
+        std::string name;
+        std::string trace;
+        std::string log;
+        double driftPpm;
+        pid_t pid;
+    };
+
+    pid_t spawn(const std::vector<std::string> &arguments,
+                const std::string &log) {
+        pid_t pid = fork();
+        if (pid != 0) {
+            return pid;
+        }
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        std::vector<char *> argv;
+        for (const auto &argument : arguments) {
+            argv.push_back(const_cast<char *>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    // The carriage leaves a stop, going up or down.
+    struct Departure {
+        uint64_t micros;
+        int direction;
+    };
+
+    std::vector<Departure> readDepartures(const std::string &path) {
+        // A stop is at least this many samples, one per millisecond.
+        constexpr int minRestSamples = 3;
+        std::vector<Departure> departures;
+        FILE *file = fopen(path.c_str(), "r");
+        if (file == nullptr) {
+            return departures;
+        }
+        unsigned long long micros, lastMicros = 0;
+        double position, lastPosition = NAN;
+        int rest = 0;
+        while (fscanf(file, "%llu %lf", &micros, &position) == 2) {
+            if (!std::isnan(lastPosition)) {
+                double step = position - lastPosition;
+                if (std::fabs(step) < 1e-4) {
+                    rest++;
+                } else {
+                    if (rest >= minRestSamples) {
+                        departures.push_back({lastMicros, step > 0 ? 1 : -1});
+                    }
+                    rest = 0;
+                }
+            }
+            lastMicros = micros;
+            lastPosition = position;
+        }
+        fclose(file);
+        return departures;
+    }
+
+    double percentile(std::vector<double> values, double percent) {
+        if (values.empty()) {
+            return 0;
+        }
+        std::sort(values.begin(), values.end());
+        size_t rank = (size_t)std::ceil(percent / 100 * values.size());
+        return values[rank == 0 ? 0 : rank - 1];
+    }
+
+    /**
+     * Pairs every departure of the leader with the follower's nearest one in
+     * the same direction and prints how far apart they were, from the time
+     * the follower locked on.
+     */
+    void report(const Machine &follower,
+                const std::vector<Departure> &leader) {
+        // Further apart is not the same stroke.
+        constexpr int64_t maxPairMicros = 250000;
+        // Locked on once this many strokes in a row are this close.
+        constexpr size_t lockOnStrokes = 5;
+        constexpr int64_t lockOnMicros = 10000;
+
+        std::vector<Departure> own = readDepartures(follower.trace);
+        std::vector<int64_t> paired(leader.size(), INT64_MAX);
+        for (size_t i = 0; i < leader.size(); i++) {
+            for (const Departure &departure : own) {
+                int64_t error =
+                    (int64_t)departure.micros - (int64_t)leader[i].micros;
+                if (departure.direction == leader[i].direction &&
+                    std::llabs(error) < std::llabs(paired[i])) {
+                    paired[i] = error;
+                }
+            }
+        }
+
+        size_t start = leader.size();
+        for (size_t i = 0, close = 0; i < leader.size(); i++) {
+            close = std::llabs(paired[i]) < lockOnMicros ? close + 1 : 0;
+            if (close == lockOnStrokes) {
+                start = i + 1 - lockOnStrokes;
+                break;
+            }
+        }
+        if (start == leader.size()) {
+            printf("%-10s %+6.0f never locked on\n", follower.name.c_str(),
+                   follower.driftPpm);
+            return;
+        }
+
+        std::vector<double> errors, signedErrors;
+        size_t unpaired = 0;
+        for (size_t i = start; i < leader.size(); i++) {
+            if (std::llabs(paired[i]) > maxPairMicros) {
+                unpaired++;
+                continue;
+            }
+            errors.push_back(std::fabs((double)paired[i]));
+            signedErrors.push_back((double)paired[i]);
+        }
+
+        printf("%-10s %+6.0f %7.1f %7zu %9zu %8.0f %8.0f %8.0f %8.0f\n",
+               follower.name.c_str(), follower.driftPpm,
+               (leader[start].micros - leader[0].micros) / 1e6, errors.size(),
+               unpaired, percentile(signedErrors, 50), percentile(errors, 50),
+               percentile(errors, 95), percentile(errors, 100));
+    }
+
+    // The summary line a SIL prints about sync.
+    std::string syncLine(const std::string &log) {
+        FILE *file = fopen(log.c_str(), "r");
+        std::string found;
+        char line[512];
+        while (file != nullptr && fgets(line, sizeof(line), file) != nullptr) {
+            if (strncmp(line, "sil: sync", 9) == 0 ||
+                strstr(line, "expected") != nullptr) {
+                found += line;
+            }
+        }
+        if (file != nullptr) {
+            fclose(file);
+        }
+        return found;
+    }
+
+    bool parse(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--sil" && hasValue) {
+                options.sil = argv[++i];
+            } else if (arg == "--scenario" && hasValue) {
+                options.scenario = argv[++i];
+            } else if (arg == "--followers" && hasValue) {
+                options.followers = atoi(argv[++i]);
+            } else if (arg == "--port" && hasValue) {
+                options.port = (uint16_t)atoi(argv[++i]);
+            } else if (arg == "--delay" && hasValue) {
+                options.delayMicros = atoi(argv[++i]);
+            } else if (arg == "--jitter" && hasValue) {
+                options.jitterMicros = atoi(argv[++i]);
+            } else if (arg == "--drift" && hasValue) {
+                options.driftPpm = atof(argv[++i]);
+            } else if (arg == "--no-sync") {
+                options.sync = false;
+            } else {
+                return false;
+            }
+        }
+        return options.followers > 0 && options.delayMicros >= 0 &&
+               options.jitterMicros >= 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    char directory[] = "/tmp/syncbench-XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        perror("syncbench");
+        return 1;
+    }
+
+    std::vector<Relay> relays(options.followers);
+    for (int i = 0; i < options.followers; i++) {
+        if (!relays[i].begin(options.port + 1 + i, options.port)) {
+            fprintf(stderr, "syncbench: port %d is taken\n",
+                    options.port + 1 + i);
+            return 1;
+        }
+    }
+
+    std::vector<Machine> machines;
+    for (int i = 0; i <= options.followers; i++) {
+        Machine machine;
+        machine.name = i == 0 ? "leader" : "follower" + std::to_string(i);
+        machine.trace = std::string(directory) + "/" + machine.name + ".txt";
+        machine.log = std::string(directory) + "/" + machine.name + ".log";
+        machine.driftPpm =
+            i == 0 ? 0 : (i % 2 == 1 ? options.driftPpm : -options.driftPpm);
+
+        std::vector<std::string> arguments = {
+            options.sil, "--realtime", "--clock-drift",
+            std::to_string(machine.driftPpm), "--position-trace",
+            machine.trace};
+        if (options.sync) {
+            arguments.insert(arguments.end(),
+                             {"--sync", i == 0 ? "leader" : "follower",
+                              "--sync-port",
+                              std::to_string(i == 0 ? options.port
+                                                    : options.port + i)});
+            if (i > 0) {
+                arguments.insert(arguments.end(),
+                                 {"--sync-leader", "127.0.0.1"});
+            }
+        }
+        arguments.push_back(options.scenario);
+
+        machine.pid = spawn(arguments, machine.log);
+        machines.push_back(machine);
+        // Boot at different times, so the clocks start out apart.
+        usleep(150000 + 100000 * i);
+    }
+    printf("Running %d followers, %d us delay plus up to %d us jitter, "
+           "logs in %s\n",
+           options.followers, options.delayMicros, options.jitterMicros,
+           directory);
+
+    std::mt19937 random(1);
+    std::vector<pollfd> fds;
+    for (Relay &relay : relays) {
+        fds.push_back({relay.socketFd(), POLLIN, 0});
+    }
+    size_t running = machines.size();
+    bool failed = false;
+    while (running > 0) {
+        uint64_t now = wallMicros();
+        uint64_t next = UINT64_MAX;
+        for (Relay &relay : relays) {
+            relay.receive(now, random, options.delayMicros,
+                          options.jitterMicros);
+            next = std::min(next, relay.deliver(now));
+        }
+        uint64_t wait = std::min<uint64_t>(10000, next > now ? next - now : 0);
+        timespec timeout = {0, long(wait * 1000)};
+        ppoll(fds.data(), fds.size(), &timeout, nullptr);
+
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            running--;
+            failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        }
+    }
+
+    for (const Machine &machine : machines) {
+        printf("%s", syncLine(machine.log).c_str());
+    }
+    if (failed) {
+        printf("A SIL failed, see the logs.\n");
+    }
+
+    std::vector<Departure> leader = readDepartures(machines[0].trace);
+    printf("\nPhase error in microseconds over %zu strokes of the leader, from\n"
+           "when each follower locked on, in seconds after the first. Bias is\n"
+           "the median signed error, positive when the follower is late.\n",
+           leader.size());
+    printf("%-10s %6s %7s %7s %9s %8s %8s %8s %8s\n", "follower", "ppm",
+           "lock s", "strokes", "unpaired", "bias", "p50", "p95", "max");
+    for (size_t i = 1; i < machines.size(); i++) {
+        report(machines[i], leader);
+    }
+    return failed ? 1 : 0;
+}
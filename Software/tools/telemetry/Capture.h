@@ -0,0 +1,167 @@
+#ifndef OSSM_TOOLS_TELEMETRY_CAPTURE_H
+#define OSSM_TOOLS_TELEMETRY_CAPTURE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "utils/Telemetry.h"
+
+/**
+ * A telemetry capture, the stream as it came over the network, mapped into
+ * memory.
+ *
+ * Nothing is read up front: opening checks the stream header and a block is
+ * only touched when its samples are. Blocks sit at fixed offsets, so
+ * finding the one that holds a time is a binary search over the keyframes,
+ * and a capture of any length opens at once.
+ *
+ * A capture cut off mid-block ends at the last whole one.
+ */
+class TelemetryCapture {
+  public:
+    TelemetryCapture() = default;
+    TelemetryCapture(const TelemetryCapture &) = delete;
+    TelemetryCapture &operator=(const TelemetryCapture &) = delete;
+
+    ~TelemetryCapture() {
+        if (_data != nullptr) {
+            munmap(const_cast<uint8_t *>(_data), _size);
+        }
+    }
+
+    bool open(const char *path, std::string &error) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            error = std::string("cannot read ") + path;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 ||
+            size_t(info.st_size) < sizeof(Telemetry::StreamHeader)) {
+            close(fd);
+            error = std::string(path) + " is too short for a capture";
+            return false;
+        }
+        _size = size_t(info.st_size);
+        void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            error = std::string("cannot map ") + path;
+            return false;
+        }
+        _data = static_cast<const uint8_t *>(data);
+        // Most reads go front to back.
+        madvise(data, _size, MADV_SEQUENTIAL);
+
+        if (!Telemetry::isValid(header())) {
+            error = std::string(path) + " is not a telemetry capture";
+            return false;
+        }
+        _blockCount =
+            (_size - sizeof(Telemetry::StreamHeader)) / Telemetry::blockSize;
+        return true;
+    }
+
+    const Telemetry::StreamHeader &header() const {
+        return *reinterpret_cast<const Telemetry::StreamHeader *>(_data);
+    }
+
+    size_t blockCount() const { return _blockCount; }
+
+    const Telemetry::Block &block(size_t index) const {
+        return *reinterpret_cast<const Telemetry::Block *>(
+            _data + sizeof(Telemetry::StreamHeader) +
+            index * Telemetry::blockSize);
+    }
+
+    /**
+     * The last block whose keyframe is at or before the time, 0 if none
+     * is. A torn block's keyframe may be anything, it can only mislead the
+     * search by that block.
+     */
+    size_t findBlock(uint64_t timeMicros) const {
+        size_t low = 0, high = _blockCount;
+        while (high - low > 1) {
+            size_t middle = low + (high - low) / 2;
+            if (block(middle).keyframe.timeMicros <= timeMicros) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    /**
+     * Samples in order, from one block to the next, over torn blocks.
+     */
+    class Cursor {
+      public:
+        Cursor(const TelemetryCapture &capture, size_t block)
+            : _capture(&capture), _block(block), _reader(_empty) {}
+
+        bool next(Telemetry::Sample &sample) {
+            while (!_reader.next(sample)) {
+                if (_block >= _capture->blockCount()) {
+                    return false;
+                }
+                const Telemetry::Block &block = _capture->block(_block++);
+                if (!Telemetry::isIntact(block)) {
+                    _tornBlocks++;
+                    continue;
+                }
+                _reader = Telemetry::BlockReader(block);
+            }
+            return true;
+        }
+
+        size_t tornBlocks() const { return _tornBlocks; }
+
+      private:
+        static inline const Telemetry::Block _empty = {};
+
+        const TelemetryCapture *_capture;
+        size_t _block;
+        Telemetry::BlockReader _reader;
+        size_t _tornBlocks = 0;
+    };
+
+    Cursor begin() const { return Cursor(*this, 0); }
+
+    /**
+     * A cursor whose next sample is the first at or after the time.
+     */
+    Cursor seek(uint64_t timeMicros) const {
+        Cursor cursor(*this, findBlock(timeMicros));
+        Cursor ahead = cursor;
+        Telemetry::Sample sample;
+        while (ahead.next(sample) && sample.timeMicros < timeMicros) {
+            cursor = ahead;
+        }
+        return cursor;
+    }
+
+    // When the capture starts, from the first intact block.
+    bool firstTime(uint64_t &timeMicros) const {
+        for (size_t i = 0; i < _blockCount; i++) {
+            if (Telemetry::isIntact(block(i))) {
+                timeMicros = block(i).keyframe.timeMicros;
+                return true;
+            }
+        }
+        return false;
+    }
+
+  private:
+    const uint8_t *_data = nullptr;
+    size_t _size = 0;
+    size_t _blockCount = 0;
+};
+
+#endif  // OSSM_TOOLS_TELEMETRY_CAPTURE_H
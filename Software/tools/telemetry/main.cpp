@@ -0,0 +1,438 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Capture.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Telemetry
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * Records the telemetry stream of an OSSM, see utils/Telemetry.h, and turns
+ * captures into something to plot.
+ *
+ *  pio run -e telemetry
+ *  .pio/build/telemetry/program record 192.168.1.50 --seconds 600 \
+ *      --out session.ostm
+ *  .pio/build/telemetry/program info session.ostm
+ *  .pio/build/telemetry/program csv session.ostm --from 30 --to 40
+ *  .pio/build/telemetry/program columns session.ostm session/
+ *
+ * Captures are read through TelemetryCapture, mapped and decoded block by
+ * block, so a capture of hours converts at disk speed.
+ */
+
+namespace {
+    struct Options {
+        std::string command;
+        std::vector<std::string> arguments;
+        uint16_t port = 9101;
+        double seconds = 0;
+        double from = 0;
+        double to = INFINITY;
+        std::string out;
+    };
+
+    const char *usage =
+        "usage: telemetry <command> ...\n"
+        "  record <host> --out <file> [--port 9101] [--seconds <s>]\n"
+        "                     capture the stream, until the OSSM hangs up\n"
+        "                     or for that long\n"
+        "  info <file>        samples, blocks and time span of a capture\n"
+        "  csv <file> [--from <s>] [--to <s>] [--out <file>]\n"
+        "                     samples as CSV, times from the start\n"
+        "  columns <file> <dir>\n"
+        "                     one raw little endian file per field, and a\n"
+        "                     schema.txt naming them\n"
+        "  synth <file> --seconds <s>\n"
+        "                     write a capture of strokes without an OSSM\n";
+
+    bool parse(int argc, char **argv, Options &options) {
+        if (argc < 2) {
+            return false;
+        }
+        options.command = argv[1];
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            bool isParsed = hasValue;
+            if (arg == "--port" && hasValue) {
+                options.port = (uint16_t)atoi(argv[++i]);
+            } else if (arg == "--seconds" && hasValue) {
+                options.seconds = atof(argv[++i]);
+            } else if (arg == "--from" && hasValue) {
+                options.from = atof(argv[++i]);
+            } else if (arg == "--to" && hasValue) {
+                options.to = atof(argv[++i]);
+            } else if (arg == "--out" && hasValue) {
+                options.out = argv[++i];
+            } else if (arg[0] != '-') {
+                options.arguments.push_back(arg);
+                isParsed = true;
+            } else {
+                isParsed = false;
+            }
+            if (!isParsed) {
+                return false;
+            }
+        }
+
+        size_t count = options.arguments.size();
+        if (options.command == "record") {
+            return count == 1 && !options.out.empty();
+        } else if (options.command == "info" || options.command == "csv") {
+            return count == 1;
+        } else if (options.command == "columns") {
+            return count == 2;
+        } else if (options.command == "synth") {
+            return count == 1 && options.seconds > 0;
+        }
+        return false;
+    }
+
+    double since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    }
+
+    int connectTo(const std::string &host, uint16_t port) {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                        &result) != 0) {
+            return -1;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(result);
+        return fd;
+    }
+
+    int record(const Options &options) {
+        const std::string &host = options.arguments[0];
+        int fd = connectTo(host, options.port);
+        if (fd < 0) {
+            fprintf(stderr, "telemetry: cannot connect to %s:%u\n",
+                    host.c_str(), options.port);
+            return 1;
+        }
+        FILE *out = fopen(options.out.c_str(), "wb");
+        if (out == nullptr) {
+            fprintf(stderr, "telemetry: cannot write %s\n",
+                    options.out.c_str());
+            close(fd);
+            return 1;
+        }
+
+        // Wakes up now and then to look at the clock.
+        timeval timeout = {.tv_sec = 0, .tv_usec = 200000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        auto start = std::chrono::steady_clock::now();
+        size_t received = 0;
+        bool isChecked = false;
+        static char buffer[64 * 1024];
+        while (options.seconds == 0 || since(start) < options.seconds) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                break;
+            }
+            if (n < 0) {
+                continue;
+            }
+            fwrite(buffer, 1, size_t(n), out);
+            received += size_t(n);
+
+            if (!isChecked && received >= sizeof(Telemetry::StreamHeader)) {
+                // The header arrives in one piece, it is the first write.
+                Telemetry::StreamHeader header;
+                memcpy(&header, buffer, sizeof(header));
+                if (!Telemetry::isValid(header)) {
+                    fprintf(stderr, "telemetry: %s:%u does not send "
+                                    "telemetry\n",
+                            host.c_str(), options.port);
+                    break;
+                }
+                isChecked = true;
+            }
+        }
+        close(fd);
+        fclose(out);
+
+        size_t blocks =
+            received < sizeof(Telemetry::StreamHeader)
+                ? 0
+                : (received - sizeof(Telemetry::StreamHeader)) /
+                      Telemetry::blockSize;
+        fprintf(stderr, "telemetry: %zu blocks in %.1f s to %s\n", blocks,
+                since(start), options.out.c_str());
+        return isChecked ? 0 : 1;
+    }
+
+    bool open(const std::string &path, TelemetryCapture &capture) {
+        std::string error;
+        if (!capture.open(path.c_str(), error)) {
+            fprintf(stderr, "telemetry: %s\n", error.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    int info(const Options &options) {
+        TelemetryCapture capture;
+        if (!open(options.arguments[0], capture)) {
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t samples = 0, moving = 0, violations = 0, alarms = 0, torn = 0;
+        uint64_t first = 0, last = 0;
+        uint32_t firstSequence = 0, lastSequence = 0;
+        bool isFirst = true;
+        for (size_t i = 0; i < capture.blockCount(); i++) {
+            const Telemetry::Block &block = capture.block(i);
+            if (!Telemetry::isIntact(block)) {
+                torn++;
+                continue;
+            }
+            if (isFirst) {
+                firstSequence = block.header.sequence;
+            }
+            lastSequence = block.header.sequence;
+
+            Telemetry::BlockReader reader(block);
+            Telemetry::Sample sample;
+            while (reader.next(sample)) {
+                if (isFirst) {
+                    first = sample.timeMicros;
+                    isFirst = false;
+                }
+                last = sample.timeMicros;
+                samples++;
+                moving += (sample.flags & Telemetry::Moving) != 0;
+                violations += (sample.flags & Telemetry::Violation) != 0;
+                alarms += (sample.flags & Telemetry::ServoAlarm) != 0;
+            }
+        }
+        double elapsed = since(start);
+
+        // Blocks the OSSM started but could not send in time.
+        size_t started = isFirst ? 0 : lastSequence - firstSequence + 1;
+        size_t dropped = started > capture.blockCount()
+                             ? started - capture.blockCount()
+                             : 0;
+        const Telemetry::StreamHeader &header = capture.header();
+        printf("samples     %zu, every %u us, %.1f steps/mm\n", samples,
+               header.sampleIntervalMicros, header.stepsPerMm);
+        printf("span        %.3f s\n", (last - first) * 1e-6);
+        printf("blocks      %zu, %zu torn, %zu dropped by the OSSM\n",
+               capture.blockCount(), torn, dropped);
+        printf("size        %.2f bytes a sample\n",
+               samples == 0 ? 0.0
+                            : double(capture.blockCount()) *
+                                  Telemetry::blockSize / samples);
+        printf("moving      %.1f %% of samples\n",
+               samples == 0 ? 0.0 : 100.0 * moving / samples);
+        printf("violations  %zu\n", violations);
+        printf("servo alarm %zu samples\n", alarms);
+        printf("decoded     in %.1f ms, %.0f M samples/s\n", elapsed * 1e3,
+               samples / elapsed * 1e-6);
+        return 0;
+    }
+
+    int csv(const Options &options) {
+        TelemetryCapture capture;
+        uint64_t first;
+        if (!open(options.arguments[0], capture)) {
+            return 1;
+        }
+        FILE *out = stdout;
+        if (!options.out.empty() &&
+            (out = fopen(options.out.c_str(), "w")) == nullptr) {
+            fprintf(stderr, "telemetry: cannot write %s\n",
+                    options.out.c_str());
+            return 1;
+        }
+
+        fprintf(out, "time_s,position_mm,target_mm,speed_mm_s,moving,"
+                     "violation,following_error_mm,servo_load,servo_alarm\n");
+        if (capture.firstTime(first)) {
+            float mmPerStep = 1 / capture.header().stepsPerMm;
+            auto cursor =
+                capture.seek(first + uint64_t(options.from * 1e6));
+            Telemetry::Sample sample;
+            while (cursor.next(sample)) {
+                double time = (sample.timeMicros - first) * 1e-6;
+                if (time > options.to) {
+                    break;
+                }
+                fprintf(out, "%.6f,%.3f,%.3f,%.2f,%d,%d,%.3f,%d,%d\n", time,
+                        sample.position * mmPerStep,
+                        sample.target * mmPerStep,
+                        sample.speedHz * mmPerStep,
+                        (sample.flags & Telemetry::Moving) != 0,
+                        (sample.flags & Telemetry::Violation) != 0,
+                        sample.followingError * mmPerStep, sample.load,
+                        (sample.flags & Telemetry::ServoAlarm) != 0);
+            }
+        }
+        if (out != stdout) {
+            fclose(out);
+        }
+        return 0;
+    }
+
+    /**
+     * Every field in a file of its own, for numpy.fromfile() and the like,
+     * which read one column without touching the others.
+     */
+    int columns(const Options &options) {
+        TelemetryCapture capture;
+        if (!open(options.arguments[0], capture)) {
+            return 1;
+        }
+        const std::string dir = options.arguments[1];
+        mkdir(dir.c_str(), 0755);
+
+        struct Column {
+            const char *name;
+            const char *type;
+            FILE *file;
+        };
+        Column columns[] = {
+            {"time_us", "uint64", nullptr},
+            {"position", "int32", nullptr},
+            {"target", "int32", nullptr},
+            {"speed_hz", "int32", nullptr},
+            {"flags", "uint8", nullptr},
+            {"following_error", "int32", nullptr},
+            {"servo_load", "int16", nullptr},
+        };
+        for (Column &column : columns) {
+            std::string path = dir + "/" + column.name + ".bin";
+            column.file = fopen(path.c_str(), "wb");
+            if (column.file == nullptr) {
+                fprintf(stderr, "telemetry: cannot write %s\n", path.c_str());
+                return 1;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto cursor = capture.begin();
+        Telemetry::Sample sample;
+        size_t rows = 0;
+        while (cursor.next(sample)) {
+            fwrite(&sample.timeMicros, 8, 1, columns[0].file);
+            fwrite(&sample.position, 4, 1, columns[1].file);
+            fwrite(&sample.target, 4, 1, columns[2].file);
+            fwrite(&sample.speedHz, 4, 1, columns[3].file);
+            fwrite(&sample.flags, 1, 1, columns[4].file);
+            fwrite(&sample.followingError, 4, 1, columns[5].file);
+            fwrite(&sample.load, 2, 1, columns[6].file);
+            rows++;
+        }
+        for (Column &column : columns) {
+            fclose(column.file);
+        }
+
+        std::string path = dir + "/schema.txt";
+        FILE *schema = fopen(path.c_str(), "w");
+        if (schema == nullptr) {
+            fprintf(stderr, "telemetry: cannot write %s\n", path.c_str());
+            return 1;
+        }
+        fprintf(schema, "rows %zu\nsteps_per_mm %g\n", rows,
+                capture.header().stepsPerMm);
+        for (const Column &column : columns) {
+            fprintf(schema, "column %s.bin %s\n", column.name, column.type);
+        }
+        fclose(schema);
+        fprintf(stderr, "telemetry: %zu rows in %.1f ms, %zu torn blocks\n",
+                rows, since(start) * 1e3, cursor.tornBlocks());
+        return 0;
+    }
+
+    /**
+     * Strokes of 100 mm at 60 per minute, sampled like the firmware does,
+     * to try the tools and measure them on captures of any length.
+     */
+    int synth(const Options &options) {
+        FILE *out = fopen(options.arguments[0].c_str(), "wb");
+        if (out == nullptr) {
+            fprintf(stderr, "telemetry: cannot write %s\n",
+                    options.arguments[0].c_str());
+            return 1;
+        }
+        const float stepsPerMm = 10;
+        Telemetry::StreamHeader header =
+            Telemetry::streamHeader(1000, stepsPerMm);
+        fwrite(&header, sizeof(header), 1, out);
+
+        Telemetry::Block block;
+        Telemetry::BlockWriter writer;
+        uint32_t sequence = 0;
+        auto samples = uint64_t(options.seconds * 1000);
+        for (uint64_t i = 0; i < samples; i++) {
+            // In for half a second, out for the other half.
+            double phase = std::fmod(i * 1e-3, 1.0);
+            double travel = 0.5 - 0.5 * std::cos(2 * M_PI * phase);
+            double speed = 0.5 * std::sin(2 * M_PI * phase) * 2 * M_PI;
+            int32_t target = phase < 0.5 ? 1000 : 0;
+            Telemetry::Sample sample = {
+                1000000 + i * 1000, int32_t(1000 * travel), target,
+                int32_t(1000 * speed), Telemetry::Moving};
+            if (i == 0) {
+                writer.begin(block, sequence++, sample);
+            } else if (!writer.append(sample)) {
+                writer.seal();
+                fwrite(&block, sizeof(block), 1, out);
+                writer.begin(block, sequence++, sample);
+            }
+        }
+        if (samples > 0) {
+            writer.seal();
+            fwrite(&block, sizeof(block), 1, out);
+        }
+        fclose(out);
+        return 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    if (options.command == "record") {
+        return record(options);
+    } else if (options.command == "info") {
+        return info(options);
+    } else if (options.command == "csv") {
+        return csv(options);
+    } else if (options.command == "columns") {
+        return columns(options);
+    }
+    return synth(options);
+}
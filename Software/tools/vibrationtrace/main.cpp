@@ -0,0 +1,386 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "FastAccelStepper.h"
+#include "StrokeEngine.h"
+#include "VibrationOverlay.h"
+#include "pattern.h"
+#include "sil/Rail.h"
+#include "sil/VirtualTime.h"
+#include "utils/StrokeEngineHelper.h"
+
+/**
+ * ///////////////////////////////////////////
+ * ////
+ * ////  Vibration Trace
+ * ////
+ * ///////////////////////////////////////////
+ *
+ * A vibration laid over a pattern, on the simulated stepper of the
+ * software-in-the-loop build.
+ *
+ * Each case strokes with a vibration on top and samples the carriage and
+ * the stepper's command queue every 500 us. For each it reports
+ *  fits       the amplitude the machine's limits leave at that frequency
+ *  speed      the top speed, over 10 ms
+ *  accel      the top acceleration, over 10 ms
+ *  min, max   where the carriage went
+ *  underruns  how often the queue ran dry while stroking
+ *  lead       the least motion that was queued, in ms
+ * and fails when a case leaves the limits or the queue runs dry. Last it
+ * times the segment generator on this computer.
+ *
+ *  pio run -e vibrationtrace
+ *  .pio/build/vibrationtrace/program
+ *  .pio/build/vibrationtrace/program dump 15hz > 15hz.csv
+ */
+
+namespace {
+    constexpr uint32_t sampleMicros = 500;
+    constexpr double caseSeconds = 4;
+    constexpr size_t samplesPerCase = caseSeconds * 1e6 / sampleMicros;
+    // The vibration takes over at the end of the first stroke.
+    constexpr double steadyFromSeconds = 1.5;
+    // Speed and acceleration over 10 ms, where a step more or less
+    // rounding hardly counts.
+    constexpr size_t window = 10000 / sampleMicros;
+
+    // The rail StrokeEngine gets from homing, as in OSSM.StrokeEngine.cpp.
+    constexpr float travelMm = 200;
+    constexpr float keepoutMm = 6;
+    constexpr float strokeTravelMm = travelMm - 2 * keepoutMm;
+
+    struct Case {
+        const char *name;
+        float frequency;
+        float amplitudeMm;
+        float strokesPerMinute;
+        float depthMm;
+        float strokeMm;
+        // When to stop the pattern, negative for never.
+        double stopSeconds;
+    };
+
+    const Case cases[] = {
+        {"5hz", 5, 3, 45, 150, 100, -1},
+        // More than the acceleration allows, it is cut to fit.
+        {"15hz", 15, 1, 45, 150, 100, -1},
+        {"30hz", 30, 1, 45, 150, 100, -1},
+        // The moves are as fast as the vibration leaves them.
+        {"fast_strokes", 10, 2, 200, strokeTravelMm, strokeTravelMm, -1},
+        // End to end, the moves stop short so the vibration fits.
+        {"end_to_end", 5, 3, 30, strokeTravelMm, strokeTravelMm, -1},
+        // Braked and faded out.
+        {"stop", 10, 1, 45, 150, 100, 2.5},
+    };
+
+    struct Sample {
+        float position;
+        uint8_t queued;
+        bool isStroking;
+    };
+
+    class Sampler : public sil::Stimulus {
+      public:
+        const Case *current = nullptr;
+        std::vector<Sample> samples;
+        uint64_t stopMicros = 0;
+
+        void start(uint64_t now) { next = now; }
+
+        uint64_t nextEventMicros() const override { return next; }
+
+        void fire(uint64_t nowMicros) override;
+
+      private:
+        uint64_t next = sil::never;
+    };
+
+    struct Run {
+        Sampler sampler;
+        StrokeEngine engine;
+        machineGeometry geometry = {.physicalTravel = travelMm,
+                                    .keepoutBoundary = keepoutMm};
+    };
+
+    Run run;
+
+    void Sampler::fire(uint64_t nowMicros) {
+        FastAccelStepper &stepper = sil::stepper();
+        samples.push_back({float(stepper.getCurrentPosition() /
+                                 servoMotor.stepsPerMillimeter),
+                           stepper.queueEntries(),
+                           run.engine.getState() == PATTERN});
+        next = nowMicros + sampleMicros;
+        if (samples.size() == samplesPerCase) {
+            next = sil::never;
+            sil::stop();
+        }
+    }
+
+    // Homes, starts the pattern with the vibration and stops it, if asked.
+    void operatorTask(void *) {
+        FastAccelStepperEngine stepperEngine;
+        FastAccelStepper *stepper = stepperEngine.stepperConnectToPin(
+            Pins::Driver::motorStepPin);
+
+        const Case &c = *run.sampler.current;
+        StrokeEngine &engine = run.engine;
+        engine.begin(&run.geometry, &servoMotor, stepper);
+        engine.thisIsHome();
+        while (stepper->isRunning()) {
+            vTaskDelay(10);
+        }
+
+        engine.setSpeed(c.strokesPerMinute, false);
+        engine.setDepth(c.depthMm, false);
+        engine.setStroke(c.strokeMm, false);
+        engine.setPattern(new SimpleStroke("Simple Stroke"), false);
+        engine.setVibration(c.frequency, c.amplitudeMm);
+        run.sampler.start(sil::now());
+        uint64_t started = sil::now();
+        engine.startPattern();
+
+        if (c.stopSeconds >= 0) {
+            uint64_t stopAt = started + uint64_t(c.stopSeconds * 1e6);
+            vTaskDelay((stopAt - sil::now()) / 1000);
+            uint64_t stopping = sil::now();
+            engine.stopMotion();
+            run.sampler.stopMicros = sil::now() - stopping;
+        }
+        vTaskSuspend(nullptr);
+    }
+
+    struct Result {
+        bool isSimulated = false;
+        std::vector<Sample> samples;
+        uint64_t stopMicros = 0;
+    };
+
+    /**
+     * Each case runs in a child process, so it starts from a fresh scheduler
+     * and clock.
+     */
+    bool simulate(const Case &c, Result &result) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return false;
+        }
+        fflush(stdout);
+        pid_t child = fork();
+        if (child < 0) {
+            return false;
+        }
+        if (child == 0) {
+            close(fds[0]);
+            run.sampler.current = &c;
+            sil::rail().reset();
+            sil::addStimulus(&run.sampler);
+            xTaskCreatePinnedToCore(operatorTask, "operator", 8192, nullptr,
+                                    1, nullptr, 1);
+            sil::run(60 * 1000000ULL);
+            const std::vector<Sample> &samples = run.sampler.samples;
+            size_t bytes = samples.size() * sizeof(Sample);
+            bool ok = write(fds[1], &run.sampler.stopMicros,
+                            sizeof(uint64_t)) == sizeof(uint64_t) &&
+                      write(fds[1], samples.data(), bytes) == (ssize_t)bytes;
+            _exit(ok ? 0 : 1);
+        }
+
+        close(fds[1]);
+        result.samples.clear();
+        bool ok = read(fds[0], &result.stopMicros, sizeof(uint64_t)) ==
+                  sizeof(uint64_t);
+        Sample buffer[512];
+        ssize_t n;
+        while (ok && (n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            result.samples.insert(result.samples.end(), buffer,
+                                  buffer + n / sizeof(Sample));
+        }
+        close(fds[0]);
+        int status = 0;
+        waitpid(child, &status, 0);
+        return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+               result.samples.size() == samplesPerCase;
+    }
+
+    // The amplitude VibrationOverlay settles on for a case, in mm.
+    float fittedMm(const Case &c) {
+        float stepsPerMm = servoMotor.stepsPerMillimeter;
+        VibrationOverlay overlay;
+        overlay.setLimits(0, int32_t(strokeTravelMm * stepsPerMm),
+                          uint32_t(servoMotor.maxSpeed * stepsPerMm),
+                          uint32_t(servoMotor.maxAcceleration * stepsPerMm));
+        overlay.setVibration(c.frequency, c.amplitudeMm * stepsPerMm);
+        overlay.reset(int32_t(0.5f * strokeTravelMm * stepsPerMm));
+        float segmentsPerPeriod = 1e6f / VibrationOverlay::segmentMicros /
+                                  c.frequency;
+        for (int i = 0;
+             i < (VibrationOverlay::fadePeriods + 1) * segmentsPerPeriod;
+             i++) {
+            overlay.next();
+        }
+        return overlay.amplitude() / stepsPerMm;
+    }
+
+    struct Measured {
+        double topSpeed = 0;
+        double topAcceleration = 0;
+        double minMm = INFINITY;
+        double maxMm = -INFINITY;
+        int underruns = 0;
+        double leadMs = INFINITY;
+    };
+
+    Measured measure(const std::vector<Sample> &samples) {
+        Measured m;
+        double h = window * sampleMicros * 1e-6;
+        bool hasQueued = false;
+        bool wasDry = false;
+        for (size_t i = 0; i < samples.size(); i++) {
+            const Sample &s = samples[i];
+            m.minMm = std::min(m.minMm, double(s.position));
+            m.maxMm = std::max(m.maxMm, double(s.position));
+
+            // Once the vibration took over, the queue must never run dry
+            // while stroking.
+            hasQueued = hasQueued || s.queued > 0;
+            if (hasQueued && s.isStroking) {
+                bool isDry = s.queued == 0;
+                m.underruns += isDry && !wasDry ? 1 : 0;
+                wasDry = isDry;
+                if (i * sampleMicros * 1e-6 >= steadyFromSeconds) {
+                    m.leadMs = std::min(
+                        m.leadMs,
+                        s.queued * VibrationOverlay::segmentMicros * 1e-3);
+                }
+            }
+
+            if (i >= window && i + window < samples.size()) {
+                double before = samples[i - window].position;
+                double after = samples[i + window].position;
+                m.topSpeed =
+                    std::max(m.topSpeed, std::fabs(after - before) / (2 * h));
+                m.topAcceleration = std::max(
+                    m.topAcceleration,
+                    std::fabs(after - 2 * s.position + before) / (h * h));
+            }
+        }
+        return m;
+    }
+
+    const Case *find(const std::string &name) {
+        for (const Case &c : cases) {
+            if (name == c.name) {
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    // How long the segment generator takes on this computer.
+    double nanosPerSegment() {
+        VibrationOverlay overlay;
+        overlay.setLimits(0, 3760, 18000, 200000);
+        overlay.setVibration(15, 20);
+        overlay.reset(0);
+        constexpr int segments = 1000000;
+        int32_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < segments; i++) {
+            if (!overlay.isMoving()) {
+                overlay.moveTo(i % 2 == 0 ? 3500 : 200, 15000, 100000);
+            }
+            sum += overlay.next().steps;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        // Keep the loop from being optimized away.
+        if (sum == INT32_MIN) {
+            puts("");
+        }
+        return std::chrono::duration<double, std::nano>(elapsed).count() /
+               segments;
+    }
+
+    bool report() {
+        bool allPassed = true;
+        // Rounding to steps, off by up to a step at either end of a window.
+        double h = window * sampleMicros * 1e-6;
+        double speedTolerance = 2 / servoMotor.stepsPerMillimeter / (2 * h);
+        double accelerationTolerance =
+            2 / servoMotor.stepsPerMillimeter / (h * h);
+        printf("%-13s %5s %5s %7s %7s %6s %6s %9s %7s %7s  %s\n", "case",
+               "asked", "fits", "speed", "accel", "min", "max", "underruns",
+               "lead ms", "stop ms", "result");
+        for (const Case &c : cases) {
+            Result result;
+            if (!simulate(c, result)) {
+                fprintf(stderr, "%s: simulation failed\n", c.name);
+                allPassed = false;
+                continue;
+            }
+            Measured m = measure(result.samples);
+            bool passed = m.topSpeed <= servoMotor.maxSpeed + speedTolerance &&
+                          m.topAcceleration <= servoMotor.maxAcceleration +
+                                                   accelerationTolerance &&
+                          m.minMm >= 0 && m.maxMm <= strokeTravelMm &&
+                          m.underruns == 0 && m.leadMs < INFINITY;
+            allPassed = allPassed && passed;
+            printf("%-13s %5.2f %5.2f %7.0f %7.0f %6.1f %6.1f %9d %7.0f %7.0f"
+                   "  %s\n",
+                   c.name, c.amplitudeMm, fittedMm(c), m.topSpeed,
+                   m.topAcceleration, m.minMm, m.maxMm, m.underruns,
+                   m.leadMs, result.stopMicros * 1e-3,
+                   passed ? "ok" : "FAILED");
+        }
+
+        double nanos = nanosPerSegment();
+        double segmentsPerSecond = 1e6 / VibrationOverlay::segmentMicros;
+        printf("\nsegment generator: %.0f ns a segment on this computer, "
+               "%.3f%% of a core at %.0f segments/s\n",
+               nanos, nanos * segmentsPerSecond * 1e-7, segmentsPerSecond);
+        return allPassed;
+    }
+
+    bool dump(const std::string &name) {
+        const Case *c = find(name);
+        if (c == nullptr) {
+            fprintf(stderr, "vibrationtrace: no case %s\n", name.c_str());
+            return false;
+        }
+        Result result;
+        if (!simulate(*c, result)) {
+            fprintf(stderr, "vibrationtrace: simulation failed\n");
+            return false;
+        }
+        printf("seconds,position_mm,queued\n");
+        for (size_t i = 0; i < result.samples.size(); i++) {
+            printf("%.4f,%.2f,%d\n", i * sampleMicros * 1e-6,
+                   result.samples[i].position, result.samples[i].queued);
+        }
+        return true;
+    }
+}
+
+static const char *usage =
+    "usage: vibrationtrace\n"
+    "       vibrationtrace dump <case>\n";
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        return report() ? 0 : 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "dump") == 0) {
+        return dump(argv[2]) ? 0 : 1;
+    }
+    fputs(usage, stderr);
+    return 2;
+}